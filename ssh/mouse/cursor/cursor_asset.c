@@ -0,0 +1,373 @@
+/**
+ * @file cursor_asset.c
+ * Decription: Build-time cursor compiler: PNG -> embedded cursor header.
+ *
+ * Reads a PNG (8 or 16 bit, grey/RGB with or without alpha, palette; not
+ * interlaced), premultiplies it, makes the requested sizes by averaging
+ * and writes them to stdout as a C header for cursor_image.h: one RLE
+ * byte stream per size plus the size and hotspot of each. The libraries
+ * decode it straight into the mapped cursor buffer at init, so only the
+ * opaque pixels are stored and a new cursor is a new PNG, not new code.
+ *
+ *   cursor_asset -n arrow -s 64,48,32 mouse_cursor.png > cursor_arrow.h
+ *   cursor_asset -n offset -y 27 mouse_cursor_offset.png > cursor_offset.h
+ *
+ * The SVGs next to the PNGs are the sources they were exported from; to
+ * change a cursor, export the SVG to a 64x64 PNG (e.g. rsvg-convert -w 64)
+ * and rebuild.
+ *
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "../no3z/mouseCursor_v2/cursor_image.h"
+
+#define ALPHA_THRESHOLD 10  // 0-255, pixels below become transparent
+#define MAX_SIZES 8
+
+struct image {
+    int w;
+    int h;
+    uint32_t* px;  // premultiplied ARGB
+};
+
+static void die(const char* what, const char* path)
+{
+    fprintf(stderr, "cursor_asset: %s: %s\n", path, what);
+    exit(1);
+}
+
+static uint32_t be32(const uint8_t* p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static uint8_t* read_file(const char* path, size_t* len)
+{
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+        die("cannot open", path);
+    size_t cap = 65536, n = 0;
+    uint8_t* buf = malloc(cap);
+    size_t got;
+    while (buf && (got = fread(buf + n, 1, cap - n, fp)) > 0) {
+        n += got;
+        if (n == cap)
+            buf = realloc(buf, cap *= 2);
+    }
+    fclose(fp);
+    if (!buf)
+        die("out of memory", path);
+    *len = n;
+    return buf;
+}
+
+static int paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+// Decode to premultiplied ARGB, alpha below the threshold -> transparent
+static void load_png(const char* path, int threshold, struct image* img)
+{
+    static const uint8_t sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    size_t len;
+    uint8_t* file = read_file(path, &len);
+    if (len < 8 || memcmp(file, sig, 8) != 0)
+        die("not a PNG", path);
+
+    int depth = 0, type = -1, channels = 0;
+    uint8_t palette[256][4];
+    memset(palette, 0xff, sizeof(palette));
+    uint8_t* idat = NULL;
+    size_t idat_len = 0;
+    for (size_t pos = 8; pos + 12 <= len;) {
+        uint32_t n = be32(file + pos);
+        const uint8_t* tag = file + pos + 4;
+        const uint8_t* data = file + pos + 8;
+        if (n > len - pos - 12)
+            die("truncated chunk", path);
+        if (memcmp(tag, "IHDR", 4) == 0 && n >= 13) {
+            img->w = (int)be32(data);
+            img->h = (int)be32(data + 4);
+            depth = data[8];
+            type = data[9];
+            if (data[12] != 0)
+                die("interlaced PNGs are not supported", path);
+        } else if (memcmp(tag, "PLTE", 4) == 0) {
+            for (uint32_t i = 0; i < n / 3 && i < 256; i++)
+                memcpy(palette[i], data + 3 * i, 3);
+        } else if (memcmp(tag, "tRNS", 4) == 0 && type == 3) {
+            for (uint32_t i = 0; i < n && i < 256; i++)
+                palette[i][3] = data[i];
+        } else if (memcmp(tag, "IDAT", 4) == 0) {
+            idat = realloc(idat, idat_len + n);
+            if (!idat)
+                die("out of memory", path);
+            memcpy(idat + idat_len, data, n);
+            idat_len += n;
+        } else if (memcmp(tag, "IEND", 4) == 0) {
+            break;
+        }
+        pos += 12 + n;
+    }
+    channels = type == 0 ? 1 : type == 2 ? 3 : type == 3 ? 1 : type == 4 ? 2 : type == 6 ? 4 : 0;
+    if (!channels || (depth != 8 && !(depth == 16 && type != 3)) || !idat)
+        die("only 8/16 bit and 8 bit palette PNGs are supported", path);
+    if (img->w < 1 || img->h < 1 || img->w > CURSOR_IMAGE_MAX || img->h > CURSOR_IMAGE_MAX)
+        die("image must be 1x1 to 64x64", path);
+
+    int bpp = channels * depth / 8;
+    size_t stride = (size_t)img->w * bpp;
+    uLongf raw_len = (stride + 1) * img->h;
+    uint8_t* raw = malloc(raw_len);
+    if (!raw || uncompress(raw, &raw_len, idat, idat_len) != Z_OK || raw_len != (stride + 1) * img->h)
+        die("bad image data", path);
+
+    // Undo the per-row filters in place
+    for (int y = 0; y < img->h; y++) {
+        uint8_t* row = raw + y * (stride + 1);
+        uint8_t* cur = row + 1;
+        const uint8_t* up = y ? row - stride : NULL;
+        for (size_t i = 0; i < stride; i++) {
+            int a = i >= (size_t)bpp ? cur[i - bpp] : 0;
+            int b = up ? up[i] : 0;
+            int c = up && i >= (size_t)bpp ? up[i - bpp] : 0;
+            switch (row[0]) {
+            case 0: break;
+            case 1: cur[i] += a; break;
+            case 2: cur[i] += b; break;
+            case 3: cur[i] += (a + b) / 2; break;
+            case 4: cur[i] += paeth(a, b, c); break;
+            default: die("bad row filter", path);
+            }
+        }
+    }
+
+    img->px = calloc((size_t)img->w * img->h, sizeof(uint32_t));
+    if (!img->px)
+        die("out of memory", path);
+    for (int y = 0; y < img->h; y++) {
+        const uint8_t* row = raw + y * (stride + 1) + 1;
+        for (int x = 0; x < img->w; x++) {
+            const uint8_t* p = row + x * bpp;
+            int s[4];
+            // 16 bit samples: the high byte, big endian
+            for (int i = 0; i < channels; i++)
+                s[i] = p[i * depth / 8];
+            int r, g, b, a;
+            if (type == 3) {
+                r = palette[s[0]][0], g = palette[s[0]][1], b = palette[s[0]][2], a = palette[s[0]][3];
+            } else if (channels <= 2) {
+                r = g = b = s[0];
+                a = channels == 2 ? s[1] : 255;
+            } else {
+                r = s[0], g = s[1], b = s[2];
+                a = channels == 4 ? s[3] : 255;
+            }
+            if (a < threshold)
+                continue;
+            r = (r * a + 127) / 255;
+            g = (g * a + 127) / 255;
+            b = (b * a + 127) / 255;
+            img->px[y * img->w + x] = (uint32_t)a << 24 | (uint32_t)r << 16 | (uint32_t)g << 8 | (uint32_t)b;
+        }
+    }
+    free(raw);
+    free(idat);
+    free(file);
+}
+
+// Area average; premultiplied, so edges blend correctly
+static void scale(const struct image* src, int size, struct image* dst)
+{
+    int big = src->w > src->h ? src->w : src->h;
+    dst->w = (src->w * size + big / 2) / big;
+    dst->h = (src->h * size + big / 2) / big;
+    dst->w = dst->w < 1 ? 1 : dst->w;
+    dst->h = dst->h < 1 ? 1 : dst->h;
+    dst->px = calloc((size_t)dst->w * dst->h, sizeof(uint32_t));
+    if (!dst->px)
+        die("out of memory", "scale");
+
+    for (int y = 0; y < dst->h; y++) {
+        for (int x = 0; x < dst->w; x++) {
+            // Source box [x0, x1) x [y0, y1) in 1/size units of a pixel
+            int x0 = x * src->w, x1 = (x + 1) * src->w;
+            int y0 = y * src->h, y1 = (y + 1) * src->h;
+            uint64_t sum[4] = { 0 }, area = 0;
+            for (int sy = y0 / dst->h; sy * dst->h < y1; sy++) {
+                int wy = (sy + 1) * dst->h < y1 ? (sy + 1) * dst->h : y1;
+                wy -= sy * dst->h > y0 ? sy * dst->h : y0;
+                for (int sx = x0 / dst->w; sx * dst->w < x1; sx++) {
+                    int wx = (sx + 1) * dst->w < x1 ? (sx + 1) * dst->w : x1;
+                    wx -= sx * dst->w > x0 ? sx * dst->w : x0;
+                    uint32_t p = src->px[sy * src->w + sx];
+                    for (int c = 0; c < 4; c++)
+                        sum[c] += (uint64_t)((p >> (8 * c)) & 0xff) * wx * wy;
+                    area += (uint64_t)wx * wy;
+                }
+            }
+            uint32_t p = 0;
+            for (int c = 0; c < 4; c++)
+                p |= (uint32_t)((sum[c] + area / 2) / area) << (8 * c);
+            dst->px[y * dst->w + x] = p >> 24 ? p : 0;
+        }
+    }
+}
+
+struct out {
+    uint8_t* buf;
+    size_t len;
+    size_t cap;
+};
+
+static void emit(struct out* o, const void* p, size_t n)
+{
+    if (o->len + n > o->cap) {
+        o->cap = (o->cap + n) * 2;
+        o->buf = realloc(o->buf, o->cap);
+        if (!o->buf)
+            die("out of memory", "encode");
+    }
+    memcpy(o->buf + o->len, p, n);
+    o->len += n;
+}
+
+static void emit_pixel(struct out* o, uint32_t p)
+{
+    uint8_t b[4] = { p & 0xff, (p >> 8) & 0xff, (p >> 16) & 0xff, p >> 24 };
+    emit(o, b, 4);
+}
+
+// Row by row, see cursor_image.h for the ops
+static void encode(const struct image* img, struct out* o)
+{
+    for (int y = 0; y < img->h; y++) {
+        const uint32_t* row = img->px + y * img->w;
+        int x = 0;
+        while (x < img->w) {
+            int n = 1;
+            while (x + n < img->w && n < CURSOR_RLE_MAX_RUN && row[x + n] == row[x])
+                n++;
+            if (row[x] == 0 || n >= 3) {
+                uint8_t op = (row[x] ? CURSOR_RLE_FILL : CURSOR_RLE_SKIP) | (n - 1);
+                emit(o, &op, 1);
+                if (row[x])
+                    emit_pixel(o, row[x]);
+                x += n;
+                continue;
+            }
+            // Literals up to the next transparent pixel or run of 3
+            n = 1;
+            while (x + n < img->w && n < CURSOR_RLE_MAX_RUN && row[x + n] &&
+                   !(x + n + 2 < img->w && row[x + n] == row[x + n + 1] && row[x + n] == row[x + n + 2]))
+                n++;
+            uint8_t op = CURSOR_RLE_COPY | (n - 1);
+            emit(o, &op, 1);
+            for (int i = 0; i < n; i++)
+                emit_pixel(o, row[x + i]);
+            x += n;
+        }
+    }
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: cursor_asset [-n name] [-x hot_x] [-y hot_y] [-s size,size...] [-t alpha] image.png\n");
+    exit(2);
+}
+
+int main(int argc, char** argv)
+{
+    const char* name = "cursor";
+    const char* sizes_arg = NULL;
+    int hot_x = 0, hot_y = 0, threshold = ALPHA_THRESHOLD, opt;
+    while ((opt = getopt(argc, argv, "n:x:y:s:t:")) != -1) {
+        switch (opt) {
+        case 'n':
+            name = optarg;
+            break;
+        case 'x':
+            hot_x = atoi(optarg);
+            break;
+        case 'y':
+            hot_y = atoi(optarg);
+            break;
+        case 's':
+            sizes_arg = optarg;
+            break;
+        case 't':
+            threshold = atoi(optarg);
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind != argc - 1)
+        usage();
+    const char* path = argv[optind];
+
+    struct image src;
+    load_png(path, threshold, &src);
+    if (hot_x < 0 || hot_y < 0 || hot_x >= src.w || hot_y >= src.h)
+        die("hotspot outside the image", path);
+
+    // Sizes, largest side in pixels; the first is the default
+    int sizes[MAX_SIZES], num_sizes = 0;
+    int big = src.w > src.h ? src.w : src.h;
+    for (const char* p = sizes_arg; p && *p && num_sizes < MAX_SIZES;) {
+        char* end;
+        long v = strtol(p, &end, 10);
+        if (end == p || v < 1 || v > big)
+            die("sizes must be 1 .. the image size", path);
+        sizes[num_sizes++] = (int)v;
+        p = *end == ',' ? end + 1 : end;
+    }
+    if (!num_sizes)
+        sizes[num_sizes++] = big;
+
+    char upper[64];
+    size_t i;
+    for (i = 0; name[i] && i < sizeof(upper) - 1; i++)
+        upper[i] = name[i] >= 'a' && name[i] <= 'z' ? name[i] - 'a' + 'A' : name[i];
+    upper[i] = 0;
+
+    struct out rle = { 0 };
+    uint32_t offset[MAX_SIZES], len[MAX_SIZES];
+    struct image scaled[MAX_SIZES];
+    for (int s = 0; s < num_sizes; s++) {
+        if (sizes[s] == big)
+            scaled[s] = src;
+        else
+            scale(&src, sizes[s], &scaled[s]);
+        offset[s] = rle.len;
+        encode(&scaled[s], &rle);
+        len[s] = rle.len - offset[s];
+    }
+
+    const char* base = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    printf("/* Generated by cursor_asset from %s, do not edit: %d size(s), %zu bytes */\n", base, num_sizes, rle.len);
+    printf("#include \"cursor_image.h\"\n\n");
+    printf("#define CURSOR_%s_HOT_X %d\n", upper, hot_x);
+    printf("#define CURSOR_%s_HOT_Y %d\n", upper, hot_y);
+    printf("#define CURSOR_%s_SIZES %d\n\n", upper, num_sizes);
+    printf("static const uint8_t cursor_%s_rle[%zu] = {", name, rle.len);
+    for (size_t n = 0; n < rle.len; n++)
+        printf("%s0x%02X,", n % 16 ? " " : "\n    ", rle.buf[n]);
+    printf("\n};\n\n");
+    printf("static const struct cursor_image cursor_%s[CURSOR_%s_SIZES] = {\n", name, upper);
+    for (int s = 0; s < num_sizes; s++) {
+        // The hotspot scales with the image
+        printf("    { %d, %d, %d, %d, cursor_%s_rle + %u, %u },\n", scaled[s].w, scaled[s].h,
+               hot_x * scaled[s].w / src.w, hot_y * scaled[s].h / src.h, name, offset[s], len[s]);
+    }
+    printf("};\n");
+    return 0;
+}
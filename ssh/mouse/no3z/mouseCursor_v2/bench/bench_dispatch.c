@@ -0,0 +1,132 @@
+/**
+ * @file bench_dispatch.c
+ * Decription: Microbenchmark for the compiled button dispatch table.
+ *
+ * Compiles configs with an increasing number of bindings and measures the cost
+ * of dispatching a fixed stream of button and wheel events. Dispatch is a
+ * direct table index, so ns/event should stay flat as bindings grow.
+ *
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "button_dispatch.h"
+
+#define NUM_EVENTS (1 << 20)
+#define ROUNDS 20
+
+static const char* triggers[] = {
+    "BTN_LEFT", "BTN_RIGHT", "BTN_MIDDLE", "BTN_SIDE", "BTN_EXTRA",
+    "BTN_FORWARD", "BTN_BACK", "BTN_TASK", "WHEEL_UP", "WHEEL_DOWN",
+};
+static const char* mods[] = { "BTN_SIDE", "BTN_EXTRA", "BTN_FORWARD", "BTN_BACK" };
+
+struct bench_event {
+    uint16_t code;     // 0 = wheel
+    int16_t value;
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Build a config with num_bindings lines spread over layers and chords
+static void build_table(struct dispatch_table* t, int num_bindings)
+{
+    static struct dispatch_builder b;
+    char line[128];
+
+    // Keep the [CONFIG] log out of the CSV on stdout
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+
+    dispatch_builder_init(&b);
+    for (int i = 0; i < num_bindings; i++) {
+        int layer = i / 32;
+        int ntrig = sizeof(triggers) / sizeof(triggers[0]);
+        const char* trig = triggers[i % ntrig];
+        const char* mod = mods[(i / ntrig) % 4];
+
+        snprintf(line, sizeof line, "[layer %d]", layer % DISPATCH_NUM_LAYERS);
+        dispatch_parse_line(&b, line);
+        if ((i / ntrig) % 2 && strcmp(mod, trig) != 0)
+            snprintf(line, sizeof line, "%s+%s=KEY_F%d,MIDI_CC_%d", mod, trig, 1 + i % 12, i % 128);
+        else
+            snprintf(line, sizeof line, "%s=MIDI_CC_%d", trig, i % 128);
+        dispatch_parse_line(&b, line);
+    }
+    dispatch_compile(&b, t);
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    close(devnull);
+}
+
+int main(void)
+{
+    static const int sizes[] = { 1, 4, 16, 64, 128 };
+    static struct dispatch_table table;
+    struct bench_event* events = malloc(NUM_EVENTS * sizeof(*events));
+    int down[DISPATCH_NUM_BUTTONS] = { 0 };
+
+    // Same random press/release/wheel stream for every table size
+    srand(1);
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        int r = rand() % 10;
+        if (r < 2) {
+            events[i].code = 0;
+            events[i].value = (rand() & 1) ? 1 : -1;
+        } else {
+            int idx = BTN_LEFT - DISPATCH_FIRST_CODE + rand() % 8;
+            events[i].code = (uint16_t)(DISPATCH_FIRST_CODE + idx);
+            events[i].value = (int16_t)(down[idx] ^= 1);
+        }
+    }
+
+    fprintf(stdout, "bindings,actions,ns_per_event,hits\n");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        build_table(&table, sizes[s]);
+
+        uint64_t best = UINT64_MAX;
+        unsigned long hits = 0;
+        for (int round = 0; round < ROUNDS; round++) {
+            struct dispatch_state state;
+            struct dispatch_hit hit;
+            dispatch_state_reset(&state);
+            hits = 0;
+
+            uint64_t start = now_ns();
+            for (int i = 0; i < NUM_EVENTS; i++) {
+                int got = events[i].code
+                    ? dispatch_button(&table, &state, events[i].code, events[i].value, &hit)
+                    : dispatch_wheel(&table, &state, events[i].value, &hit);
+                if (got) {
+                    // Emulate the layer side effects the library applies
+                    for (int a = 0; a < hit.count; a++)
+                        dispatch_layer_action(&state, &hit.actions[a], hit.edge);
+                    hits += hit.count;
+                }
+            }
+            uint64_t elapsed = now_ns() - start;
+            if (elapsed < best)
+                best = elapsed;
+        }
+        fprintf(stdout, "%d,%d,%.2f,%lu\n", table.num_bindings, table.num_actions,
+                (double)best / NUM_EVENTS, hits);
+    }
+
+    free(events);
+    return 0;
+}
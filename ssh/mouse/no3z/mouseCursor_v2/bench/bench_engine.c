@@ -0,0 +1,339 @@
+/**
+ * @file bench_engine.c
+ * Decription: Microbenchmarks for the engine's event-processing core.
+ *
+ * Builds force_cursor.c into the benchmark (its handlers are static) and
+ * feeds synthetic traces straight to them, with no devices or DRM:
+ *
+ *   rel_transform   REL_X/REL_Y -> portrait screen position and clamp
+ *   coalesce        1 kHz reports read 1-8 per batch, one cursor move per batch
+ *   button_touch    BTN_LEFT press/release -> dispatch -> touch frame (/dev/null)
+ *   pinch_frame     two-finger MT frames as a pinch sends them (/dev/null)
+ *   config_parse    load_config() of a 40 line config, per line
+ *   cursor_upload   map a 64x64 dumb buffer, decode the cursor into it, unmap
+ *
+ * Each case runs ROUNDS times and reports the best round as CSV on stdout,
+ * one row per case, so runs on two commits can be diffed or joined:
+ *
+ *   case,events,ns_per_event,allocs_per_event,alloc_bytes_per_event
+ *
+ * Allocations are counted by replacing malloc/calloc/realloc; that sees
+ * libc's own (fopen's buffer) as well. The /dev/null writes are real
+ * syscalls, so button_touch and pinch_frame include the write cost.
+ *
+ */
+#include "../force_cursor.c"
+#include "cursor_arrow.h"
+
+#include <sys/mman.h>
+
+#define NUM_EVENTS (1 << 18)
+#define ROUNDS 15
+#define CONFIG_LOADS 200
+#define UPLOADS 2000
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+
+static uint64_t alloc_calls = 0;
+static uint64_t alloc_bytes = 0;
+
+void* malloc(size_t size)
+{
+    __atomic_add_fetch(&alloc_calls, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&alloc_bytes, size, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size)
+{
+    __atomic_add_fetch(&alloc_calls, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&alloc_bytes, n * size, __ATOMIC_RELAXED);
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    __atomic_add_fetch(&alloc_calls, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&alloc_bytes, size, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr)
+{
+    __libc_free(ptr);
+}
+
+struct result {
+    uint64_t best_ns;
+    uint64_t allocs;
+    uint64_t bytes;
+};
+
+static struct engine_persist bench_persist;
+static struct engine_state bench_state;
+static uint64_t moves = 0;
+
+static int count_move(int fd, uint32_t crtc, int x, int y)
+{
+    (void)fd;
+    (void)crtc;
+    (void)x;
+    (void)y;
+    moves++;
+    return 0;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static struct input_event make_event(uint16_t type, uint16_t code, int32_t value)
+{
+    struct input_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.type = type;
+    ev.code = code;
+    ev.value = value;
+    return ev;
+}
+
+static void print_row(const char* name, uint64_t events, const struct result* r)
+{
+    fprintf(stdout, "%s,%llu,%.2f,%.3f,%.1f\n", name, (unsigned long long)events, (double)r->best_ns / events,
+            (double)r->allocs / events, (double)r->bytes / events);
+}
+
+// Time one round; allocations are the same every round, keep the last
+static void timed(struct result* r, uint64_t start, uint64_t allocs0, uint64_t bytes0)
+{
+    uint64_t elapsed = now_ns() - start;
+    if (elapsed < r->best_ns)
+        r->best_ns = elapsed;
+    r->allocs = alloc_calls - allocs0;
+    r->bytes = alloc_bytes - bytes0;
+}
+
+// Motion only: the transform and clamp, no frames
+static void bench_rel(const struct input_event* evs, uint64_t n, struct result* r)
+{
+    for (int round = 0; round < ROUNDS; round++) {
+        uint64_t a = alloc_calls, b = alloc_bytes, start = now_ns();
+        for (uint64_t i = 0; i < n; i++)
+            handle_mouse_event(&evs[i]);
+        timed(r, start, a, b);
+    }
+}
+
+// Whole reports in read batches, flushed like on_mouse_readable()
+static void bench_coalesce(const struct input_event* evs, const uint32_t* batches, uint64_t nbatches,
+                           struct result* r)
+{
+    for (int round = 0; round < ROUNDS; round++) {
+        uint64_t a = alloc_calls, b = alloc_bytes, start = now_ns();
+        const struct input_event* ev = evs;
+        for (uint64_t i = 0; i < nbatches; i++) {
+            for (uint32_t k = 0; k < batches[i]; k++)
+                handle_mouse_event(ev++);
+            flush_cursor();
+        }
+        timed(r, start, a, b);
+    }
+}
+
+static void bench_pinch(uint64_t n, struct result* r)
+{
+    for (int round = 0; round < ROUNDS; round++) {
+        uint64_t a = alloc_calls, b = alloc_bytes, start = now_ns();
+        for (uint64_t i = 0; i < n; i++) {
+            int spacing = 30 + (int)(i % 5) * 17;
+            if (i % 6 == 5)
+                send_two_finger_frame(uinput_fd, 0, 0, -1, 0, 0, -1, 1);
+            else
+                send_two_finger_frame(uinput_fd, 400 - spacing / 2, 640 - spacing / 2, 10, 400 + spacing / 2,
+                                      640 + spacing / 2, 11, i % 6 == 0);
+        }
+        timed(r, start, a, b);
+    }
+}
+
+// A config like the README's, with every kind of line
+static int write_config(const char* path, int* lines)
+{
+    FILE* fp = fopen(path, "w");
+    if (!fp)
+        return -1;
+    int n = 0;
+    n += fprintf(fp, "/dev/input/event1\n1.5\n") > 0 ? 2 : 0;
+    static const char* const settings[] = {
+        "LOG_LEVEL=info", "LATENCY_STATS=1", "TRACE=0", "ENCODER_RATE=200", "ENCODER_SENSITIVITY=2.0",
+        "ENCODER_CHANNEL=2", "XRUN_MONITOR=1", "XRUN_WINDOW=50",
+    };
+    for (size_t i = 0; i < sizeof(settings) / sizeof(settings[0]); i++, n++)
+        fprintf(fp, "%s\n", settings[i]);
+    fprintf(fp, "MACRO save=KEYDOWN KEY_LEFTCTRL; KEY KEY_ENTER; WAIT 20; KEYUP KEY_LEFTCTRL\n");
+    fprintf(fp, "MACRO pads=TAP 100 900; WAIT 30; CC 20 127\n");
+    n += 2;
+    static const char* const bindings[] = {
+        "BTN_LEFT=TOUCH", "BTN_RIGHT=KEY_ESC", "BTN_MIDDLE=MIDI_CC_20", "WHEEL_UP=PINCH_IN",
+        "WHEEL_DOWN=PINCH_OUT", "BTN_SIDE=LAYER_1", "BTN_EXTRA=LAYER_TOGGLE_2", "BTN_FORWARD=MACRO_save",
+        "BTN_BACK=ENCODER_CC_21",
+    };
+    for (int layer = 0; layer < 3; layer++) {
+        fprintf(fp, "[layer %d]\n", layer);
+        n++;
+        for (size_t i = 0; i < sizeof(bindings) / sizeof(bindings[0]); i++, n++)
+            fprintf(fp, "%s\n", bindings[i]);
+    }
+    fclose(fp);
+    *lines = n;
+    return 0;
+}
+
+static int bench_config(const char* path, struct result* r)
+{
+    for (int round = 0; round < ROUNDS; round++) {
+        uint64_t a = alloc_calls, b = alloc_bytes, start = now_ns();
+        for (int i = 0; i < CONFIG_LOADS; i++) {
+            char* dev = NULL;
+            struct config* c = load_config(path, &dev, 1);
+            if (!c)
+                return -1;
+            free(dev);
+            free(c);
+        }
+        timed(r, start, a, b);
+    }
+    return 0;
+}
+
+// What the shim's init_cursor does with the buffer, on a memfd standing in
+// for the DRM fd
+static int bench_upload(struct result* r)
+{
+    const size_t size = CURSOR_IMAGE_MAX * CURSOR_IMAGE_MAX * 4;
+    int fd = memfd_create("bench_cursor", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, size) < 0)
+        return -1;
+    for (int round = 0; round < ROUNDS; round++) {
+        uint64_t a = alloc_calls, b = alloc_bytes, start = now_ns();
+        for (int i = 0; i < UPLOADS; i++) {
+            void* ptr = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (ptr == MAP_FAILED)
+                return -1;
+            cursor_image_decode(&cursor_arrow[0], ptr, CURSOR_IMAGE_MAX * 4, CURSOR_IMAGE_MAX, CURSOR_IMAGE_MAX);
+            munmap(ptr, size);
+        }
+        timed(r, start, a, b);
+    }
+    close(fd);
+    return 0;
+}
+
+int main(void)
+{
+    char config_path[] = "/tmp/bench_engine_XXXXXX";
+    int config_fd = mkstemp(config_path);
+    int config_lines = 0;
+    if (config_fd < 0 || write_config(config_path, &config_lines) < 0) {
+        perror("bench_engine: config");
+        return 1;
+    }
+    close(config_fd);
+
+    // Keep the engine's [CONFIG] output out of the CSV on stdout
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+
+    bench_persist.cursor_x = ENGINE_DEFAULT_X;
+    bench_persist.cursor_y = ENGINE_DEFAULT_Y;
+    bench_state.drm_fd = ENGINE_DRM_REMOTE;  // moves go to count_move, no vblank timing
+    bench_state.persist = &bench_persist;
+    bench_state.move_cursor = count_move;
+    shim = &bench_state;
+    config = load_config(config_path, &device, 1);
+    if (!config) {
+        dup2(saved, STDOUT_FILENO);
+        fprintf(stderr, "bench_engine: config did not load\n");
+        return 1;
+    }
+    apply_settings(config);
+    macro_commit();
+    cursor.rate = config->rate;
+    latency_enabled = 0;
+    trace_on = 0;
+    dispatch_state_reset(&button_state);
+
+    // Same traces every run
+    srand(1);
+    struct input_event* rel = malloc(NUM_EVENTS * sizeof(*rel));
+    for (uint64_t i = 0; i < NUM_EVENTS; i++)
+        rel[i] = make_event(EV_REL, i & 1 ? REL_Y : REL_X, rand() % 41 - 20);
+
+    // X, Y, SYN per report; batches of 1-8 reports (mostly 1-2, as when
+    // the loop keeps up with a 1 kHz mouse)
+    uint64_t reports = NUM_EVENTS / 3, nbatches = 0;
+    struct input_event* frames = malloc(reports * 3 * sizeof(*frames));
+    uint32_t* batches = malloc(reports * sizeof(*batches));
+    for (uint64_t i = 0; i < reports; i++) {
+        int still = rand() % 8 == 0;  // a report that does not move the cursor
+        frames[i * 3] = make_event(EV_REL, REL_X, still ? 0 : rand() % 9 - 4);
+        frames[i * 3 + 1] = make_event(EV_REL, REL_Y, still ? 0 : rand() % 9 - 4);
+        frames[i * 3 + 2] = make_event(EV_SYN, SYN_REPORT, 0);
+    }
+    for (uint64_t left = reports; left > 0;) {
+        uint32_t k = rand() % 4 ? 1 + rand() % 2 : 1 + rand() % 8;
+        if (k > left)
+            k = (uint32_t)left;
+        batches[nbatches++] = k * 3;
+        left -= k;
+    }
+
+    struct input_event* buttons = malloc(NUM_EVENTS * sizeof(*buttons));
+    for (uint64_t i = 0; i < NUM_EVENTS; i += 2) {
+        buttons[i] = make_event(EV_KEY, BTN_LEFT, (int)((i / 2) & 1) ^ 1);
+        buttons[i + 1] = make_event(EV_SYN, SYN_REPORT, 0);
+    }
+
+    uinput_fd = devnull;
+    struct result res[6];
+    for (int i = 0; i < 6; i++)
+        res[i] = (struct result){ UINT64_MAX, 0, 0 };
+
+    bench_rel(rel, NUM_EVENTS, &res[0]);
+    bench_coalesce(frames, batches, nbatches, &res[1]);
+    bench_rel(buttons, NUM_EVENTS, &res[2]);
+    bench_pinch(NUM_EVENTS / 8, &res[3]);
+    int config_ok = bench_config(config_path, &res[4]) == 0;
+    int upload_ok = bench_upload(&res[5]) == 0;
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    close(devnull);
+    unlink(config_path);
+
+    fprintf(stdout, "case,events,ns_per_event,allocs_per_event,alloc_bytes_per_event\n");
+    print_row("rel_transform", NUM_EVENTS, &res[0]);
+    print_row("coalesce", reports * 3, &res[1]);
+    print_row("button_touch", NUM_EVENTS, &res[2]);
+    print_row("pinch_frame", NUM_EVENTS / 8, &res[3]);
+    if (config_ok)
+        print_row("config_parse", (uint64_t)CONFIG_LOADS * config_lines, &res[4]);
+    if (upload_ok)
+        print_row("cursor_upload", UPLOADS, &res[5]);
+    fprintf(stderr, "cursor at %d,%d after %llu moves\n", cursor.x, cursor.y, (unsigned long long)moves);
+
+    free(rel);
+    free(frames);
+    free(batches);
+    free(buttons);
+    return !config_ok || !upload_ok;
+}
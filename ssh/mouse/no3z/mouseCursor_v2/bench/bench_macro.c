@@ -0,0 +1,192 @@
+/**
+ * @file bench_macro.c
+ * Decription: Timing jitter of the macro sequencer.
+ *
+ * Plays a macro of evenly spaced taps into a pipe standing in for the uinput
+ * device. A reader thread timestamps each touch-down as it arrives and compares
+ * it with the macro's schedule. Meanwhile a feeder thread sends fake mouse
+ * reports every millisecond through the same event loop, and the bench records
+ * how long they wait, to show the loop never blocks during a macro.
+ *
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <linux/input.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ev_loop.h"
+#include "macro.h"
+
+#define TAPS 20            // taps per macro
+#define TAP_PERIOD_MS 5    // 1 ms down + 4 ms wait
+#define RUNS 50
+#define MAX_SAMPLES (TAPS * RUNS)
+
+static int sink_pipe[2];
+static int mouse_pipe[2];
+static volatile int feeding = 1;
+
+static uint64_t expected[MAX_SAMPLES];
+static int64_t jitter[MAX_SAMPLES];
+static volatile int num_arrivals = 0;
+static uint64_t mouse_late_max = 0;
+static uint64_t mouse_late_total = 0;
+static unsigned long mouse_reports = 0;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Same frame the library writes to uinput for a touch
+static void sink_touch(int x, int y, int pressed)
+{
+    struct input_event ev[4];
+    memset(ev, 0, sizeof(ev));
+    ev[0].type = EV_ABS;
+    ev[0].code = ABS_X;
+    ev[0].value = x;
+    ev[1].type = EV_ABS;
+    ev[1].code = ABS_Y;
+    ev[1].value = y;
+    ev[2].type = EV_KEY;
+    ev[2].code = BTN_TOUCH;
+    ev[2].value = pressed;
+    ev[3].type = EV_SYN;
+    ev[3].code = SYN_REPORT;
+    if (write(sink_pipe[1], ev, sizeof(ev)) != sizeof(ev))
+        perror("write");
+}
+
+static void* reader_thread(void* arg)
+{
+    (void)arg;
+    struct input_event ev[4];
+
+    while (read(sink_pipe[0], ev, sizeof(ev)) == sizeof(ev)) {
+        uint64_t t = now_ns();
+        if (ev[2].value == 1 && num_arrivals < MAX_SAMPLES) {
+            jitter[num_arrivals] = (int64_t)(t - expected[num_arrivals]);
+            num_arrivals++;
+        }
+    }
+    return NULL;
+}
+
+static void* feeder_thread(void* arg)
+{
+    (void)arg;
+    while (feeding) {
+        uint64_t t = now_ns();
+        if (write(mouse_pipe[1], &t, sizeof(t)) != sizeof(t))
+            break;
+        usleep(1000);
+    }
+    return NULL;
+}
+
+static void on_mouse(void* ctx, uint32_t events)
+{
+    (void)ctx;
+    (void)events;
+    uint64_t stamps[64];
+    ssize_t n = read(mouse_pipe[0], stamps, sizeof(stamps));
+    uint64_t t = now_ns();
+
+    for (ssize_t i = 0; i < n / (ssize_t)sizeof(stamps[0]); i++) {
+        uint64_t late = t - stamps[i];
+        mouse_late_total += late;
+        if (late > mouse_late_max)
+            mouse_late_max = late;
+        mouse_reports++;
+    }
+}
+
+static int cmp_i64(const void* a, const void* b)
+{
+    int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+int main(void)
+{
+    static char text[TAPS * 32];
+    size_t len = 0;
+    for (int i = 0; i < TAPS; i++)
+        len += snprintf(text + len, sizeof(text) - len, "TAP %d 600 1; WAIT %d;", 100 + i * 20, TAP_PERIOD_MS - 1);
+
+    if (pipe(sink_pipe) < 0 || pipe(mouse_pipe) < 0 || ev_loop_init() < 0) {
+        perror("bench_macro");
+        return 1;
+    }
+    // Keep the [CONFIG] log out of the CSV
+    int saved = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+    int index = macro_define("bench", text);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    close(devnull);
+    if (index < 0)
+        return 1;
+    macro_commit();
+
+    static const struct macro_sink sink = { sink_touch, NULL, NULL };
+    if (macro_init(&sink) < 0 || ev_loop_add(mouse_pipe[0], EPOLLIN, on_mouse, NULL) < 0) {
+        perror("bench_macro");
+        return 1;
+    }
+
+    pthread_t reader, feeder;
+    pthread_create(&reader, NULL, reader_thread, NULL);
+    pthread_create(&feeder, NULL, feeder_thread, NULL);
+
+    for (int run = 0; run < RUNS; run++) {
+        uint64_t t0 = ev_now_ns();
+        for (int i = 0; i < TAPS; i++)
+            expected[run * TAPS + i] = t0 + (uint64_t)i * TAP_PERIOD_MS * 1000000ull;
+        __sync_synchronize();
+        macro_play(0);
+        while (macro_playing())
+            ev_loop_run_once(-1);
+    }
+
+    feeding = 0;
+    pthread_join(feeder, NULL);
+    close(sink_pipe[1]);
+    pthread_join(reader, NULL);
+
+    int n = num_arrivals;
+    double sum = 0.0;
+    for (int i = 0; i < n; i++)
+        sum += (double)jitter[i];
+    qsort(jitter, n, sizeof(jitter[0]), cmp_i64);
+
+    struct macro_stats st;
+    macro_get_stats(&st);
+
+    fprintf(stdout, "samples,mean_us,p50_us,p99_us,max_us,timer_late_max_us,mouse_reports,mouse_mean_us,mouse_max_us\n");
+    fprintf(stdout, "%d,%.1f,%.1f,%.1f,%.1f,%.1f,%lu,%.1f,%.1f\n", n,
+            n ? sum / n / 1000.0 : 0.0,
+            n ? jitter[n / 2] / 1000.0 : 0.0,
+            n ? jitter[(n * 99) / 100] / 1000.0 : 0.0,
+            n ? jitter[n - 1] / 1000.0 : 0.0,
+            st.late_max_ns / 1000.0,
+            mouse_reports,
+            mouse_reports ? (double)mouse_late_total / mouse_reports / 1000.0 : 0.0,
+            mouse_late_max / 1000.0);
+
+    macro_close();
+    ev_loop_close();
+    return 0;
+}
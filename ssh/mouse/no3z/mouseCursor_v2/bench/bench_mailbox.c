@@ -0,0 +1,117 @@
+/**
+ * @file bench_mailbox.c
+ * Decription: Cost of the cursord -> MPC cursor mailbox.
+ *
+ * A forked reader plays the shim's mailbox thread: it waits on the mailbox
+ * and timestamps every wakeup against the post it finds. The writer plays
+ * cursord in two runs: one post per millisecond (a 1000 Hz mouse, reader
+ * asleep between posts, so every post pays for a FUTEX_WAKE), then posts
+ * back to back (the reader folds them). The budget is one vblank, 16.7 ms.
+ *
+ */
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mailbox.h"
+
+#define BENCH_SHM_NAME "/force_cursor_mailbox_bench"  // never the live mailbox
+#define PACED_POSTS 2000
+#define BURST_POSTS 200000
+#define MAX_SAMPLES 200000
+#define VBLANK_NS 16666667ull
+
+struct shared {
+    volatile int done;
+    int num_samples;
+    uint64_t sample[MAX_SAMPLES];  // post -> reader awake, ns
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void reader(struct mailbox* mb, struct shared* sh)
+{
+    uint32_t seen = __atomic_load_n(&mb->seq, __ATOMIC_ACQUIRE);
+
+    while (!sh->done) {
+        if (!mailbox_wait(mb, &seen, 1000) || sh->done)
+            continue;
+        uint64_t t = now_ns();
+        int x, y, shape;
+        uint64_t post_ns;
+        mailbox_read(mb, &x, &y, &shape, &post_ns);
+        if (sh->num_samples < MAX_SAMPLES && t > post_ns)
+            sh->sample[sh->num_samples++] = t - post_ns;
+    }
+}
+
+static int cmp_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void run(const char* name, int posts, int period_us)
+{
+    struct mailbox* mb = mailbox_map(BENCH_SHM_NAME);
+    struct shared* sh = mmap(NULL, sizeof(*sh), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (!mb || sh == MAP_FAILED) {
+        perror("bench_mailbox");
+        exit(1);
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        reader(mb, sh);
+        _exit(0);
+    }
+    usleep(100000);  // reader asleep in FUTEX_WAIT
+
+    uint64_t post_total = 0, post_max = 0;
+    for (int i = 0; i < posts; i++) {
+        uint64_t t = now_ns();
+        mailbox_post(mb, i % 800, i % 1280, MAILBOX_SHAPE_ARROW);
+        uint64_t cost = now_ns() - t;
+        post_total += cost;
+        if (cost > post_max)
+            post_max = cost;
+        if (period_us)
+            usleep(period_us);
+    }
+    usleep(100000);
+    sh->done = 1;
+    mailbox_wake(mb);
+    waitpid(pid, NULL, 0);
+
+    int n = sh->num_samples;
+    qsort(sh->sample, n, sizeof(sh->sample[0]), cmp_u64);
+    uint64_t p99 = n ? sh->sample[(n * 99) / 100] : 0;
+    fprintf(stdout, "%s,%d,%d,%.0f,%.1f,%.1f,%.1f,%.1f,%.3f\n", name, posts, n,
+            (double)post_total / posts, post_max / 1000.0,
+            n ? sh->sample[n / 2] / 1000.0 : 0.0,
+            p99 / 1000.0,
+            n ? sh->sample[n - 1] / 1000.0 : 0.0,
+            100.0 * (double)p99 / VBLANK_NS);
+
+    munmap(sh, sizeof(*sh));
+    munmap(mb, sizeof(*mb));
+    shm_unlink(BENCH_SHM_NAME);
+}
+
+int main(void)
+{
+    fprintf(stdout, "run,posts,wakeups,post_mean_ns,post_max_us,wake_p50_us,wake_p99_us,wake_max_us,p99_pct_of_vblank\n");
+    run("paced_1ms", PACED_POSTS, 1000);
+    run("burst", BURST_POSTS, 0);
+    return 0;
+}
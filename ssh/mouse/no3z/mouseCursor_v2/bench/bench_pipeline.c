@@ -0,0 +1,145 @@
+/**
+ * @file bench_pipeline.c
+ * Decription: Microbenchmark for the shared mouse event pipeline.
+ *
+ * Builds pipeline.h with the PIPELINE_* flags given on the command line
+ * (see compile: once as the lite builds have it, once as the engine has
+ * it) and plays a synthetic 1 kHz mouse through pipeline_event(): motion
+ * with a press, drag and release now and then, and a wheel notch in the
+ * engine build. The stages only count, so ns/event is the pipeline's own
+ * cost; bench_engine measures the engine's real stages.
+ *
+ *   ./bench_pipeline lite
+ *
+ */
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pipeline.h"
+
+#define NUM_EVENTS (1 << 20)
+#define ROUNDS 20
+
+static struct pipeline cursor;
+static uint64_t touches = 0;
+static uint64_t moves = 0;
+
+static void pipeline_touch(int x, int y, int pressed)
+{
+    (void)x;
+    (void)y;
+    (void)pressed;
+    touches++;
+}
+
+#if PIPELINE_COALESCE
+static void pipeline_frame(const struct input_event* ev)
+{
+    (void)ev;
+    moves++;
+}
+#else
+static void pipeline_move(int x, int y)
+{
+    (void)x;
+    (void)y;
+    moves++;
+}
+#endif
+
+#if PIPELINE_BUTTONS == PIPELINE_BUTTONS_HOOK
+// What the default bindings do: L/R/M touch at the cursor
+static void pipeline_key(const struct input_event* ev)
+{
+    if (ev->code == BTN_LEFT || ev->code == BTN_RIGHT || ev->code == BTN_MIDDLE) {
+        cursor.touch_down = ev->value != 0;
+        pipeline_touch(cursor.x, cursor.y, cursor.touch_down);
+    }
+}
+#endif
+
+#if PIPELINE_REL_FILTER
+static int pipeline_rel_filter(const struct input_event* ev)
+{
+    return ev->code == REL_HWHEEL;
+}
+#endif
+
+#if PIPELINE_WHEEL
+static uint64_t notches = 0;
+
+static void pipeline_wheel(int value)
+{
+    notches += value != 0;
+}
+#endif
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void put(struct input_event* ev, uint16_t type, uint16_t code, int32_t value)
+{
+    memset(ev, 0, sizeof(*ev));
+    ev->type = type;
+    ev->code = code;
+    ev->value = value;
+}
+
+// Reports of REL_X, REL_Y, SYN; every 64th report presses or releases the
+// left button and every 256th is a wheel notch
+static int build_trace(struct input_event* evs, int max)
+{
+    int n = 0, report = 0;
+    srand(1);
+    while (n + 4 <= max) {
+        if (report % 64 == 0) {
+            put(&evs[n++], EV_KEY, BTN_LEFT, (report / 64) & 1);
+        } else if (report % 256 == 1) {
+            put(&evs[n++], EV_REL, REL_WHEEL, rand() % 2 ? 1 : -1);
+        } else {
+            put(&evs[n++], EV_REL, REL_X, rand() % 17 - 8);
+            put(&evs[n++], EV_REL, REL_Y, rand() % 17 - 8);
+        }
+        put(&evs[n++], EV_SYN, SYN_REPORT, 0);
+        report++;
+    }
+    return n;
+}
+
+int main(int argc, char** argv)
+{
+    const char* variant = argc > 1 ? argv[1] : "pipeline";
+    struct input_event* evs = malloc(NUM_EVENTS * sizeof(*evs));
+    if (!evs)
+        return 1;
+    int n = build_trace(evs, NUM_EVENTS);
+
+    double best = 0;
+    for (int r = 0; r < ROUNDS; r++) {
+        cursor.x = PIPELINE_WIDTH / 2;
+        cursor.y = PIPELINE_HEIGHT / 2;
+        cursor.rate = PIPELINE_DEFAULT_RATE;
+        cursor.touch_down = 0;
+        uint64_t t0 = now_ns();
+        for (int i = 0; i < n; i++)
+            pipeline_event(&cursor, &evs[i]);
+        double ns = (double)(now_ns() - t0) / n;
+        if (r == 0 || ns < best)
+            best = ns;
+    }
+
+    fprintf(stderr, "cursor at %d,%d, %llu touches, %llu moves\n", cursor.x, cursor.y,
+            (unsigned long long)touches, (unsigned long long)moves);
+    fprintf(stdout, "variant,events,ns_per_event\n");
+    fprintf(stdout, "%s,%d,%.2f\n", variant, n, best);
+    free(evs);
+    return 0;
+}
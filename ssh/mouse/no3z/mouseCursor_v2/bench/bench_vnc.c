@@ -0,0 +1,305 @@
+/**
+ * @file bench_vnc.c
+ * Decription: Cost and correctness of the VNC server.
+ *
+ * A feeder thread plays MPC: it renders 800x1280 frames in memory at 60 Hz
+ * (a moving block and a level meter over a static screen) and hands each
+ * one to the server with vnc_present(). A minimal RFB 3.8 client on
+ * loopback asks for zlib updates, decodes them into its own copy of the
+ * screen and, once the feeder stops, checks it pixel by pixel against the
+ * last frame. A click is checked to arrive as a touch frame on a pipe
+ * standing in for the uinput device. Reports updates, bytes per update,
+ * changed tiles, flip -> sent latency and the server's CPU use.
+ *
+ */
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <linux/input.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "stats.h"
+#include "vnc.h"
+
+#define WIDTH 800
+#define HEIGHT 1280
+#define BENCH_PORT 5959
+#define BENCH_FPS 30
+#define RUN_S 5
+#define FRAME_US 16667
+#define BLOCK 64
+
+static uint8_t* buffers[3];
+static struct vnc_frame frames[3];
+static volatile int feeding = 1;
+static int last_frame = -1;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void fill(uint8_t* p, int x, int y, int w, int h, uint32_t colour)
+{
+    for (int r = y; r < y + h; r++) {
+        uint32_t* row = (uint32_t*)(p + (size_t)r * WIDTH * 4);
+        for (int c = x; c < x + w; c++)
+            row[c] = colour;
+    }
+}
+
+// Static background: a grid of pads and a header bar
+static void draw_background(uint8_t* p)
+{
+    fill(p, 0, 0, WIDTH, HEIGHT, 0xFF202020);
+    fill(p, 0, 0, WIDTH, 80, 0xFF3050A0);
+    for (int i = 0; i < 16; i++)
+        fill(p, 40 + (i % 4) * 185, 700 + (i / 4) * 140, 165, 120, 0xFF404040 + (uint32_t)i * 0x000A0A00);
+}
+
+// Triple buffered: the server may still be reading the frame before the
+// last one (vnc_present's contract is one frame)
+static void* feeder(void* arg)
+{
+    (void)arg;
+    for (int i = 0; i < 3; i++)
+        draw_background(buffers[i]);
+
+    for (int n = 0; feeding; n++) {
+        int b = n % 3;
+        uint8_t* p = buffers[b];
+        draw_background(p);
+        int x = (n * 7) % (WIDTH - BLOCK);
+        fill(p, x, 300, BLOCK, BLOCK, 0xFFE0C040);
+        int level = (int)(200 + 180 * sin(n / 10.0));
+        fill(p, 20, 120, level, 24, 0xFF40E040);
+        // Alpha only: must not count as a change
+        ((uint32_t*)p)[WIDTH * 1000 + 10] = (uint32_t)n << 24 | 0x202020;
+        vnc_present(&frames[b]);
+        last_frame = b;
+        usleep(FRAME_US);
+    }
+    return NULL;
+}
+
+static int read_all(int fd, void* buf, size_t len)
+{
+    uint8_t* p = buf;
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static uint32_t get16(const uint8_t* p)
+{
+    return (uint32_t)p[0] << 8 | p[1];
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void request(int fd, int incremental)
+{
+    uint8_t m[10] = { 3, (uint8_t)incremental, 0, 0, 0, 0, WIDTH >> 8, WIDTH & 255, HEIGHT >> 8, HEIGHT & 255 };
+    if (send(fd, m, sizeof(m), 0) != sizeof(m))
+        exit(1);
+}
+
+static int connect_and_init(void)
+{
+    struct sockaddr_in addr = { 0 };
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(BENCH_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("bench_vnc: connect");
+        exit(1);
+    }
+
+    uint8_t buf[64];
+    if (read_all(fd, buf, 12) < 0 || memcmp(buf, "RFB 003.008\n", 12) != 0)
+        goto bad;
+    send(fd, "RFB 003.008\n", 12, 0);
+    if (read_all(fd, buf, 2) < 0 || buf[0] != 1 || buf[1] != 1)
+        goto bad;
+    send(fd, "\x01", 1, 0);
+    if (read_all(fd, buf, 4) < 0 || get32(buf) != 0)
+        goto bad;
+    send(fd, "\x01", 1, 0);  // shared
+    if (read_all(fd, buf, 24) < 0)
+        goto bad;
+    uint32_t w = get16(buf), h = get16(buf + 2), name_len = get32(buf + 20);
+    if (read_all(fd, buf + 24, name_len) < 0 || w != WIDTH || h != HEIGHT || buf[4] != 32)
+        goto bad;
+
+    uint8_t enc[12] = { 2, 0, 0, 2, 0, 0, 0, 6, 0, 0, 0, 0 };  // zlib, raw
+    send(fd, enc, sizeof(enc), 0);
+    return fd;
+bad:
+    fprintf(stderr, "bench_vnc: bad handshake\n");
+    exit(1);
+}
+
+// Read one FramebufferUpdate into screen; returns the bytes it took
+static size_t read_update(int fd, z_stream* z, uint8_t* screen, uint8_t* rect)
+{
+    static uint8_t* comp = NULL;
+    static size_t comp_cap = 0;
+    uint8_t hdr[16];
+    size_t bytes = 4;
+
+    if (read_all(fd, hdr, 4) < 0 || hdr[0] != 0) {
+        fprintf(stderr, "bench_vnc: bad update\n");
+        exit(1);
+    }
+    uint32_t rects = get16(hdr + 2);
+    for (uint32_t i = 0; i < rects; i++) {
+        if (read_all(fd, hdr, 12) < 0)
+            exit(1);
+        uint32_t x = get16(hdr), y = get16(hdr + 2), w = get16(hdr + 4), h = get16(hdr + 6);
+        int32_t encoding = (int32_t)get32(hdr + 8);
+        size_t raw = (size_t)w * h * 4;
+        bytes += 12;
+        if (encoding == 6) {
+            if (read_all(fd, hdr, 4) < 0)
+                exit(1);
+            size_t len = get32(hdr);
+            if (len > comp_cap) {
+                comp = realloc(comp, len);
+                comp_cap = len;
+            }
+            if (read_all(fd, comp, len) < 0)
+                exit(1);
+            z->next_in = comp;
+            z->avail_in = (uInt)len;
+            z->next_out = rect;
+            z->avail_out = (uInt)raw;
+            if (inflate(z, Z_SYNC_FLUSH) != Z_OK || z->avail_out != 0) {
+                fprintf(stderr, "bench_vnc: inflate failed\n");
+                exit(1);
+            }
+            bytes += 4 + len;
+        } else {
+            if (read_all(fd, rect, raw) < 0)
+                exit(1);
+            bytes += raw;
+        }
+        for (uint32_t r = 0; r < h; r++)
+            memcpy(screen + ((size_t)(y + r) * WIDTH + x) * 4, rect + (size_t)r * w * 4, (size_t)w * 4);
+    }
+    return bytes;
+}
+
+static double hist_pct(int id, double pct)
+{
+    const struct stats_hist* h = &stats->hist[id];
+    uint64_t want = (uint64_t)(h->count * pct / 100.0), seen = 0;
+    for (int i = 0; i < STATS_HIST_BUCKETS; i++) {
+        seen += h->bucket[i];
+        if (seen > want)
+            return stats_hist_bucket_lo(i) / 1000.0;
+    }
+    return 0.0;
+}
+
+int main(void)
+{
+    int touch[2];
+    if (pipe(touch) < 0)
+        return 1;
+    for (int i = 0; i < 3; i++) {
+        buffers[i] = malloc((size_t)WIDTH * HEIGHT * 4);
+        frames[i] = (struct vnc_frame){ buffers[i], WIDTH, HEIGHT, WIDTH * 4 };
+    }
+    uint8_t* screen = calloc((size_t)WIDTH * HEIGHT, 4);
+    uint8_t* rect = malloc((size_t)WIDTH * HEIGHT * 4);
+
+    vnc_init(&touch[1]);
+    vnc_config.enabled = 1;
+    vnc_config.port = BENCH_PORT;
+    vnc_config.fps = BENCH_FPS;
+    vnc_apply();
+
+    pthread_t feed;
+    pthread_create(&feed, NULL, feeder, NULL);
+    usleep(50000);
+
+    int fd = connect_and_init();
+    z_stream z = { 0 };
+    inflateInit(&z);
+
+    // Streaming: one incremental request per update, like a viewer
+    uint64_t start = now_ns(), updates = 0, bytes = 0;
+    request(fd, 0);
+    while (now_ns() - start < RUN_S * 1000000000ull) {
+        bytes += read_update(fd, &z, screen, rect);
+        updates++;
+        request(fd, 1);
+    }
+    double wall_s = (now_ns() - start) / 1e9;
+    uint64_t cpu_ns = stats->counter[STAT_VNC_CPU_NS];
+    uint64_t tiles = stats->counter[STAT_VNC_TILES];
+    uint64_t throttled = stats->counter[STAT_VNC_THROTTLED];
+
+    // Stop drawing; the open request returns the last change, then nothing
+    feeding = 0;
+    pthread_join(feed, NULL);
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    while (poll(&pfd, 1, 1500) > 0) {
+        read_update(fd, &z, screen, rect);
+        request(fd, 1);
+    }
+    size_t wrong = 0;
+    const uint8_t* final = buffers[last_frame];
+    for (size_t i = 0; i < (size_t)WIDTH * HEIGHT; i++) {
+        if ((((const uint32_t*)screen)[i] ^ ((const uint32_t*)final)[i]) & 0x00FFFFFF)
+            wrong++;
+    }
+
+    // Click at (100, 200): press and release as two touch frames
+    uint8_t click[12] = { 5, 1, 0, 100, 0, 200, 5, 0, 0, 100, 0, 200 };
+    send(fd, click, sizeof(click), 0);
+    struct input_event ev[8];
+    size_t got = 0;
+    while (got < sizeof(ev)) {
+        ssize_t n = read(touch[0], (uint8_t*)ev + got, sizeof(ev) - got);
+        if (n <= 0)
+            break;
+        got += (size_t)n;
+    }
+    int touch_ok = got == sizeof(ev) && ev[0].code == ABS_X
+        && ev[0].value == 100 && ev[1].code == ABS_Y && ev[1].value == 200 && ev[2].code == BTN_TOUCH
+        && ev[2].value == 1 && ev[6].code == BTN_TOUCH && ev[6].value == 0;
+
+    fprintf(stdout, "updates,fps,bytes_per_update,kbit_s,tiles_per_update,flip_to_sent_p50_us,flip_to_sent_p99_us,"
+                    "cpu_pct,throttled,wrong_pixels,touch\n");
+    fprintf(stdout, "%llu,%.1f,%.0f,%.0f,%.1f,%.0f,%.0f,%.2f,%llu,%zu,%s\n", (unsigned long long)updates,
+            updates / wall_s, updates ? (double)bytes / updates : 0.0, bytes * 8 / wall_s / 1000.0,
+            updates ? (double)tiles / updates : 0.0, hist_pct(HIST_VNC_FLIP_TO_SENT, 50),
+            hist_pct(HIST_VNC_FLIP_TO_SENT, 99), 100.0 * cpu_ns / (wall_s * 1e9), (unsigned long long)throttled,
+            wrong, touch_ok ? "ok" : "FAIL");
+
+    close(fd);
+    vnc_stop();
+    return wrong || !touch_ok;
+}
@@ -0,0 +1,574 @@
+/**
+ * @file fake_drm.c
+ * Decription: In-memory stand-in for libdrm (see fake_drm.h).
+ *
+ */
+#define _GNU_SOURCE
+#include "fake_drm.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+struct bo {
+    int used;
+    uint64_t offset;                    // in the memfd
+    uint64_t size;
+    uint32_t pitch;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bpp;
+};
+
+struct fb {
+    uint32_t id;                        // 0 = free slot
+    uint32_t handle;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pitch;
+    uint32_t bpp;
+    uint32_t depth;
+};
+
+struct flip {
+    uint64_t seq;                       // vblank it completes at
+    uint32_t fb_id;
+    int event;                          // DRM_MODE_PAGE_FLIP_EVENT: drmHandleEvent reports it
+    int latched;                        // on screen, event not delivered yet
+    void* user_data;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int dev_fd = -1;
+static uint64_t epoch_ns;
+static uint64_t period_ns;
+static int ioctl_us;
+static uint64_t arena_next = 0;
+static struct bo bos[FAKE_DRM_MAX_BOS]; // handle = index + 1
+static struct fb fbs[FAKE_DRM_MAX_FBS];
+static uint32_t next_fb_id = 100;
+static uint32_t scanout_fb = 0;
+static struct flip flips[FAKE_DRM_MAX_FLIPS];
+static int num_flips = 0;
+static uint64_t move_ns = 0;            // newest cursor move, not latched yet
+static uint64_t move_seq = 0;
+static struct fake_drm_stats st;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t t)
+{
+    struct timespec ts = { (time_t)(t / 1000000000ull), (long)(t % 1000000000ull) };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+static uint64_t vblank_time(uint64_t seq)
+{
+    return epoch_ns + seq * period_ns;
+}
+
+// First vblank strictly after t
+static uint64_t next_vblank_seq(uint64_t t)
+{
+    return (t - epoch_ns) / period_ns + 1;
+}
+
+// The time a real ioctl would spend in the kernel, as CPU time
+static void ioctl_cost(void)
+{
+    __atomic_add_fetch(&st.ioctls, 1, __ATOMIC_RELAXED);
+    if (ioctl_us <= 0)
+        return;
+    uint64_t end = now_ns() + (uint64_t)ioctl_us * 1000ull;
+    while (now_ns() < end) {
+    }
+}
+
+static int fail(int err)
+{
+    errno = err;
+    return -1;
+}
+
+static int check_fd(int fd)
+{
+    return fd >= 0 && fd == dev_fd ? 0 : fail(EBADF);
+}
+
+// The cursor move waiting for its vblank is on screen once that passed
+static void latch_cursor(uint64_t now)
+{
+    if (move_ns && vblank_time(move_seq) <= now) {
+        uint64_t ns = vblank_time(move_seq) - move_ns;
+        st.move_to_latch.bucket[stats_hist_bucket(ns)]++;
+        st.move_to_latch.count++;
+        st.move_to_latch.sum_ns += ns;
+        if (ns > st.move_to_latch.max_ns)
+            st.move_to_latch.max_ns = ns;
+        move_ns = 0;
+    }
+}
+
+// Flips whose vblank passed are scanned out; those without an event go
+static void latch_flips(uint64_t now)
+{
+    int kept = 0;
+    for (int i = 0; i < num_flips; i++) {
+        if (!flips[i].latched && vblank_time(flips[i].seq) <= now) {
+            scanout_fb = flips[i].fb_id;
+            flips[i].latched = 1;
+        }
+        if (!flips[i].latched || flips[i].event)
+            flips[kept++] = flips[i];
+    }
+    num_flips = kept;
+}
+
+static struct bo* find_bo(uint32_t handle)
+{
+    if (handle == 0 || handle > FAKE_DRM_MAX_BOS || !bos[handle - 1].used)
+        return NULL;
+    return &bos[handle - 1];
+}
+
+static struct fb* find_fb(uint32_t id)
+{
+    for (int i = 0; i < FAKE_DRM_MAX_FBS; i++) {
+        if (id && fbs[i].id == id)
+            return &fbs[i];
+    }
+    return NULL;
+}
+
+static uint32_t new_bo(void)
+{
+    for (int i = 0; i < FAKE_DRM_MAX_BOS; i++) {
+        if (!bos[i].used) {
+            memset(&bos[i], 0, sizeof(bos[i]));
+            bos[i].used = 1;
+            return (uint32_t)i + 1;
+        }
+    }
+    return 0;
+}
+
+void fake_drm_get_stats(struct fake_drm_stats* out)
+{
+    pthread_mutex_lock(&lock);
+    if (dev_fd >= 0)
+        latch_cursor(now_ns());
+    *out = st;
+    out->ioctls = __atomic_load_n(&st.ioctls, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&lock);
+}
+
+int drmOpen(const char* name, const char* busid)
+{
+    (void)name;
+    (void)busid;
+    pthread_mutex_lock(&lock);
+    if (dev_fd < 0) {
+        const char* hz = getenv("FAKE_DRM_HZ");
+        const char* us = getenv("FAKE_DRM_IOCTL_US");
+        int rate = hz ? atoi(hz) : FAKE_DRM_DEFAULT_HZ;
+        if (rate < 1 || rate > 1000)
+            rate = FAKE_DRM_DEFAULT_HZ;
+        period_ns = 1000000000ull / (uint64_t)rate;
+        ioctl_us = us ? atoi(us) : 0;
+        epoch_ns = now_ns();
+        dev_fd = memfd_create("fake_drm", MFD_CLOEXEC);
+        if (dev_fd >= 0 && ftruncate(dev_fd, FAKE_DRM_ARENA) < 0) {
+            close(dev_fd);
+            dev_fd = -1;
+        }
+    }
+    int fd = dev_fd;
+    pthread_mutex_unlock(&lock);
+    return fd;
+}
+
+int drmClose(int fd)
+{
+    return check_fd(fd);
+}
+
+int drmIoctl(int fd, unsigned long request, void* arg)
+{
+    if (check_fd(fd) < 0)
+        return -1;
+    ioctl_cost();
+
+    int ret = 0;
+    pthread_mutex_lock(&lock);
+    if (request == DRM_IOCTL_MODE_CREATE_DUMB) {
+        struct drm_mode_create_dumb* req = arg;
+        uint32_t handle = new_bo();
+        uint64_t pitch = ((uint64_t)req->width * ((req->bpp + 7) / 8) + 63) & ~63ull;
+        uint64_t size = (pitch * req->height + 4095) & ~4095ull;
+        if (!handle || !size || arena_next + size > FAKE_DRM_ARENA) {
+            if (handle)
+                bos[handle - 1].used = 0;
+            ret = fail(handle ? ENOMEM : ENOSPC);
+        } else {
+            struct bo* b = &bos[handle - 1];
+            b->offset = arena_next;
+            b->size = size;
+            b->pitch = (uint32_t)pitch;
+            b->width = req->width;
+            b->height = req->height;
+            b->bpp = req->bpp;
+            arena_next += size;
+            req->handle = handle;
+            req->pitch = (uint32_t)pitch;
+            req->size = size;
+        }
+    } else if (request == DRM_IOCTL_MODE_MAP_DUMB) {
+        struct drm_mode_map_dumb* req = arg;
+        struct bo* b = find_bo(req->handle);
+        if (b)
+            req->offset = b->offset;
+        else
+            ret = fail(ENOENT);
+    } else if (request == DRM_IOCTL_MODE_DESTROY_DUMB || request == DRM_IOCTL_GEM_CLOSE) {
+        // Both take the handle first. The memory is not reused: the arena
+        // is large enough for a benchmark run.
+        struct bo* b = find_bo(*(uint32_t*)arg);
+        if (b)
+            b->used = 0;
+        else
+            ret = fail(ENOENT);
+    } else {
+        ret = fail(EINVAL);
+    }
+    pthread_mutex_unlock(&lock);
+    return ret;
+}
+
+int drmPrimeHandleToFD(int fd, uint32_t handle, uint32_t flags, int* prime_fd)
+{
+    (void)fd;
+    (void)handle;
+    (void)flags;
+    (void)prime_fd;
+    return fail(ENOSYS);
+}
+
+drmModeResPtr drmModeGetResources(int fd)
+{
+    if (check_fd(fd) < 0)
+        return NULL;
+    ioctl_cost();
+    // One block, so drmModeFreeResources is one free()
+    drmModeResPtr res = calloc(1, sizeof(*res) + sizeof(uint32_t));
+    if (!res)
+        return NULL;
+    res->crtcs = (uint32_t*)(res + 1);
+    res->crtcs[0] = FAKE_DRM_CRTC_ID;
+    res->count_crtcs = 1;
+    res->max_width = FAKE_DRM_WIDTH;
+    res->max_height = FAKE_DRM_HEIGHT;
+    return res;
+}
+
+void drmModeFreeResources(drmModeResPtr ptr)
+{
+    free(ptr);
+}
+
+drmModeCrtcPtr drmModeGetCrtc(int fd, uint32_t crtc_id)
+{
+    if (check_fd(fd) < 0)
+        return NULL;
+    if (crtc_id != FAKE_DRM_CRTC_ID) {
+        errno = ENOENT;
+        return NULL;
+    }
+    ioctl_cost();
+    drmModeCrtcPtr crtc = calloc(1, sizeof(*crtc));
+    if (!crtc)
+        return NULL;
+    pthread_mutex_lock(&lock);
+    latch_flips(now_ns());
+    crtc->buffer_id = scanout_fb;
+    pthread_mutex_unlock(&lock);
+    crtc->crtc_id = crtc_id;
+    crtc->width = FAKE_DRM_WIDTH;
+    crtc->height = FAKE_DRM_HEIGHT;
+    crtc->mode_valid = 1;
+    crtc->mode.hdisplay = FAKE_DRM_WIDTH;
+    crtc->mode.vdisplay = FAKE_DRM_HEIGHT;
+    crtc->mode.vrefresh = (uint32_t)(1000000000ull / period_ns);
+    return crtc;
+}
+
+void drmModeFreeCrtc(drmModeCrtcPtr ptr)
+{
+    free(ptr);
+}
+
+int drmModeSetCrtc(int fd, uint32_t crtc_id, uint32_t buffer_id, uint32_t x, uint32_t y, uint32_t* connectors,
+                   int count, drmModeModeInfoPtr mode)
+{
+    (void)x;
+    (void)y;
+    (void)connectors;
+    (void)count;
+    (void)mode;
+    if (check_fd(fd) < 0)
+        return -1;
+    if (crtc_id != FAKE_DRM_CRTC_ID)
+        return fail(ENOENT);
+    ioctl_cost();
+    pthread_mutex_lock(&lock);
+    int ret = buffer_id && !find_fb(buffer_id) ? fail(ENOENT) : 0;
+    if (ret == 0)
+        scanout_fb = buffer_id;
+    pthread_mutex_unlock(&lock);
+    return ret;
+}
+
+int drmModeAddFB(int fd, uint32_t width, uint32_t height, uint8_t depth, uint8_t bpp, uint32_t pitch,
+                 uint32_t bo_handle, uint32_t* buf_id)
+{
+    if (check_fd(fd) < 0)
+        return -1;
+    ioctl_cost();
+    int ret = fail(ENOSPC);
+    pthread_mutex_lock(&lock);
+    struct bo* b = find_bo(bo_handle);
+    if (!b || (uint64_t)pitch * height > b->size) {
+        ret = fail(EINVAL);
+    } else {
+        for (int i = 0; i < FAKE_DRM_MAX_FBS; i++) {
+            if (fbs[i].id)
+                continue;
+            fbs[i] = (struct fb){ next_fb_id++, bo_handle, width, height, pitch, bpp, depth };
+            *buf_id = fbs[i].id;
+            ret = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return ret;
+}
+
+int drmModeAddFB2(int fd, uint32_t width, uint32_t height, uint32_t pixel_format, const uint32_t bo_handles[4],
+                  const uint32_t pitches[4], const uint32_t offsets[4], uint32_t* buf_id, uint32_t flags)
+{
+    (void)pixel_format;
+    (void)offsets;
+    (void)flags;
+    // Single plane 32 bpp formats only (XRGB8888 and friends)
+    return drmModeAddFB(fd, width, height, 24, 32, pitches[0], bo_handles[0], buf_id);
+}
+
+int drmModeRmFB(int fd, uint32_t buffer_id)
+{
+    if (check_fd(fd) < 0)
+        return -1;
+    ioctl_cost();
+    pthread_mutex_lock(&lock);
+    struct fb* f = find_fb(buffer_id);
+    int ret = f ? 0 : fail(ENOENT);
+    if (f) {
+        f->id = 0;
+        if (scanout_fb == buffer_id)
+            scanout_fb = 0;  // the kernel turns the plane off
+    }
+    pthread_mutex_unlock(&lock);
+    return ret;
+}
+
+drmModeFBPtr drmModeGetFB(int fd, uint32_t buffer_id)
+{
+    if (check_fd(fd) < 0)
+        return NULL;
+    ioctl_cost();
+    drmModeFBPtr out = NULL;
+    pthread_mutex_lock(&lock);
+    struct fb* f = find_fb(buffer_id);
+    struct bo* b = f ? find_bo(f->handle) : NULL;
+    // Like the kernel: a new handle to the same memory, closed by the caller
+    uint32_t handle = b ? new_bo() : 0;
+    if (handle) {
+        bos[handle - 1] = *b;
+        out = calloc(1, sizeof(*out));
+    }
+    if (out) {
+        out->fb_id = f->id;
+        out->width = f->width;
+        out->height = f->height;
+        out->pitch = f->pitch;
+        out->bpp = f->bpp;
+        out->depth = f->depth;
+        out->handle = handle;
+    } else {
+        if (handle)
+            bos[handle - 1].used = 0;
+        errno = ENOENT;
+    }
+    pthread_mutex_unlock(&lock);
+    return out;
+}
+
+void drmModeFreeFB(drmModeFBPtr ptr)
+{
+    free(ptr);
+}
+
+int drmModeSetCursor2(int fd, uint32_t crtc_id, uint32_t bo_handle, uint32_t width, uint32_t height, int32_t hot_x,
+                      int32_t hot_y)
+{
+    (void)width;
+    (void)height;
+    (void)hot_x;
+    (void)hot_y;
+    if (check_fd(fd) < 0)
+        return -1;
+    if (crtc_id != FAKE_DRM_CRTC_ID)
+        return fail(ENOENT);
+    ioctl_cost();
+    pthread_mutex_lock(&lock);
+    int ret = bo_handle && !find_bo(bo_handle) ? fail(ENOENT) : 0;
+    if (ret == 0) {
+        if (bo_handle)
+            st.cursor_sets++;
+        else
+            st.cursor_hides++;
+    }
+    pthread_mutex_unlock(&lock);
+    return ret;
+}
+
+int drmModeSetCursor(int fd, uint32_t crtc_id, uint32_t bo_handle, uint32_t width, uint32_t height)
+{
+    return drmModeSetCursor2(fd, crtc_id, bo_handle, width, height, 0, 0);
+}
+
+int drmModeMoveCursor(int fd, uint32_t crtc_id, int x, int y)
+{
+    (void)x;
+    (void)y;
+    if (check_fd(fd) < 0)
+        return -1;
+    if (crtc_id != FAKE_DRM_CRTC_ID)
+        return fail(ENOENT);
+    ioctl_cost();
+    uint64_t now = now_ns();
+    pthread_mutex_lock(&lock);
+    latch_cursor(now);
+    // Only the last move before a vblank is ever on screen
+    if (move_ns)
+        st.moves_superseded++;
+    else
+        move_seq = next_vblank_seq(now);
+    move_ns = now;
+    st.cursor_moves++;
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+int drmModePageFlip(int fd, uint32_t crtc_id, uint32_t fb_id, uint32_t flags, void* user_data)
+{
+    if (check_fd(fd) < 0)
+        return -1;
+    if (crtc_id != FAKE_DRM_CRTC_ID)
+        return fail(ENOENT);
+    ioctl_cost();
+    uint64_t now = now_ns();
+    int ret = 0;
+    pthread_mutex_lock(&lock);
+    latch_flips(now);
+    int busy = 0;
+    for (int i = 0; i < num_flips; i++)
+        busy |= !flips[i].latched;
+    if (!find_fb(fb_id)) {
+        ret = fail(ENOENT);
+    } else if (busy || num_flips == FAKE_DRM_MAX_FLIPS) {
+        ret = fail(EBUSY);  // one flip in flight per CRTC
+    } else {
+        flips[num_flips++] = (struct flip){ next_vblank_seq(now), fb_id, (flags & DRM_MODE_PAGE_FLIP_EVENT) != 0, 0,
+                                            user_data };
+        st.flips++;
+    }
+    pthread_mutex_unlock(&lock);
+    return ret;
+}
+
+int drmWaitVBlank(int fd, drmVBlankPtr vbl)
+{
+    if (check_fd(fd) < 0)
+        return -1;
+    if (vbl->request.type & DRM_VBLANK_EVENT)
+        return fail(EINVAL);
+    ioctl_cost();
+    __atomic_add_fetch(&st.vblank_waits, 1, __ATOMIC_RELAXED);
+
+    uint64_t now = now_ns();
+    uint64_t current = (now - epoch_ns) / period_ns;
+    uint64_t target = vbl->request.sequence;
+    if (vbl->request.type & DRM_VBLANK_RELATIVE)
+        target += current;
+    if (target > current)
+        sleep_until(vblank_time(target));
+    else
+        target = current;
+
+    uint64_t t = vblank_time(target);
+    vbl->reply.sequence = (unsigned int)target;
+    vbl->reply.tval_sec = (long)(t / 1000000000ull);
+    vbl->reply.tval_usec = (long)(t % 1000000000ull / 1000ull);
+    return 0;
+}
+
+// Deliver the oldest flip event, waiting for its vblank: what a blocking
+// read of the DRM fd does. Returns at once when no flip asked for one.
+int drmHandleEvent(int fd, drmEventContextPtr evctx)
+{
+    if (check_fd(fd) < 0)
+        return -1;
+
+    pthread_mutex_lock(&lock);
+    int idx = -1;
+    for (int i = 0; i < num_flips && idx < 0; i++) {
+        if (flips[i].event)
+            idx = i;
+    }
+    if (idx < 0) {
+        pthread_mutex_unlock(&lock);
+        return 0;
+    }
+    uint64_t seq = flips[idx].seq;
+    pthread_mutex_unlock(&lock);
+
+    uint64_t t = vblank_time(seq);
+    sleep_until(t);
+
+    pthread_mutex_lock(&lock);
+    latch_flips(now_ns());
+    struct flip f = flips[0];
+    for (int i = 1; i < num_flips; i++)
+        flips[i - 1] = flips[i];
+    num_flips--;
+    pthread_mutex_unlock(&lock);
+
+    unsigned int sec = (unsigned int)(t / 1000000000ull);
+    unsigned int usec = (unsigned int)(t % 1000000000ull / 1000ull);
+    if (evctx->version >= 3 && evctx->page_flip_handler2)
+        evctx->page_flip_handler2(fd, (unsigned int)f.seq, sec, usec, FAKE_DRM_CRTC_ID, f.user_data);
+    else if (evctx->page_flip_handler)
+        evctx->page_flip_handler(fd, (unsigned int)f.seq, sec, usec, f.user_data);
+    return 0;
+}
@@ -0,0 +1,55 @@
+/**
+ * @file fake_drm.h
+ * Decription: In-memory stand-in for libdrm, to run the preload off-device.
+ *
+ * libfake_drm.so exports the libdrm calls MPC and the cursor library make,
+ * so libforce_cursor.so can be preloaded in front of it on any Linux box:
+ * its dlsym(RTLD_NEXT, ...) lookups land here instead of in a kernel
+ * driver. fake_mpc (fake_mpc.c) links against it and plays MPC.
+ *
+ * The "device" is one CRTC (FAKE_DRM_CRTC_ID) with a WIDTHxHEIGHT mode. Its
+ * fd (drmOpen) is a memfd: dumb buffers are ranges of it, so the usual
+ * CREATE_DUMB / MAP_DUMB / mmap(fd, offset) sequence works. Vblanks are
+ * simulated at FAKE_DRM_HZ from the first drmOpen; a page flip completes,
+ * and a cursor move is latched, at the first vblank after the call.
+ * drmHandleEvent blocks until the oldest pending flip completes, like a
+ * blocking read of a real DRM fd.
+ *
+ * Environment:
+ *   FAKE_DRM_HZ=60          refresh rate
+ *   FAKE_DRM_IOCTL_US=0     CPU time each ioctl-like call spins for
+ *
+ * Not implemented: atomic modesetting, planes, connectors, PRIME export.
+ *
+ */
+#ifndef FAKE_DRM_H
+#define FAKE_DRM_H
+
+#include <stdint.h>
+
+#include "stats.h"
+
+#define FAKE_DRM_CRTC_ID 41
+#define FAKE_DRM_WIDTH 800
+#define FAKE_DRM_HEIGHT 1280
+#define FAKE_DRM_DEFAULT_HZ 60
+#define FAKE_DRM_MAX_BOS 64
+#define FAKE_DRM_MAX_FBS 16
+#define FAKE_DRM_MAX_FLIPS 8           // pending page flips
+#define FAKE_DRM_ARENA (256u << 20)    // memfd size; sparse, only touched pages count
+
+struct fake_drm_stats {
+    uint64_t ioctls;                   // every call that would enter the kernel
+    uint64_t cursor_sets;              // drmModeSetCursor(2) with a buffer
+    uint64_t cursor_hides;             // ... with buffer 0
+    uint64_t cursor_moves;
+    uint64_t moves_superseded;         // replaced by a later move before their vblank
+    uint64_t flips;
+    uint64_t vblank_waits;
+    struct stats_hist move_to_latch;   // drmModeMoveCursor -> vblank that shows it
+};
+
+// Counters since drmOpen (fake_mpc's report)
+void fake_drm_get_stats(struct fake_drm_stats* out);
+
+#endif // FAKE_DRM_H
@@ -0,0 +1,300 @@
+/**
+ * @file fake_mpc.c
+ * Decription: Stand-in for MPC's display loop, on top of libfake_drm.so.
+ *
+ * Does what MPC does with the display: two 800x1280 dumb buffers, a
+ * drmModeSetCursor2(.., 0, ..) now and then (the call the cursor library
+ * answers by showing its cursor), and a render loop that draws into the
+ * back buffer, page flips with an event and blocks in drmHandleEvent. With
+ * -m it also plays a mouse: a thread writes circular REL motion to a FIFO
+ * at the given rate, which the cursor library reads as its mouse device.
+ *
+ * Preloading the cursor library in front of it measures the whole path off
+ * the device; running it twice, with and without LD_PRELOAD, gives the
+ * library's cost to MPC:
+ *
+ *   mkfifo /tmp/fake_mouse
+ *   printf '/tmp/fake_mouse\n1.0\nLATENCY_STATS=1\n' > /dev/shm/.mouseCursor
+ *   FORCE_CURSOR_PROCESS=fake_mpc FORCE_CURSOR_ENGINE=$PWD/../libforce_cursor_engine.so \
+ *       LD_PRELOAD=$PWD/../libforce_cursor.so ./fake_mpc -s 30 -m /tmp/fake_mouse
+ *   ../cursor_stats
+ *
+ * Prints frames, missed vblanks, CPU and the fake driver's counters: how
+ * many cursor moves reached it, how many were superseded before a vblank
+ * and the move -> on-screen latency.
+ *
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include "fake_drm.h"
+
+#define CURSOR_EVERY_S 5            // MPC re-asserts its (hidden) cursor
+#define BAND 48                     // height of the moving band
+
+struct buffer {
+    uint32_t handle;
+    uint32_t fb_id;
+    uint32_t pitch;
+    uint64_t size;
+    uint8_t* map;
+};
+
+static volatile sig_atomic_t running = 1;
+static const char* mouse_path = NULL;
+static int mouse_hz = 1000;
+static uint64_t mouse_events = 0;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    running = 0;
+}
+
+static int create_buffer(int fd, struct buffer* b)
+{
+    struct drm_mode_create_dumb create = { 0 };
+    create.width = FAKE_DRM_WIDTH;
+    create.height = FAKE_DRM_HEIGHT;
+    create.bpp = 32;
+    if (drmIoctl(fd, DRM_IOCTL_MODE_CREATE_DUMB, &create) < 0)
+        return -1;
+    struct drm_mode_map_dumb map = { 0 };
+    map.handle = create.handle;
+    if (drmIoctl(fd, DRM_IOCTL_MODE_MAP_DUMB, &map) < 0)
+        return -1;
+    b->map = mmap(NULL, create.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, map.offset);
+    if (b->map == MAP_FAILED)
+        return -1;
+    b->handle = create.handle;
+    b->pitch = create.pitch;
+    b->size = create.size;
+    return drmModeAddFB(fd, FAKE_DRM_WIDTH, FAKE_DRM_HEIGHT, 24, 32, b->pitch, b->handle, &b->fb_id);
+}
+
+// Background plus a band that moves down one row per frame: a few
+// hundred KB of stores per frame, like MPC's meters and waveforms
+static void draw(struct buffer* b, int frame)
+{
+    int top = frame % (FAKE_DRM_HEIGHT - BAND);
+    for (int y = 0; y < FAKE_DRM_HEIGHT; y++) {
+        uint32_t* row = (uint32_t*)(b->map + (size_t)y * b->pitch);
+        if (y >= top && y < top + BAND) {
+            for (int x = 0; x < FAKE_DRM_WIDTH; x++)
+                row[x] = 0xFF000000u | (uint32_t)(x + frame) * 0x010203u;
+        } else if (y == top - 1 || y == top + BAND) {
+            for (int x = 0; x < FAKE_DRM_WIDTH; x++)
+                row[x] = 0xFF202020;
+        }
+    }
+}
+
+static void on_flip(int fd, unsigned int seq, unsigned int sec, unsigned int usec, void* data)
+{
+    (void)fd;
+    (void)sec;
+    (void)usec;
+    *(unsigned int*)data = seq;
+}
+
+// A 1 kHz-ish mouse drawing circles: one REL_X/REL_Y/SYN frame per report
+static void* mouse_thread(void* arg)
+{
+    (void)arg;
+    // Until the cursor library opens the FIFO: a blocking open would hang
+    // the exit if it never does
+    int fd = -1;
+    while (running && (fd = open(mouse_path, O_WRONLY | O_NONBLOCK)) < 0 && errno == ENXIO)
+        usleep(10000);
+    if (fd < 0) {
+        if (running)
+            perror("fake_mpc: mouse");
+        return NULL;
+    }
+    fcntl(fd, F_SETFL, 0);
+    uint64_t period = 1000000000ull / (uint64_t)mouse_hz;
+    uint64_t next = now_ns();
+    for (uint64_t n = 0; running; n++) {
+        double a = n * 2.0 * M_PI / mouse_hz;  // one turn a second
+        struct input_event ev[3];
+        memset(ev, 0, sizeof(ev));
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        for (int i = 0; i < 3; i++)
+            ev[i].time = tv;
+        ev[0].type = EV_REL;
+        ev[0].code = REL_X;
+        ev[0].value = (int)lround(-8.0 * sin(a));
+        ev[1].type = EV_REL;
+        ev[1].code = REL_Y;
+        ev[1].value = (int)lround(8.0 * cos(a));
+        ev[2].type = EV_SYN;
+        ev[2].code = SYN_REPORT;
+        if (write(fd, ev, sizeof(ev)) != sizeof(ev))
+            break;
+        mouse_events++;
+        next += period;
+        struct timespec ts = { (time_t)(next / 1000000000ull), (long)(next % 1000000000ull) };
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    }
+    close(fd);
+    return NULL;
+}
+
+static double cpu_s(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+static double pct_us(const struct stats_hist* h, double pct)
+{
+    return stats_hist_percentile(h->bucket, h->count, h->max_ns, pct) / 1000.0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: fake_mpc [-s seconds] [-f fps] [-m mouse_fifo] [-r mouse_hz]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv)
+{
+    int seconds = 10, fps = 60, opt;
+    while ((opt = getopt(argc, argv, "s:f:m:r:")) != -1) {
+        switch (opt) {
+        case 's':
+            seconds = atoi(optarg);
+            break;
+        case 'f':
+            fps = atoi(optarg);
+            break;
+        case 'm':
+            mouse_path = optarg;
+            break;
+        case 'r':
+            mouse_hz = atoi(optarg);
+            break;
+        default:
+            usage();
+        }
+    }
+    if (seconds < 1 || fps < 1 || mouse_hz < 1 || mouse_hz > 20000)
+        usage();
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    int fd = drmOpen("fake", NULL);
+    drmModeResPtr res = fd >= 0 ? drmModeGetResources(fd) : NULL;
+    if (!res || res->count_crtcs < 1) {
+        fprintf(stderr, "fake_mpc: no DRM device\n");
+        return 1;
+    }
+    uint32_t crtc = res->crtcs[0];
+    drmModeFreeResources(res);
+
+    struct buffer bufs[2];
+    for (int i = 0; i < 2; i++) {
+        if (create_buffer(fd, &bufs[i]) < 0) {
+            perror("fake_mpc: buffer");
+            return 1;
+        }
+        draw(&bufs[i], 0);
+    }
+    drmModeModeInfo mode = { 0 };
+    mode.hdisplay = FAKE_DRM_WIDTH;
+    mode.vdisplay = FAKE_DRM_HEIGHT;
+    drmModeSetCrtc(fd, crtc, bufs[0].fb_id, 0, 0, NULL, 0, &mode);
+    drmModeCrtcPtr info = drmModeGetCrtc(fd, crtc);
+    unsigned int hz = info && info->mode.vrefresh ? info->mode.vrefresh : FAKE_DRM_DEFAULT_HZ;
+    drmModeFreeCrtc(info);
+
+    pthread_t mouse;
+    int have_mouse = mouse_path && pthread_create(&mouse, NULL, mouse_thread, NULL) == 0;
+
+    drmEventContext ev = { 0 };
+    ev.version = 2;
+    ev.page_flip_handler = on_flip;
+
+    // Flips pace the loop at the refresh rate; a lower -f skips vblanks
+    // between them, which are not counted as missed
+    unsigned int step = (unsigned int)fps < hz ? hz / (unsigned int)fps : 1;
+    uint64_t frame_ns = 1000000000ull / (uint64_t)fps;
+    uint64_t start = now_ns(), next_cursor = start, next_frame = start;
+    double cpu0 = cpu_s();
+    unsigned int last_seq = 0, seq = 0;
+    uint64_t frames = 0, missed = 0;
+    int back = 1;
+    while (running && now_ns() - start < (uint64_t)seconds * 1000000000ull) {
+        uint64_t now = now_ns();
+        if (now >= next_cursor) {
+            drmModeSetCursor2(fd, crtc, 0, 0, 0, 0, 0);
+            next_cursor = now + CURSOR_EVERY_S * 1000000000ull;
+        }
+        if (now < next_frame) {
+            struct timespec ts = { (time_t)(next_frame / 1000000000ull), (long)(next_frame % 1000000000ull) };
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        }
+        next_frame += frame_ns;
+
+        draw(&bufs[back], (int)frames);
+        if (drmModePageFlip(fd, crtc, bufs[back].fb_id, DRM_MODE_PAGE_FLIP_EVENT, &seq) < 0) {
+            perror("fake_mpc: page flip");
+            break;
+        }
+        drmHandleEvent(fd, &ev);
+        if (frames > 0 && seq > last_seq + step)
+            missed += seq - last_seq - step;
+        last_seq = seq;
+        back ^= 1;
+        frames++;
+    }
+    double wall = (now_ns() - start) / 1e9;
+    double cpu = cpu_s() - cpu0;
+    running = 0;
+    if (have_mouse)
+        pthread_join(mouse, NULL);
+
+    struct fake_drm_stats st;
+    fake_drm_get_stats(&st);
+    fprintf(stdout, "frames,fps,missed_vblanks,cpu_pct,mouse_events,ioctls,cursor_sets,cursor_moves,"
+                    "moves_superseded,move_to_latch_p50_us,move_to_latch_p99_us\n");
+    fprintf(stdout, "%llu,%.1f,%llu,%.2f,%llu,%llu,%llu,%llu,%llu,%.0f,%.0f\n", (unsigned long long)frames,
+            frames / wall, (unsigned long long)missed, 100.0 * cpu / wall, (unsigned long long)mouse_events,
+            (unsigned long long)st.ioctls, (unsigned long long)st.cursor_sets, (unsigned long long)st.cursor_moves,
+            (unsigned long long)st.moves_superseded, pct_us(&st.move_to_latch, 50), pct_us(&st.move_to_latch, 99));
+
+    for (int i = 0; i < 2; i++) {
+        drmModeRmFB(fd, bufs[i].fb_id);
+        munmap(bufs[i].map, bufs[i].size);
+        struct drm_mode_destroy_dumb destroy = { bufs[i].handle };
+        drmIoctl(fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy);
+    }
+    drmClose(fd);
+    return 0;
+}
@@ -0,0 +1,149 @@
+/**
+ * @file test_config.c
+ * Decription: Checks that bad button mappings never make it into a config.
+ *
+ * Builds force_cursor.c in, like bench_engine, and loads config files the
+ * way the engine does: a strict hot reload must reject a file with any
+ * invalid mapping and keep the table it had, and the first load must drop
+ * the bad line whole so the button keeps its default. Prints one line per
+ * check to stderr and exits 1 if any failed.
+ *
+ *   ./test_config
+ *
+ */
+#include "../force_cursor.c"
+
+static struct engine_persist test_persist;
+static struct engine_state test_state;
+static char config_path[] = "/tmp/test_config_XXXXXX";
+static int failures = 0;
+
+static void check(int ok, const char* what)
+{
+    fprintf(stderr, "%s %s\n", ok ? "ok  " : "FAIL", what);
+    failures += !ok;
+}
+
+static void write_config(const char* mappings)
+{
+    FILE* fp = fopen(config_path, "w");
+    if (!fp) {
+        perror("test_config");
+        exit(1);
+    }
+    fprintf(fp, "/dev/input/event1\n1.0\n%s", mappings);
+    fclose(fp);
+}
+
+// The one action bound to a button on layer 0 without modifiers
+static const struct action* bound(const struct config* c, int code)
+{
+    const struct dispatch_slot* s = &c->table.slot[0][0][code - DISPATCH_FIRST_CODE];
+    return s->count == 1 ? &c->table.actions[s->first] : NULL;
+}
+
+static int bound_to(const struct config* c, int code, int type, int value)
+{
+    const struct action* a = bound(c, code);
+    return a && a->type == type && a->value == value;
+}
+
+// A hot reload of each file must fail and leave BTN_SIDE=KEY_ESC in place
+static void check_strict_reload(void)
+{
+    static const struct {
+        const char* what;
+        const char* mappings;
+    } bad[] = {
+        { "unknown key", "BTN_SIDE=KEY_ENTER\nBTN_EXTRA=KEY_TYPO\n" },
+        { "CC out of range", "BTN_SIDE=KEY_ENTER\nBTN_EXTRA=MIDI_CC_300\n" },
+        { "one bad action of two", "BTN_SIDE=KEY_ENTER,KEY_TYPO\n" },
+        { "too many actions", "BTN_SIDE=KEY_F1,KEY_F2,KEY_F3,KEY_F4,KEY_F5,KEY_F6,KEY_F7,KEY_F8,KEY_F9\n" },
+    };
+
+    write_config("BTN_SIDE=KEY_ESC\n");
+    config = load_config(config_path, &device, 0);
+    if (!config) {
+        check(0, "initial config loads");
+        return;
+    }
+    macro_commit();
+    check(bound_to(config, BTN_SIDE, ACTION_KEY, KEY_ESC), "initial config binds BTN_SIDE");
+
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        const struct config* before = config;
+        char what[160];
+        write_config(bad[i].mappings);
+        int ret = reload_config(config_path);
+        snprintf(what, sizeof(what), "strict reload rejects a file with: %s", bad[i].what);
+        check(ret < 0 && config == before && !pending_config &&
+              bound_to(config, BTN_SIDE, ACTION_KEY, KEY_ESC), what);
+    }
+
+    write_config("BTN_SIDE=KEY_ENTER\n");
+    check(reload_config(config_path) == 0 && bound_to(config, BTN_SIDE, ACTION_KEY, KEY_ENTER),
+          "strict reload installs a good file");
+}
+
+// A first load (not strict) drops a bad line whole: BTN_LEFT keeps its
+// default touch, the other buttons stay unbound
+static void check_dropped_lines(void)
+{
+    static const struct {
+        const char* what;
+        const char* mappings;
+    } bad[] = {
+        { "unknown key", "BTN_LEFT=KEY_TYPO\n" },
+        { "good action, then a bad one", "BTN_LEFT=KEY_ESC,bogus\n" },
+        { "CC that is not a number", "BTN_LEFT=MIDI_CC_abc\n" },
+        { "CC with trailing junk", "BTN_LEFT=MIDI_CC_12x\n" },
+        { "NRPN out of range", "BTN_LEFT=ENCODER_NRPN_16384\n" },
+        { "hex key with junk", "BTN_LEFT=0x1cz\n" },
+    };
+
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        char what[160];
+        char* dev = NULL;
+        write_config(bad[i].mappings);
+        struct config* c = load_config(config_path, &dev, 0);
+        snprintf(what, sizeof(what), "BTN_LEFT keeps its touch after: %s", bad[i].what);
+        check(c && c->table.num_bindings == 0 && bound_to(c, BTN_LEFT, ACTION_TOUCH, 0), what);
+        free(dev);
+        free(c);
+    }
+
+    char* dev = NULL;
+    write_config("BTN_LEFT=MIDI_CC_127\nBTN_RIGHT=0x1c\n");
+    struct config* c = load_config(config_path, &dev, 0);
+    check(c && bound_to(c, BTN_LEFT, ACTION_MIDI_CC, 127) && bound_to(c, BTN_RIGHT, ACTION_KEY, KEY_ENTER),
+          "numbers at the edge of their range still parse");
+    free(dev);
+    free(c);
+}
+
+int main(void)
+{
+    int fd = mkstemp(config_path);
+    if (fd < 0) {
+        perror("test_config");
+        return 1;
+    }
+    close(fd);
+
+    // The engine's [CONFIG] chatter goes to stdout
+    if (!freopen("/dev/null", "w", stdout))
+        return 1;
+    test_persist.cursor_x = ENGINE_DEFAULT_X;
+    test_persist.cursor_y = ENGINE_DEFAULT_Y;
+    test_state.drm_fd = ENGINE_DRM_REMOTE;
+    test_state.persist = &test_persist;
+    test_state.keyboard_fd = -1;
+    shim = &test_state;
+
+    check_strict_reload();
+    check_dropped_lines();
+
+    unlink(config_path);
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "all passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,160 @@
+/**
+ * @file test_remote.c
+ * Decription: Checks that a remote client leaving mid-press releases what
+ * it held.
+ *
+ * Builds force_cursor.c in, like bench_engine, starts the remote server on
+ * the event loop with the engine's own handler, and plays cursor_remote:
+ * BTN_LEFT and KEY_ESC go down, then the connection drops. The touch and
+ * key devices are pipes, read back to see what MPC would have been sent.
+ * Prints one line per check to stderr and exits 1 if any failed.
+ *
+ *   ./test_remote
+ *
+ */
+#include "../force_cursor.c"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static struct engine_persist test_persist;
+static struct engine_state test_state;
+static char config_path[] = "/tmp/test_remote_XXXXXX";
+static int failures = 0;
+
+static void check(int ok, const char* what)
+{
+    fprintf(stderr, "%s %s\n", ok ? "ok  " : "FAIL", what);
+    failures += !ok;
+}
+
+static int connect_remote(void)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", REMOTE_SOCKET_PATH);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int send_events(int fd, const struct remote_event* evs, int count)
+{
+    unsigned char buf[sizeof(struct remote_header) + REMOTE_MAX_EVENTS * sizeof(struct remote_event)];
+    struct remote_header h;
+    memset(&h, 0, sizeof(h));
+    h.magic = REMOTE_MAGIC;
+    h.version = REMOTE_VERSION;
+    h.kind = REMOTE_EVENTS;
+    h.count = (uint16_t)count;
+    memcpy(buf, &h, sizeof(h));
+    memcpy(buf + sizeof(h), evs, count * sizeof(*evs));
+    size_t len = sizeof(h) + count * sizeof(*evs);
+    return write(fd, buf, len) == (ssize_t)len ? 0 : -1;
+}
+
+// Let the loop take everything that is waiting
+static void run_loop(void)
+{
+    for (int i = 0; i < 10; i++)
+        ev_loop_run_once(10);
+}
+
+// Last value written to a device pipe for type/code, -1 if none
+static int last_value(int fd, uint16_t type, uint16_t code)
+{
+    struct input_event ev;
+    int value = -1;
+    while (read(fd, &ev, sizeof(ev)) == sizeof(ev)) {
+        if (ev.type == type && ev.code == code)
+            value = ev.value;
+    }
+    return value;
+}
+
+int main(void)
+{
+    int fd = mkstemp(config_path);
+    if (fd < 0 || write(fd, "/dev/input/event1\n1.0\n", 22) != 22) {
+        perror("test_remote");
+        return 1;
+    }
+    close(fd);
+
+    // The engine's [CONFIG] chatter goes to stdout
+    if (!freopen("/dev/null", "w", stdout))
+        return 1;
+    test_persist.cursor_x = ENGINE_DEFAULT_X;
+    test_persist.cursor_y = ENGINE_DEFAULT_Y;
+    test_state.drm_fd = ENGINE_DRM_REMOTE;
+    test_state.persist = &test_persist;
+    shim = &test_state;
+    config = load_config(config_path, &device, 0);
+    unlink(config_path);
+    if (!config) {
+        fprintf(stderr, "test_remote: config did not load\n");
+        return 1;
+    }
+    macro_commit();
+    dispatch_state_reset(&button_state);
+    latency_enabled = 0;
+
+    int touch_pipe[2], key_pipe[2];
+    if (pipe2(touch_pipe, O_NONBLOCK) < 0 || pipe2(key_pipe, O_NONBLOCK) < 0) {
+        perror("test_remote: pipe");
+        return 1;
+    }
+    uinput_fd = touch_pipe[1];
+    keyboard_fd = key_pipe[1];
+
+    remote_config.enabled = 1;
+    remote_config.port = 0;
+    if (ev_loop_init() < 0 || remote_start(on_remote_events) < 0) {
+        fprintf(stderr, "test_remote: could not start the remote server\n");
+        return 1;
+    }
+
+    int client = connect_remote();
+    static const struct remote_event press[] = {
+        { EV_KEY, BTN_LEFT, 1 },
+        { EV_KEY, KEY_ESC, 1 },
+        { EV_SYN, SYN_REPORT, 0 },
+    };
+    if (client < 0 || send_events(client, press, 3) < 0) {
+        fprintf(stderr, "test_remote: could not talk to the server\n");
+        return 1;
+    }
+    run_loop();
+    check(cursor.touch_down && last_value(touch_pipe[0], EV_KEY, BTN_TOUCH) == 1, "BTN_LEFT touches down");
+    check(last_value(key_pipe[0], EV_KEY, KEY_ESC) == 1, "KEY_ESC goes down");
+
+    close(client);
+    run_loop();
+    check(!cursor.touch_down && last_value(touch_pipe[0], EV_KEY, BTN_TOUCH) == 0,
+          "dropped client: the touch is released");
+    check(last_value(key_pipe[0], EV_KEY, KEY_ESC) == 0, "dropped client: KEY_ESC is released");
+
+    // A client that let go itself gets nothing extra on the way out
+    static const struct remote_event click[] = {
+        { EV_KEY, BTN_LEFT, 1 },
+        { EV_SYN, SYN_REPORT, 0 },
+        { EV_KEY, BTN_LEFT, 0 },
+        { EV_SYN, SYN_REPORT, 0 },
+    };
+    client = connect_remote();
+    if (client < 0 || send_events(client, click, 4) < 0)
+        return 1;
+    run_loop();
+    last_value(touch_pipe[0], EV_KEY, BTN_TOUCH);
+    close(client);
+    run_loop();
+    check(last_value(touch_pipe[0], EV_KEY, BTN_TOUCH) == -1, "released buttons are not released again");
+
+    remote_stop();
+    fprintf(stderr, "%s\n", failures ? "FAILED" : "all passed");
+    return failures ? 1 : 0;
+}
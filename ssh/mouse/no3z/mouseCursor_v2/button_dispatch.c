@@ -0,0 +1,465 @@
+/**
+ * @file button_dispatch.c
+ * Decription: Config parsing and compilation of button mappings into the
+ * direct-indexed dispatch table (see button_dispatch.h).
+ *
+ * Mapping line format (after the device and speed lines):
+ *
+ *   [layer N]                          following lines go to layer N (0-3)
+ *   TRIGGER=ACTION[,ACTION...]
+ *   MOD+TRIGGER=ACTION[,ACTION...]     chord, up to 4 distinct modifier buttons
+ *
+ * A button used as a chord modifier fires its own binding as a tap when it is
+ * released without a chord, so LAYER_n and ENCODER_* (which last while the
+ * button is held) cannot be bound to it; such lines are skipped.
+ *
+ * A line with any action that does not parse (unknown name, number with junk
+ * or out of range) is dropped whole, so the button keeps its default.
+ *
+ * TRIGGER is a button (BTN_xxx, hex or decimal code) or WHEEL_UP / WHEEL_DOWN.
+ * ACTION is KEY_xxx, MIDI_CC_n, LAYER_n, LAYER_TOGGLE_n, ENCODER_CC_n,
+ * ENCODER_NRPN_n, TOUCH, PINCH_IN, PINCH_OUT or NONE.
+ *
+ */
+#include "button_dispatch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// Button name to code mapping
+struct name_code_pair {
+    const char* name;
+    int code;
+};
+
+static const struct name_code_pair button_names[] = {
+    {"BTN_LEFT", BTN_LEFT},
+    {"BTN_RIGHT", BTN_RIGHT},
+    {"BTN_MIDDLE", BTN_MIDDLE},
+    {"BTN_SIDE", BTN_SIDE},
+    {"BTN_EXTRA", BTN_EXTRA},
+    {"BTN_FORWARD", BTN_FORWARD},
+    {"BTN_BACK", BTN_BACK},
+    {"BTN_TASK", BTN_TASK},
+    {NULL, 0}
+};
+
+static const struct name_code_pair key_names[] = {
+    {"KEY_ESC", KEY_ESC},
+    {"KEY_SPACE", KEY_SPACE},
+    {"KEY_ENTER", KEY_ENTER},
+    {"KEY_TAB", KEY_TAB},
+    {"KEY_BACKSPACE", KEY_BACKSPACE},
+    {"KEY_LEFTSHIFT", KEY_LEFTSHIFT},
+    {"KEY_RIGHTSHIFT", KEY_RIGHTSHIFT},
+    {"KEY_LEFTCTRL", KEY_LEFTCTRL},
+    {"KEY_RIGHTCTRL", KEY_RIGHTCTRL},
+    {"KEY_LEFTALT", KEY_LEFTALT},
+    {"KEY_RIGHTALT", KEY_RIGHTALT},
+    {"KEY_UP", KEY_UP},
+    {"KEY_DOWN", KEY_DOWN},
+    {"KEY_LEFT", KEY_LEFT},
+    {"KEY_RIGHT", KEY_RIGHT},
+    {"KEY_PAGEUP", KEY_PAGEUP},
+    {"KEY_PAGEDOWN", KEY_PAGEDOWN},
+    {"KEY_HOME", KEY_HOME},
+    {"KEY_END", KEY_END},
+    {"KEY_DELETE", KEY_DELETE},
+    {"KEY_INSERT", KEY_INSERT},
+    {"KEY_F1", KEY_F1},
+    {"KEY_F2", KEY_F2},
+    {"KEY_F3", KEY_F3},
+    {"KEY_F4", KEY_F4},
+    {"KEY_F5", KEY_F5},
+    {"KEY_F6", KEY_F6},
+    {"KEY_F7", KEY_F7},
+    {"KEY_F8", KEY_F8},
+    {"KEY_F9", KEY_F9},
+    {"KEY_F10", KEY_F10},
+    {"KEY_F11", KEY_F11},
+    {"KEY_F12", KEY_F12},
+    {"KEY_MENU", KEY_MENU},
+    {NULL, 0}
+};
+
+// Parse code from string (name, hex, or decimal)
+static int parse_code(const char* str, const struct name_code_pair* table)
+{
+    char* endptr;
+    long val;
+
+    // Try hex format (0xNNNN)
+    if (str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+        val = strtol(str, &endptr, 16);
+        return endptr != str + 2 && *endptr == '\0' && val >= 0 && val <= 0xFFFF ? (int)val : -1;
+    }
+
+    // Try plain decimal number
+    val = strtol(str, &endptr, 10);
+    if (endptr != str && *endptr == '\0' && val >= 0 && val <= 0xFFFF) {
+        return (int)val;
+    }
+
+    // Try name lookup
+    for (int i = 0; table[i].name != NULL; i++) {
+        if (strcasecmp(str, table[i].name) == 0) {
+            return table[i].code;
+        }
+    }
+
+    return -1;  // Not found
+}
+
+// Strip leading/trailing blanks in place
+static char* trim(char* s)
+{
+    while (*s == ' ' || *s == '\t')
+        s++;
+    size_t len = strlen(s);
+    while (len > 0 && (s[len - 1] == ' ' || s[len - 1] == '\t'))
+        s[--len] = '\0';
+    return s;
+}
+
+// Button code -> table index, or -1 when outside BTN_MISC..BTN_TASK
+static int button_index(const char* str)
+{
+    int code = parse_code(str, button_names);
+    if (code < DISPATCH_FIRST_CODE || code > DISPATCH_LAST_CODE)
+        return -1;
+    return code - DISPATCH_FIRST_CODE;
+}
+
+static int parse_trigger(const char* str)
+{
+    if (strcasecmp(str, "WHEEL_UP") == 0)
+        return TRIGGER_WHEEL_UP;
+    if (strcasecmp(str, "WHEEL_DOWN") == 0)
+        return TRIGGER_WHEEL_DOWN;
+    return button_index(str);
+}
+
+// A whole decimal number in 0..max, or -1 (MIDI_CC_abc, MIDI_CC_12x)
+static int parse_number(const char* str, long max)
+{
+    char* endptr;
+    long n = strtol(str, &endptr, 10);
+    if (endptr == str || *endptr != '\0' || n < 0 || n > max)
+        return -1;
+    return (int)n;
+}
+
+static int parse_layer_number(const char* str)
+{
+    return parse_number(str, DISPATCH_NUM_LAYERS - 1);
+}
+
+static int parse_action(const struct dispatch_builder* b, const char* str, struct action* a)
+{
+    int n;
+
+    if (strncasecmp(str, "MACRO_", 6) == 0) {
+        // Macros are defined before the bindings that use them
+        if (!b->macro_lookup || (n = b->macro_lookup(str + 6)) < 0)
+            return -1;
+        a->type = ACTION_MACRO;
+        a->value = (uint16_t)n;
+    } else if (strncasecmp(str, "MIDI_CC_", 8) == 0) {
+        if ((n = parse_number(str + 8, 127)) < 0)
+            return -1;
+        a->type = ACTION_MIDI_CC;
+        a->value = (uint16_t)n;
+    } else if (strncasecmp(str, "ENCODER_CC_", 11) == 0) {
+        if ((n = parse_number(str + 11, 127)) < 0)
+            return -1;
+        a->type = ACTION_ENCODER_CC;
+        a->value = (uint16_t)n;
+    } else if (strncasecmp(str, "ENCODER_NRPN_", 13) == 0) {
+        if ((n = parse_number(str + 13, 16383)) < 0)
+            return -1;
+        a->type = ACTION_ENCODER_NRPN;
+        a->value = (uint16_t)n;
+    } else if (strncasecmp(str, "LAYER_TOGGLE_", 13) == 0) {
+        if ((n = parse_layer_number(str + 13)) < 0)
+            return -1;
+        a->type = ACTION_LAYER_TOGGLE;
+        a->value = (uint16_t)n;
+    } else if (strncasecmp(str, "LAYER_", 6) == 0) {
+        if ((n = parse_layer_number(str + 6)) < 0)
+            return -1;
+        a->type = ACTION_LAYER_HOLD;
+        a->value = (uint16_t)n;
+    } else if (strcasecmp(str, "TOUCH") == 0) {
+        a->type = ACTION_TOUCH;
+        a->value = 0;
+    } else if (strcasecmp(str, "PINCH_IN") == 0) {
+        a->type = ACTION_PINCH;
+        a->value = 1;
+    } else if (strcasecmp(str, "PINCH_OUT") == 0) {
+        a->type = ACTION_PINCH;
+        a->value = 0;
+    } else if (strcasecmp(str, "NONE") == 0) {
+        a->type = ACTION_NONE;
+        a->value = 0;
+    } else {
+        if ((n = parse_code(str, key_names)) < 0)
+            return -1;
+        a->type = ACTION_KEY;
+        a->value = (uint16_t)n;
+    }
+    return 0;
+}
+
+void dispatch_builder_init(struct dispatch_builder* b)
+{
+    b->cur_layer = 0;
+    b->num_bindings = 0;
+    b->macro_lookup = NULL;
+}
+
+int dispatch_key_code(const char* name)
+{
+    return parse_code(name, key_names);
+}
+
+// Parse one mapping line (already stripped of its newline).
+// Returns 0 when the line was used or ignored, -1 on a syntax error (the
+// line adds no binding then, not even with the actions that did parse).
+int dispatch_parse_line(struct dispatch_builder* b, char* line)
+{
+    line = trim(line);
+
+    // Skip empty lines and comments
+    if (line[0] == '\0' || line[0] == '#')
+        return 0;
+
+    // Layer section header: [layer N]
+    if (line[0] == '[') {
+        char* end = strchr(line, ']');
+        if (!end || strncasecmp(line + 1, "layer", 5) != 0)
+            return -1;
+        *end = '\0';
+        int layer = parse_layer_number(trim(line + 6));
+        if (layer < 0) {
+            fprintf(stdout, "[CONFIG] Warning: Invalid layer '%s' (must be 0-%d)\n",
+                    line + 6, DISPATCH_NUM_LAYERS - 1);
+            fflush(stdout);
+            return -1;
+        }
+        b->cur_layer = layer;
+        return 0;
+    }
+
+    char* eq = strchr(line, '=');
+    if (!eq)
+        return -1;  // Invalid format
+    *eq = '\0';
+
+    if (b->num_bindings >= DISPATCH_MAX_BINDINGS) {
+        fprintf(stdout, "[CONFIG] Warning: Too many mappings (max %d), '%s' skipped\n",
+                DISPATCH_MAX_BINDINGS, line);
+        fflush(stdout);
+        return -1;
+    }
+
+    struct binding* bd = &b->bindings[b->num_bindings];
+    memset(bd, 0, sizeof(*bd));
+    bd->layer = (uint8_t)b->cur_layer;
+
+    // Left side: MOD+MOD+TRIGGER
+    char* save = NULL;
+    char* parts[DISPATCH_MAX_MODIFIERS + 1];
+    int num_parts = 0;
+    for (char* tok = strtok_r(line, "+", &save); tok; tok = strtok_r(NULL, "+", &save)) {
+        if (num_parts == DISPATCH_MAX_MODIFIERS + 1) {
+            fprintf(stdout, "[CONFIG] Warning: Chord has more than %d modifiers (skipped)\n",
+                    DISPATCH_MAX_MODIFIERS);
+            fflush(stdout);
+            return -1;
+        }
+        parts[num_parts++] = trim(tok);
+    }
+    if (num_parts == 0)
+        return -1;
+
+    int trigger = parse_trigger(parts[num_parts - 1]);
+    if (trigger < 0) {
+        fprintf(stdout, "[CONFIG] Warning: Invalid button '%s' (skipped)\n", parts[num_parts - 1]);
+        fflush(stdout);
+        return -1;
+    }
+    bd->trigger = (uint8_t)trigger;
+
+    for (int i = 0; i < num_parts - 1; i++) {
+        int idx = button_index(parts[i]);
+        if (idx < 0 || idx == trigger) {
+            fprintf(stdout, "[CONFIG] Warning: Invalid modifier '%s' (skipped)\n", parts[i]);
+            fflush(stdout);
+            return -1;
+        }
+        bd->mods[bd->num_mods++] = (uint16_t)(idx + DISPATCH_FIRST_CODE);
+    }
+
+    // Right side: ACTION,ACTION,...
+    for (char* tok = strtok_r(eq + 1, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char* name = trim(tok);
+        if (bd->num_actions == BINDING_MAX_ACTIONS) {
+            fprintf(stdout, "[CONFIG] Warning: More than %d actions at '%s'\n",
+                    BINDING_MAX_ACTIONS, name);
+            fflush(stdout);
+            return -1;
+        }
+        if (parse_action(b, name, &bd->actions[bd->num_actions]) < 0) {
+            fprintf(stdout, "[CONFIG] Warning: Invalid action '%s'\n", name);
+            fflush(stdout);
+            return -1;
+        }
+        if (bd->actions[bd->num_actions].type != ACTION_NONE)
+            bd->num_actions++;
+    }
+
+    fprintf(stdout, "[CONFIG] Button mapping: layer %d, %d modifier(s), trigger %d -> %d action(s)\n",
+            bd->layer, bd->num_mods, bd->trigger, bd->num_actions);
+    fflush(stdout);
+    b->num_bindings++;
+    return 0;
+}
+
+static int add_actions(struct dispatch_table* t, const struct action* actions, int count,
+    struct dispatch_slot* slot)
+{
+    if (t->num_actions + count > DISPATCH_MAX_ACTIONS)
+        return -1;
+    slot->first = t->num_actions;
+    slot->count = (uint16_t)count;
+    for (int i = 0; i < count; i++) {
+        t->actions[t->num_actions++] = actions[i];
+        if (actions[i].type == ACTION_KEY)
+            t->has_key_actions = 1;
+        else if (actions[i].type == ACTION_MIDI_CC || actions[i].type == ACTION_ENCODER_CC ||
+                 actions[i].type == ACTION_ENCODER_NRPN)
+            t->has_midi_actions = 1;
+        else if (actions[i].type == ACTION_MACRO)
+            t->has_macro_actions = 1;
+    }
+    return 0;
+}
+
+static int has_hold_action(const struct binding* bd)
+{
+    for (int i = 0; i < bd->num_actions; i++) {
+        int type = bd->actions[i].type;
+        if (type == ACTION_LAYER_HOLD || type == ACTION_ENCODER_CC || type == ACTION_ENCODER_NRPN)
+            return 1;
+    }
+    return 0;
+}
+
+// Compile parsed bindings into the dispatch table.
+//
+// Empty entries are resolved at compile time so the input thread never has to
+// fall back at run time: a chord missing from a layer uses the base layer
+// chord, then the layer's plain binding, then the base layer's plain binding.
+int dispatch_compile(const struct dispatch_builder* b, struct dispatch_table* t)
+{
+    static const struct action default_touch = { ACTION_TOUCH, 0 };
+    static const struct action default_zoom_in = { ACTION_PINCH, 1 };
+    static const struct action default_zoom_out = { ACTION_PINCH, 0 };
+    uint8_t bound[DISPATCH_NUM_LAYERS][DISPATCH_NUM_MODSETS][DISPATCH_NUM_TRIGGERS];
+    int num_mods = 0;
+    int skipped = 0;
+
+    memset(t, 0, sizeof(*t));
+    memset(bound, 0, sizeof(bound));
+    memset(t->mod_bit, -1, sizeof(t->mod_bit));
+
+    // Modifier bits first: whether a trigger is a modifier decides below
+    // what may be bound to it
+    unsigned int masks[DISPATCH_MAX_BINDINGS];
+    for (int i = 0; i < b->num_bindings; i++) {
+        const struct binding* bd = &b->bindings[i];
+        unsigned int mask = 0;
+
+        for (int m = 0; m < bd->num_mods; m++) {
+            int idx = bd->mods[m] - DISPATCH_FIRST_CODE;
+            if (t->mod_bit[idx] < 0) {
+                if (num_mods == DISPATCH_MAX_MODIFIERS) {
+                    fprintf(stdout, "[CONFIG] Warning: More than %d modifier buttons, chord skipped\n",
+                            DISPATCH_MAX_MODIFIERS);
+                    fflush(stdout);
+                    mask = ~0u;
+                    skipped = 1;
+                    break;
+                }
+                t->mod_bit[idx] = (int8_t)num_mods++;
+            }
+            mask |= 1u << t->mod_bit[idx];
+        }
+        masks[i] = mask;
+    }
+
+    for (int i = 0; i < b->num_bindings; i++) {
+        const struct binding* bd = &b->bindings[i];
+        unsigned int mask = masks[i];
+        if (mask == ~0u)
+            continue;
+
+        // A modifier's own binding only fires as a tap on release (see
+        // dispatch_button()), so actions that last while it is held cannot work
+        if (bd->trigger < DISPATCH_NUM_BUTTONS && t->mod_bit[bd->trigger] >= 0 && has_hold_action(bd)) {
+            fprintf(stdout, "[CONFIG] Warning: Button %d is a chord modifier, LAYER_n/ENCODER_* "
+                            "cannot be bound to it (skipped)\n", bd->trigger + DISPATCH_FIRST_CODE);
+            fflush(stdout);
+            skipped = 1;
+            continue;
+        }
+
+        // Later lines override earlier ones
+        struct dispatch_slot* slot = &t->slot[bd->layer][mask][bd->trigger];
+        if (add_actions(t, bd->actions, bd->num_actions, slot) < 0) {
+            fprintf(stdout, "[CONFIG] Warning: Action pool full (max %d)\n", DISPATCH_MAX_ACTIONS);
+            fflush(stdout);
+            skipped = 1;
+            break;
+        }
+        bound[bd->layer][mask][bd->trigger] = 1;
+        t->num_bindings++;
+    }
+
+    // Built-in behaviour for anything left unbound on the base layer
+    const int touch_buttons[] = { BTN_LEFT, BTN_RIGHT, BTN_MIDDLE };
+    for (int i = 0; i < 3; i++) {
+        int idx = touch_buttons[i] - DISPATCH_FIRST_CODE;
+        if (!bound[0][0][idx])
+            add_actions(t, &default_touch, 1, &t->slot[0][0][idx]);
+    }
+    if (!bound[0][0][TRIGGER_WHEEL_UP])
+        add_actions(t, &default_zoom_in, 1, &t->slot[0][0][TRIGGER_WHEEL_UP]);
+    if (!bound[0][0][TRIGGER_WHEEL_DOWN])
+        add_actions(t, &default_zoom_out, 1, &t->slot[0][0][TRIGGER_WHEEL_DOWN]);
+
+    // Resolve fallbacks (base layer first, so higher layers see resolved entries)
+    for (int layer = 0; layer < DISPATCH_NUM_LAYERS; layer++) {
+        for (int mask = 0; mask < DISPATCH_NUM_MODSETS; mask++) {
+            for (int trig = 0; trig < DISPATCH_NUM_TRIGGERS; trig++) {
+                if (bound[layer][mask][trig] || (layer == 0 && mask == 0))
+                    continue;
+                if (layer > 0 && mask > 0 && bound[0][mask][trig])
+                    t->slot[layer][mask][trig] = t->slot[0][mask][trig];
+                else if (mask > 0)
+                    t->slot[layer][mask][trig] = t->slot[layer][0][trig];
+                else
+                    t->slot[layer][0][trig] = t->slot[0][0][trig];
+            }
+        }
+    }
+
+    return skipped ? -1 : 0;
+}
+
+void dispatch_state_reset(struct dispatch_state* s)
+{
+    memset(s, 0, sizeof(*s));
+}
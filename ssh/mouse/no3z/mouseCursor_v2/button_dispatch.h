@@ -0,0 +1,194 @@
+/**
+ * @file button_dispatch.h
+ * Decription: Compiled mouse button -> action dispatch for the Force cursor.
+ *
+ * Button mappings from the config file are compiled once at load time into a
+ * table indexed directly by [layer][modifier set][trigger], where a trigger is
+ * a button code in the BTN_MISC..BTN_TASK range or a wheel direction. The
+ * input thread only does array indexing: no string compares, no scans.
+ *
+ */
+#ifndef BUTTON_DISPATCH_H
+#define BUTTON_DISPATCH_H
+
+#include <linux/input.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Button code range covered by the table (mouse + misc buttons)
+#define DISPATCH_FIRST_CODE BTN_MISC
+#define DISPATCH_LAST_CODE BTN_TASK
+#define DISPATCH_NUM_BUTTONS (DISPATCH_LAST_CODE - DISPATCH_FIRST_CODE + 1)
+
+// Wheel triggers follow the button triggers
+#define TRIGGER_WHEEL_UP DISPATCH_NUM_BUTTONS
+#define TRIGGER_WHEEL_DOWN (DISPATCH_NUM_BUTTONS + 1)
+#define DISPATCH_NUM_TRIGGERS (DISPATCH_NUM_BUTTONS + 2)
+
+#define DISPATCH_MAX_MODIFIERS 4   // distinct buttons usable as chord modifiers
+#define DISPATCH_NUM_MODSETS (1 << DISPATCH_MAX_MODIFIERS)
+#define DISPATCH_NUM_LAYERS 4
+#define DISPATCH_MAX_BINDINGS 128
+#define DISPATCH_MAX_ACTIONS 512    // shared action pool for all bindings
+#define BINDING_MAX_ACTIONS 8      // actions per binding (comma separated)
+
+enum action_type {
+    ACTION_NONE = 0,
+    ACTION_TOUCH,        // single touch at the cursor (default for L/R/M buttons)
+    ACTION_PINCH,        // value: 1 = zoom in, 0 = zoom out (default for the wheel)
+    ACTION_KEY,          // value: key code, follows button press/release
+    ACTION_MIDI_CC,      // value: CC number, sent with 127 on press
+    ACTION_LAYER_HOLD,   // value: layer, active while the button is held
+    ACTION_LAYER_TOGGLE, // value: layer, toggled on press
+    ACTION_ENCODER_CC,   // value: CC number, relative encoder while held
+    ACTION_ENCODER_NRPN, // value: NRPN number, 14-bit encoder while held
+    ACTION_MACRO,        // value: macro index, started on press
+};
+
+struct action {
+    uint16_t type;
+    uint16_t value;
+};
+
+// A binding is a run of actions in the pool (count == 0: unbound)
+struct dispatch_slot {
+    uint16_t first;
+    uint16_t count;
+};
+
+struct dispatch_table {
+    int8_t mod_bit[DISPATCH_NUM_BUTTONS];   // modifier bit for a button, or -1
+    uint8_t has_key_actions;
+    uint8_t has_midi_actions;
+    uint8_t has_macro_actions;
+    uint16_t num_bindings;                  // user bindings (not counting defaults)
+    uint16_t num_actions;
+    struct dispatch_slot slot[DISPATCH_NUM_LAYERS][DISPATCH_NUM_MODSETS][DISPATCH_NUM_TRIGGERS];
+    struct action actions[DISPATCH_MAX_ACTIONS];
+};
+
+// Parsed (not yet compiled) bindings
+struct binding {
+    uint8_t layer;
+    uint8_t num_mods;
+    uint8_t num_actions;
+    uint8_t trigger;
+    uint16_t mods[DISPATCH_MAX_MODIFIERS];  // modifier button codes
+    struct action actions[BINDING_MAX_ACTIONS];
+};
+
+struct dispatch_builder {
+    int cur_layer;                          // set by "[layer N]" lines
+    int (*macro_lookup)(const char* name);  // resolves MACRO_<name>, optional
+    int num_bindings;
+    struct binding bindings[DISPATCH_MAX_BINDINGS];
+};
+
+// Per input thread state
+struct dispatch_state {
+    uint8_t modmask;                        // modifiers currently held
+    uint8_t chord_used;                     // modifiers that took part in a chord
+    uint8_t base_layer;                     // latched by LAYER_TOGGLE
+    uint8_t hold_layer;                     // set while a LAYER_HOLD button is down
+    uint8_t layer;                          // active layer
+    const struct dispatch_slot* held[DISPATCH_NUM_BUTTONS]; // binding captured at press
+};
+
+// How the actions of a hit should be applied
+enum dispatch_edge {
+    DISPATCH_PRESS = 0,
+    DISPATCH_RELEASE,
+    DISPATCH_TAP,        // press immediately followed by release (wheel, modifier taps)
+};
+
+struct dispatch_hit {
+    const struct action* actions;
+    uint16_t count;
+    uint8_t edge;
+    uint8_t trigger;     // button index (code - DISPATCH_FIRST_CODE) or TRIGGER_WHEEL_*
+};
+
+// Config side (load time only)
+void dispatch_builder_init(struct dispatch_builder* b);
+int dispatch_parse_line(struct dispatch_builder* b, char* line);
+int dispatch_compile(const struct dispatch_builder* b, struct dispatch_table* t);  // -1: bindings skipped
+void dispatch_state_reset(struct dispatch_state* s);
+int dispatch_key_code(const char* name);    // KEY_* name, hex or decimal, -1 if unknown
+
+// Apply a LAYER_* action to the state
+static inline void dispatch_layer_action(struct dispatch_state* s, const struct action* a, int edge)
+{
+    if (a->type == ACTION_LAYER_HOLD) {
+        if (edge == DISPATCH_PRESS)
+            s->hold_layer = (uint8_t)a->value;
+        else if (s->hold_layer == a->value)
+            s->hold_layer = 0;
+    } else if (a->type == ACTION_LAYER_TOGGLE && edge != DISPATCH_RELEASE) {
+        s->base_layer = (s->base_layer == a->value) ? 0 : (uint8_t)a->value;
+    }
+    s->layer = s->hold_layer ? s->hold_layer : s->base_layer;
+}
+
+static inline int dispatch_fill_hit(const struct dispatch_table* t, const struct dispatch_slot* slot,
+    int edge, int trigger, struct dispatch_hit* hit)
+{
+    if (!slot || !slot->count)
+        return 0;
+    hit->actions = &t->actions[slot->first];
+    hit->count = slot->count;
+    hit->edge = (uint8_t)edge;
+    hit->trigger = (uint8_t)trigger;
+    return 1;
+}
+
+// Button edge (value 1 = press, 0 = release, 2 = autorepeat is ignored).
+// Returns 1 and fills hit when there are actions to run.
+//
+// Buttons used as chord modifiers fire their own binding as a tap on release,
+// and only if no chord was used while they were held. They never see a press,
+// so dispatch_compile() drops hold actions (LAYER_n, ENCODER_*) bound to them.
+static inline int dispatch_button(const struct dispatch_table* t, struct dispatch_state* s,
+    unsigned int code, int value, struct dispatch_hit* hit)
+{
+    unsigned int idx = code - DISPATCH_FIRST_CODE;
+    if (idx >= DISPATCH_NUM_BUTTONS || (unsigned int)value > 1)
+        return 0;
+
+    int bit = t->mod_bit[idx];
+    const struct dispatch_slot* slot;
+
+    if (value) {
+        slot = &t->slot[s->layer][s->modmask][idx];
+        s->chord_used |= s->modmask;
+        s->held[idx] = slot;
+        if (bit >= 0) {
+            s->modmask |= (uint8_t)(1u << bit);
+            s->chord_used &= (uint8_t)~(1u << bit);
+            return 0;
+        }
+        return dispatch_fill_hit(t, slot, DISPATCH_PRESS, (int)idx, hit);
+    }
+
+    slot = s->held[idx];
+    s->held[idx] = NULL;
+    if (bit >= 0) {
+        s->modmask &= (uint8_t)~(1u << bit);
+        if (s->chord_used & (1u << bit))
+            return 0;
+        return dispatch_fill_hit(t, slot, DISPATCH_TAP, (int)idx, hit);
+    }
+    return dispatch_fill_hit(t, slot, DISPATCH_RELEASE, (int)idx, hit);
+}
+
+// Wheel notch (REL_WHEEL value), always a tap
+static inline int dispatch_wheel(const struct dispatch_table* t, struct dispatch_state* s,
+    int value, struct dispatch_hit* hit)
+{
+    if (value == 0)
+        return 0;
+    int trigger = value > 0 ? TRIGGER_WHEEL_UP : TRIGGER_WHEEL_DOWN;
+    s->chord_used |= s->modmask;
+    return dispatch_fill_hit(t, &t->slot[s->layer][s->modmask][trigger], DISPATCH_TAP, trigger, hit);
+}
+
+#endif // BUTTON_DISPATCH_H
@@ -0,0 +1,142 @@
+/**
+ * @file ctl.c
+ * Decription: Control socket server on the event loop (see ctl.h).
+ *
+ */
+#define _GNU_SOURCE
+#include "ctl.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ev_loop.h"
+#include "log.h"
+
+static int listen_fd = -1;
+static int clients[CTL_MAX_CLIENTS];
+static ctl_handler handler;
+static char socket_path[108];
+
+static void drop_client(int slot)
+{
+    ev_loop_remove(clients[slot]);
+    close(clients[slot]);
+    clients[slot] = -1;
+}
+
+static void on_client(void* ctx, uint32_t events)
+{
+    int slot = (int)(intptr_t)ctx;
+    int fd = clients[slot];
+    struct ctl_request req;
+    static struct ctl_response resp;  // 4 KB, kept off the input thread's stack
+
+    if (fd < 0)
+        return;
+    if (events & (EPOLLHUP | EPOLLERR)) {
+        drop_client(slot);
+        return;
+    }
+
+    for (;;) {
+        ssize_t n = recv(fd, &req, sizeof(req), MSG_DONTWAIT);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if (n <= 0) {
+            drop_client(slot);
+            return;
+        }
+
+        memset(&resp, 0, offsetof(struct ctl_response, text) + 1);
+        resp.magic = CTL_MAGIC;
+        resp.version = CTL_VERSION;
+        if ((size_t)n != sizeof(req) || req.magic != CTL_MAGIC || req.version != CTL_VERSION) {
+            resp.status = CTL_BAD_REQUEST;
+            snprintf(resp.text, sizeof(resp.text), "bad request (%zd bytes)", n);
+        } else {
+            req.text[sizeof(req.text) - 1] = '\0';
+            handler(&req, &resp);
+        }
+
+        // Only the used part of the text goes back
+        size_t len = offsetof(struct ctl_response, text) + strnlen(resp.text, sizeof(resp.text) - 1) + 1;
+        if (send(fd, &resp, len, MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+            drop_client(slot);
+            return;
+        }
+    }
+}
+
+static void on_accept(void* ctx, uint32_t events)
+{
+    (void)ctx;
+    (void)events;
+
+    for (;;) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        int slot = -1;
+        for (int i = 0; i < CTL_MAX_CLIENTS; i++) {
+            if (clients[i] < 0) {
+                slot = i;
+                break;
+            }
+        }
+        if (slot < 0 || ev_loop_add(fd, EPOLLIN, on_client, (void*)(intptr_t)slot) < 0) {
+            LOGW("[CTL] Too many control clients, connection refused");
+            close(fd);
+            continue;
+        }
+        clients[slot] = fd;
+    }
+}
+
+int ctl_start(const char* path, ctl_handler h)
+{
+    struct sockaddr_un addr;
+
+    for (int i = 0; i < CTL_MAX_CLIENTS; i++)
+        clients[i] = -1;
+    handler = h;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    snprintf(socket_path, sizeof(socket_path), "%s", path);
+
+    listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0)
+        return -1;
+
+    // A previous MPC run may have left the socket file behind
+    unlink(path);
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || chmod(path, 0660) < 0
+        || listen(listen_fd, CTL_MAX_CLIENTS) < 0 || ev_loop_add(listen_fd, EPOLLIN, on_accept, NULL) < 0) {
+        close(listen_fd);
+        listen_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+void ctl_stop(void)
+{
+    if (listen_fd < 0)
+        return;
+    for (int i = 0; i < CTL_MAX_CLIENTS; i++) {
+        if (clients[i] >= 0)
+            drop_client(i);
+    }
+    ev_loop_remove(listen_fd);
+    close(listen_fd);
+    listen_fd = -1;
+    unlink(socket_path);
+}
@@ -0,0 +1,75 @@
+/**
+ * @file ctl.h
+ * Decription: Control socket: binary request/response protocol and server.
+ *
+ * A SOCK_SEQPACKET Unix socket served from the input thread's event loop,
+ * so every command runs on the thread that owns the cursor state: nothing
+ * is shared, nothing locks. An idle socket is one more fd in epoll_wait().
+ * Each packet is one fixed-size request, answered by one response packet.
+ * cursor_ctl is the command line client.
+ *
+ */
+#ifndef CTL_H
+#define CTL_H
+
+#include <stdint.h>
+
+#define CTL_SOCKET_PATH "/dev/shm/force_cursor.sock"
+#define CTL_MAGIC 0x4346u           // "FC"
+#define CTL_VERSION 1
+#define CTL_MAX_CLIENTS 4
+#define CTL_TEXT_LEN 256
+#define CTL_REPLY_TEXT_LEN 4096
+
+enum ctl_cmd {
+    CTL_PING = 0,
+    CTL_GET_STATE,      // value[]: x, y, layer, speed x1000, bindings, config pending, engine
+                        // generation; text: engine build
+    CTL_SET_SPEED,      // arg[0]: speed multiplier x1000
+    CTL_LOAD_CONFIG,    // text: config file (empty = the usual one), swaps mappings
+    CTL_WARP,           // arg[0], arg[1]: cursor position
+    CTL_GESTURE,        // arg[0]: CTL_GESTURE_*; at arg[1], arg[2] or the cursor if arg[1] < 0
+    CTL_SET,            // text: a NAME=value setting line
+    CTL_TRACE,          // arg[0]: 1 = record, 0 = stop
+    CTL_DUMP,           // write the trace / DRM census reports now
+    CTL_STATS,          // text: every counter as "name value" lines
+    CTL_RELOAD,         // text: engine .so (empty = the same file), see engine.h
+};
+
+enum ctl_gesture {
+    CTL_GESTURE_ZOOM_OUT = 0,
+    CTL_GESTURE_ZOOM_IN,
+    CTL_GESTURE_TAP,
+};
+
+enum ctl_status {
+    CTL_OK = 0,
+    CTL_PENDING,        // accepted, applied once buttons/encoder/macros are released
+    CTL_ERROR,
+    CTL_BAD_REQUEST,
+};
+
+struct ctl_request {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t cmd;
+    int32_t arg[4];
+    char text[CTL_TEXT_LEN];
+};
+
+struct ctl_response {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t status;
+    int32_t value[8];
+    char text[CTL_REPLY_TEXT_LEN];
+};
+
+// Runs on the event loop thread; resp arrives zeroed with status CTL_OK
+typedef void (*ctl_handler)(const struct ctl_request* req, struct ctl_response* resp);
+
+// Server side, needs the event loop
+int ctl_start(const char* path, ctl_handler handler);
+void ctl_stop(void);
+
+#endif // CTL_H
@@ -0,0 +1,141 @@
+/**
+ * @file cursor_ctl.c
+ * Decription: Command line client for the cursor library's control socket.
+ *
+ * Talks to /dev/shm/force_cursor.sock (see ctl.h): one request, one
+ * response, exit status 0 when the command was applied (or queued until
+ * the buttons are released), 1 when it failed.
+ *
+ *   cursor_ctl state                  cursor position, layer, speed
+ *   cursor_ctl speed 1.5              speed multiplier
+ *   cursor_ctl load [file]            swap in mappings from a config file
+ *   cursor_ctl warp 400 640           move the cursor
+ *   cursor_ctl zoom-in|zoom-out|tap [x y]
+ *   cursor_ctl set LOG_LEVEL=debug    any NAME=value setting
+ *   cursor_ctl trace on|off
+ *   cursor_ctl dump                   write the trace / DRM census reports
+ *   cursor_ctl stats                  counters, name value per line
+ *   cursor_ctl reload [engine.so]     replace the engine, MPC keeps running
+ *
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ctl.h"
+
+static void usage(const char* prog)
+{
+    fprintf(stderr,
+            "usage: %s state | speed <multiplier> | load [file] | warp <x> <y>\n"
+            "       %s zoom-in|zoom-out|tap [x y] | set NAME=value | trace on|off\n"
+            "       %s dump | stats | reload [engine.so] | ping\n",
+            prog, prog, prog);
+}
+
+// Fill req from the command line; returns -1 on a usage error
+static int build_request(int argc, char** argv, struct ctl_request* req)
+{
+    const char* cmd = argv[1];
+
+    if (strcmp(cmd, "ping") == 0 && argc == 2) {
+        req->cmd = CTL_PING;
+    } else if (strcmp(cmd, "state") == 0 && argc == 2) {
+        req->cmd = CTL_GET_STATE;
+    } else if (strcmp(cmd, "speed") == 0 && argc == 3) {
+        req->cmd = CTL_SET_SPEED;
+        req->arg[0] = (int32_t)(strtod(argv[2], NULL) * 1000.0 + 0.5);
+    } else if (strcmp(cmd, "load") == 0 && argc <= 3) {
+        req->cmd = CTL_LOAD_CONFIG;
+        if (argc == 3)
+            snprintf(req->text, sizeof(req->text), "%s", argv[2]);
+    } else if (strcmp(cmd, "warp") == 0 && argc == 4) {
+        req->cmd = CTL_WARP;
+        req->arg[0] = atoi(argv[2]);
+        req->arg[1] = atoi(argv[3]);
+    } else if ((strcmp(cmd, "zoom-in") == 0 || strcmp(cmd, "zoom-out") == 0 || strcmp(cmd, "tap") == 0)
+               && (argc == 2 || argc == 4)) {
+        req->cmd = CTL_GESTURE;
+        req->arg[0] = cmd[0] == 't' ? CTL_GESTURE_TAP : strcmp(cmd, "zoom-in") == 0 ? CTL_GESTURE_ZOOM_IN : CTL_GESTURE_ZOOM_OUT;
+        req->arg[1] = argc == 4 ? atoi(argv[2]) : -1;
+        req->arg[2] = argc == 4 ? atoi(argv[3]) : -1;
+    } else if (strcmp(cmd, "set") == 0 && argc == 3 && strchr(argv[2], '=')) {
+        req->cmd = CTL_SET;
+        snprintf(req->text, sizeof(req->text), "%s", argv[2]);
+    } else if (strcmp(cmd, "trace") == 0 && argc == 3) {
+        req->cmd = CTL_TRACE;
+        req->arg[0] = strcasecmp(argv[2], "on") == 0 || strcmp(argv[2], "1") == 0;
+    } else if (strcmp(cmd, "dump") == 0 && argc == 2) {
+        req->cmd = CTL_DUMP;
+    } else if (strcmp(cmd, "stats") == 0 && argc == 2) {
+        req->cmd = CTL_STATS;
+    } else if (strcmp(cmd, "reload") == 0 && argc <= 3) {
+        req->cmd = CTL_RELOAD;
+        if (argc == 3)
+            snprintf(req->text, sizeof(req->text), "%s", argv[2]);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    struct ctl_request req;
+    static struct ctl_response resp;
+    struct sockaddr_un addr;
+
+    memset(&req, 0, sizeof(req));
+    req.magic = CTL_MAGIC;
+    req.version = CTL_VERSION;
+    if (argc < 2 || build_request(argc, argv, &req) < 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", CTL_SOCKET_PATH);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "cursor_ctl: %s: %s (is the cursor library loaded?)\n", CTL_SOCKET_PATH, strerror(errno));
+        return 1;
+    }
+
+    // A gesture animates for ~100 ms before the reply comes back
+    struct timeval tv = { .tv_sec = 5 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (send(fd, &req, sizeof(req), 0) != sizeof(req)) {
+        fprintf(stderr, "cursor_ctl: send failed: %s\n", strerror(errno));
+        return 1;
+    }
+    ssize_t n = recv(fd, &resp, sizeof(resp), 0);
+    close(fd);
+    if (n < (ssize_t)offsetof(struct ctl_response, text) + 1 || resp.magic != CTL_MAGIC) {
+        fprintf(stderr, "cursor_ctl: no valid reply\n");
+        return 1;
+    }
+    resp.text[sizeof(resp.text) - 1] = '\0';
+
+    if (resp.status != CTL_OK && resp.status != CTL_PENDING) {
+        fprintf(stderr, "cursor_ctl: %s\n", resp.text[0] ? resp.text : "command failed");
+        return 1;
+    }
+    if (req.cmd == CTL_GET_STATE) {
+        printf("cursor %d,%d\nlayer %d\nspeed %.3f\nbindings %d\nreload_pending %d\nengine %d (built %s)\n",
+               resp.value[0], resp.value[1], resp.value[2], resp.value[3] / 1000.0, resp.value[4], resp.value[5],
+               resp.value[6], resp.text);
+    } else if (resp.text[0]) {
+        printf("%s%s", resp.text, resp.text[strlen(resp.text) - 1] == '\n' ? "" : "\n");
+    }
+    if (resp.status == CTL_PENDING)
+        printf("pending: applied once buttons, encoder and macros are released\n");
+    return 0;
+}
@@ -0,0 +1,937 @@
+/**
+ * @file cursor_rec.c
+ * Decription: Record, replay and soak-test evdev input sessions.
+ *
+ * Records what a mouse, touchpad or keyboard sends into a capture file (see
+ * evrec.h) and plays it back through a uinput device that looks like the
+ * original, so a latency or coalescing change can be tested the same way
+ * every time, without waving a mouse at the device.
+ *
+ *   cursor_rec record [-g] [-s seconds] -o session.fcev /dev/input/event3
+ *   cursor_rec info session.fcev
+ *   cursor_rec replay [-x 4] [-l loops | -t seconds] [-L link] session.fcev
+ *   cursor_rec replay -r 8000 -t 60 session.fcev       8 kHz frame storm
+ *   cursor_rec soak [-d] [-t 60] [-p 2000] [-c 5] [replay options] session.fcev
+ *
+ * replay keeps the recorded timing (-x: that many times faster), or with
+ * -r plays one frame per tick at a fixed rate, whatever the recording says.
+ * Keys and buttons still held when it ends are released. -L makes a symlink
+ * to the new device, so the cursor config can name a path that does not
+ * change; -o writes the events to a file or pipe instead of uinput.
+ *
+ * soak replays into the running cursor library and fails (exit status 1)
+ * unless, over the run: p99 of evdev_to_dequeue and dequeue_to_move stays
+ * under -p microseconds (LATENCY_STATS=1), the input thread uses less than
+ * -c percent of a core, no touch frame was dropped, and once the replay has
+ * ended no touch is left pressed on the virtual or real touchscreen.
+ *
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "evrec.h"
+#include "stats.h"
+
+#define WRITE_BATCH 64                  // events per write()
+#define LOOP_GAP_NS 10000000ull         // pause between two passes over a capture
+#define WAIT_OPEN_S 120                 // soak: time for the library to open the device
+#define SETTLE_MS 1500                  // soak: let the once-a-second counters catch up
+#define DEFAULT_SOAK_S 60
+#define DEFAULT_P99_US 2000
+#define DEFAULT_CPU_PCT 5
+#define TOUCH_DEVICE_NAME "Virtual Mouse Touch"  // force_cursor.c init_uinput()
+#define TOUCHSCREEN_DEVICE "/dev/input/event0"
+
+struct capture {
+    const struct evrec_header* hdr;
+    const struct evrec_event* ev;
+    uint64_t count;
+    size_t size;
+};
+
+struct replay {
+    double speed;                       // 1 = recorded timing
+    int rate;                           // frames per second, 0 = recorded timing
+    int loops;                          // 0 = until -t runs out
+    int seconds;
+    const char* link;
+    const char* output;
+};
+
+struct play_stats {
+    uint64_t frames;
+    uint64_t events;
+    uint64_t max_late_ns;               // worst write after its due time
+    uint64_t elapsed_ns;
+};
+
+static volatile sig_atomic_t stop = 0;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+static void catch_signals(void)
+{
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+}
+
+static void sleep_until(uint64_t t)
+{
+    struct timespec ts = { (time_t)(t / 1000000000ull), (long)(t % 1000000000ull) };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && !stop) {
+    }
+}
+
+// --- Record -----------------------------------------------------------
+
+static int read_caps(int fd, struct evrec_header* h)
+{
+    struct input_id id;
+
+    if (ioctl(fd, EVIOCGNAME(sizeof(h->name) - 1), h->name) < 0)
+        return -1;
+    if (ioctl(fd, EVIOCGID, &id) == 0) {
+        h->bustype = id.bustype;
+        h->vendor = id.vendor;
+        h->product = id.product;
+        h->id_version = id.version;
+    }
+    ioctl(fd, EVIOCGPROP(sizeof(h->prop_bits)), h->prop_bits);
+    ioctl(fd, EVIOCGBIT(0, sizeof(h->ev_bits)), h->ev_bits);
+    ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(h->key_bits)), h->key_bits);
+    ioctl(fd, EVIOCGBIT(EV_REL, sizeof(h->rel_bits)), h->rel_bits);
+    ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(h->abs_bits)), h->abs_bits);
+    ioctl(fd, EVIOCGBIT(EV_MSC, sizeof(h->msc_bits)), h->msc_bits);
+    for (int i = 0; i < EVREC_ABS_MAX; i++) {
+        if (evrec_test_bit(h->abs_bits, i))
+            ioctl(fd, EVIOCGABS(i), &h->absinfo[i]);
+    }
+    return 0;
+}
+
+static int record(int argc, char** argv)
+{
+    const char* out_path = NULL;
+    int grab = 0, seconds = 0, opt;
+
+    while ((opt = getopt(argc, argv, "go:s:")) != -1) {
+        switch (opt) {
+        case 'g': grab = 1; break;
+        case 'o': out_path = optarg; break;
+        case 's': seconds = atoi(optarg); break;
+        default: return 2;
+        }
+    }
+    if (!out_path || optind != argc - 1)
+        return 2;
+    const char* dev_path = argv[optind];
+
+    int fd = open(dev_path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "cursor_rec: %s: %s\n", dev_path, strerror(errno));
+        return 1;
+    }
+    static struct evrec_header h;
+    h.magic = EVREC_MAGIC;
+    h.version = EVREC_VERSION;
+    h.header_size = EVREC_HEADER_SIZE;
+    h.event_size = sizeof(struct evrec_event);
+    h.start_realtime = time(NULL);
+    // Kernel timestamps on the clock the library asks for too
+    int clock = CLOCK_MONOTONIC;
+    ioctl(fd, EVIOCSCLOCKID, &clock);
+    if (read_caps(fd, &h) < 0)
+        fprintf(stderr, "cursor_rec: %s is not an evdev device, capabilities are taken from the events\n", dev_path);
+    if (grab && ioctl(fd, EVIOCGRAB, 1) < 0)
+        fprintf(stderr, "cursor_rec: could not grab %s\n", dev_path);
+
+    FILE* out = fopen(out_path, "w");
+    static const char page[EVREC_HEADER_SIZE];
+    if (!out || fwrite(page, sizeof(page), 1, out) != 1) {
+        fprintf(stderr, "cursor_rec: %s: %s\n", out_path, strerror(errno));
+        return 1;
+    }
+
+    catch_signals();
+    fprintf(stdout, "recording \"%s\" to %s, Ctrl-C to stop\n", h.name, out_path);
+    fflush(stdout);
+
+    uint64_t deadline = seconds > 0 ? now_ns() + (uint64_t)seconds * 1000000000ull : 0;
+    uint64_t first = 0, last = 0, count = 0;
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    while (!stop && (!deadline || now_ns() < deadline)) {
+        if (poll(&pfd, 1, 200) <= 0)
+            continue;
+        struct input_event evs[WRITE_BATCH];
+        ssize_t n;
+        while ((n = read(fd, evs, sizeof(evs))) >= (ssize_t)sizeof(evs[0])) {
+            for (size_t i = 0; i < (size_t)n / sizeof(evs[0]); i++) {
+                uint64_t t = (uint64_t)evs[i].input_event_sec * 1000000000ull
+                    + (uint64_t)evs[i].input_event_usec * 1000ull;
+                if (count == 0)
+                    first = t;
+                // Never backwards, whatever the source did
+                uint64_t rel = t > first ? t - first : 0;
+                if (rel < last)
+                    rel = last;
+                last = rel;
+                struct evrec_event e = { rel, evs[i].type, evs[i].code, evs[i].value };
+                if (fwrite(&e, sizeof(e), 1, out) != 1) {
+                    fprintf(stderr, "cursor_rec: %s: %s\n", out_path, strerror(errno));
+                    return 1;
+                }
+                count++;
+            }
+        }
+        if (n == 0 || (n < 0 && errno != EAGAIN))
+            break;  // device gone, or the pipe's writer
+    }
+
+    h.count = count;
+    h.duration_ns = last;
+    if (fseek(out, 0, SEEK_SET) != 0 || fwrite(&h, sizeof(h), 1, out) != 1 || fclose(out) != 0) {
+        fprintf(stderr, "cursor_rec: %s: %s\n", out_path, strerror(errno));
+        return 1;
+    }
+    fprintf(stdout, "%llu event(s), %.1f s\n", (unsigned long long)count, last / 1e9);
+    return 0;
+}
+
+// --- Captures ---------------------------------------------------------
+
+static int load_capture(const char* path, struct capture* c)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "cursor_rec: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    c->size = (size_t)st.st_size;
+    void* map = c->size >= sizeof(struct evrec_header)
+        ? mmap(NULL, c->size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "cursor_rec: %s: not a capture\n", path);
+        return -1;
+    }
+    c->hdr = map;
+    if (c->hdr->magic != EVREC_MAGIC || c->hdr->version != EVREC_VERSION
+        || c->hdr->event_size != sizeof(struct evrec_event) || c->hdr->header_size < sizeof(struct evrec_header)
+        || c->hdr->header_size > c->size) {
+        fprintf(stderr, "cursor_rec: %s: not a version %d capture\n", path, EVREC_VERSION);
+        return -1;
+    }
+    c->ev = (const struct evrec_event*)((const char*)map + c->hdr->header_size);
+    uint64_t whole = (c->size - c->hdr->header_size) / sizeof(struct evrec_event);
+    c->count = c->hdr->count && c->hdr->count < whole ? c->hdr->count : whole;
+    return 0;
+}
+
+static int is_frame_end(const struct evrec_event* e)
+{
+    return e->type == EV_SYN && e->code == SYN_REPORT;
+}
+
+static int info(int argc, char** argv)
+{
+    struct capture c;
+    if (argc != 2 || load_capture(argv[1], &c) < 0)
+        return argc != 2 ? 2 : 1;
+    const struct evrec_header* h = c.hdr;
+
+    uint64_t frames = 0, rel = 0, key = 0, absolute = 0, min_gap = UINT64_MAX, frame_start = 0;
+    int have_frame = 0;
+    for (uint64_t i = 0; i < c.count; i++) {
+        const struct evrec_event* e = &c.ev[i];
+        rel += e->type == EV_REL;
+        key += e->type == EV_KEY;
+        absolute += e->type == EV_ABS;
+        if (!is_frame_end(e))
+            continue;
+        if (have_frame && e->time_ns - frame_start < min_gap)
+            min_gap = e->time_ns - frame_start;
+        frame_start = e->time_ns;
+        have_frame = 1;
+        frames++;
+    }
+    uint64_t duration = c.count ? c.ev[c.count - 1].time_ns : 0;
+    char when[32] = "";
+    time_t start = (time_t)h->start_realtime;
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&start));
+
+    fprintf(stdout, "device      \"%.*s\" (bus %04x vendor %04x product %04x)\n", EVREC_NAME_LEN, h->name,
+            h->bustype, h->vendor, h->product);
+    fprintf(stdout, "recorded    %s, %.1f s%s\n", when, duration / 1e9, h->count ? "" : " (cut short)");
+    fprintf(stdout, "events      %llu: %llu rel, %llu key, %llu abs\n", (unsigned long long)c.count,
+            (unsigned long long)rel, (unsigned long long)key, (unsigned long long)absolute);
+    fprintf(stdout, "frames      %llu, %.0f/s average", (unsigned long long)frames,
+            duration ? frames / (duration / 1e9) : 0.0);
+    if (min_gap != UINT64_MAX && min_gap > 0)
+        fprintf(stdout, ", %.0f/s peak", 1e9 / (double)min_gap);
+    fprintf(stdout, "\n");
+    return 0;
+}
+
+// --- Replay -----------------------------------------------------------
+
+// The recorded capabilities, plus anything the events use: captures from
+// a pipe have none recorded
+static void merge_caps(const struct capture* c, struct evrec_header* caps)
+{
+    *caps = *c->hdr;
+    for (uint64_t i = 0; i < c->count; i++) {
+        const struct evrec_event* e = &c->ev[i];
+        switch (e->type) {
+        case EV_KEY:
+            if (e->code < EVREC_KEY_MAX)
+                evrec_set_bit(caps->key_bits, e->code);
+            break;
+        case EV_REL:
+            if (e->code < EVREC_REL_MAX)
+                evrec_set_bit(caps->rel_bits, e->code);
+            break;
+        case EV_ABS:
+            if (e->code < EVREC_ABS_MAX && !evrec_test_bit(c->hdr->abs_bits, e->code)) {
+                // No recorded range: the range of the values seen
+                struct input_absinfo* a = &caps->absinfo[e->code];
+                if (!evrec_test_bit(caps->abs_bits, e->code))
+                    a->minimum = a->maximum = e->value;
+                if (e->value < a->minimum)
+                    a->minimum = e->value;
+                if (e->value > a->maximum)
+                    a->maximum = e->value;
+                evrec_set_bit(caps->abs_bits, e->code);
+            }
+            break;
+        case EV_MSC:
+            if (e->code < EVREC_MSC_MAX)
+                evrec_set_bit(caps->msc_bits, e->code);
+            break;
+        default:
+            continue;
+        }
+        evrec_set_bit(caps->ev_bits, e->type);
+    }
+    if (!caps->name[0])
+        snprintf(caps->name, sizeof(caps->name), "cursor_rec replay");
+}
+
+// /dev/input/eventN of a uinput device
+static int device_node(int ufd, char* path, size_t size)
+{
+    char sys[64], dir[128];
+    if (ioctl(ufd, UI_GET_SYSNAME(sizeof(sys)), sys) < 0)
+        return -1;
+    snprintf(dir, sizeof(dir), "/sys/devices/virtual/input/%s", sys);
+
+    // udev may not have created the node yet
+    for (int tries = 0; tries < 50; tries++) {
+        DIR* d = opendir(dir);
+        struct dirent* de;
+        while (d && (de = readdir(d)) != NULL) {
+            if (strncmp(de->d_name, "event", 5) == 0) {
+                snprintf(path, size, "/dev/input/%.32s", de->d_name);
+                closedir(d);
+                if (access(path, F_OK) == 0)
+                    return 0;
+                d = NULL;
+                break;
+            }
+        }
+        if (d)
+            closedir(d);
+        usleep(20000);
+    }
+    return -1;
+}
+
+// A uinput device with the capture's capabilities (only what the library
+// reads: keys, motion, axes; autorepeat stays off, the capture has it)
+static int create_device(const struct capture* c, char* node, size_t node_size)
+{
+    struct evrec_header caps;
+    struct uinput_user_dev uidev;
+
+    merge_caps(c, &caps);
+    int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    memset(&uidev, 0, sizeof(uidev));
+    snprintf(uidev.name, UINPUT_MAX_NAME_SIZE, "%s", caps.name);
+    uidev.id.bustype = caps.bustype ? caps.bustype : BUS_VIRTUAL;
+    uidev.id.vendor = caps.vendor;
+    uidev.id.product = caps.product;
+    uidev.id.version = caps.id_version;
+
+    ioctl(fd, UI_SET_EVBIT, EV_SYN);
+    static const int types[] = { EV_KEY, EV_REL, EV_ABS, EV_MSC };
+    for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+        if (evrec_test_bit(caps.ev_bits, types[t]))
+            ioctl(fd, UI_SET_EVBIT, types[t]);
+    }
+    for (int i = 0; i < EVREC_KEY_MAX; i++) {
+        if (evrec_test_bit(caps.key_bits, i))
+            ioctl(fd, UI_SET_KEYBIT, i);
+    }
+    for (int i = 0; i < EVREC_REL_MAX; i++) {
+        if (evrec_test_bit(caps.rel_bits, i))
+            ioctl(fd, UI_SET_RELBIT, i);
+    }
+    for (int i = 0; i < EVREC_ABS_MAX && i < ABS_CNT; i++) {
+        if (!evrec_test_bit(caps.abs_bits, i))
+            continue;
+        ioctl(fd, UI_SET_ABSBIT, i);
+        uidev.absmin[i] = caps.absinfo[i].minimum;
+        uidev.absmax[i] = caps.absinfo[i].maximum;
+        uidev.absfuzz[i] = caps.absinfo[i].fuzz;
+        uidev.absflat[i] = caps.absinfo[i].flat;
+    }
+    for (int i = 0; i < EVREC_MSC_MAX; i++) {
+        if (evrec_test_bit(caps.msc_bits, i))
+            ioctl(fd, UI_SET_MSCBIT, i);
+    }
+    for (int i = 0; i < EVREC_PROP_MAX; i++) {
+        if (evrec_test_bit(caps.prop_bits, i))
+            ioctl(fd, UI_SET_PROPBIT, i);
+    }
+
+    if (write(fd, &uidev, sizeof(uidev)) != (ssize_t)sizeof(uidev) || ioctl(fd, UI_DEV_CREATE) < 0) {
+        close(fd);
+        return -1;
+    }
+    if (device_node(fd, node, node_size) < 0)
+        snprintf(node, node_size, "(unknown node)");
+    return fd;
+}
+
+// Where the events go: a new uinput device, or -o a file or pipe
+static int open_output(const struct capture* c, const struct replay* r, char* node, size_t node_size)
+{
+    if (r->output) {
+        int fd = open(r->output, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0)
+            fprintf(stderr, "cursor_rec: %s: %s\n", r->output, strerror(errno));
+        snprintf(node, node_size, "%s", r->output);
+        return fd;
+    }
+    int fd = create_device(c, node, node_size);
+    if (fd < 0) {
+        fprintf(stderr, "cursor_rec: could not create a uinput device: %s\n", strerror(errno));
+        return -1;
+    }
+    if (r->link && node[0] == '/') {
+        unlink(r->link);
+        if (symlink(node, r->link) < 0)
+            fprintf(stderr, "cursor_rec: %s: %s\n", r->link, strerror(errno));
+    }
+    fprintf(stdout, "replaying as %s%s%s\n", node, r->link ? " -> " : "", r->link ? r->link : "");
+    fflush(stdout);
+    return fd;
+}
+
+static int write_events(int fd, const struct input_event* evs, size_t n)
+{
+    const char* p = (const char*)evs;
+    size_t len = n * sizeof(evs[0]);
+    while (len > 0) {
+        ssize_t w = write(fd, p, len);
+        if (w < 0 && (errno == EINTR || errno == EAGAIN))
+            continue;
+        if (w <= 0)
+            return -1;
+        p += w;
+        len -= (size_t)w;
+    }
+    return 0;
+}
+
+// Keys and buttons still down at the end go up, and touches are lifted,
+// so a capture cut mid-press does not leave the library holding a touch
+static int release_held(int fd, const uint8_t* held, const struct capture* c)
+{
+    struct input_event evs[WRITE_BATCH];
+    size_t n = 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    memset(evs, 0, sizeof(evs));
+    for (int code = 0; code < EVREC_KEY_MAX && n < WRITE_BATCH - 1; code++) {
+        if (!evrec_test_bit(held, code))
+            continue;
+        evs[n].type = EV_KEY;
+        evs[n].code = (uint16_t)code;
+        evs[n++].value = 0;
+    }
+    if (evrec_test_bit(c->hdr->abs_bits, ABS_MT_SLOT)) {
+        int slots = c->hdr->absinfo[ABS_MT_SLOT].maximum + 1;
+        for (int s = 0; s < slots && n < WRITE_BATCH - 3; s++) {
+            evs[n].type = EV_ABS;
+            evs[n].code = ABS_MT_SLOT;
+            evs[n++].value = s;
+            evs[n].type = EV_ABS;
+            evs[n].code = ABS_MT_TRACKING_ID;
+            evs[n++].value = -1;
+        }
+    }
+    if (n == 0)
+        return 0;
+    evs[n].type = EV_SYN;
+    evs[n++].code = SYN_REPORT;
+    for (size_t i = 0; i < n; i++) {
+        evs[i].input_event_sec = ts.tv_sec;
+        evs[i].input_event_usec = ts.tv_nsec / 1000;
+    }
+    return write_events(fd, evs, n);
+}
+
+// Play whole frames (up to and including SYN_REPORT) at their recorded
+// time divided by the speed, or one per tick with -r
+static int play(const struct capture* c, int fd, const struct replay* r, struct play_stats* st)
+{
+    static uint8_t held[EVREC_KEY_MAX / 8];
+    uint64_t start = now_ns();
+    uint64_t end = r->seconds > 0 ? start + (uint64_t)r->seconds * 1000000000ull : 0;
+    uint64_t period = r->rate > 0 ? 1000000000ull / (uint64_t)r->rate : 0;
+    uint64_t pass_start = start, next_tick = start;
+    int ret = 0, done = 0;
+
+    memset(st, 0, sizeof(*st));
+    for (int loop = 0; !stop && !done && (r->loops == 0 || loop < r->loops); loop++) {
+        uint64_t i = 0;
+        while (i < c->count && !stop) {
+            uint64_t j = i;
+            while (j < c->count && !is_frame_end(&c->ev[j]))
+                j++;
+            if (j < c->count)
+                j++;
+
+            uint64_t due = period ? next_tick : pass_start + (uint64_t)((double)c->ev[i].time_ns / r->speed);
+            if (end && due >= end) {
+                done = 1;
+                break;
+            }
+            sleep_until(due);
+            uint64_t now = now_ns();
+            if (now - due > st->max_late_ns)
+                st->max_late_ns = now - due;
+
+            struct input_event evs[WRITE_BATCH];
+            struct timespec ts;
+            size_t n = 0;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            for (uint64_t k = i; k < j; k++) {
+                const struct evrec_event* e = &c->ev[k];
+                if (e->type == EV_SYN && e->code == SYN_DROPPED)
+                    continue;  // the recorder fell behind, not part of the input
+                if (e->type == EV_KEY && e->code < EVREC_KEY_MAX) {
+                    if (e->value)
+                        evrec_set_bit(held, e->code);
+                    else
+                        held[e->code / 8] &= (uint8_t)~(1u << (e->code % 8));
+                }
+                evs[n].input_event_sec = ts.tv_sec;
+                evs[n].input_event_usec = ts.tv_nsec / 1000;
+                evs[n].type = e->type;
+                evs[n].code = e->code;
+                evs[n].value = e->value;
+                if (++n < WRITE_BATCH && k + 1 < j)
+                    continue;
+                if (write_events(fd, evs, n) < 0)
+                    break;
+                st->events += n;
+                n = 0;
+            }
+            if (n > 0 && write_events(fd, evs, n) == 0) {
+                st->events += n;
+                n = 0;
+            }
+            if (n > 0) {
+                fprintf(stderr, "cursor_rec: write: %s\n", strerror(errno));
+                ret = -1;
+                stop = 1;
+            }
+            st->frames++;
+            next_tick += period;
+            i = j;
+        }
+        pass_start = now_ns() + LOOP_GAP_NS;
+    }
+    if (release_held(fd, held, c) < 0)
+        ret = -1;
+    st->elapsed_ns = now_ns() - start;
+    return ret;
+}
+
+static int parse_replay_opt(int opt, struct replay* r)
+{
+    switch (opt) {
+    case 'x': r->speed = strtod(optarg, NULL); break;
+    case 'r': r->rate = atoi(optarg); break;
+    case 'l': r->loops = atoi(optarg); break;
+    case 't': r->seconds = atoi(optarg); break;
+    case 'L': r->link = optarg; break;
+    case 'o': r->output = optarg; break;
+    default: return -1;
+    }
+    return 0;
+}
+
+static int check_replay(struct replay* r)
+{
+    if (r->speed <= 0.0 || r->rate < 0 || r->rate > 100000 || r->loops < 0 || r->seconds < 0)
+        return -1;
+    if (r->loops == 0 && r->seconds == 0)
+        r->loops = 1;
+    return 0;
+}
+
+static void print_play(const struct play_stats* st)
+{
+    double s = st->elapsed_ns / 1e9;
+    fprintf(stdout, "%llu frame(s), %llu event(s) in %.1f s: %.0f frames/s, at most %.0f us late\n",
+            (unsigned long long)st->frames, (unsigned long long)st->events, s, s > 0 ? st->frames / s : 0.0,
+            st->max_late_ns / 1e3);
+}
+
+static int replay(int argc, char** argv)
+{
+    struct replay r = { 1.0, 0, 0, 0, NULL, NULL };
+    struct capture c;
+    char node[128];
+    int opt;
+
+    while ((opt = getopt(argc, argv, "x:r:l:t:L:o:")) != -1) {
+        if (parse_replay_opt(opt, &r) < 0)
+            return 2;
+    }
+    if (optind != argc - 1 || check_replay(&r) < 0)
+        return 2;
+    if (load_capture(argv[optind], &c) < 0)
+        return 1;
+    catch_signals();
+    int fd = open_output(&c, &r, node, sizeof(node));
+    if (fd < 0)
+        return 1;
+
+    struct play_stats st;
+    int ret = play(&c, fd, &r, &st);
+    print_play(&st);
+    if (r.link && !r.output)
+        unlink(r.link);
+    close(fd);
+    return ret < 0 ? 1 : 0;
+}
+
+// --- Soak -------------------------------------------------------------
+
+struct soak_snapshot {
+    uint64_t counter[STATS_MAX_COUNTERS];
+    struct stats_hist hist[STATS_MAX_HISTS];
+};
+
+static const struct stats_page* open_stats(const char* name)
+{
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        fprintf(stderr, "cursor_rec: /dev/shm%s not found (is the cursor library loaded?)\n", name);
+        return NULL;
+    }
+    void* ptr = mmap(NULL, sizeof(struct stats_page), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    const struct stats_page* p = ptr;
+    if (ptr == MAP_FAILED || p->magic != STATS_MAGIC || p->num_counters > STATS_MAX_COUNTERS
+        || p->num_hists > STATS_MAX_HISTS) {
+        fprintf(stderr, "cursor_rec: unrecognised stats page\n");
+        return NULL;
+    }
+    return p;
+}
+
+static void take_snapshot(const struct stats_page* p, struct soak_snapshot* s)
+{
+    for (uint32_t i = 0; i < p->num_counters; i++)
+        s->counter[i] = __atomic_load_n(&p->counter[i], __ATOMIC_RELAXED);
+    for (uint32_t i = 0; i < p->num_hists; i++) {
+        s->hist[i].max_ns = __atomic_load_n(&p->hist[i].max_ns, __ATOMIC_RELAXED);
+        s->hist[i].count = 0;
+        for (int b = 0; b < STATS_HIST_BUCKETS; b++) {
+            s->hist[i].bucket[b] = __atomic_load_n(&p->hist[i].bucket[b], __ATOMIC_RELAXED);
+            s->hist[i].count += s->hist[i].bucket[b];
+        }
+    }
+}
+
+// Counters and histograms are matched by name, like cursor_stats does
+static int find_counter(const struct stats_page* p, const char* name)
+{
+    for (uint32_t i = 0; i < p->num_counters; i++) {
+        if (strncmp(p->name[i], name, STATS_NAME_LEN) == 0)
+            return (int)i;
+    }
+    return -1;
+}
+
+static int find_hist(const struct stats_page* p, const char* name)
+{
+    for (uint32_t i = 0; i < p->num_hists; i++) {
+        if (strncmp(p->hist_name[i], name, STATS_NAME_LEN) == 0)
+            return (int)i;
+    }
+    return -1;
+}
+
+static uint64_t counter_delta(const struct stats_page* p, const struct soak_snapshot* a,
+                              const struct soak_snapshot* b, const char* name)
+{
+    int i = find_counter(p, name);
+    return i < 0 ? 0 : b->counter[i] - a->counter[i];
+}
+
+// p99 over the run, -1 if nothing was recorded
+static double hist_p99_us(const struct stats_page* p, const struct soak_snapshot* a,
+                          const struct soak_snapshot* b, const char* name, uint64_t* samples)
+{
+    int i = find_hist(p, name);
+    *samples = 0;
+    if (i < 0)
+        return -1.0;
+    uint64_t delta[STATS_HIST_BUCKETS];
+    for (int k = 0; k < STATS_HIST_BUCKETS; k++)
+        delta[k] = b->hist[i].bucket[k] - a->hist[i].bucket[k];
+    *samples = b->hist[i].count - a->hist[i].count;
+    if (*samples == 0)
+        return -1.0;
+    return stats_hist_percentile(delta, *samples, b->hist[i].max_ns, 99.0) / 1000.0;
+}
+
+// Wait until the library has the replay device open (its config names it)
+static int wait_for_open(pid_t pid, const char* node, const char* link)
+{
+    char dir[64];
+    snprintf(dir, sizeof(dir), "/proc/%d/fd", (int)pid);
+    fprintf(stdout, "waiting for pid %d to open %s (point the config's device line at %s and restart MPC)\n",
+            (int)pid, node, link ? link : node);
+    fflush(stdout);
+
+    uint64_t deadline = now_ns() + WAIT_OPEN_S * 1000000000ull;
+    while (!stop && now_ns() < deadline) {
+        DIR* d = opendir(dir);
+        struct dirent* de;
+        while (d && (de = readdir(d)) != NULL) {
+            char path[320], target[128];
+            snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+            ssize_t n = readlink(path, target, sizeof(target) - 1);
+            if (n <= 0)
+                continue;
+            target[n] = '\0';
+            if (strcmp(target, node) == 0) {
+                closedir(d);
+                return 0;
+            }
+        }
+        if (d)
+            closedir(d);
+        usleep(200000);
+    }
+    return -1;
+}
+
+// 1 pressed, 0 not, -1 no such device
+static int touch_down(const char* path)
+{
+    uint8_t keys[KEY_MAX / 8 + 1];
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    memset(keys, 0, sizeof(keys));
+    int ret = ioctl(fd, EVIOCGKEY(sizeof(keys)), keys) < 0 ? -1 : evrec_test_bit(keys, BTN_TOUCH);
+    close(fd);
+    return ret;
+}
+
+// The library's virtual touch device, found by name
+static int find_touch_device(char* path, size_t size)
+{
+    DIR* d = opendir("/sys/class/input");
+    struct dirent* de;
+    while (d && (de = readdir(d)) != NULL) {
+        char name_path[300], name[UINPUT_MAX_NAME_SIZE] = "";
+        if (strncmp(de->d_name, "event", 5) != 0)
+            continue;
+        snprintf(name_path, sizeof(name_path), "/sys/class/input/%s/device/name", de->d_name);
+        FILE* f = fopen(name_path, "r");
+        if (!f)
+            continue;
+        if (fgets(name, sizeof(name), f))
+            name[strcspn(name, "\n")] = '\0';
+        fclose(f);
+        if (strcmp(name, TOUCH_DEVICE_NAME) == 0) {
+            snprintf(path, size, "/dev/input/%.32s", de->d_name);
+            closedir(d);
+            return 0;
+        }
+    }
+    if (d)
+        closedir(d);
+    return -1;
+}
+
+static int soak(int argc, char** argv)
+{
+    struct replay r = { 1.0, 0, 0, DEFAULT_SOAK_S, NULL, NULL };
+    struct capture c;
+    int p99_limit_us = DEFAULT_P99_US, cpu_limit = DEFAULT_CPU_PCT, daemon = 0, opt;
+    char node[128];
+
+    while ((opt = getopt(argc, argv, "x:r:l:t:L:o:p:c:d")) != -1) {
+        if (opt == 'p')
+            p99_limit_us = atoi(optarg);
+        else if (opt == 'c')
+            cpu_limit = atoi(optarg);
+        else if (opt == 'd')
+            daemon = 1;
+        else if (parse_replay_opt(opt, &r) < 0)
+            return 2;
+    }
+    if (optind != argc - 1 || check_replay(&r) < 0 || p99_limit_us <= 0 || cpu_limit <= 0)
+        return 2;
+    if (load_capture(argv[optind], &c) < 0)
+        return 1;
+    const struct stats_page* p = open_stats(daemon ? STATS_DAEMON_SHM_NAME : STATS_SHM_NAME);
+    if (!p)
+        return 1;
+    catch_signals();
+    int fd = open_output(&c, &r, node, sizeof(node));
+    if (fd < 0)
+        return 1;
+    if (!r.output && wait_for_open(p->pid, node, r.link) < 0) {
+        fprintf(stderr, "cursor_rec: pid %d never opened %s\n", p->pid, node);
+        return 1;
+    }
+
+    static struct soak_snapshot before, after;
+    take_snapshot(p, &before);
+    struct play_stats st;
+    int ret = play(&c, fd, &r, &st);
+    usleep(SETTLE_MS * 1000);
+    take_snapshot(p, &after);
+    print_play(&st);
+
+    int failed = ret < 0;
+    double wall_ns = (double)st.elapsed_ns + SETTLE_MS * 1e6;
+
+    uint64_t events_read = counter_delta(p, &before, &after, "events_read");
+    uint64_t remote = counter_delta(p, &before, &after, "remote_events");
+    fprintf(stdout, "library read %llu event(s), made %llu cursor move(s), %llu touch frame(s)\n",
+            (unsigned long long)(events_read + remote),
+            (unsigned long long)counter_delta(p, &before, &after, "cursor_moves"),
+            (unsigned long long)counter_delta(p, &before, &after, "touch_frames"));
+
+    static const char* const hists[] = { "evdev_to_dequeue", "dequeue_to_move" };
+    int measured = 0;
+    for (size_t i = 0; i < sizeof(hists) / sizeof(hists[0]); i++) {
+        uint64_t n;
+        double p99 = hist_p99_us(p, &before, &after, hists[i], &n);
+        if (p99 < 0)
+            continue;
+        measured = 1;
+        int ok = p99 <= p99_limit_us;
+        failed |= !ok;
+        fprintf(stdout, "%-7s %s p99 %.1f us over %llu sample(s), limit %d us\n", ok ? "ok" : "FAIL", hists[i], p99,
+                (unsigned long long)n, p99_limit_us);
+    }
+    if (!measured) {
+        failed = 1;
+        fprintf(stdout, "FAIL    no latency samples (set LATENCY_STATS=1)\n");
+    }
+
+    double cpu = 100.0 * (double)counter_delta(p, &before, &after, "input_cpu_ns") / wall_ns;
+    failed |= cpu > cpu_limit;
+    fprintf(stdout, "%-7s input thread CPU %.2f%%, limit %d%%\n", cpu > cpu_limit ? "FAIL" : "ok", cpu, cpu_limit);
+
+    uint64_t dropped = counter_delta(p, &before, &after, "touch_dropped");
+    failed |= dropped != 0;
+    fprintf(stdout, "%-7s %llu touch frame(s) dropped\n", dropped ? "FAIL" : "ok", (unsigned long long)dropped);
+
+    char touch_path[64];
+    const char* touch_devs[2] = { NULL, TOUCHSCREEN_DEVICE };
+    if (find_touch_device(touch_path, sizeof(touch_path)) == 0)
+        touch_devs[0] = touch_path;
+    for (int i = 0; i < 2; i++) {
+        int down = touch_devs[i] ? touch_down(touch_devs[i]) : -1;
+        const char* what = i == 0 ? "virtual touch device" : "touchscreen";
+        if (down < 0) {
+            fprintf(stdout, "skip    %s not found\n", what);
+            continue;
+        }
+        failed |= down;
+        fprintf(stdout, "%-7s %s %s: %s\n", down ? "FAIL" : "ok", what, touch_devs[i], down ? "touch stuck down" : "released");
+    }
+
+    fprintf(stdout, "%s\n", failed ? "FAIL" : "PASS");
+    if (r.link && !r.output)
+        unlink(r.link);
+    close(fd);
+    return failed ? 1 : 0;
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr,
+            "usage: %s record [-g] [-s seconds] -o capture.fcev /dev/input/eventN\n"
+            "       %s info capture.fcev\n"
+            "       %s replay [-x speed | -r frames/s] [-l loops | -t seconds] [-L link] [-o output] capture.fcev\n"
+            "       %s soak [-d] [-p p99_us] [-c cpu_pct] [replay options] capture.fcev\n",
+            prog, prog, prog, prog);
+}
+
+int main(int argc, char** argv)
+{
+    int ret = 2;
+
+    if (argc >= 2) {
+        // Subcommand options start after the subcommand
+        if (strcmp(argv[1], "record") == 0)
+            ret = record(argc - 1, argv + 1);
+        else if (strcmp(argv[1], "info") == 0)
+            ret = info(argc - 1, argv + 1);
+        else if (strcmp(argv[1], "replay") == 0)
+            ret = replay(argc - 1, argv + 1);
+        else if (strcmp(argv[1], "soak") == 0)
+            ret = soak(argc - 1, argv + 1);
+    }
+    if (ret == 2)
+        usage(argv[0]);
+    return ret;
+}
@@ -0,0 +1,423 @@
+/**
+ * @file cursor_remote.c
+ * Decription: Drive the cursor from another machine (see remote.h).
+ *
+ * Forwards local evdev devices (a laptop's trackpad and keyboard) to the
+ * cursor library's remote socket, or sends a synthetic pattern to test the
+ * path without hardware. Needs REMOTE=1 (and REMOTE_PORT for TCP) in the
+ * cursor config.
+ *
+ *   cursor_remote -d /dev/input/event5 -d /dev/input/event3   Unix socket on the device
+ *   cursor_remote -t 127.0.0.1:7531 -d /dev/input/event5     through ssh -L 7531:127.0.0.1:7531
+ *   cursor_remote -s 10 [-r 1000] [-b 4]                     circles for 10 s, 1000 frames/s, 4 per packet
+ *   cursor_remote -p                                         clock offset and round trip only
+ *
+ * Forwarded devices are grabbed (-n: not grabbed). Touchpads report
+ * absolute positions; one finger's motion becomes relative motion.
+ *
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "remote.h"
+
+#define MAX_DEVICES 4
+#define SYNC_PINGS 8                    // per clock sync, lowest round trip wins
+#define RESYNC_NS 10000000000ull        // follow clock drift every 10 s
+#define TOUCHPAD_COUNTS_PER_MM 8.0      // touchpad travel -> mouse counts
+
+struct device {
+    int fd;
+    int touching;                       // touchpad: finger down
+    int abs_x, abs_y;                   // last position, -1 = none yet
+    double scale;                       // abs units -> counts
+    double rest_x, rest_y;              // fractions carried to the next frame
+};
+
+static int sock = -1;
+static int synced = 0;
+static int64_t offset_ns = 0;           // server clock - our clock
+static uint64_t best_rtt_ns = 0;
+static uint64_t last_sync_ns = 0;
+static volatile sig_atomic_t stop = 0;
+
+static struct remote_event pending[REMOTE_MAX_EVENTS];
+static int num_pending = 0;
+static unsigned long packets_sent = 0;
+static unsigned long events_sent = 0;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+static int write_all(const void* buf, size_t len)
+{
+    const char* p = buf;
+    while (len > 0) {
+        ssize_t n = send(sock, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static void fill_header(struct remote_header* h, int kind, int count)
+{
+    memset(h, 0, sizeof(*h));
+    h->magic = REMOTE_MAGIC;
+    h->version = REMOTE_VERSION;
+    h->kind = (uint8_t)kind;
+    h->count = (uint16_t)count;
+    h->flags = synced ? REMOTE_SYNCED : 0;
+    h->offset_ns = offset_ns;
+    h->sent_ns = now_ns();
+}
+
+// Everything queued since the last flush, as one packet
+static int flush_events(void)
+{
+    struct {
+        struct remote_header h;
+        struct remote_event ev[REMOTE_MAX_EVENTS];
+    } pkt;
+
+    if (num_pending == 0)
+        return 0;
+    memcpy(pkt.ev, pending, num_pending * sizeof(pending[0]));
+    fill_header(&pkt.h, REMOTE_EVENTS, num_pending);
+    int ret = write_all(&pkt, sizeof(pkt.h) + num_pending * sizeof(pending[0]));
+    packets_sent++;
+    events_sent += num_pending;
+    num_pending = 0;
+    return ret;
+}
+
+static int queue_event(int type, int code, int value)
+{
+    if (num_pending == REMOTE_MAX_EVENTS && flush_events() < 0)
+        return -1;
+    pending[num_pending].type = (uint16_t)type;
+    pending[num_pending].code = (uint16_t)code;
+    pending[num_pending].value = value;
+    num_pending++;
+    return 0;
+}
+
+static int send_ping(void)
+{
+    struct remote_header h;
+    fill_header(&h, REMOTE_PING, 0);
+    return write_all(&h, sizeof(h));
+}
+
+// A PONG: keep the offset from the fastest round trip. Later samples
+// within 1.5x of the best one replace it, so the offset follows drift.
+static int read_pong(void)
+{
+    struct remote_header h;
+    ssize_t n = recv(sock, &h, sizeof(h), MSG_WAITALL);
+    uint64_t t = now_ns();
+
+    if (n != sizeof(h) || h.magic != REMOTE_MAGIC || h.kind != REMOTE_PONG)
+        return -1;
+    uint64_t rtt = t - h.echo_ns;
+    if (!synced || rtt <= best_rtt_ns + best_rtt_ns / 2) {
+        offset_ns = (int64_t)h.sent_ns - (int64_t)(h.echo_ns + rtt / 2);
+        if (!synced || rtt < best_rtt_ns)
+            best_rtt_ns = rtt;
+        synced = 1;
+    }
+    return 0;
+}
+
+static int clock_sync(void)
+{
+    for (int i = 0; i < SYNC_PINGS; i++) {
+        struct pollfd pfd = { sock, POLLIN, 0 };
+        if (send_ping() < 0 || poll(&pfd, 1, 1000) != 1 || read_pong() < 0)
+            return -1;
+    }
+    last_sync_ns = now_ns();
+    return 0;
+}
+
+static int connect_unix(const char* path)
+{
+    struct sockaddr_un addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+static int connect_tcp(const char* host_port)
+{
+    char host[256];
+    const char* port = strrchr(host_port, ':');
+    struct addrinfo hints, *res;
+    int one = 1;
+
+    snprintf(host, sizeof(host), "%.*s", port ? (int)(port - host_port) : (int)strlen(host_port), host_port);
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    char port_buf[8];
+    snprintf(port_buf, sizeof(port_buf), "%d", port ? atoi(port + 1) : REMOTE_DEFAULT_PORT);
+    if (getaddrinfo(host, port_buf, &hints, &res) != 0)
+        return -1;
+
+    int fd = -1;
+    for (struct addrinfo* ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+            break;
+        if (fd >= 0)
+            close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd >= 0)
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static int open_device(struct device* d, const char* path, int grab)
+{
+    struct input_absinfo abs;
+
+    memset(d, 0, sizeof(*d));
+    d->abs_x = d->abs_y = -1;
+    d->fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (d->fd < 0)
+        return -1;
+    if (grab && ioctl(d->fd, EVIOCGRAB, 1) < 0)
+        fprintf(stderr, "cursor_remote: could not grab %s, it also drives this machine\n", path);
+    // Touchpad: scale by its resolution (units per mm) when it reports one
+    d->scale = 0.25;
+    if (ioctl(d->fd, EVIOCGABS(ABS_X), &abs) == 0 && abs.resolution > 0)
+        d->scale = TOUCHPAD_COUNTS_PER_MM / abs.resolution;
+    return 0;
+}
+
+// Keep what the cursor library understands: relative motion, the wheel,
+// mouse buttons and keyboard keys. Touchpad positions become motion.
+static int forward(struct device* d, const struct input_event* ev)
+{
+    switch (ev->type) {
+    case EV_REL:
+        if (ev->code == REL_X || ev->code == REL_Y || ev->code == REL_WHEEL)
+            return queue_event(EV_REL, ev->code, ev->value);
+        return 0;
+    case EV_KEY:
+        if (ev->code == BTN_TOUCH) {
+            d->touching = ev->value != 0;
+            d->abs_x = d->abs_y = -1;
+            return 0;
+        }
+        if (ev->code < BTN_MISC || (ev->code >= BTN_LEFT && ev->code <= BTN_TASK))
+            return queue_event(EV_KEY, ev->code, ev->value);
+        return 0;
+    case EV_ABS: {
+        int* last = ev->code == ABS_X ? &d->abs_x : ev->code == ABS_Y ? &d->abs_y : NULL;
+        if (!last)
+            return 0;
+        int prev = *last;
+        *last = ev->value;
+        if (!d->touching || prev < 0)
+            return 0;
+        double* rest = ev->code == ABS_X ? &d->rest_x : &d->rest_y;
+        double delta = (ev->value - prev) * d->scale + *rest;
+        int counts = (int)delta;
+        *rest = delta - counts;
+        return counts ? queue_event(EV_REL, ev->code == ABS_X ? REL_X : REL_Y, counts) : 0;
+    }
+    case EV_SYN:
+        if (ev->code == SYN_REPORT && num_pending > 0 && pending[num_pending - 1].type != EV_SYN)
+            return queue_event(EV_SYN, SYN_REPORT, 0);
+        return 0;
+    }
+    return 0;
+}
+
+// Forward until interrupted; each wakeup's frames go out as one packet
+static int run_devices(struct device* devs, int num_devs)
+{
+    struct pollfd pfd[MAX_DEVICES + 1];
+
+    for (int i = 0; i < num_devs; i++) {
+        pfd[i].fd = devs[i].fd;
+        pfd[i].events = POLLIN;
+    }
+    pfd[num_devs].fd = sock;
+    pfd[num_devs].events = POLLIN;
+
+    while (!stop) {
+        if (poll(pfd, num_devs + 1, 1000) < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (pfd[num_devs].revents & (POLLIN | POLLHUP | POLLERR)) {
+            if (read_pong() < 0)
+                return -1;
+        }
+        for (int i = 0; i < num_devs; i++) {
+            if (!(pfd[i].revents & POLLIN))
+                continue;
+            struct input_event evs[64];
+            ssize_t n;
+            while ((n = read(devs[i].fd, evs, sizeof(evs))) > 0) {
+                for (size_t k = 0; k < (size_t)n / sizeof(evs[0]); k++) {
+                    if (forward(&devs[i], &evs[k]) < 0)
+                        return -1;
+                }
+            }
+        }
+        if (flush_events() < 0)
+            return -1;
+        if (now_ns() - last_sync_ns > RESYNC_NS) {
+            if (send_ping() < 0)
+                return -1;
+            last_sync_ns = now_ns();
+        }
+    }
+    return 0;
+}
+
+// Circles for a loopback test: rate frames per second, batch frames per packet
+static int run_synthetic(int seconds, int rate, int batch)
+{
+    uint64_t period = 1000000000ull / (uint64_t)rate;
+    uint64_t next = now_ns();
+    int frames = seconds * rate;
+    double phase = 0.0;
+
+    for (int f = 0; f < frames && !stop; f++) {
+        phase += 2.0 * M_PI / rate;   // one turn per second
+        int dx = (int)lround(8.0 * cos(phase));
+        int dy = (int)lround(8.0 * sin(phase));
+        if (queue_event(EV_REL, REL_X, dx) < 0 || queue_event(EV_REL, REL_Y, dy) < 0
+            || queue_event(EV_SYN, SYN_REPORT, 0) < 0)
+            return -1;
+        if ((f + 1) % batch == 0 && flush_events() < 0)
+            return -1;
+
+        next += period;
+        struct timespec ts = { (time_t)(next / 1000000000ull), (long)(next % 1000000000ull) };
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    }
+    return flush_events();
+}
+
+static void usage(const char* prog)
+{
+    fprintf(stderr,
+            "usage: %s [-u socket | -t host:port] [-n] -d /dev/input/eventN [-d ...]\n"
+            "       %s [-u socket | -t host:port] -s seconds [-r frames/s] [-b frames/packet]\n"
+            "       %s [-u socket | -t host:port] -p\n",
+            prog, prog, prog);
+}
+
+int main(int argc, char** argv)
+{
+    const char* unix_path = REMOTE_SOCKET_PATH;
+    const char* tcp = NULL;
+    const char* dev_paths[MAX_DEVICES];
+    int num_devs = 0, grab = 1, seconds = 0, rate = 1000, batch = 1, ping_only = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "u:t:d:ns:r:b:ph")) != -1) {
+        switch (opt) {
+        case 'u': unix_path = optarg; break;
+        case 't': tcp = optarg; break;
+        case 'd':
+            if (num_devs < MAX_DEVICES)
+                dev_paths[num_devs++] = optarg;
+            break;
+        case 'n': grab = 0; break;
+        case 's': seconds = atoi(optarg); break;
+        case 'r': rate = atoi(optarg); break;
+        case 'b': batch = atoi(optarg); break;
+        case 'p': ping_only = 1; break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if ((num_devs == 0 && seconds <= 0 && !ping_only) || rate < 1 || rate > 10000 || batch < 1
+        || batch * 3 > REMOTE_MAX_EVENTS) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    struct device devs[MAX_DEVICES];
+    for (int i = 0; i < num_devs; i++) {
+        if (open_device(&devs[i], dev_paths[i], grab) < 0) {
+            fprintf(stderr, "cursor_remote: %s: %s\n", dev_paths[i], strerror(errno));
+            return 1;
+        }
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    sock = tcp ? connect_tcp(tcp) : connect_unix(unix_path);
+    if (sock < 0) {
+        fprintf(stderr, "cursor_remote: cannot connect to %s (is REMOTE=1 set?)\n", tcp ? tcp : unix_path);
+        return 1;
+    }
+    if (clock_sync() < 0) {
+        fprintf(stderr, "cursor_remote: no answer to clock sync pings\n");
+        return 1;
+    }
+    fprintf(stdout, "clock offset %+.3f ms, round trip %.1f us\n", offset_ns / 1e6, best_rtt_ns / 1e3);
+    fflush(stdout);
+    if (ping_only)
+        return 0;
+
+    int ret = num_devs ? run_devices(devs, num_devs) : run_synthetic(seconds, rate, batch);
+    if (ret < 0 && !stop)
+        fprintf(stderr, "cursor_remote: connection lost\n");
+    fprintf(stdout, "%lu packet(s), %lu event(s) sent; see remote_to_dequeue in cursor_stats\n",
+            packets_sent, events_sent);
+    close(sock);
+    return ret < 0 && !stop ? 1 : 0;
+}
@@ -0,0 +1,208 @@
+/**
+ * @file cursor_stats.c
+ * Decription: Print the cursor library's live counters over SSH.
+ *
+ * Reads /dev/shm/force_cursor_stats (see stats.h) without touching the MPC
+ * process. Prints totals and per-second rates every interval, or a single
+ * name=value snapshot with -1 for scripts. Latency histograms are shown as
+ * p50/p99 over the interval and the all-time max.
+ *
+ *   cursor_stats            refresh every second until Ctrl-C
+ *   cursor_stats -i 5       refresh every 5 seconds
+ *   cursor_stats -1         one snapshot, name=value per line
+ *   cursor_stats -d         cursord's counters (FORCE_CURSOR_DAEMON=1)
+ *
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+static uint32_t num_hists = 0;  // histograms the page holds, 0 on a version 1 page
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// A page from another build may be smaller (older) or larger (newer) than
+// ours: map what the file holds, up to our layout, and show the fields that
+// fit. Counters are always there; histograms came with version 2.
+static const struct stats_page* open_page(const char* name)
+{
+    const size_t min_size = offsetof(struct stats_page, num_hists);
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        fprintf(stderr, "cursor_stats: /dev/shm%s not found (is the cursor library loaded?)\n", name);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < min_size) {
+        fprintf(stderr, "cursor_stats: /dev/shm%s is too small for a stats page\n", name);
+        close(fd);
+        return NULL;
+    }
+    size_t map_size = (size_t)st.st_size < sizeof(struct stats_page) ? (size_t)st.st_size : sizeof(struct stats_page);
+    void* ptr = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        fprintf(stderr, "cursor_stats: mmap failed: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    const struct stats_page* p = ptr;
+    if (__atomic_load_n(&p->magic, __ATOMIC_ACQUIRE) != STATS_MAGIC || p->size < min_size ||
+        p->size > (uint64_t)st.st_size || p->num_counters > STATS_MAX_COUNTERS) {
+        fprintf(stderr, "cursor_stats: unrecognised stats page (version %u)\n", p->version);
+        return NULL;
+    }
+    if (p->size >= sizeof(*p) && p->num_hists <= STATS_MAX_HISTS)
+        num_hists = p->num_hists;
+    if (p->version != STATS_VERSION) {
+        fprintf(stderr, "cursor_stats: page version %u, built for %u; counters are matched by name%s\n",
+                p->version, STATS_VERSION, num_hists ? "" : ", no latency histograms");
+    }
+    return p;
+}
+
+static void snapshot(const struct stats_page* p, uint64_t* out)
+{
+    for (uint32_t i = 0; i < p->num_counters; i++)
+        out[i] = __atomic_load_n(&p->counter[i], __ATOMIC_RELAXED);
+}
+
+static void snapshot_hists(const struct stats_page* p, struct stats_hist* out)
+{
+    for (uint32_t i = 0; i < num_hists; i++) {
+        const struct stats_hist* h = &p->hist[i];
+        out[i].max_ns = __atomic_load_n(&h->max_ns, __ATOMIC_RELAXED);
+        out[i].sum_ns = __atomic_load_n(&h->sum_ns, __ATOMIC_RELAXED);
+        // Count from the buckets so percentiles never see a torn total
+        out[i].count = 0;
+        for (int b = 0; b < STATS_HIST_BUCKETS; b++) {
+            out[i].bucket[b] = __atomic_load_n(&h->bucket[b], __ATOMIC_RELAXED);
+            out[i].count += out[i].bucket[b];
+        }
+    }
+}
+
+// p50/p99 of what was recorded between two snapshots
+static void print_hist(const char* name, const struct stats_hist* prev, const struct stats_hist* cur)
+{
+    uint64_t delta[STATS_HIST_BUCKETS];
+    for (int b = 0; b < STATS_HIST_BUCKETS; b++)
+        delta[b] = cur->bucket[b] - prev->bucket[b];
+    uint64_t n = cur->count - prev->count;
+
+    fprintf(stdout, "%-24.*s %10llu %10.1f %10.1f %10.1f\n", STATS_NAME_LEN, name, (unsigned long long)n,
+            stats_hist_percentile(delta, n, cur->max_ns, 50.0) / 1000.0,
+            stats_hist_percentile(delta, n, cur->max_ns, 99.0) / 1000.0,
+            cur->max_ns / 1000.0);
+}
+
+static void print_header(const struct stats_page* p)
+{
+    uint64_t now = now_ns();
+    uint64_t update = __atomic_load_n(&p->update_ns, __ATOMIC_RELAXED);
+    int alive = kill(p->pid, 0) == 0 || errno == EPERM;
+
+    fprintf(stdout, "pid %d%s, up %llus, ", p->pid, alive ? "" : " (gone)",
+            (unsigned long long)((now - p->start_ns) / 1000000000ull));
+    if (update)
+        fprintf(stdout, "refreshed %.1fs ago\n", (double)(now - update) / 1e9);
+    else
+        fprintf(stdout, "not refreshed yet\n");
+}
+
+int main(int argc, char** argv)
+{
+    int interval = 1;
+    int once = 0;
+    const char* name = STATS_SHM_NAME;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "1di:h")) != -1) {
+        if (opt == '1') {
+            once = 1;
+        } else if (opt == 'd') {
+            name = STATS_DAEMON_SHM_NAME;
+        } else if (opt == 'i') {
+            interval = atoi(optarg);
+            if (interval < 1)
+                interval = 1;
+        } else {
+            fprintf(stderr, "usage: %s [-1] [-d] [-i seconds]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    const struct stats_page* p = open_page(name);
+    if (!p)
+        return 1;
+
+    uint64_t prev[STATS_MAX_COUNTERS], cur[STATS_MAX_COUNTERS];
+    static struct stats_hist prev_hist[STATS_MAX_HISTS], cur_hist[STATS_MAX_HISTS];
+    snapshot(p, prev);
+    snapshot_hists(p, prev_hist);
+
+    if (once) {
+        for (uint32_t i = 0; i < p->num_counters; i++)
+            fprintf(stdout, "%.*s=%llu\n", STATS_NAME_LEN, p->name[i], (unsigned long long)prev[i]);
+        for (uint32_t i = 0; i < num_hists; i++) {
+            const struct stats_hist* h = &prev_hist[i];
+            fprintf(stdout, "%.*s_count=%llu\n", STATS_NAME_LEN, p->hist_name[i], (unsigned long long)h->count);
+            fprintf(stdout, "%.*s_p50_ns=%llu\n", STATS_NAME_LEN, p->hist_name[i],
+                    (unsigned long long)stats_hist_percentile(h->bucket, h->count, h->max_ns, 50.0));
+            fprintf(stdout, "%.*s_p99_ns=%llu\n", STATS_NAME_LEN, p->hist_name[i],
+                    (unsigned long long)stats_hist_percentile(h->bucket, h->count, h->max_ns, 99.0));
+            fprintf(stdout, "%.*s_max_ns=%llu\n", STATS_NAME_LEN, p->hist_name[i], (unsigned long long)h->max_ns);
+        }
+        return 0;
+    }
+
+    uint64_t prev_ns = now_ns();
+    for (;;) {
+        sleep((unsigned int)interval);
+        snapshot(p, cur);
+        snapshot_hists(p, cur_hist);
+        uint64_t t = now_ns();
+        double secs = (double)(t - prev_ns) / 1e9;
+
+        print_header(p);
+        fprintf(stdout, "%-24s %16s %12s\n", "counter", "total", "per second");
+        for (uint32_t i = 0; i < p->num_counters; i++) {
+            double rate = (double)(cur[i] - prev[i]) / secs;
+            if (strncmp(p->name[i], "input_cpu_ns", STATS_NAME_LEN) == 0) {
+                // CPU time reads better as a share of one core
+                fprintf(stdout, "%-24.*s %16llu %11.2f%%\n", STATS_NAME_LEN, p->name[i],
+                        (unsigned long long)cur[i], rate / 1e7);
+            } else {
+                fprintf(stdout, "%-24.*s %16llu %12.1f\n", STATS_NAME_LEN, p->name[i],
+                        (unsigned long long)cur[i], rate);
+            }
+        }
+        if (num_hists) {
+            fprintf(stdout, "\n%-24s %10s %10s %10s %10s\n", "latency (us)", "samples", "p50", "p99", "max");
+            for (uint32_t i = 0; i < num_hists; i++)
+                print_hist(p->hist_name[i], &prev_hist[i], &cur_hist[i]);
+        }
+        fprintf(stdout, "\n");
+        fflush(stdout);
+
+        memcpy(prev, cur, sizeof(prev));
+        memcpy(prev_hist, cur_hist, sizeof(prev_hist));
+        prev_ns = t;
+    }
+}
@@ -0,0 +1,115 @@
+/**
+ * @file cursord.c
+ * Decription: Cursor daemon: runs the engine outside the MPC process.
+ *
+ * Same config, devices, injection, gestures, MIDI and control socket as the
+ * in-process engine (force_cursor.c is linked in), under its own systemd
+ * unit and scheduling, so a bug or CPU spike here cannot take MPC with it.
+ * Cursor moves go to the mailbox (see mailbox.h); MPC's shim, started with
+ * FORCE_CURSOR_DAEMON=1, moves the hardware cursor.
+ *
+ * "cursor_ctl reload" ends the daemon and systemd starts the installed
+ * binary again. SIGTERM hides the cursor and exits.
+ *
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "engine.h"
+#include "mailbox.h"
+#include "log.h"
+#include "stats.h"
+
+const struct engine_ops* force_cursor_engine(void);
+
+static const struct engine_ops* ops;
+static struct mailbox* mailbox;
+static struct engine_persist persist_private = {
+    .cursor_x = ENGINE_DEFAULT_X,
+    .cursor_y = ENGINE_DEFAULT_Y,
+};
+
+static struct engine_state state = {
+    .drm_fd = ENGINE_DRM_REMOTE,
+    .persist = &persist_private,
+    .mouse_fd = -1,
+    .uinput_fd = -1,
+    .touchscreen_fd = -1,
+    .keyboard_fd = -1,
+    .generation = 1,
+};
+
+// engine_state.move_cursor: the shim in MPC does the drmModeMoveCursor
+static int post_cursor(int fd, uint32_t crtc, int x, int y)
+{
+    (void)fd;
+    (void)crtc;
+    mailbox_post(mailbox, x, y, MAILBOX_SHAPE_ARROW);
+    return 0;
+}
+
+static void on_stop_signal(int sig)
+{
+    (void)sig;
+    state.stop = 1;
+    ops->wake();
+}
+
+int main(void)
+{
+    ops = force_cursor_engine();
+    mailbox = mailbox_map(MAILBOX_SHM_NAME);
+    if (!mailbox) {
+        fprintf(stderr, "cursord: could not map /dev/shm%s: %s\n", MAILBOX_SHM_NAME, strerror(errno));
+        return 1;
+    }
+    struct engine_persist* p = persist_map();
+    if (p)
+        state.persist = p;
+    state.move_cursor = post_cursor;
+    __atomic_store_n(&mailbox->writer_pid, (int32_t)getpid(), __ATOMIC_RELAXED);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+
+    if (ops->init(&state) < 0) {
+        fprintf(stderr, "cursord: no usable config, see the [CONFIG] lines above\n");
+        return 1;
+    }
+    if (log_start() < 0) {
+        fprintf(stdout, "[INIT] FAILED: Could not start the log thread\n");
+        fflush(stdout);
+    }
+    if (stats_publish(STATS_DAEMON_SHM_NAME) < 0) {
+        fprintf(stdout, "[INIT] FAILED: Could not publish /dev/shm%s (errno=%d)\n", STATS_DAEMON_SHM_NAME, errno);
+        fflush(stdout);
+    }
+
+    // Show the cursor where it was left; the engine posts from here on
+    mailbox_post(mailbox, state.persist->cursor_x, state.persist->cursor_y, MAILBOX_SHAPE_ARROW);
+    fprintf(stdout, "[DAEMON] cursord %d running, engine built %s\n", getpid(), ops->build);
+    fflush(stdout);
+
+    int ret = ops->run(&state);
+
+    if (ret == ENGINE_EXIT_RELOAD) {
+        // The engine is linked in: a restart is the reload. The devices
+        // close with the process; the cursor stays up meanwhile.
+        fprintf(stdout, "[DAEMON] Reload requested, exiting for systemd to restart cursord\n");
+    } else {
+        mailbox_post(mailbox, state.persist->cursor_x, state.persist->cursor_y, MAILBOX_SHAPE_HIDDEN);
+        fprintf(stdout, "[DAEMON] Stopped\n");
+    }
+    fflush(stdout);
+    stats_unpublish();
+    log_stop();
+    return 0;
+}
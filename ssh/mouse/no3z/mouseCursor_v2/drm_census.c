@@ -0,0 +1,187 @@
+/**
+ * @file drm_census.c
+ * Decription: drmIoctl hook and census report (see drm_census.h).
+ *
+ */
+#define _GNU_SOURCE
+#include "drm_census.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+int drm_census_enabled = 0;
+
+// DRM ioctl numbers (the low byte of the request) from drm.h. 0x40-0x9f
+// belong to the GPU driver.
+static const char* const ioctl_names[256] = {
+    [0x00] = "VERSION",
+    [0x09] = "GEM_CLOSE",
+    [0x0a] = "GEM_FLINK",
+    [0x0b] = "GEM_OPEN",
+    [0x0c] = "GET_CAP",
+    [0x0d] = "SET_CLIENT_CAP",
+    [0x1e] = "SET_MASTER",
+    [0x1f] = "DROP_MASTER",
+    [0x2d] = "PRIME_HANDLE_TO_FD",
+    [0x2e] = "PRIME_FD_TO_HANDLE",
+    [0x3a] = "WAIT_VBLANK",
+    [0x3b] = "CRTC_GET_SEQUENCE",
+    [0x3c] = "CRTC_QUEUE_SEQUENCE",
+    [0xa0] = "MODE_GETRESOURCES",
+    [0xa1] = "MODE_GETCRTC",
+    [0xa2] = "MODE_SETCRTC",
+    [0xa3] = "MODE_CURSOR",
+    [0xa4] = "MODE_GETGAMMA",
+    [0xa5] = "MODE_SETGAMMA",
+    [0xa6] = "MODE_GETENCODER",
+    [0xa7] = "MODE_GETCONNECTOR",
+    [0xaa] = "MODE_GETPROPERTY",
+    [0xab] = "MODE_SETPROPERTY",
+    [0xac] = "MODE_GETPROPBLOB",
+    [0xad] = "MODE_GETFB",
+    [0xae] = "MODE_ADDFB",
+    [0xaf] = "MODE_RMFB",
+    [0xb0] = "MODE_PAGE_FLIP",
+    [0xb1] = "MODE_DIRTYFB",
+    [0xb2] = "MODE_CREATE_DUMB",
+    [0xb3] = "MODE_MAP_DUMB",
+    [0xb4] = "MODE_DESTROY_DUMB",
+    [0xb5] = "MODE_GETPLANERESOURCES",
+    [0xb6] = "MODE_GETPLANE",
+    [0xb7] = "MODE_SETPLANE",
+    [0xb8] = "MODE_ADDFB2",
+    [0xb9] = "MODE_OBJ_GETPROPERTIES",
+    [0xba] = "MODE_OBJ_SETPROPERTY",
+    [0xbb] = "MODE_CURSOR2",
+    [0xbc] = "MODE_ATOMIC",
+    [0xbd] = "MODE_CREATEPROPBLOB",
+    [0xbe] = "MODE_DESTROYPROPBLOB",
+    [0xce] = "MODE_GETFB2",
+};
+
+// One entry per ioctl number. Any thread may call drmIoctl, so every field
+// is updated with atomic adds; an ioctl costs microseconds, these nanoseconds.
+struct census_entry {
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+    uint64_t overlapped;            // started while another thread was in an ioctl
+    uint64_t per_thread[DRM_CENSUS_THREADS];
+    uint64_t bucket[STATS_HIST_BUCKETS];
+};
+
+static struct census_entry entries[256];
+static int in_flight = 0;
+
+static char thread_names[DRM_CENSUS_THREADS][16];
+static int num_threads = 0;
+static __thread int my_thread = -1;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int thread_slot(void)
+{
+    if (my_thread >= 0)
+        return my_thread;
+    int slot = __atomic_fetch_add(&num_threads, 1, __ATOMIC_RELAXED);
+    if (slot >= DRM_CENSUS_THREADS - 1) {
+        slot = DRM_CENSUS_THREADS - 1;
+        snprintf(thread_names[slot], sizeof(thread_names[slot]), "(others)");
+    } else if (pthread_getname_np(pthread_self(), thread_names[slot], sizeof(thread_names[slot])) != 0) {
+        snprintf(thread_names[slot], sizeof(thread_names[slot]), "thread %d", slot);
+    }
+    my_thread = slot;
+    return slot;
+}
+
+static void record(unsigned long request, uint64_t ns, int overlapped)
+{
+    struct census_entry* e = &entries[request & 0xff];
+    __atomic_fetch_add(&e->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&e->sum_ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&e->per_thread[thread_slot()], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&e->bucket[stats_hist_bucket(ns)], 1, __ATOMIC_RELAXED);
+    if (overlapped)
+        __atomic_fetch_add(&e->overlapped, 1, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&e->max_ns, __ATOMIC_RELAXED);
+    while (ns > max && !__atomic_compare_exchange_n(&e->max_ns, &max, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+// Hook drmIoctl: everything libdrm sends to the kernel passes through here
+int drmIoctl(int fd, unsigned long request, void* arg)
+{
+    static int (*real_drmIoctl)(int, unsigned long, void*) = NULL;
+
+    if (!real_drmIoctl) {
+        real_drmIoctl = dlsym(RTLD_NEXT, "drmIoctl");
+        if (!real_drmIoctl)
+            return -ENOSYS;
+    }
+    if (!drm_census_enabled)
+        return real_drmIoctl(fd, request, arg);
+
+    int overlapped = __atomic_fetch_add(&in_flight, 1, __ATOMIC_RELAXED) > 0;
+    uint64_t t0 = now_ns();
+    int ret = real_drmIoctl(fd, request, arg);
+    uint64_t ns = now_ns() - t0;
+    __atomic_fetch_sub(&in_flight, 1, __ATOMIC_RELAXED);
+
+    record(request, ns, overlapped);
+    return ret;
+}
+
+int drm_census_dump(const char* path)
+{
+    FILE* fp = fopen(path ? path : DRM_CENSUS_PATH, "w");
+    if (!fp)
+        return -1;
+
+    int threads = __atomic_load_n(&num_threads, __ATOMIC_RELAXED);
+    if (threads > DRM_CENSUS_THREADS)
+        threads = DRM_CENSUS_THREADS;
+
+    fprintf(fp, "%-24s %10s %9s %9s %9s %9s %8s", "ioctl", "calls", "mean_us", "p50_us", "p99_us", "max_us", "overlap");
+    for (int t = 0; t < threads; t++)
+        fprintf(fp, " %15s", thread_names[t]);
+    fprintf(fp, "\n");
+
+    int listed = 0;
+    for (int nr = 0; nr < 256; nr++) {
+        struct census_entry snap;
+        memcpy(&snap, &entries[nr], sizeof(snap));  // racy but only read for a report
+        if (snap.count == 0)
+            continue;
+
+        char name[24];
+        if (ioctl_names[nr])
+            snprintf(name, sizeof(name), "%s", ioctl_names[nr]);
+        else if (nr >= 0x40 && nr < 0xa0)
+            snprintf(name, sizeof(name), "DRIVER_0x%02x", nr);
+        else
+            snprintf(name, sizeof(name), "0x%02x", nr);
+
+        fprintf(fp, "%-24s %10llu %9.1f %9.1f %9.1f %9.1f %8llu", name, (unsigned long long)snap.count,
+                snap.sum_ns / 1e3 / snap.count,
+                stats_hist_percentile(snap.bucket, snap.count, snap.max_ns, 50.0) / 1e3,
+                stats_hist_percentile(snap.bucket, snap.count, snap.max_ns, 99.0) / 1e3,
+                snap.max_ns / 1e3, (unsigned long long)snap.overlapped);
+        for (int t = 0; t < threads; t++)
+            fprintf(fp, " %15llu", (unsigned long long)snap.per_thread[t]);
+        fprintf(fp, "\n");
+        listed++;
+    }
+    fclose(fp);
+    return listed;
+}
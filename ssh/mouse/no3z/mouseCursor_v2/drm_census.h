@@ -0,0 +1,23 @@
+/**
+ * @file drm_census.h
+ * Decription: Per-ioctl latency census of libdrm (profiling mode, DRM_CENSUS=1).
+ *
+ * libdrm funnels every mode-setting and buffer call through drmIoctl(), so
+ * one hook there sees all of them: MPC's and ours (cursor moves, UI probe
+ * mappings). Per ioctl it counts calls, calls per thread, calls that
+ * started while another thread was inside a DRM ioctl, and keeps a latency
+ * histogram. The report is written on demand (cursor_ctl dump).
+ *
+ */
+#ifndef DRM_CENSUS_H
+#define DRM_CENSUS_H
+
+#define DRM_CENSUS_THREADS 8        // last slot collects any further threads
+#define DRM_CENSUS_PATH "/tmp/force_cursor_drm_census.txt"
+
+extern int drm_census_enabled;      // DRM_CENSUS=
+
+// Write the report; returns the number of ioctls listed, -1 on error
+int drm_census_dump(const char* path);
+
+#endif // DRM_CENSUS_H
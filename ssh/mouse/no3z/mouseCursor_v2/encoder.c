@@ -0,0 +1,172 @@
+/**
+ * @file encoder.c
+ * Decription: Mouse-as-encoder mode (see encoder.h).
+ *
+ */
+#include "encoder.h"
+
+#include <stdint.h>
+
+#include "ev_loop.h"
+#include "log.h"
+#include "trace.h"
+#include "midi_out.h"
+
+struct encoder_config encoder_config = {
+    .rate_hz = ENCODER_DEFAULT_RATE,
+    .sensitivity = ENCODER_DEFAULT_SENSITIVITY,
+    .wheel_step = ENCODER_DEFAULT_WHEEL_STEP,
+    .select_tap = 1,
+    .channel = 0,
+};
+
+static int active = 0;
+static int enc_mode = ENCODER_MODE_CC_RELATIVE;
+static int enc_param = 0;
+static float accum = 0.0f;           // steps not sent yet (keeps the fraction)
+static uint64_t next_send_ns = 0;    // earliest time the next message may go out
+static int timer_fd = -1;
+static int timer_armed = 0;
+
+// Last absolute NRPN value per parameter we have driven (starts centred)
+#define ENCODER_NRPN_SLOTS 64
+static struct {
+    int param;
+    int value;
+    int last_sent;
+} nrpn_values[ENCODER_NRPN_SLOTS];
+static int num_nrpn_values = 0;
+static int cur_nrpn = -1;
+
+static uint64_t send_interval_ns(void)
+{
+    int rate = encoder_config.rate_hz > 0 ? encoder_config.rate_hz : ENCODER_DEFAULT_RATE;
+    return 1000000000ull / (uint64_t)rate;
+}
+
+static int find_nrpn_slot(int param)
+{
+    for (int i = 0; i < num_nrpn_values; i++) {
+        if (nrpn_values[i].param == param)
+            return i;
+    }
+    int i = num_nrpn_values < ENCODER_NRPN_SLOTS ? num_nrpn_values++ : ENCODER_NRPN_SLOTS - 1;
+    nrpn_values[i].param = param;
+    nrpn_values[i].value = (ENCODER_NRPN_MAX + 1) / 2;
+    nrpn_values[i].last_sent = -1;
+    return i;
+}
+
+// Send whatever has accumulated. Returns 1 if a remainder is still pending.
+static int flush(uint64_t now)
+{
+    int steps = (int)accum;  // truncate towards zero, keep the fraction
+    if (steps == 0)
+        return 0;
+
+    if (enc_mode == ENCODER_MODE_CC_RELATIVE) {
+        // Binary offset relative CC: one message carries at most +/-63
+        if (steps > 63)
+            steps = 63;
+        if (steps < -63)
+            steps = -63;
+        accum -= (float)steps;
+        midi_out_cc(encoder_config.channel, enc_param, 64 + steps);
+    } else {
+        accum -= (float)steps;
+        int value = nrpn_values[cur_nrpn].value + steps;
+        if (value < 0)
+            value = 0;
+        if (value > ENCODER_NRPN_MAX)
+            value = ENCODER_NRPN_MAX;
+        nrpn_values[cur_nrpn].value = value;
+        // Collapse redundant values (e.g. pushing against an end stop)
+        if (value != nrpn_values[cur_nrpn].last_sent) {
+            midi_out_nrpn(encoder_config.channel, enc_param, value);
+            nrpn_values[cur_nrpn].last_sent = value;
+        }
+    }
+
+    next_send_ns = now + send_interval_ns();
+    trace_mark("encoder_send", (uint32_t)(steps < 0 ? -steps : steps));
+    return (int)accum != 0;
+}
+
+// Send now if the rate limit allows, otherwise make sure the timer will
+static void schedule(void)
+{
+    uint64_t now = ev_now_ns();
+
+    if (now >= next_send_ns && !flush(now))
+        return;
+    if (!timer_armed && timer_fd >= 0) {
+        ev_timer_arm_at(timer_fd, next_send_ns);
+        timer_armed = 1;
+    }
+}
+
+static void on_timer(void* ctx, uint32_t events)
+{
+    (void)ctx;
+    (void)events;
+    timer_armed = 0;
+    if (active || (int)accum != 0)
+        schedule();
+}
+
+int encoder_init(void)
+{
+    timer_fd = ev_timer_create(on_timer, NULL);
+    return timer_fd < 0 ? -1 : 0;
+}
+
+void encoder_close(void)
+{
+    ev_timer_destroy(timer_fd);
+    timer_fd = -1;
+    timer_armed = 0;
+    active = 0;
+}
+
+void encoder_begin(int mode, int param)
+{
+    // Finish the previous target before switching
+    if ((int)accum != 0)
+        flush(ev_now_ns());
+
+    active = 1;
+    enc_mode = mode;
+    enc_param = param;
+    accum = 0.0f;
+    if (mode == ENCODER_MODE_NRPN)
+        cur_nrpn = find_nrpn_slot(param);
+
+    LOGI("[ENCODER] %s %d active", mode == ENCODER_MODE_NRPN ? "NRPN" : "CC", param);
+}
+
+void encoder_end(void)
+{
+    if (!active)
+        return;
+    active = 0;
+    // Whatever is left goes out on the rate limit timer, never dropped
+    schedule();
+}
+
+int encoder_active(void)
+{
+    return active;
+}
+
+void encoder_motion(int dx, int dy)
+{
+    // Right or forward increases, like turning a knob clockwise
+    accum += (float)(dx - dy) * encoder_config.sensitivity;
+    schedule();
+}
+
+void encoder_wheel(int notches)
+{
+    accum += (float)(notches * encoder_config.wheel_step);
+    schedule();
+}
@@ -0,0 +1,44 @@
+/**
+ * @file encoder.h
+ * Decription: Mouse-as-encoder mode for the Force cursor.
+ *
+ * While an ENCODER_CC_n / ENCODER_NRPN_n button is held, mouse motion and the
+ * wheel stop moving the cursor and instead drive a MIDI encoder: relative CC
+ * (binary offset, 64 = no change) or an absolute 14-bit NRPN value. Deltas are
+ * accumulated and sent at most ENCODER_RATE times per second, and flushes
+ * that would not change anything are skipped.
+ *
+ */
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#define ENCODER_MODE_CC_RELATIVE 0
+#define ENCODER_MODE_NRPN 1
+
+#define ENCODER_DEFAULT_RATE 100      // messages per second ceiling
+#define ENCODER_DEFAULT_SENSITIVITY 0.25f
+#define ENCODER_DEFAULT_WHEEL_STEP 8
+#define ENCODER_NRPN_MAX 16383
+
+struct encoder_config {
+    int rate_hz;          // ENCODER_RATE=
+    float sensitivity;    // ENCODER_SENSITIVITY= (steps per mouse count)
+    int wheel_step;       // ENCODER_WHEEL_STEP= (steps per wheel notch)
+    int select_tap;       // ENCODER_TAP= touch the knob under the cursor first
+    int channel;          // MIDI channel (0-15)
+};
+
+extern struct encoder_config encoder_config;
+
+// Needs the event loop (for the rate limit timer)
+int encoder_init(void);
+void encoder_close(void);
+
+void encoder_begin(int mode, int param);
+void encoder_end(void);
+int encoder_active(void);
+
+void encoder_motion(int dx, int dy);
+void encoder_wheel(int notches);
+
+#endif // ENCODER_H
@@ -0,0 +1,84 @@
+/**
+ * @file engine.h
+ * Decription: Interface between the preloaded shim and the reloadable engine.
+ *
+ * libforce_cursor.so (shim.c) is what MPC preloads. It owns the libdrm and
+ * ALSA hooks, the profilers behind them, the log thread and the stats page:
+ * code that rarely changes. The config, input loop, injection, gestures, MIDI
+ * and control socket live in libforce_cursor_engine.so (force_cursor.c),
+ * which the shim dlopens and can replace while MPC keeps running.
+ *
+ * A reload is asked for with "cursor_ctl reload". The engine waits until no
+ * press, drag, encoder turn or macro is in progress, tears down everything
+ * it owns except the devices in struct engine_state, and returns from run().
+ * The shim then loads and starts the new engine, which picks the devices up.
+ *
+ * The engine calls the shim's log/stats/trace/... functions directly: the
+ * shim is in the global symbol scope, so they resolve when it is dlopened.
+ * cursord (cursord.c) links the same engine and runs it out of MPC instead.
+ *
+ */
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdint.h>
+
+#define ENGINE_ABI 3                    // bump when engine_state/engine_ops change
+#define ENGINE_DEFAULT_PATH "/usr/lib/libforce_cursor_engine.so"
+#define ENGINE_PATH_ENV "FORCE_CURSOR_ENGINE"  // overrides the default path
+#define ENGINE_ENTRY "force_cursor_engine"
+#define ENGINE_PATH_LEN 256
+#define ENGINE_PERSIST_SHM "/force_cursor_state"   // shm_open name
+#define ENGINE_PERSIST_MAGIC 0x46435253u          // "FCRS"
+#define ENGINE_PERSIST_VERSION 1
+#define ENGINE_DEFAULT_X 50             // first run: bottom left corner
+#define ENGINE_DEFAULT_Y 1230
+#define ENGINE_DRM_REMOTE -2            // drm_fd in cursord: move_cursor posts to the mailbox
+
+enum engine_exit {
+    ENGINE_EXIT_STOP = 0,               // input thread ends, devices closed
+    ENGINE_EXIT_RELOAD,                 // devices left open for the next engine
+};
+
+// Survives MPC restarts (Restart=always): a mapped page in /dev/shm that
+// the engine writes as it goes, no syscalls
+struct engine_persist {
+    uint32_t magic;
+    uint32_t version;
+    int32_t cursor_x;                   // last cursor position
+    int32_t cursor_y;
+    char device[128];                   // mouse device opened last time
+};
+
+// Map the page (persist.c, in the shim and in cursord); NULL on failure
+struct engine_persist* persist_map(void);
+
+// Owned by the shim, survives engine reloads. Devices are -1 until opened.
+struct engine_state {
+    int drm_fd;                         // MPC's DRM fd and CRTC once the cursor is
+    uint32_t crtc;                      // set up (release store of drm_fd), else -1
+    struct engine_persist* persist;
+    int mouse_fd;
+    int uinput_fd;                      // virtual single-touch device
+    int touchscreen_fd;                 // real touchscreen, MT gestures
+    int keyboard_fd;
+    int (*move_cursor)(int fd, uint32_t crtc, int x, int y);  // real drmModeMoveCursor
+    volatile int stop;                  // set by the shim at exit, then wake()
+    int generation;                     // 1 for the first engine, +1 per reload
+    char next_engine[ENGINE_PATH_LEN];  // set with ENGINE_EXIT_RELOAD, empty = same file
+};
+
+struct engine_ops {
+    uint32_t abi;                       // ENGINE_ABI
+    const char* build;                  // build date and time, for "cursor_ctl state"
+    // Load the config, on the input thread; < 0: engine not used
+    int (*init)(struct engine_state* s);
+    // Input loop, on the shim's input thread; returns enum engine_exit
+    int (*run)(struct engine_state* s);
+    // Make run() look at engine_state.stop; any thread, async-signal-safe
+    void (*wake)(void);
+};
+
+typedef const struct engine_ops* (*engine_entry_fn)(void);
+
+#endif // ENGINE_H
@@ -0,0 +1,170 @@
+/**
+ * @file ev_loop.c
+ * Decription: Minimal epoll event loop (see ev_loop.h).
+ *
+ */
+#define _GNU_SOURCE
+#include "ev_loop.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+struct ev_watch {
+    int fd;            // -1 = free slot
+    int is_timer;      // timerfd: expirations are consumed before the callback
+    ev_loop_cb cb;
+    void* ctx;
+};
+
+static int epoll_fd = -1;
+static int wake_fd = -1;
+static struct ev_watch watches[EV_LOOP_MAX_WATCHES];
+
+uint64_t ev_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void on_wake(void* ctx, uint32_t events)
+{
+    (void)ctx;
+    (void)events;
+    uint64_t count;
+    if (read(wake_fd, &count, sizeof(count)) < 0) {
+        // Already consumed
+    }
+}
+
+int ev_loop_init(void)
+{
+    for (int i = 0; i < EV_LOOP_MAX_WATCHES; i++)
+        watches[i].fd = -1;
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0)
+        return -1;
+
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0 || ev_loop_add(wake_fd, EPOLLIN, on_wake, NULL) < 0) {
+        ev_loop_close();
+        return -1;
+    }
+    return 0;
+}
+
+void ev_loop_close(void)
+{
+    for (int i = 0; i < EV_LOOP_MAX_WATCHES; i++)
+        watches[i].fd = -1;
+    if (wake_fd >= 0)
+        close(wake_fd);
+    if (epoll_fd >= 0)
+        close(epoll_fd);
+    wake_fd = -1;
+    epoll_fd = -1;
+}
+
+int ev_loop_add(int fd, uint32_t events, ev_loop_cb cb, void* ctx)
+{
+    for (int i = 0; i < EV_LOOP_MAX_WATCHES; i++) {
+        if (watches[i].fd >= 0)
+            continue;
+
+        struct epoll_event ev = { .events = events, .data.ptr = &watches[i] };
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+            return -1;
+        watches[i].fd = fd;
+        watches[i].is_timer = 0;
+        watches[i].cb = cb;
+        watches[i].ctx = ctx;
+        return 0;
+    }
+
+    fprintf(stdout, "[LOOP] No free watch slot for fd %d\n", fd);
+    fflush(stdout);
+    return -1;
+}
+
+void ev_loop_remove(int fd)
+{
+    for (int i = 0; i < EV_LOOP_MAX_WATCHES; i++) {
+        if (watches[i].fd == fd) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+            watches[i].fd = -1;
+            return;
+        }
+    }
+}
+
+int ev_loop_run_once(int timeout_ms)
+{
+    struct epoll_event events[EV_LOOP_MAX_WATCHES];
+
+    int n = epoll_wait(epoll_fd, events, EV_LOOP_MAX_WATCHES, timeout_ms);
+    if (n < 0)
+        return errno == EINTR ? 0 : -1;
+
+    for (int i = 0; i < n; i++) {
+        struct ev_watch* w = events[i].data.ptr;
+        // A callback earlier in this batch may have removed the watch
+        if (w->fd < 0)
+            continue;
+        if (w->is_timer) {
+            uint64_t expirations;
+            if (read(w->fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+                continue;  // re-armed or disarmed since it fired
+        }
+        w->cb(w->ctx, events[i].events);
+    }
+    return n;
+}
+
+void ev_loop_wake(void)
+{
+    uint64_t one = 1;
+    if (wake_fd >= 0 && write(wake_fd, &one, sizeof(one)) < 0) {
+        // Counter is already non-zero
+    }
+}
+
+int ev_timer_create(ev_loop_cb cb, void* ctx)
+{
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    if (ev_loop_add(fd, EPOLLIN, cb, ctx) < 0) {
+        close(fd);
+        return -1;
+    }
+    for (int i = 0; i < EV_LOOP_MAX_WATCHES; i++) {
+        if (watches[i].fd == fd)
+            watches[i].is_timer = 1;
+    }
+    return fd;
+}
+
+void ev_timer_arm_at(int timer_fd, uint64_t deadline_ns)
+{
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (deadline_ns) {
+        its.it_value.tv_sec = (time_t)(deadline_ns / 1000000000ull);
+        its.it_value.tv_nsec = (long)(deadline_ns % 1000000000ull);
+    }
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+void ev_timer_destroy(int timer_fd)
+{
+    if (timer_fd < 0)
+        return;
+    ev_loop_remove(timer_fd);
+    close(timer_fd);
+}
@@ -0,0 +1,40 @@
+/**
+ * @file ev_loop.h
+ * Decription: Minimal epoll event loop run by the input thread.
+ *
+ * Everything the input thread waits on (mouse device, timers, control fds)
+ * is registered here, so the thread sleeps in one epoll_wait() instead of
+ * polling, and timed work (encoder flushes, macros) never blocks input.
+ *
+ */
+#ifndef EV_LOOP_H
+#define EV_LOOP_H
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+#define EV_LOOP_MAX_WATCHES 32
+
+typedef void (*ev_loop_cb)(void* ctx, uint32_t events);
+
+int ev_loop_init(void);
+void ev_loop_close(void);
+
+// Watch fd for epoll events; cb runs on the loop thread
+int ev_loop_add(int fd, uint32_t events, ev_loop_cb cb, void* ctx);
+void ev_loop_remove(int fd);
+
+// Wait for and dispatch one batch of events (timeout_ms -1 = forever)
+int ev_loop_run_once(int timeout_ms);
+
+// Make a blocked ev_loop_run_once() return (callable from any thread)
+void ev_loop_wake(void);
+
+// One-shot CLOCK_MONOTONIC timers backed by timerfd
+int ev_timer_create(ev_loop_cb cb, void* ctx);
+void ev_timer_arm_at(int timer_fd, uint64_t deadline_ns);  // 0 disarms
+void ev_timer_destroy(int timer_fd);
+
+uint64_t ev_now_ns(void);
+
+#endif // EV_LOOP_H
@@ -0,0 +1,75 @@
+/**
+ * @file evrec.h
+ * Decription: Capture file format of cursor_rec (evdev record/replay).
+ *
+ * A capture is one header page describing the device it was recorded from
+ * (name, ids, capability bits, axis ranges), then fixed-size events. It can
+ * be mmapped and indexed as is, with no parsing:
+ *
+ *   const struct evrec_event* ev = (const void*)((const char*)map + hdr->header_size);
+ *
+ * Event times come from the kernel's timestamps (CLOCK_MONOTONIC), relative
+ * to the first event, so a replay can keep the original spacing. A capture
+ * that was cut short still says count 0: readers then take the number of
+ * whole events in the file.
+ *
+ * The bit arrays use fixed sizes, not the kernel's *_CNT, so a capture is
+ * read the same way by tools built against other kernel headers.
+ *
+ */
+#ifndef EVREC_H
+#define EVREC_H
+
+#include <stdint.h>
+#include <linux/input.h>
+
+#define EVREC_MAGIC 0x56454346u     // "FCEV"
+#define EVREC_VERSION 1
+#define EVREC_HEADER_SIZE 4096      // events start page aligned
+#define EVREC_NAME_LEN 80
+#define EVREC_KEY_MAX 0x300         // codes covered by the bit arrays
+#define EVREC_REL_MAX 0x10
+#define EVREC_ABS_MAX 0x40
+#define EVREC_MSC_MAX 0x08
+#define EVREC_PROP_MAX 0x20
+
+struct evrec_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;           // offset of the first event
+    uint32_t event_size;            // sizeof(struct evrec_event)
+    uint64_t count;                 // events, 0 = as many as the file holds
+    uint64_t duration_ns;           // time of the last event
+    int64_t start_realtime;         // wall clock seconds at the start, for "info"
+    char name[EVREC_NAME_LEN];      // EVIOCGNAME
+    uint16_t bustype;               // EVIOCGID
+    uint16_t vendor;
+    uint16_t product;
+    uint16_t id_version;
+    uint8_t prop_bits[EVREC_PROP_MAX / 8];
+    uint8_t ev_bits[EV_MAX / 8 + 1];
+    uint8_t key_bits[EVREC_KEY_MAX / 8];
+    uint8_t rel_bits[EVREC_REL_MAX / 8];
+    uint8_t abs_bits[EVREC_ABS_MAX / 8];
+    uint8_t msc_bits[EVREC_MSC_MAX / 8];
+    struct input_absinfo absinfo[EVREC_ABS_MAX];
+};
+
+struct evrec_event {
+    uint64_t time_ns;               // since the first event
+    uint16_t type;
+    uint16_t code;
+    int32_t value;
+};
+
+static inline int evrec_test_bit(const uint8_t* bits, int bit)
+{
+    return (bits[bit / 8] >> (bit % 8)) & 1;
+}
+
+static inline void evrec_set_bit(uint8_t* bits, int bit)
+{
+    bits[bit / 8] |= (uint8_t)(1u << (bit % 8));
+}
+
+#endif // EVREC_H
@@ -0,0 +1,63 @@
+/**
+ * @file fb_map.c
+ * Decription: Read-only framebuffer mappings (see fb_map.h).
+ *
+ */
+#define _GNU_SOURCE
+#include "fb_map.h"
+
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+void fb_unmap(int fd, struct fb_map* m)
+{
+    if (m->ptr)
+        munmap((void*)m->ptr, m->size);
+    if (m->handle) {
+        struct drm_gem_close close_req = { .handle = m->handle };
+        drmIoctl(fd, DRM_IOCTL_GEM_CLOSE, &close_req);
+    }
+    memset(m, 0, sizeof(*m));
+}
+
+int fb_map(int fd, uint32_t fb_id, struct fb_map* m)
+{
+    memset(m, 0, sizeof(*m));
+    drmModeFBPtr fb = drmModeGetFB(fd, fb_id);
+    if (!fb)
+        return -1;
+    m->fb_id = fb_id;
+    m->handle = fb->handle;
+    m->pitch = fb->pitch;
+    m->width = fb->width;
+    m->height = fb->height;
+    m->size = (size_t)fb->pitch * fb->height;
+    int bpp = fb->bpp;
+    drmModeFreeFB(fb);
+    if (bpp != 32 || !m->handle) {
+        fb_unmap(fd, m);
+        return -1;
+    }
+
+    // Dumb buffers map through the DRM fd, GPU buffers through a dma-buf
+    void* ptr = MAP_FAILED;
+    struct drm_mode_map_dumb map_req = { .handle = m->handle };
+    if (drmIoctl(fd, DRM_IOCTL_MODE_MAP_DUMB, &map_req) == 0) {
+        ptr = mmap(NULL, m->size, PROT_READ, MAP_SHARED, fd, map_req.offset);
+    } else {
+        int dmabuf = -1;
+        if (drmPrimeHandleToFD(fd, m->handle, DRM_CLOEXEC, &dmabuf) == 0) {
+            ptr = mmap(NULL, m->size, PROT_READ, MAP_SHARED, dmabuf, 0);
+            close(dmabuf);
+        }
+    }
+    if (ptr == MAP_FAILED) {
+        fb_unmap(fd, m);
+        return -1;
+    }
+    m->ptr = ptr;
+    return 0;
+}
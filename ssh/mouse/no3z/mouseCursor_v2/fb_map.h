@@ -0,0 +1,31 @@
+/**
+ * @file fb_map.h
+ * Decription: Read-only CPU mappings of MPC's framebuffers.
+ *
+ * A framebuffer id is looked up with drmModeGetFB() and its buffer mapped
+ * read-only: dumb map through the DRM fd, or PRIME mmap for GPU buffers.
+ * The mapping keeps its own GEM handle, so it stays readable after MPC
+ * removes the framebuffer; only the id may then be reused.
+ *
+ */
+#ifndef FB_MAP_H
+#define FB_MAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct fb_map {
+    uint32_t fb_id;
+    uint32_t handle;
+    const uint8_t* ptr;
+    size_t size;
+    uint32_t pitch;
+    uint32_t width;
+    uint32_t height;
+};
+
+// Map a 32 bpp framebuffer; -1 (and *m zeroed) if it can't be read
+int fb_map(int fd, uint32_t fb_id, struct fb_map* m);
+void fb_unmap(int fd, struct fb_map* m);
+
+#endif // FB_MAP_H
@@ -6,184 +6,114 @@
  * MockbaMid Addon Adaptation: Amit Talwar (@locrian) (Discord)
  * Date: January 2026
  *
+ * Engine part: config, input loop, injection, gestures, MIDI. Built as
+ * libforce_cursor_engine.so and run by the preloaded shim (see engine.h),
+ * or linked into cursord to run outside MPC (see mailbox.h).
+ *
  */
 #define _GNU_SOURCE
-#include <dlfcn.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/input.h>
 #include <linux/uinput.h>
-#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/inotify.h>
 #include <sys/ioctl.h>
-#include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
-#include <xf86drm.h>
-#include <xf86drmMode.h>
-#include <alsa/asoundlib.h>
 #define MULTIPLIER 1.5
 
 // Cursor state
-#include "mouse_cursor.h"  // External cursor design (64x64 RGBA)
-static uint32_t cursor_bo = 0;
-static int cursor_initialized = 0;
-static int saved_fd = -1;
-static uint32_t saved_crtc = 0;
-static int cursor_x = 50; // Bottom left corner
-static int cursor_y = 1230; // Bottom left corner
-static pthread_t input_thread;
+#include "engine.h"
+#include "button_dispatch.h"
+#include "midi_out.h"
+#include "ev_loop.h"
+#include "encoder.h"
+#include "macro.h"
+#include "log.h"
+#include "stats.h"
+#include "latency.h"
+#include "ui_probe.h"
+#include "frametime.h"
+#include "xrun.h"
+#include "drm_census.h"
+#include "ctl.h"
+#include "remote.h"
+#include "vnc.h"
+#include "trace.h"
+
+// The shared event pipeline with the engine's stages plugged in: bindings
+// get the buttons and wheel, the encoder takes REL first, and the cursor
+// moves once per read batch (see flush_cursor())
+#define PIPELINE_SOURCE PIPELINE_SOURCE_NONE
+#define PIPELINE_BUTTONS PIPELINE_BUTTONS_HOOK
+#define PIPELINE_REL_FILTER 1
+#define PIPELINE_WHEEL 1
+#define PIPELINE_COALESCE 1
+#include "pipeline.h"
+
+static struct engine_state* shim = NULL;  // devices and cursor handed over by the shim
+static struct pipeline cursor = { ENGINE_DEFAULT_X, ENGINE_DEFAULT_Y, 1.0f, 0 };
 static int input_running = 0;
+static int reload_requested = 0;  // cursor_ctl reload, once config_quiescent()
 static int uinput_fd = -1;        // Single device for single touch (cursor clicks)
 static int touchscreen_fd = -1;   // Real touchscreen device for MT gestures
 static int keyboard_fd = -1;      // Virtual keyboard for button->key mappings
-static volatile int gesture_in_progress = 0;
-static volatile int left_button_pressed = 0;  // Track left button state for dragging
+static int gesture_in_progress = 0;   // pinch frames or cooldown pending
+static int mouse_fd = -1;
+static int frames_pending = 0;    // SYN frames since the last cursor move
+static int moved_x = -1;          // position of the last cursor move
+static int moved_y = -1;
+static uint64_t batch_dequeue_ns = 0; // when the current read batch returned
+static int latency_fd = -1;       // DRM fd given to latency_set_crtc()
 char* device = NULL;
 
-// MIDI sequencer state
-static snd_seq_t *midi_seq = NULL;
-static int midi_port = -1;
-
-// Button to key/MIDI mappings (max 16 mappings)
-#define MAX_BUTTON_MAPPINGS 16
-#define MAPPING_TYPE_KEY 0
-#define MAPPING_TYPE_MIDI_CC 1
-
-struct button_mapping {
-    int button_code;
-    int type;           // MAPPING_TYPE_KEY or MAPPING_TYPE_MIDI_CC
-    int value;          // key_code for keyboard, CC number for MIDI
-};
-static struct button_mapping button_mappings[MAX_BUTTON_MAPPINGS];
-static int num_button_mappings = 0;
-
-static float rate = 1.0f;
-static int read_params_file(const char* path, char** device, float* multiplier);
-
-// Button name to code mapping
-struct name_code_pair {
-    const char* name;
-    int code;
+// MIDI destination (client/port name or numbers), see midi_out.h
+static char midi_dest[128] = MIDI_OUT_DEFAULT_DEST;
+
+// Everything the input thread reads from the config file, as one immutable
+// snapshot. A reload parses into a new one and swaps the pointer.
+#define CONFIG_PATH "/dev/shm/.mouseCursor"
+#define CONFIG_DIR "/dev/shm"
+#define CONFIG_NAME ".mouseCursor"
+#define CONFIG_MAX_SETTINGS 64
+#define CONFIG_SETTLE_NS 100000000ull  // reload once writes stop for 100 ms
+
+struct config {
+    float rate;                                 // speed multiplier
+    int new_macros;                             // parsed with the macro staging set
+    struct dispatch_table table;                // button/wheel -> actions
+    int num_settings;                           // NAME=value lines, applied at the swap
+    char settings[CONFIG_MAX_SETTINGS][128];
 };
 
-static const struct name_code_pair button_names[] = {
-    {"BTN_LEFT", BTN_LEFT},
-    {"BTN_RIGHT", BTN_RIGHT},
-    {"BTN_MIDDLE", BTN_MIDDLE},
-    {"BTN_SIDE", BTN_SIDE},
-    {"BTN_EXTRA", BTN_EXTRA},
-    {"BTN_FORWARD", BTN_FORWARD},
-    {"BTN_BACK", BTN_BACK},
-    {"BTN_TASK", BTN_TASK},
-    {NULL, 0}
-};
-
-static const struct name_code_pair key_names[] = {
-    {"KEY_ESC", KEY_ESC},
-    {"KEY_SPACE", KEY_SPACE},
-    {"KEY_ENTER", KEY_ENTER},
-    {"KEY_TAB", KEY_TAB},
-    {"KEY_BACKSPACE", KEY_BACKSPACE},
-    {"KEY_LEFTSHIFT", KEY_LEFTSHIFT},
-    {"KEY_RIGHTSHIFT", KEY_RIGHTSHIFT},
-    {"KEY_LEFTCTRL", KEY_LEFTCTRL},
-    {"KEY_RIGHTCTRL", KEY_RIGHTCTRL},
-    {"KEY_LEFTALT", KEY_LEFTALT},
-    {"KEY_RIGHTALT", KEY_RIGHTALT},
-    {"KEY_UP", KEY_UP},
-    {"KEY_DOWN", KEY_DOWN},
-    {"KEY_LEFT", KEY_LEFT},
-    {"KEY_RIGHT", KEY_RIGHT},
-    {"KEY_PAGEUP", KEY_PAGEUP},
-    {"KEY_PAGEDOWN", KEY_PAGEDOWN},
-    {"KEY_HOME", KEY_HOME},
-    {"KEY_END", KEY_END},
-    {"KEY_DELETE", KEY_DELETE},
-    {"KEY_INSERT", KEY_INSERT},
-    {"KEY_F1", KEY_F1},
-    {"KEY_F2", KEY_F2},
-    {"KEY_F3", KEY_F3},
-    {"KEY_F4", KEY_F4},
-    {"KEY_F5", KEY_F5},
-    {"KEY_F6", KEY_F6},
-    {"KEY_F7", KEY_F7},
-    {"KEY_F8", KEY_F8},
-    {"KEY_F9", KEY_F9},
-    {"KEY_F10", KEY_F10},
-    {"KEY_F11", KEY_F11},
-    {"KEY_F12", KEY_F12},
-    {"KEY_MENU", KEY_MENU},
-    {NULL, 0}
-};
-
-// Parse code from string (name, hex, or decimal)
-static int parse_code(const char* str, const struct name_code_pair* table)
-{
-    // Try hex format (0xNNNN)
-    if (str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
-        return (int)strtol(str, NULL, 16);
-    }
-
-    // Try plain decimal number
-    char* endptr;
-    long val = strtol(str, &endptr, 10);
-    if (endptr != str && *endptr == '\0' && val >= 0 && val <= 0xFFFF) {
-        return (int)val;
-    }
+static struct config* config = NULL;            // current snapshot
+static struct config* pending_config = NULL;    // parsed, waiting for a quiet moment
+static struct dispatch_state button_state;
+static int applying_settings = 0;   // servers are reconciled once, at the end
 
-    // Try name lookup
-    for (int i = 0; table[i].name != NULL; i++) {
-        if (strcasecmp(str, table[i].name) == 0) {
-            return table[i].code;
-        }
-    }
+static struct config* load_config(const char* path, char** device, int strict);
+static void apply_settings(const struct config* c);
+static void install_pending_config(void);
+static int parse_setting_line(const char* line);
+static const struct engine_ops ops;
 
-    return -1;  // Not found
-}
-
-// Initialize bright visible cursor
-static void init_cursor(int fd, uint32_t crtcId)
+// Load the config (engine_ops.init)
+static int engine_init(struct engine_state* s)
 {
-    fprintf(stdout, "-------MockbaMod Mouse Cursor --------\n");
-    if (read_params_file("/dev/shm/.mouseCursor", &device, &rate) != 0) {
-        fprintf(stdout, "*** MockbaMod Mouse Cursor: Failed to read device.txt file *****\n");
-
-        return;
-    } else {
-        fprintf(stdout, "-------MockbaMod Mouse Cursor --------\n\n    Device: %s\n    Speed Multiplier:%f\n", device, rate);
-    }
-    if (cursor_initialized)
-        return;
-
-    // Cursor data is loaded from mouse_cursor.h (64x64 RGBA with transparency)
-    // No need to generate it here - just use the pre-defined cursor_data array
-
-    // Create DRM buffer
-    struct drm_mode_create_dumb create_req = { 0 };
-    create_req.width = 64;
-    create_req.height = 64;
-    create_req.bpp = 32;
-
-    if (drmIoctl(fd, DRM_IOCTL_MODE_CREATE_DUMB, &create_req) == 0) {
-        cursor_bo = create_req.handle;
-        saved_fd = fd;
-        saved_crtc = crtcId;
-
-        struct drm_mode_map_dumb map_req = { 0 };
-        map_req.handle = cursor_bo;
-
-        if (drmIoctl(fd, DRM_IOCTL_MODE_MAP_DUMB, &map_req) == 0) {
-            void* ptr = mmap(0, create_req.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, map_req.offset);
-            if (ptr != MAP_FAILED) {
-                memcpy(ptr, cursor_data, sizeof(cursor_data));
-                munmap(ptr, create_req.size);
-                cursor_initialized = 1;
-            }
-        }
-    }
+    shim = s;
+    config = load_config(CONFIG_PATH, &device, 0);
+    if (!config)
+        return -1;
+    apply_settings(config);
+    macro_commit();
+    cursor.rate = config->rate;
+    fprintf(stdout, "-------MockbaMod Mouse Cursor --------\n\n    Device: %s\n    Speed Multiplier:%f\n", device, config->rate);
+    fflush(stdout);
+    return 0;
 }
 
 // Initialize uinput device for single-touch events (cursor clicks only)
@@ -192,7 +122,7 @@ static int init_uinput()
     struct uinput_user_dev uidev;
     int fd;
 
-    fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+    fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
     if (fd < 0) {
         return -1;
     }
@@ -241,7 +171,7 @@ static int init_uinput()
 // Open real touchscreen device for injecting MT gestures
 static int open_touchscreen_device()
 {
-    int fd = open("/dev/input/event0", O_WRONLY | O_NONBLOCK);
+    int fd = open("/dev/input/event0", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
     if (fd < 0) {
         fprintf(stdout, "[TOUCHSCREEN] Failed to open /dev/input/event0 for writing (errno=%d)\n", errno);
         return -1;
@@ -258,7 +188,7 @@ static int open_keyboard_monitor()
     const char* kbd_paths[] = {"/dev/input/event3", "/dev/input/event1", NULL};
 
     for (int i = 0; kbd_paths[i] != NULL; i++) {
-        int fd = open(kbd_paths[i], O_RDONLY | O_NONBLOCK);
+        int fd = open(kbd_paths[i], O_RDONLY | O_NONBLOCK | O_CLOEXEC);
         if (fd >= 0) {
             fprintf(stdout, "[KBD_MONITOR] Opened %s for hardware button monitoring\n", kbd_paths[i]);
             fprintf(stdout, "[KBD_MONITOR] Press any hardware buttons (MENU, SHIFT, etc.) to see their key codes\n");
@@ -278,7 +208,7 @@ static int init_uinput_keyboard()
     // Instead of creating a new virtual keyboard (which MPC won't listen to),
     // open the existing "Amit's Input Provider" keyboard device that MPC already monitors.
     // This device is created by the midiloop addon and MPC opens it at startup.
-    int fd = open("/dev/input/event3", O_WRONLY | O_NONBLOCK);
+    int fd = open("/dev/input/event3", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
     if (fd < 0) {
         fprintf(stdout, "[KEYBOARD] Failed to open /dev/input/event3 (Amit's Input Provider) (errno=%d)\n", errno);
         fflush(stdout);
@@ -291,78 +221,16 @@ static int init_uinput_keyboard()
     return fd;
 }
 
-// Initialize ALSA sequencer for MIDI CC sending
-static int init_midi_sequencer()
-{
-    int err;
-
-    // Open ALSA sequencer
-    err = snd_seq_open(&midi_seq, "default", SND_SEQ_OPEN_OUTPUT, 0);
-    if (err < 0) {
-        fprintf(stdout, "[MIDI] Failed to open ALSA sequencer: %s\n", snd_strerror(err));
-        fflush(stdout);
-        return -1;
-    }
-
-    // Set client name
-    snd_seq_set_client_name(midi_seq, "MouseButtonMIDI");
-
-    // Create output port
-    midi_port = snd_seq_create_simple_port(midi_seq, "Output",
-                                            SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ,
-                                            SND_SEQ_PORT_TYPE_APPLICATION);
-    if (midi_port < 0) {
-        fprintf(stdout, "[MIDI] Failed to create MIDI port\n");
-        fflush(stdout);
-        snd_seq_close(midi_seq);
-        midi_seq = NULL;
-        return -1;
-    }
-
-    fprintf(stdout, "[MIDI] ALSA sequencer initialized, client port: %d\n", midi_port);
-    fflush(stdout);
-    return 0;
-}
-
-// Send MIDI CC message to Mockba Automation In (129:0)
+// Queue a MIDI CC for the MIDI output thread (never blocks the input thread)
 static void send_midi_cc(int cc_number, int value, int pressed)
 {
-    if (!midi_seq || midi_port < 0) {
-        fprintf(stdout, "[MIDI] Sequencer not initialized!\n");
-        fflush(stdout);
-        return;
-    }
-
     // Only send on button press (not release)
     if (!pressed) {
         return;
     }
 
-    snd_seq_event_t ev;
-    snd_seq_ev_clear(&ev);
-
-    // Set event type to controller (CC)
-    snd_seq_ev_set_controller(&ev, 0, cc_number, value);
-
-    // Set source port
-    snd_seq_ev_set_source(&ev, midi_port);
-
-    // Set destination: 129:0 (Mockba Automation In)
-    snd_seq_ev_set_dest(&ev, 129, 0);
-
-    // Send event directly
-    snd_seq_ev_set_direct(&ev);
-
-    // Send the event
-    if (snd_seq_event_output(midi_seq, &ev) < 0) {
-        fprintf(stdout, "[MIDI] Error sending CC %d\n", cc_number);
-        fflush(stdout);
-    } else {
-        fprintf(stdout, "[MIDI] Sent CC %d (value=%d) to 129:0\n", cc_number, value);
-        fflush(stdout);
-    }
-
-    snd_seq_drain_output(midi_seq);
+    if (midi_out_cc(0, cc_number, value) < 0)
+        LOGW("[MIDI] CC %d dropped (output not running or queue full)", cc_number);
 }
 
 // Send keyboard key event
@@ -381,46 +249,33 @@ static void send_key_event(int fd, int key_code, int pressed)
     ev[1].code = SYN_REPORT;
     ev[1].value = 0;
 
+    uint64_t t = trace_begin();
     write(fd, ev, sizeof(ev));
-}
-
-// Check if button has a mapping (returns pointer to mapping struct, or NULL)
-static struct button_mapping* get_button_mapping(int button_code)
-{
-    for (int i = 0; i < num_button_mappings; i++) {
-        if (button_mappings[i].button_code == button_code) {
-            return &button_mappings[i];
-        }
-    }
-    return NULL;  // No mapping
+    trace_end("uinput_key", t, (uint32_t)key_code);
+    stats_inc(STAT_KEY_EVENTS);
+    xrun_activity(XRUN_ACT_KEY);
 }
 
 // Send touch event
 static void send_touch_event(int fd, int x, int y, int pressed)
 {
+    static int was_pressed = 0;
     struct input_event ev[4];
-    memset(ev, 0, sizeof(ev));
-
-    // Position
-    ev[0].type = EV_ABS;
-    ev[0].code = ABS_X;
-    ev[0].value = x;
-
-    ev[1].type = EV_ABS;
-    ev[1].code = ABS_Y;
-    ev[1].value = y;
-
-    // Touch state
-    ev[2].type = EV_KEY;
-    ev[2].code = BTN_TOUCH;
-    ev[2].value = pressed;
-
-    // Sync
-    ev[3].type = EV_SYN;
-    ev[3].code = SYN_REPORT;
-    ev[3].value = 0;
-
-    write(fd, ev, sizeof(ev));
+    pipeline_touch_frame(ev, x, y, pressed);
+
+    uint64_t t = trace_begin();
+    ssize_t n = write(fd, ev, sizeof(ev));
+    trace_end("uinput_touch", t, (uint32_t)pressed);
+    xrun_activity(XRUN_ACT_TOUCH);
+    if (n == (ssize_t)sizeof(ev))
+        stats_inc(STAT_TOUCH_FRAMES);
+    else
+        stats_inc(STAT_TOUCH_DROPPED);
+
+    // Time how long the UI takes to react to a new press
+    if (pressed && !was_pressed)
+        ui_probe_arm(x, y);
+    was_pressed = pressed;
 }
 
 // Send a complete two-finger touch frame (both slots + one sync)
@@ -504,175 +359,768 @@ static void send_two_finger_frame(int fd, int x1, int y1, int tracking_id1, int
     idx++;
 
     write(fd, ev, idx * sizeof(struct input_event));
+    xrun_activity(XRUN_ACT_GESTURE);
 }
 
-// Animate pinch gesture (zoom in or out)
-static void animate_pinch_gesture(int fd, int center_x, int center_y, int zoom_in)
+// Pinch gestures (zoom in or out) play from a timer on the event loop, one
+// frame per tick, like macros: the loop never sleeps, so input, macros and
+// the encoder keep running while the fingers move
+#define PINCH_FRAMES 5
+#define PINCH_FRAME_NS 16000000ull     // ~60fps
+#define PINCH_COOLDOWN_NS 30000000ull  // before the next gesture is allowed
+#define PINCH_MIN_SPACING 30           // fingers close (zoom in start)
+#define PINCH_MAX_SPACING 100          // fingers apart (diagonal spread)
+
+static struct {
+    int timer_fd;
+    int fd;                            // touchscreen the frames go to
+    int x;                             // center
+    int y;
+    int zoom_in;
+    int frame;                         // next frame; PINCH_FRAMES: release, then cooldown
+    int tracking_id;                   // first finger, the second is +1
+    uint64_t deadline_ns;
+    uint64_t trace_start;
+} pinch = { -1, -1, 0, 0, 0, 0, 10, 0, 0 };
+
+static void pinch_frame(void)
 {
-    // Prevent overlapping gestures
-    if (gesture_in_progress) {
+    float progress = (float)pinch.frame / (float)(PINCH_FRAMES - 1);
+    int spacing;
+
+    if (pinch.zoom_in) {
+        // Zoom in: fingers start close, move apart diagonally
+        spacing = PINCH_MIN_SPACING + (int)((PINCH_MAX_SPACING - PINCH_MIN_SPACING) * progress);
+    } else {
+        // Zoom out: fingers start far, move together diagonally
+        spacing = PINCH_MAX_SPACING - (int)((PINCH_MAX_SPACING - PINCH_MIN_SPACING) * progress);
+    }
+
+    // Two touch points, diagonal spread, kept on screen
+    int x1 = pipeline_clamp(pinch.x - spacing / 2, PIPELINE_WIDTH - 1);
+    int y1 = pipeline_clamp(pinch.y - spacing / 2, PIPELINE_HEIGHT - 1);  // Bottom-left
+    int x2 = pipeline_clamp(pinch.x + spacing / 2, PIPELINE_WIDTH - 1);
+    int y2 = pipeline_clamp(pinch.y + spacing / 2, PIPELINE_HEIGHT - 1);  // Top-right
+
+    if (pinch.frame == 0) {
+        LOGD("[GESTURE] Frame %d: finger1=(%d,%d) finger2=(%d,%d) spacing=%dpx",
+             pinch.frame, x1, y1, x2, y2, spacing);
+    }
+
+    // Send BOTH fingers in ONE frame (one sync), BTN_TOUCH on the first only
+    send_two_finger_frame(pinch.fd, x1, y1, pinch.tracking_id, x2, y2, pinch.tracking_id + 1, pinch.frame == 0);
+    trace_mark("pinch_frame", (uint32_t)spacing);
+}
+
+// Release both touches in ONE frame with BTN_TOUCH=0
+static void pinch_release(void)
+{
+    send_two_finger_frame(pinch.fd, 0, 0, -1, 0, 0, -1, 1);
+    pinch.tracking_id += 2;  // sequential tracking IDs, like a real touchscreen
+    trace_end("pinch_gesture", pinch.trace_start, (uint32_t)pinch.zoom_in);
+}
+
+static void on_pinch_timer(void* ctx, uint32_t events)
+{
+    (void)ctx;
+    (void)events;
+
+    if (pinch.frame < PINCH_FRAMES) {
+        pinch_frame();
+        pinch.frame++;
+    } else if (pinch.frame == PINCH_FRAMES) {
+        pinch_release();
+        pinch.frame++;
+        pinch.deadline_ns += PINCH_COOLDOWN_NS - PINCH_FRAME_NS;
+    } else {
+        gesture_in_progress = 0;
         return;
     }
+    // Deadlines chain off the previous one, as in macro.c
+    pinch.deadline_ns += PINCH_FRAME_NS;
+    ev_timer_arm_at(pinch.timer_fd, pinch.deadline_ns);
+}
+
+// Start a pinch; returns before the second frame. Returns 0, or -1 while
+// the previous one (or its cooldown) is still running.
+static int animate_pinch_gesture(int fd, int center_x, int center_y, int zoom_in)
+{
+    // Prevent overlapping gestures
+    if (gesture_in_progress || pinch.timer_fd < 0) {
+        return -1;
+    }
     gesture_in_progress = 1;
+    stats_inc(STAT_GESTURES);
+    pinch.trace_start = trace_begin();
+    pinch.fd = fd;
+    pinch.x = center_x;
+    pinch.y = center_y;
+    pinch.zoom_in = zoom_in;
+    pinch.frame = 0;
+    pinch.deadline_ns = ev_now_ns();
+    on_pinch_timer(NULL, 0);
+    return 0;
+}
 
-    // Fast, small diagonal gesture (both horizontal and vertical)
-    const int frames = 5;
-    const int frame_delay_ms = 16;  // ~60fps
+static int pinch_init(void)
+{
+    pinch.timer_fd = ev_timer_create(on_pinch_timer, NULL);
+    return pinch.timer_fd < 0 ? -1 : 0;
+}
 
-    // Diagonal spacing (both X and Y movement)
-    const int min_spacing = 30;     // Fingers close (zoom in start)
-    const int max_spacing = 100;    // Fingers apart (diagonal spread)
+// Engine exit: no fingers are left on the screen
+static void pinch_close(void)
+{
+    if (gesture_in_progress && pinch.frame < PINCH_FRAMES + 1)
+        pinch_release();
+    gesture_in_progress = 0;
+    ev_timer_destroy(pinch.timer_fd);
+    pinch.timer_fd = -1;
+}
 
-    // First frame: send BTN_TOUCH
-    int first_frame = 1;
+// Macro steps go to the same devices as button actions
+static void macro_touch(int x, int y, int pressed)
+{
+    if (uinput_fd >= 0)
+        send_touch_event(uinput_fd, x, y, pressed);
+}
 
-    for (int frame = 0; frame < frames; frame++) {
-        int spacing;
+static void macro_key(int code, int pressed)
+{
+    if (keyboard_fd >= 0)
+        send_key_event(keyboard_fd, code, pressed);
+}
 
-        // Calculate spacing based on zoom direction
-        float progress = (float)frame / (float)(frames - 1);
+static void macro_midi(const struct midi_msg* msg)
+{
+    if (midi_out_send(msg) < 0)
+        LOGW("[MIDI] Macro message dropped (output not running or queue full)");
+}
 
-        if (zoom_in) {
-            // Zoom in: fingers start close, move apart diagonally
-            spacing = min_spacing + (int)((max_spacing - min_spacing) * progress);
-        } else {
-            // Zoom out: fingers start far, move together diagonally
-            spacing = max_spacing - (int)((max_spacing - min_spacing) * progress);
+// Run the actions of a dispatched binding
+static void run_actions(const struct dispatch_hit* hit)
+{
+    int pressed = hit->edge != DISPATCH_RELEASE;
+    uint64_t t = trace_begin();
+
+    for (int n = 0; n < hit->count; n++) {
+        // Release in reverse order so multi-key bindings unwind like a chord
+        const struct action* a = &hit->actions[pressed ? n : hit->count - 1 - n];
+
+        switch (a->type) {
+        case ACTION_TOUCH:
+            if (uinput_fd >= 0) {
+                send_touch_event(uinput_fd, cursor.x, cursor.y, pressed);
+                if (hit->edge == DISPATCH_TAP)
+                    send_touch_event(uinput_fd, cursor.x, cursor.y, 0);
+                // Track touch state for continuous drag (left button only)
+                if (hit->trigger == BTN_LEFT - DISPATCH_FIRST_CODE)
+                    cursor.touch_down = hit->edge == DISPATCH_PRESS;
+            }
+            break;
+        case ACTION_PINCH:
+            // Mouse wheel -> pinch gesture (inject to real touchscreen)
+            if (pressed && touchscreen_fd >= 0 && !gesture_in_progress) {
+                LOGI("[WHEEL] Injecting ZOOM %s gesture to /dev/input/event0 at (%d, %d)",
+                     a->value ? "IN" : "OUT", cursor.x, cursor.y);
+                animate_pinch_gesture(touchscreen_fd, cursor.x, cursor.y, a->value);
+            }
+            break;
+        case ACTION_KEY:
+            if (keyboard_fd >= 0) {
+                LOGI("[BUTTON] Key %d (pressed=%d)", a->value, pressed);
+                send_key_event(keyboard_fd, a->value, pressed);
+                if (hit->edge == DISPATCH_TAP)
+                    send_key_event(keyboard_fd, a->value, 0);
+            }
+            break;
+        case ACTION_MIDI_CC:
+            LOGI("[BUTTON] MIDI CC %d (pressed=%d)", a->value, pressed);
+            send_midi_cc(a->value, 127, pressed);
+            break;
+        case ACTION_LAYER_HOLD:
+        case ACTION_LAYER_TOGGLE:
+            dispatch_layer_action(&button_state, a, hit->edge);
+            if (hit->edge == DISPATCH_TAP && a->type == ACTION_LAYER_HOLD)
+                dispatch_layer_action(&button_state, a, DISPATCH_RELEASE);
+            LOGI("[BUTTON] Layer %d active", button_state.layer);
+            break;
+        case ACTION_ENCODER_CC:
+        case ACTION_ENCODER_NRPN:
+            if (hit->edge == DISPATCH_PRESS) {
+                // Touch the knob under the cursor so MPC targets it
+                if (encoder_config.select_tap && uinput_fd >= 0) {
+                    send_touch_event(uinput_fd, cursor.x, cursor.y, 1);
+                    send_touch_event(uinput_fd, cursor.x, cursor.y, 0);
+                }
+                encoder_begin(a->type == ACTION_ENCODER_NRPN ? ENCODER_MODE_NRPN : ENCODER_MODE_CC_RELATIVE,
+                              a->value);
+            } else if (hit->edge == DISPATCH_RELEASE) {
+                encoder_end();
+            }
+            break;
+        case ACTION_MACRO:
+            // Plays from the event loop timer; returns before the first wait
+            if (pressed && macro_play(a->value) < 0)
+                LOGW("[MACRO] Macro %d dropped (queue full)", a->value);
+            break;
         }
+    }
+    trace_end("run_actions", t, hit->count);
+}
 
-        // Calculate two touch points (diagonal spread - both X and Y)
-        int x1 = center_x - spacing / 2;
-        int y1 = center_y - spacing / 2;  // Bottom-left
-        int x2 = center_x + spacing / 2;
-        int y2 = center_y + spacing / 2;  // Top-right
-
-        // Bounds checking - keep fingers on screen
-        if (x1 < 0) x1 = 0;
-        if (x1 > 799) x1 = 799;
-        if (x2 < 0) x2 = 0;
-        if (x2 > 799) x2 = 799;
-        if (y1 < 0) y1 = 0;
-        if (y1 > 1279) y1 = 1279;
-        if (y2 < 0) y2 = 0;
-        if (y2 > 1279) y2 = 1279;
-
-        // Use sequential tracking IDs (like real touchscreen)
-        static int base_tracking_id = 10;
-        int tid1 = base_tracking_id;
-        int tid2 = base_tracking_id + 1;
-
-        // Debug output for first frame
-        if (first_frame) {
-            fprintf(stdout, "[GESTURE] Frame %d: finger1=(%d,%d) finger2=(%d,%d) spacing=%dpx tid=(%d,%d)\n",
-                    frame, x1, y1, x2, y2, spacing, tid1, tid2);
-            fflush(stdout);
+// Pipeline stages. Encoder mode: motion and wheel drive the encoder, the
+// cursor stays put
+static int pipeline_rel_filter(const struct input_event* ev)
+{
+    if (!encoder_active())
+        return 0;
+    if (ev->code == REL_X)
+        encoder_motion(ev->value, 0);
+    else if (ev->code == REL_Y)
+        encoder_motion(0, ev->value);
+    else if (ev->code == REL_WHEEL)
+        encoder_wheel(ev->value);
+    return 1;
+}
+
+// Wheel notch -> bound action (pinch gesture by default)
+static void pipeline_wheel(int value)
+{
+    struct dispatch_hit hit;
+    if (dispatch_wheel(&config->table, &button_state, value, &hit))
+        run_actions(&hit);
+}
+
+// Mouse button events -> compiled binding (touch by default for L/R/M)
+static void pipeline_key(const struct input_event* ev)
+{
+    struct dispatch_hit hit;
+    if (dispatch_button(&config->table, &button_state, ev->code, ev->value, &hit))
+        run_actions(&hit);
+}
+
+// Dragging: the touch follows the cursor while a button holds it
+static void pipeline_touch(int x, int y, int pressed)
+{
+    if (uinput_fd >= 0)
+        send_touch_event(uinput_fd, x, y, pressed);
+}
+
+// The cursor moves once per read batch, see flush_cursor()
+static void pipeline_frame(const struct input_event* ev)
+{
+    frames_pending++;
+    stats_inc(STAT_FRAMES);
+    latency_frame((uint64_t)ev->input_event_sec * 1000000000ull + (uint64_t)ev->input_event_usec * 1000ull,
+                  batch_dequeue_ns);
+}
+
+// Handle one mouse event (called from the event loop)
+static void handle_mouse_event(const struct input_event* ev)
+{
+    pipeline_event(&cursor, ev);
+}
+
+// Move the cursor for all frames read in one batch, and only if it moved
+static void flush_cursor(void)
+{
+    if (!frames_pending)
+        return;
+    int frames = frames_pending;
+    stats_add(STAT_FRAMES_COALESCED, (uint64_t)(frames - 1));
+    frames_pending = 0;
+
+    if (cursor.x == moved_x && cursor.y == moved_y) {
+        stats_inc(STAT_CURSOR_MOVES_ELIDED);
+        latency_elided();
+        return;
+    }
+    // The input thread starts with MPC; the cursor only exists once MPC
+    // has shown its own (the shim then publishes the DRM fd). In cursord
+    // there is no fd: the move is a mailbox post, with no vblank to time.
+    int drm_fd = __atomic_load_n(&shim->drm_fd, __ATOMIC_ACQUIRE);
+    if (drm_fd != -1 && shim->move_cursor) {
+        if (drm_fd >= 0 && drm_fd != latency_fd) {
+            latency_set_crtc(drm_fd, shim->crtc);
+            latency_fd = drm_fd;
         }
+        uint64_t t = trace_begin();
+        shim->move_cursor(drm_fd, shim->crtc, cursor.x, cursor.y);
+        trace_end("drmModeMoveCursor", t, (uint32_t)frames);
+        xrun_activity(XRUN_ACT_CURSOR);
+        latency_moved(ev_now_ns());
+        moved_x = cursor.x;
+        moved_y = cursor.y;
+        shim->persist->cursor_x = cursor.x;  // where the next engine or MPC starts
+        shim->persist->cursor_y = cursor.y;
+        stats_inc(STAT_CURSOR_MOVES);
+    }
+}
 
-        // Send BOTH fingers in ONE frame (one sync)
-        // Only send BTN_TOUCH on first frame
-        send_two_finger_frame(fd, x1, y1, tid1, x2, y2, tid2, first_frame);
-        first_frame = 0;
+// Mouse fd is readable: drain everything the kernel has queued
+static void on_mouse_readable(void* ctx, uint32_t events)
+{
+    (void)ctx;
+    struct input_event evs[64];
 
-        usleep(frame_delay_ms * 1000);
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        LOGE("[INPUT] Mouse device went away");
+        ev_loop_remove(mouse_fd);
+        return;
     }
 
-    // Release both touches in ONE frame with BTN_TOUCH=0
-    send_two_finger_frame(fd, 0, 0, -1, 0, 0, -1, 1);
+    uint64_t t = trace_begin();
+    uint32_t count = 0;
+    for (;;) {
+        ssize_t n = read(mouse_fd, evs, sizeof(evs));
+        if (n < (ssize_t)sizeof(evs[0]))
+            break;
+        count += (uint32_t)((size_t)n / sizeof(evs[0]));
+        batch_dequeue_ns = ev_now_ns();
+        stats_inc(STAT_READ_BATCHES);
+        stats_add(STAT_EVENTS_READ, (uint64_t)n / sizeof(evs[0]));
+        for (size_t i = 0; i < (size_t)n / sizeof(evs[0]); i++)
+            handle_mouse_event(&evs[i]);
+        if ((size_t)n < sizeof(evs))
+            break;
+    }
+    flush_cursor();
+    trace_end("mouse_batch", t, count);
 
-    // Increment tracking IDs for next gesture
-    static int base_tracking_id = 10;
-    base_tracking_id += 2;
+    // A reloaded config waiting for the buttons to be released
+    if (pending_config)
+        install_pending_config();
+}
 
-    gesture_in_progress = 0;
+// Keyboard keys from cursor_remote go to the keyboard device as they are
+// (autorepeat is left to whoever reads it)
+static void send_remote_key(int code, int value)
+{
+    static int opened = 0;
 
-    // Small delay before allowing next gesture
-    usleep(30000); // 30ms
+    if (keyboard_fd < 0 && !opened) {
+        opened = 1;
+        keyboard_fd = init_uinput_keyboard();
+        shim->keyboard_fd = keyboard_fd;
+    }
+    if (keyboard_fd >= 0 && (value == 0 || value == 1))
+        send_key_event(keyboard_fd, code, value);
 }
 
-// Input monitoring thread
-static void* input_monitor(void* arg)
+// Events from cursor_remote: the same path as a read from the mouse
+static void on_remote_events(const struct input_event* evs, int count)
 {
+    uint64_t t = trace_begin();
+    batch_dequeue_ns = ev_now_ns();
+    for (int i = 0; i < count; i++) {
+        if (evs[i].type == EV_KEY && evs[i].code < BTN_MISC)
+            send_remote_key(evs[i].code, evs[i].value);
+        else
+            handle_mouse_event(&evs[i]);
+    }
+    flush_cursor();
+    trace_end("remote_batch", t, (uint32_t)count);
 
-    fprintf(stdout, "--------- opening device %s\n", device);
-    int fd = open(device, O_RDONLY | O_NONBLOCK);
-    if (fd < 0) {
-        fprintf(stdout, "----------- ERROR opening device %s for Mouse Events\n", device);
-        free(device);
+    if (pending_config)
+        install_pending_config();
+}
 
-        return NULL;
+// cursor_ctl dump: write the reports that are on (TRACE=1, DRM_CENSUS=1)
+static void dump_reports(void)
+{
+    if (trace_on) {
+        int n = trace_dump(TRACE_DEFAULT_PATH);
+        if (n < 0)
+            LOGE("[TRACE] Could not write %s", TRACE_DEFAULT_PATH);
+        else
+            LOGI("[TRACE] %d event(s) written to %s", n, TRACE_DEFAULT_PATH);
+    }
+    if (drm_census_enabled) {
+        int n = drm_census_dump(DRM_CENSUS_PATH);
+        if (n < 0)
+            LOGE("[CENSUS] Could not write %s", DRM_CENSUS_PATH);
+        else
+            LOGI("[CENSUS] %d ioctl(s) written to %s", n, DRM_CENSUS_PATH);
     }
-    free(device);
+}
 
-    // Initialize uinput for single-touch injection (cursor clicks)
-    fprintf(stdout, "[INIT] Attempting to create uinput device...\n");
-    fflush(stdout);
-    uinput_fd = init_uinput();
-    if (uinput_fd >= 0) {
-        fprintf(stdout, "[INIT] SUCCESS: Virtual Touch device created (single-touch only), fd=%d\n", uinput_fd);
-        fflush(stdout);
-    } else {
-        fprintf(stdout, "[INIT] FAILED: Could not create uinput device (errno=%d)\n", errno);
+// Once a second: counters owned by other modules, and our own CPU time
+static void on_stats_timer(void* ctx, uint32_t events)
+{
+    (void)events;
+    int timer_fd = *(int*)ctx;
+    struct timespec ts;
+    struct midi_out_stats midi;
+    struct log_stats logs;
+    struct macro_stats macro;
+    struct xrun_stats xrun;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        stats_set(STAT_INPUT_CPU_NS, (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec);
+    midi_out_get_stats(&midi);
+    stats_set(STAT_MIDI_QUEUED, midi.queued);
+    stats_set(STAT_MIDI_SENT, midi.sent);
+    stats_set(STAT_MIDI_DROPPED, midi.dropped);
+    stats_set(STAT_MIDI_DRAINS, midi.drains);
+    log_get_stats(&logs);
+    stats_set(STAT_LOG_WRITTEN, logs.written);
+    stats_set(STAT_LOG_DROPPED, logs.dropped);
+    macro_get_stats(&macro);
+    stats_set(STAT_MACROS_PLAYED, macro.played);
+    xrun_get_stats(&xrun);
+    stats_set(STAT_PCM_XRUNS, xrun.xruns);
+    stats_set(STAT_PCM_XRUNS_NEAR_INPUT, xrun.near_activity);
+    stats_set(STAT_PCM_LATE_PERIODS, xrun.late_periods);
+
+    if (pending_config)
+        install_pending_config();
+
+    uint64_t now = ev_now_ns();
+    __atomic_store_n(&stats->update_ns, now, __ATOMIC_RELAXED);
+    ev_timer_arm_at(timer_fd, now + 1000000000ull);
+}
+
+// Keyboard and MIDI output, opened the first time the config needs them.
+// engine_run() stops MIDI on the way out and a failed engine reload runs
+// this engine again, so midi_out is asked rather than a flag kept here.
+static void open_action_devices(const struct config* c)
+{
+    // Initialize keyboard if needed
+    if ((c->table.has_key_actions || macro_uses(MACRO_STEP_KEY)) && keyboard_fd < 0) {
+        fprintf(stdout, "[INIT] Initializing keyboard device for KEY mappings...\n");
         fflush(stdout);
+        keyboard_fd = init_uinput_keyboard();
+        shim->keyboard_fd = keyboard_fd;
+        if (keyboard_fd >= 0) {
+            fprintf(stdout, "[INIT] SUCCESS: Keyboard device ready, fd=%d\n", keyboard_fd);
+            fflush(stdout);
+        } else {
+            fprintf(stdout, "[INIT] FAILED: Could not create keyboard device (errno=%d)\n", errno);
+            fflush(stdout);
+        }
     }
 
-    // Open real touchscreen for MT gesture injection
-    fprintf(stdout, "[INIT] Attempting to open /dev/input/event0 for writing...\n");
-    fflush(stdout);
-    touchscreen_fd = open_touchscreen_device();
-    if (touchscreen_fd >= 0) {
-        fprintf(stdout, "[INIT] SUCCESS: Real touchscreen opened for MT gestures, fd=%d\n", touchscreen_fd);
-        fflush(stdout);
-    } else {
-        fprintf(stdout, "[INIT] FAILED: Could not open touchscreen (errno=%d)\n", errno);
+    // Initialize MIDI sequencer if needed
+    if ((c->table.has_midi_actions || macro_uses(MACRO_STEP_MIDI)) && !midi_out_running()) {
+        fprintf(stdout, "[INIT] Initializing MIDI sequencer for MIDI_CC mappings...\n");
         fflush(stdout);
+        if (midi_out_start(midi_dest) == 0) {
+            fprintf(stdout, "[INIT] SUCCESS: MIDI sequencer ready\n");
+            fflush(stdout);
+        } else {
+            fprintf(stdout, "[INIT] FAILED: Could not initialize MIDI sequencer\n");
+            fflush(stdout);
+        }
     }
+}
 
-    // Initialize devices for button mappings
-    if (num_button_mappings > 0) {
-        fprintf(stdout, "[INIT] Processing %d button mapping(s)...\n", num_button_mappings);
-        fflush(stdout);
+// Config hot reload. The input thread is the only reader of 'config', and
+// it installs a new snapshot itself, between events, at a moment when no
+// binding, drag, encoder, macro or pinch from the old one is in progress.
+// Nothing can still be using the old snapshot then, so it is freed right away
+// (RCU with an empty grace period) and the hot path never takes a lock.
+static int config_watch_fd = -1;
+static int config_timer = -1;
+
+static int config_quiescent(void)
+{
+    if (button_state.modmask || cursor.touch_down || encoder_active() || macro_playing() || gesture_in_progress)
+        return 0;
+    for (int i = 0; i < DISPATCH_NUM_BUTTONS; i++) {
+        if (button_state.held[i])
+            return 0;
+    }
+    return 1;
+}
+
+static void install_pending_config(void)
+{
+    if (!pending_config || !config_quiescent())
+        return;
+
+    struct config* old = config;
+    apply_settings(pending_config);
+    if (pending_config->new_macros)
+        macro_commit();
+    config = pending_config;
+    pending_config = NULL;
+    cursor.rate = config->rate;
+    dispatch_state_reset(&button_state);
+    open_action_devices(config);
+    free(old);
+    LOGI("[CONFIG] Reloaded: %d mapping(s), speed multiplier %.2f", config->table.num_bindings, config->rate);
+}
+
+// The directory is watched, not the file: cp and editors replace it
+static void on_config_changed(void* ctx, uint32_t events)
+{
+    (void)ctx;
+    (void)events;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int changed = 0;
+    ssize_t n;
+
+    while ((n = read(config_watch_fd, buf, sizeof(buf))) > 0) {
+        for (char* p = buf; p < buf + n;) {
+            const struct inotify_event* ie = (const struct inotify_event*)p;
+            if (ie->len && strcmp(ie->name, CONFIG_NAME) == 0)
+                changed = 1;
+            p += sizeof(*ie) + ie->len;
+        }
+    }
+    // Writers may take several writes: reload once they settle
+    if (changed)
+        ev_timer_arm_at(config_timer, ev_now_ns() + CONFIG_SETTLE_NS);
+}
+
+// Queue a new snapshot and install it if the input side is quiet.
+// Returns 0 installed, 1 pending.
+static int replace_config(struct config* c)
+{
+    free(pending_config);
+    pending_config = c;
+    install_pending_config();
+    if (!pending_config)
+        return 0;
+    LOGI("[CONFIG] New config waits until buttons, encoder and macros are released");
+    return 1;
+}
+
+// Returns 0 installed, 1 pending, -1 parse error (current config kept)
+static int reload_config(const char* path)
+{
+    char* new_device = NULL;
+
+    // A failed parse also clobbered the macro staging set a pending
+    // snapshot may rely on, so that one goes too
+    struct config* c = load_config(path, &new_device, 1);
+    if (!c) {
+        LOGW("[CONFIG] New config rejected, keeping the current one");
+        if (pending_config && pending_config->new_macros) {
+            free(pending_config);
+            pending_config = NULL;
+        }
+        return -1;
+    }
+    if (device && strcmp(new_device, device) != 0)
+        LOGW("[CONFIG] Mouse device changes need a restart, still reading %s", device);
+    free(new_device);
+    return replace_config(c);
+}
 
-        // Check if we need keyboard device (for KEY mappings)
-        int has_key_mappings = 0;
-        int has_midi_mappings = 0;
-        for (int i = 0; i < num_button_mappings; i++) {
-            if (button_mappings[i].type == MAPPING_TYPE_KEY) {
-                has_key_mappings = 1;
-            } else if (button_mappings[i].type == MAPPING_TYPE_MIDI_CC) {
-                has_midi_mappings = 1;
+static void on_config_timer(void* ctx, uint32_t events)
+{
+    (void)ctx;
+    (void)events;
+    reload_config(CONFIG_PATH);
+}
+
+// Control socket commands (see ctl.h), run on the input thread
+static void on_ctl_request(const struct ctl_request* req, struct ctl_response* resp)
+{
+    switch (req->cmd) {
+    case CTL_PING:
+        snprintf(resp->text, sizeof(resp->text), "pong");
+        break;
+    case CTL_GET_STATE:
+        resp->value[0] = cursor.x;
+        resp->value[1] = cursor.y;
+        resp->value[2] = button_state.layer;
+        resp->value[3] = (int32_t)(config->rate * 1000.0f + 0.5f);
+        resp->value[4] = config->table.num_bindings;
+        resp->value[5] = pending_config != NULL;
+        resp->value[6] = shim->generation;
+        snprintf(resp->text, sizeof(resp->text), "%s", ops.build);
+        break;
+    case CTL_SET_SPEED: {
+        float val = req->arg[0] / 1000.0f;
+        const struct config* base = pending_config ? pending_config : config;
+        struct config* c;
+        if (val < 0.1f || val > 5.0f) {
+            resp->status = CTL_ERROR;
+            snprintf(resp->text, sizeof(resp->text), "speed must be 0.1 .. 5.0");
+            break;
+        }
+        // A copy of the newest snapshot with only the speed changed
+        c = malloc(sizeof(*c));
+        if (!c) {
+            resp->status = CTL_ERROR;
+            break;
+        }
+        memcpy(c, base, sizeof(*c));
+        c->rate = val;
+        // The installed config's macros are committed already; only a
+        // pending one still owns the staging set
+        c->new_macros = base == pending_config && pending_config->new_macros;
+        if (replace_config(c) > 0)
+            resp->status = CTL_PENDING;
+        break;
+    }
+    case CTL_LOAD_CONFIG: {
+        const char* path = req->text[0] ? req->text : CONFIG_PATH;
+        int ret = reload_config(path);
+        if (ret < 0) {
+            resp->status = CTL_ERROR;
+            snprintf(resp->text, sizeof(resp->text), "%s not loaded, see the log", path);
+        } else if (ret > 0) {
+            resp->status = CTL_PENDING;
+        }
+        break;
+    }
+    case CTL_WARP:
+        cursor.x = pipeline_clamp(req->arg[0], PIPELINE_WIDTH - 1);
+        cursor.y = pipeline_clamp(req->arg[1], PIPELINE_HEIGHT - 1);
+        frames_pending = 1;
+        flush_cursor();
+        break;
+    case CTL_GESTURE: {
+        int x = req->arg[1] < 0 ? cursor.x : req->arg[1];
+        int y = req->arg[1] < 0 ? cursor.y : req->arg[2];
+        if (req->arg[0] == CTL_GESTURE_TAP && uinput_fd >= 0) {
+            send_touch_event(uinput_fd, x, y, 1);
+            send_touch_event(uinput_fd, x, y, 0);
+        } else if (req->arg[0] != CTL_GESTURE_TAP && touchscreen_fd >= 0) {
+            if (animate_pinch_gesture(touchscreen_fd, x, y, req->arg[0] == CTL_GESTURE_ZOOM_IN) < 0) {
+                resp->status = CTL_ERROR;
+                snprintf(resp->text, sizeof(resp->text), "a pinch is already in progress");
             }
+        } else {
+            resp->status = CTL_ERROR;
+            snprintf(resp->text, sizeof(resp->text), "touch device not open");
         }
+        break;
+    }
+    case CTL_SET:
+        if (!parse_setting_line(req->text)) {
+            resp->status = CTL_ERROR;
+            snprintf(resp->text, sizeof(resp->text), "unknown setting '%s'", req->text);
+        }
+        break;
+    case CTL_TRACE:
+        trace_on = req->arg[0] != 0;
+        break;
+    case CTL_DUMP:
+        if (!trace_on && !drm_census_enabled) {
+            resp->status = CTL_ERROR;
+            snprintf(resp->text, sizeof(resp->text), "nothing to dump: tracing and DRM census are off");
+            break;
+        }
+        dump_reports();
+        snprintf(resp->text, sizeof(resp->text), "%s%s%s", trace_on ? TRACE_DEFAULT_PATH : "",
+                 trace_on && drm_census_enabled ? "\n" : "", drm_census_enabled ? DRM_CENSUS_PATH : "");
+        break;
+    case CTL_RELOAD:
+        // The loop ends after this reply; the shim loads the new engine
+        snprintf(shim->next_engine, sizeof(shim->next_engine), "%s", req->text);
+        reload_requested = 1;
+        if (!config_quiescent())
+            resp->status = CTL_PENDING;
+        snprintf(resp->text, sizeof(resp->text), "engine %d stopping, check with: cursor_ctl state", shim->generation);
+        break;
+    case CTL_STATS: {
+        size_t len = 0;
+        // Names are filled in when the page is published
+        if (stats->magic != STATS_MAGIC) {
+            resp->status = CTL_ERROR;
+            snprintf(resp->text, sizeof(resp->text), "stats page not published");
+            break;
+        }
+        for (int i = 0; i < STAT_COUNT && len < sizeof(resp->text); i++)
+            len += snprintf(resp->text + len, sizeof(resp->text) - len, "%s %llu\n", stats->name[i],
+                            (unsigned long long)stats->counter[i]);
+        break;
+    }
+    default:
+        resp->status = CTL_BAD_REQUEST;
+        snprintf(resp->text, sizeof(resp->text), "unknown command %d", req->cmd);
+        break;
+    }
+}
 
-        // Initialize keyboard if needed
-        if (has_key_mappings) {
-            fprintf(stdout, "[INIT] Initializing keyboard device for KEY mappings...\n");
-            fflush(stdout);
-            keyboard_fd = init_uinput_keyboard();
-            if (keyboard_fd >= 0) {
-                fprintf(stdout, "[INIT] SUCCESS: Keyboard device ready, fd=%d\n", keyboard_fd);
-                fflush(stdout);
-            } else {
-                fprintf(stdout, "[INIT] FAILED: Could not create keyboard device (errno=%d)\n", errno);
-                fflush(stdout);
+// Input loop (engine_ops.run) on the shim's input thread. Devices that a
+// previous engine handed back are reused, not reopened.
+static int engine_run(struct engine_state* s)
+{
+    shim = s;
+    cursor.x = s->persist->cursor_x;
+    cursor.y = s->persist->cursor_y;
+    uinput_fd = s->uinput_fd;
+    touchscreen_fd = s->touchscreen_fd;
+    keyboard_fd = s->keyboard_fd;
+    input_running = 1;
+    reload_requested = 0;
+
+    int fd = s->mouse_fd;
+    if (fd >= 0) {
+        fprintf(stdout, "[INIT] Engine %d taking over the open devices\n", s->generation);
+        fflush(stdout);
+    } else {
+        fprintf(stdout, "--------- opening device %s\n", device);
+        fd = open(device, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        // The device that worked before the last MPC restart
+        if (fd < 0 && s->persist->device[0] && strcmp(s->persist->device, device) != 0) {
+            fprintf(stdout, "----------- ERROR opening device %s, trying %s from the last run\n", device, s->persist->device);
+            fd = open(s->persist->device, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+            if (fd >= 0) {
+                free(device);
+                device = strdup(s->persist->device);
             }
         }
+        if (fd < 0) {
+            fprintf(stdout, "----------- ERROR opening device %s for Mouse Events\n", device);
+            free(device);
+            device = NULL;
+
+            return ENGINE_EXIT_STOP;
+        }
+        snprintf(s->persist->device, sizeof(s->persist->device), "%s", device ? device : "");
+    }
+    // device stays allocated: config reloads compare against it
 
-        // Initialize MIDI sequencer if needed
-        if (has_midi_mappings) {
-            fprintf(stdout, "[INIT] Initializing MIDI sequencer for MIDI_CC mappings...\n");
+    // Initialize uinput for single-touch injection (cursor clicks)
+    if (uinput_fd < 0) {
+        fprintf(stdout, "[INIT] Attempting to create uinput device...\n");
+        fflush(stdout);
+        uinput_fd = init_uinput();
+        if (uinput_fd >= 0) {
+            fprintf(stdout, "[INIT] SUCCESS: Virtual Touch device created (single-touch only), fd=%d\n", uinput_fd);
+            fflush(stdout);
+        } else {
+            fprintf(stdout, "[INIT] FAILED: Could not create uinput device (errno=%d)\n", errno);
             fflush(stdout);
-            if (init_midi_sequencer() == 0) {
-                fprintf(stdout, "[INIT] SUCCESS: MIDI sequencer ready\n");
-                fflush(stdout);
-            } else {
-                fprintf(stdout, "[INIT] FAILED: Could not initialize MIDI sequencer\n");
-                fflush(stdout);
-            }
         }
+    }
+
+    // Open real touchscreen for MT gesture injection
+    if (touchscreen_fd < 0) {
+        fprintf(stdout, "[INIT] Attempting to open /dev/input/event0 for writing...\n");
+        fflush(stdout);
+        touchscreen_fd = open_touchscreen_device();
+        if (touchscreen_fd >= 0) {
+            fprintf(stdout, "[INIT] SUCCESS: Real touchscreen opened for MT gestures, fd=%d\n", touchscreen_fd);
+            fflush(stdout);
+        } else {
+            fprintf(stdout, "[INIT] FAILED: Could not open touchscreen (errno=%d)\n", errno);
+            fflush(stdout);
+        }
+    }
+
+    // The shim keeps track of the devices (reloads, forked children)
+    s->mouse_fd = fd;
+    s->uinput_fd = uinput_fd;
+    s->touchscreen_fd = touchscreen_fd;
+
+    // Initialize devices for button mappings
+    if (config->table.num_bindings > 0) {
+        fprintf(stdout, "[INIT] Processing %d button mapping(s)...\n", config->table.num_bindings);
+        fflush(stdout);
+        open_action_devices(config);
     } else {
         fprintf(stdout, "[INIT] No button mappings configured\n");
         fflush(stdout);
     }
+    dispatch_state_reset(&button_state);
 
     // Hardware button monitoring disabled (couldn't read from event1)
     // monitor_kbd_fd = open_keyboard_monitor();
@@ -681,100 +1129,89 @@ static void* input_monitor(void* arg)
     //     fflush(stdout);
     // }
 
-    struct input_event ev;
-    int (*real_drmModeMoveCursor)(int, uint32_t, int, int) = dlsym(RTLD_NEXT, "drmModeMoveCursor");
-
-    while (input_running) {
-        // Check for mouse events
-        ssize_t n = read(fd, &ev, sizeof(ev));
-        if (n == sizeof(ev)) {
-            if (ev.type == EV_REL) {
-                // Swap X and Y for portrait display (800x1280), invert Y
-                int position_changed = 0;
-                if (ev.code == REL_X) {
-                    cursor_y -= (ev.value * rate); // Mouse X -> Screen Y (inverted)
-                    if (cursor_y < 0)
-                        cursor_y = 0;
-                    if (cursor_y > 1279)
-                        cursor_y = 1279; // Portrait height
-                    position_changed = 1;
-                } else if (ev.code == REL_Y) {
-                    cursor_x += (ev.value * rate); // Mouse Y -> Screen X
-                    if (cursor_x < 0)
-                        cursor_x = 0;
-                    if (cursor_x > 799)
-                        cursor_x = 799; // Portrait width
-                    position_changed = 1;
-                } else if (ev.code == REL_WHEEL) {
-                    // Mouse wheel -> pinch gesture (inject to real touchscreen)
-                    fprintf(stdout, "[WHEEL] Detected wheel event: value=%d, touchscreen_fd=%d, gesture_in_progress=%d\n",
-                            ev.value, touchscreen_fd, gesture_in_progress);
-                    fflush(stdout);
-
-                    if (touchscreen_fd >= 0 && !gesture_in_progress) {
-                        if (ev.value > 0) {
-                            // Scroll up = zoom in
-                            fprintf(stdout, "[WHEEL] Injecting ZOOM IN gesture to /dev/input/event0 at (%d, %d)\n", cursor_x, cursor_y);
-                            fflush(stdout);
-                            animate_pinch_gesture(touchscreen_fd, cursor_x, cursor_y, 1);
-                        } else if (ev.value < 0) {
-                            // Scroll down = zoom out
-                            fprintf(stdout, "[WHEEL] Injecting ZOOM OUT gesture to /dev/input/event0 at (%d, %d)\n", cursor_x, cursor_y);
-                            fflush(stdout);
-                            animate_pinch_gesture(touchscreen_fd, cursor_x, cursor_y, 0);
-                        }
-                    }
-                }
+    // Kernel timestamps on the same clock as ev_now_ns(), for latency stats
+    if (latency_set_clock(fd) < 0) {
+        fprintf(stdout, "[INIT] Mouse event timestamps stay on CLOCK_REALTIME, evdev latency not measured\n");
+        fflush(stdout);
+    }
 
-                // If left button is pressed and cursor moved, send touch move event
-                if (position_changed && left_button_pressed && uinput_fd >= 0) {
-                    send_touch_event(uinput_fd, cursor_x, cursor_y, 1);
-                }
-            } else if (ev.type == EV_KEY) {
-                // Mouse button events
-                fprintf(stdout, "[DEBUG] EV_KEY: code=%d value=%d\n", ev.code, ev.value);
-                fflush(stdout);
+    // Everything below runs from one epoll loop: no polling, no sleeps
+    mouse_fd = fd;
+    if (ev_loop_init() < 0 || ev_loop_add(fd, EPOLLIN, on_mouse_readable, NULL) < 0) {
+        fprintf(stdout, "[INIT] FAILED: Could not set up the event loop (errno=%d)\n", errno);
+        fflush(stdout);
+        input_running = 0;
+    }
+    if (encoder_init() < 0) {
+        fprintf(stdout, "[INIT] FAILED: Could not create encoder timer (errno=%d)\n", errno);
+        fflush(stdout);
+    }
+    if (pinch_init() < 0) {
+        fprintf(stdout, "[INIT] FAILED: Could not create gesture timer, no pinch gestures (errno=%d)\n", errno);
+        fflush(stdout);
+    }
+    static const struct macro_sink sink = { macro_touch, macro_key, macro_midi };
+    if (macro_init(&sink) < 0) {
+        fprintf(stdout, "[INIT] FAILED: Could not create macro timer (errno=%d)\n", errno);
+        fflush(stdout);
+    }
 
-                // Check if button has a mapping
-                struct button_mapping* mapping = get_button_mapping(ev.code);
-                fprintf(stdout, "[DEBUG] Button %d: mapping=%p\n", ev.code, (void*)mapping);
-                fflush(stdout);
+    // Live counters for cursor_stats (the shim publishes the page)
+    static int stats_timer = -1;
+    stats_timer = ev_timer_create(on_stats_timer, &stats_timer);
+    if (stats_timer >= 0)
+        ev_timer_arm_at(stats_timer, ev_now_ns() + 1000000000ull);
+
+    // Config hot reload: edit or copy over /dev/shm/.mouseCursor
+    config_watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    config_timer = ev_timer_create(on_config_timer, NULL);
+    if (config_watch_fd < 0 || config_timer < 0
+        || inotify_add_watch(config_watch_fd, CONFIG_DIR, IN_CLOSE_WRITE | IN_MOVED_TO) < 0
+        || ev_loop_add(config_watch_fd, EPOLLIN, on_config_changed, NULL) < 0) {
+        fprintf(stdout, "[INIT] FAILED: Could not watch %s, no config hot reload (errno=%d)\n", CONFIG_PATH, errno);
+        fflush(stdout);
+    }
 
-                if (mapping != NULL) {
-                    if (mapping->type == MAPPING_TYPE_KEY && keyboard_fd >= 0) {
-                        // Send keyboard event
-                        fprintf(stdout, "[BUTTON] Button %d -> Key %d (pressed=%d)\n", ev.code, mapping->value, ev.value);
-                        fflush(stdout);
-                        send_key_event(keyboard_fd, mapping->value, ev.value);
-                    } else if (mapping->type == MAPPING_TYPE_MIDI_CC) {
-                        // Send MIDI CC event
-                        fprintf(stdout, "[BUTTON] Button %d -> MIDI CC %d (pressed=%d)\n", ev.code, mapping->value, ev.value);
-                        fflush(stdout);
-                        send_midi_cc(mapping->value, 127, ev.value);
-                    }
-                } else if (ev.code == BTN_LEFT || ev.code == BTN_RIGHT || ev.code == BTN_MIDDLE) {
-                    // No mapping, send as touch event (default behavior)
-                    fprintf(stdout, "[DEBUG] Sending as touch event\n");
-                    fflush(stdout);
-                    if (uinput_fd >= 0) {
-                        send_touch_event(uinput_fd, cursor_x, cursor_y, ev.value);
-
-                        // Track left button state for continuous drag
-                        if (ev.code == BTN_LEFT) {
-                            left_button_pressed = ev.value;
-                            fprintf(stdout, "[DEBUG] Left button %s\n", ev.value ? "PRESSED" : "RELEASED");
-                            fflush(stdout);
-                        }
-                    }
-                }
-            } else if (ev.type == EV_SYN && ev.code == SYN_REPORT) {
-                // Move cursor after sync
-                if (saved_fd >= 0 && real_drmModeMoveCursor) {
-                    real_drmModeMoveCursor(saved_fd, saved_crtc, cursor_x, cursor_y);
-                }
-            }
+    // Runtime control: cursor_ctl
+    if (ctl_start(CTL_SOCKET_PATH, on_ctl_request) < 0) {
+        fprintf(stdout, "[INIT] FAILED: Could not open control socket %s (errno=%d)\n", CTL_SOCKET_PATH, errno);
+        fflush(stdout);
+    }
+
+    // Remote pointer/keyboard: cursor_remote (REMOTE=1)
+    if (remote_start(on_remote_events) < 0) {
+        fprintf(stdout, "[INIT] FAILED: Could not open the remote input socket(s) (errno=%d)\n", errno);
+        fflush(stdout);
+    }
+
+    // A reload waits, like a new config, for buttons, encoder, macros and pinches
+    while (input_running && !s->stop && !(reload_requested && config_quiescent())) {
+        if (ev_loop_run_once(-1) < 0) {
+            input_running = 0;
+            break;
         }
-        usleep(1000); // 1ms sleep
+        stats_inc(STAT_LOOP_WAKEUPS);
+    }
+
+    ctl_stop();
+    remote_stop();
+    ev_timer_destroy(stats_timer);
+    ev_timer_destroy(config_timer);
+    if (config_watch_fd >= 0)
+        close(config_watch_fd);
+    free(pending_config);
+    pending_config = NULL;
+    macro_close();
+    pinch_close();
+    encoder_close();
+    ev_loop_close();
+    midi_out_stop();
+
+    if (input_running && !s->stop) {
+        // Reload: the devices stay open for the next engine
+        fprintf(stdout, "[INIT] Engine %d stopped for a reload\n", s->generation);
+        fflush(stdout);
+        return ENGINE_EXIT_RELOAD;
     }
 
     if (uinput_fd >= 0) {
@@ -788,188 +1225,292 @@ static void* input_monitor(void* arg)
         close(keyboard_fd);
     }
     close(fd);
-    return NULL;
+    s->mouse_fd = s->uinput_fd = s->touchscreen_fd = s->keyboard_fd = -1;
+    return ENGINE_EXIT_STOP;
 }
 
-// Hook drmModeSetCursor2
-int drmModeSetCursor2(int fd, uint32_t crtcId, uint32_t bo_handle,
-    uint32_t width, uint32_t height,
-    int32_t hot_x, int32_t hot_y)
-{
-    static int (*real_drmModeSetCursor2)(int, uint32_t, uint32_t, uint32_t, uint32_t, int32_t, int32_t) = NULL;
-
-    if (!real_drmModeSetCursor2) {
-        real_drmModeSetCursor2 = dlsym(RTLD_NEXT, "drmModeSetCursor2");
-    }
-
-    if (bo_handle == 0) {
-        if (!cursor_initialized) {
-            init_cursor(fd, crtcId);
-
-            // Start input monitor thread
-            if (!input_running) {
-                input_running = 1;
-                pthread_create(&input_thread, NULL, input_monitor, NULL);
-            }
-        }
-
-        if (cursor_bo != 0 && real_drmModeSetCursor2) {
-            int ret = real_drmModeSetCursor2(fd, crtcId, cursor_bo, 64, 64, 0, 0);
+static const struct engine_ops ops = {
+    .abi = ENGINE_ABI,
+    .build = __DATE__ " " __TIME__,
+    .init = engine_init,
+    .run = engine_run,
+    .wake = ev_loop_wake,
+};
 
-            // Initially position the cursor
-            int (*real_drmModeMoveCursor)(int, uint32_t, int, int) = dlsym(RTLD_NEXT, "drmModeMoveCursor");
-            if (real_drmModeMoveCursor) {
-                real_drmModeMoveCursor(fd, crtcId, cursor_x, cursor_y);
-            }
+// The one symbol the shim looks up (see engine.h)
+__attribute__((visibility("default"))) const struct engine_ops* force_cursor_engine(void)
+{
+    return &ops;
+}
 
-            return ret;
-        }
+// Global settings in the mapping section (NAME=value, not a button binding).
+// Returns 1 if the line was a setting.
+static int parse_setting_line(const char* line)
+{
+    // MIDI_DEST=<client or port name>[:<port name>] (or numeric client:port)
+    if (strncasecmp(line, "MIDI_DEST=", 10) == 0) {
+        snprintf(midi_dest, sizeof midi_dest, "%s", line + 10);
+        fprintf(stdout, "[CONFIG] MIDI destination: '%s'\n", midi_dest);
+    } else if (strncasecmp(line, "LOG_LEVEL=", 10) == 0) {
+        int level = log_parse_level(line + 10);
+        if (level >= 0)
+            log_level = level;
+        fprintf(stdout, "[CONFIG] Log level: %d\n", log_level);
+    } else if (strncasecmp(line, "LOG_RATE=", 9) == 0) {
+        int lines = atoi(line + 9);
+        if (lines > 0)
+            log_rate = lines;
+        fprintf(stdout, "[CONFIG] Log rate limit: %d lines/s\n", log_rate);
+    } else if (strncasecmp(line, "LATENCY_STATS=", 14) == 0) {
+        latency_enabled = atoi(line + 14) != 0;
+        fprintf(stdout, "[CONFIG] Latency histograms: %s\n", latency_enabled ? "on" : "off");
+    } else if (strncasecmp(line, "UI_PROBE=", 9) == 0) {
+        ui_probe_enabled = atoi(line + 9) != 0;
+        fprintf(stdout, "[CONFIG] UI response probe: %s\n", ui_probe_enabled ? "on" : "off");
+    } else if (strncasecmp(line, "FRAME_STATS=", 12) == 0) {
+        frametime_enabled = atoi(line + 12) != 0;
+        fprintf(stdout, "[CONFIG] MPC frame-time stats: %s\n", frametime_enabled ? "on" : "off");
+    } else if (strncasecmp(line, "XRUN_MONITOR=", 13) == 0) {
+        xrun_enabled = atoi(line + 13) != 0;
+        fprintf(stdout, "[CONFIG] Audio xrun monitor: %s\n", xrun_enabled ? "on" : "off");
+    } else if (strncasecmp(line, "XRUN_WINDOW=", 12) == 0) {
+        int ms = atoi(line + 12);
+        if (ms > 0 && ms <= 1000)
+            xrun_window_ms = ms;
+        fprintf(stdout, "[CONFIG] Xrun activity window: %d ms\n", xrun_window_ms);
+    } else if (strncasecmp(line, "DRM_CENSUS=", 11) == 0) {
+        drm_census_enabled = atoi(line + 11) != 0;
+        fprintf(stdout, "[CONFIG] DRM ioctl census: %s\n", drm_census_enabled ? "on" : "off");
+    } else if (strncasecmp(line, "TRACE=", 6) == 0) {
+        trace_on = atoi(line + 6) != 0;
+        fprintf(stdout, "[CONFIG] Tracing: %s\n", trace_on ? "on" : "off");
+    } else if (strncasecmp(line, "REMOTE=", 7) == 0) {
+        remote_config.enabled = atoi(line + 7) != 0;
+        fprintf(stdout, "[CONFIG] Remote input: %s\n", remote_config.enabled ? "on" : "off");
+        if (!applying_settings)
+            remote_apply();
+    } else if (strncasecmp(line, "REMOTE_PORT=", 12) == 0) {
+        int port = atoi(line + 12);
+        if (port >= 0 && port < 65536)
+            remote_config.port = port;
+        fprintf(stdout, "[CONFIG] Remote input TCP port: %d\n", remote_config.port);
+        if (!applying_settings)
+            remote_apply();
+    } else if (strncasecmp(line, "VNC=", 4) == 0) {
+        vnc_config.enabled = atoi(line + 4) != 0;
+        fprintf(stdout, "[CONFIG] VNC server: %s\n", vnc_config.enabled ? "on" : "off");
+        if (!applying_settings)
+            vnc_apply();
+    } else if (strncasecmp(line, "VNC_PORT=", 9) == 0) {
+        int port = atoi(line + 9);
+        if (port > 0 && port < 65536)
+            vnc_config.port = port;
+        fprintf(stdout, "[CONFIG] VNC port: %d\n", vnc_config.port);
+        if (!applying_settings)
+            vnc_apply();
+    } else if (strncasecmp(line, "VNC_FPS=", 8) == 0) {
+        int fps = atoi(line + 8);
+        if (fps >= 1 && fps <= 60)
+            vnc_config.fps = fps;
+        fprintf(stdout, "[CONFIG] VNC frame rate limit: %d fps\n", vnc_config.fps);
+    } else if (strncasecmp(line, "VNC_CPU=", 8) == 0) {
+        int pct = atoi(line + 8);
+        if (pct >= 1 && pct <= 100)
+            vnc_config.cpu_pct = pct;
+        fprintf(stdout, "[CONFIG] VNC CPU budget: %d%%\n", vnc_config.cpu_pct);
+    } else if (strncasecmp(line, "ENCODER_RATE=", 13) == 0) {
+        encoder_config.rate_hz = atoi(line + 13);
+        if (encoder_config.rate_hz < 1 || encoder_config.rate_hz > 1000)
+            encoder_config.rate_hz = ENCODER_DEFAULT_RATE;
+        fprintf(stdout, "[CONFIG] Encoder rate limit: %d msg/s\n", encoder_config.rate_hz);
+    } else if (strncasecmp(line, "ENCODER_SENSITIVITY=", 20) == 0) {
+        float val = strtof(line + 20, NULL);
+        if (val > 0.0f && val <= 16.0f)
+            encoder_config.sensitivity = val;
+        fprintf(stdout, "[CONFIG] Encoder sensitivity: %f\n", encoder_config.sensitivity);
+    } else if (strncasecmp(line, "ENCODER_WHEEL_STEP=", 19) == 0) {
+        encoder_config.wheel_step = atoi(line + 19);
+        fprintf(stdout, "[CONFIG] Encoder wheel step: %d\n", encoder_config.wheel_step);
+    } else if (strncasecmp(line, "ENCODER_TAP=", 12) == 0) {
+        encoder_config.select_tap = atoi(line + 12) != 0;
+        fprintf(stdout, "[CONFIG] Encoder select tap: %d\n", encoder_config.select_tap);
+    } else if (strncasecmp(line, "ENCODER_CHANNEL=", 16) == 0) {
+        int ch = atoi(line + 16);
+        if (ch >= 1 && ch <= 16)
+            encoder_config.channel = ch - 1;
+        fprintf(stdout, "[CONFIG] Encoder MIDI channel: %d\n", encoder_config.channel + 1);
+    } else {
         return 0;
     }
+    fflush(stdout);
+    return 1;
+}
 
-    // Pass through other cursor sets
-    if (real_drmModeSetCursor2) {
-        return real_drmModeSetCursor2(fd, crtcId, bo_handle, width, height, hot_x, hot_y);
+// Setting names handled by parse_setting_line(), so a config line can be
+// recognised before it is applied
+static const char* const setting_names[] = {
+    "MIDI_DEST=", "LOG_LEVEL=", "LOG_RATE=", "LATENCY_STATS=", "UI_PROBE=", "FRAME_STATS=",
+    "XRUN_MONITOR=", "XRUN_WINDOW=", "DRM_CENSUS=", "TRACE=", "REMOTE=", "REMOTE_PORT=", "VNC=",
+    "VNC_PORT=", "VNC_FPS=", "VNC_CPU=", "ENCODER_RATE=",
+    "ENCODER_SENSITIVITY=", "ENCODER_WHEEL_STEP=", "ENCODER_TAP=", "ENCODER_CHANNEL=",
+};
+
+static int is_setting_line(const char* line)
+{
+    for (size_t i = 0; i < sizeof(setting_names) / sizeof(setting_names[0]); i++) {
+        if (strncasecmp(line, setting_names[i], strlen(setting_names[i])) == 0)
+            return 1;
     }
     return 0;
 }
 
-// Hook drmModeSetCursor
-int drmModeSetCursor(int fd, uint32_t crtcId, uint32_t bo_handle,
-    uint32_t width, uint32_t height)
+// What a setting is when the config file does not name it
+static void reset_settings(void)
 {
-    return drmModeSetCursor2(fd, crtcId, bo_handle, width, height, 0, 0);
+    snprintf(midi_dest, sizeof midi_dest, "%s", MIDI_OUT_DEFAULT_DEST);
+    log_level = LOG_INFO;
+    log_rate = LOG_DEFAULT_RATE;
+    latency_enabled = 1;
+    ui_probe_enabled = 0;
+    frametime_enabled = 0;
+    xrun_enabled = 0;
+    xrun_window_ms = XRUN_DEFAULT_WINDOW_MS;
+    drm_census_enabled = 0;
+    trace_on = 0;
+    remote_config.enabled = 0;
+    remote_config.port = REMOTE_DEFAULT_PORT;
+    vnc_config.enabled = 0;
+    vnc_config.port = VNC_DEFAULT_PORT;
+    vnc_config.fps = VNC_DEFAULT_FPS;
+    vnc_config.cpu_pct = VNC_DEFAULT_CPU;
+    encoder_config.rate_hz = ENCODER_DEFAULT_RATE;
+    encoder_config.sensitivity = ENCODER_DEFAULT_SENSITIVITY;
+    encoder_config.wheel_step = ENCODER_DEFAULT_WHEEL_STEP;
+    encoder_config.select_tap = 1;
+    encoder_config.channel = 0;
 }
 
-// Hook drmModeMoveCursor
-int drmModeMoveCursor(int fd, uint32_t crtcId, int x, int y)
+// The file is the whole truth: a line removed since the last load (or a
+// value changed with cursor_ctl set) goes back to its default. The servers
+// are reconciled at the end, once all of them are known.
+static void apply_settings(const struct config* c)
 {
-    static int (*real_drmModeMoveCursor)(int, uint32_t, int, int) = NULL;
-    static int count = 0;
-
-    if (!real_drmModeMoveCursor) {
-        real_drmModeMoveCursor = dlsym(RTLD_NEXT, "drmModeMoveCursor");
-    }
-
-    if (count < 3) {
-        fprintf(stderr, "[CURSOR_PATCH] MPC moved cursor to %d,%d\n", x, y);
-        count++;
-    }
-
-    if (real_drmModeMoveCursor) {
-        return real_drmModeMoveCursor(fd, crtcId, x, y);
-    }
-    return 0;
+    applying_settings = 1;
+    reset_settings();
+    for (int i = 0; i < c->num_settings; i++)
+        parse_setting_line(c->settings[i]);
+    applying_settings = 0;
+    remote_apply();
+    vnc_apply();
 }
 
-static int read_params_file(const char* path, char** out_str, float* out_val)
+// Parse the config file into a new snapshot; macros go to the macro staging
+// set. strict (reloads): any invalid line fails the whole load rather than
+// replace a working config with part of a new one.
+static struct config* load_config(const char* path, char** out_device, int strict)
 {
     FILE* fp = fopen(path, "r");
     if (!fp)
-        return -1;
+        return NULL;
 
-    char line[256];
+    struct config* c = calloc(1, sizeof(*c));
+    if (!c) {
+        fclose(fp);
+        return NULL;
+    }
+
+    char line[512];
     /* ----- first line (string) ----- */
     if (!fgets(line, sizeof line, fp)) { /* no first line? */
         fclose(fp);
-        return -1;
+        free(c);
+        return NULL;
     }
     size_t len = strcspn(line, "\r\n"); /* strip newline */
-    *out_str = malloc(len + 1);
-    if (!*out_str) {
+    *out_device = malloc(len + 1);
+    if (!*out_device) {
         fclose(fp);
-        return -1;
+        free(c);
+        return NULL;
     }
-    memcpy(*out_str, line, len);
-    (*out_str)[len] = '\0';
+    memcpy(*out_device, line, len);
+    (*out_device)[len] = '\0';
 
     /* ----- second line (float) ----- */
-    if (!fgets(line, sizeof line, fp)) {
-        *out_val = 1.0f; /* default if missing */
-    } else {
+    c->rate = 1.0f; /* default if missing */
+    if (fgets(line, sizeof line, fp)) {
         char* endptr;
         float val = strtof(line, &endptr);
-        if (endptr == line || *out_val < 0.1f || val > 5.0f)
+        if (endptr == line || val < 0.1f || val > 5.0f)
             val = 1.0f; /* default on parse error or out of range */
-        *out_val = val;
+        c->rate = val;
     }
 
-    /* ----- additional lines (button mappings) ----- */
-    num_button_mappings = 0;
+    /* ----- additional lines (settings, macros, button mappings) ----- */
+    static struct dispatch_builder builder;
+    int errors = 0;
+    dispatch_builder_init(&builder);
+    builder.macro_lookup = macro_find;
+    macro_reset();
+    c->new_macros = 1;
     fprintf(stdout, "[CONFIG] Starting to parse button mappings...\n");
     fflush(stdout);
-    while (fgets(line, sizeof line, fp) && num_button_mappings < MAX_BUTTON_MAPPINGS) {
+    while (fgets(line, sizeof line, fp)) {
         // Strip newline
         len = strcspn(line, "\r\n");
         line[len] = '\0';
 
-        fprintf(stdout, "[CONFIG] Read line: '%s'\n", line);
-        fflush(stdout);
-
-        // Skip empty lines and comments
-        if (len == 0 || line[0] == '#') {
-            fprintf(stdout, "[CONFIG] Skipping (empty or comment)\n");
-            fflush(stdout);
+        // Settings take effect when the snapshot is installed
+        if (is_setting_line(line)) {
+            if (c->num_settings == CONFIG_MAX_SETTINGS) {
+                fprintf(stdout, "[CONFIG] Warning: Too many settings, '%s' skipped\n", line);
+                fflush(stdout);
+                errors++;
+                continue;
+            }
+            snprintf(c->settings[c->num_settings++], sizeof(c->settings[0]), "%s", line);
             continue;
         }
 
-        // Parse BUTTON=KEY or BUTTON=MIDI_CC_XXX format
-        char* eq = strchr(line, '=');
-        if (!eq) {
-            continue;  // Invalid format
-        }
-
-        *eq = '\0';  // Split at '='
-        char* button_str = line;
-        char* value_str = eq + 1;
-
-        // Trim whitespace
-        while (*button_str == ' ' || *button_str == '\t') button_str++;
-        while (*value_str == ' ' || *value_str == '\t') value_str++;
-
-        // Parse button code
-        int button_code = parse_code(button_str, button_names);
-        if (button_code < 0) {
-            fprintf(stdout, "[CONFIG] Warning: Invalid button '%s' (skipped)\n", button_str);
-            fflush(stdout);
+        // MACRO name=step; step; ...
+        if (strncasecmp(line, "MACRO ", 6) == 0) {
+            char* eq = strchr(line, '=');
+            char name[MACRO_NAME_LEN];
+            if (!eq || sscanf(line + 6, "%31[^= \t]", name) != 1) {
+                fprintf(stdout, "[CONFIG] Warning: Invalid macro '%s' (skipped)\n", line);
+                fflush(stdout);
+                errors++;
+                continue;
+            }
+            if (macro_define(name, eq + 1) < 0)
+                errors++;
             continue;
         }
 
-        // Check if value is MIDI_CC_XXX format
-        if (strncasecmp(value_str, "MIDI_CC_", 8) == 0) {
-            // Parse MIDI CC number
-            int cc_number = atoi(value_str + 8);
-            if (cc_number >= 0 && cc_number <= 127) {
-                button_mappings[num_button_mappings].button_code = button_code;
-                button_mappings[num_button_mappings].type = MAPPING_TYPE_MIDI_CC;
-                button_mappings[num_button_mappings].value = cc_number;
-                fprintf(stdout, "[CONFIG] Button mapping: %s (%d) -> MIDI CC %d\n",
-                        button_str, button_code, cc_number);
-                fflush(stdout);
-                num_button_mappings++;
-            } else {
-                fprintf(stdout, "[CONFIG] Warning: Invalid MIDI CC number '%s' (must be 0-127)\n",
-                        value_str);
-                fflush(stdout);
-            }
-        } else {
-            // Parse as keyboard key
-            int key_code = parse_code(value_str, key_names);
-            if (key_code >= 0) {
-                button_mappings[num_button_mappings].button_code = button_code;
-                button_mappings[num_button_mappings].type = MAPPING_TYPE_KEY;
-                button_mappings[num_button_mappings].value = key_code;
-                fprintf(stdout, "[CONFIG] Button mapping: %s (%d) -> KEY %s (%d)\n",
-                        button_str, button_code, value_str, key_code);
-                fflush(stdout);
-                num_button_mappings++;
-            } else {
-                fprintf(stdout, "[CONFIG] Warning: Invalid key '%s' (skipped)\n", value_str);
-                fflush(stdout);
-            }
+        // The parser splits the line in place
+        char original[sizeof(line)];
+        memcpy(original, line, len + 1);
+        if (dispatch_parse_line(&builder, line) < 0) {
+            fprintf(stdout, "[CONFIG] Warning: Invalid line '%s' (skipped)\n", original);
+            fflush(stdout);
+            errors++;
         }
     }
-
     fclose(fp);
-    return 0;
+
+    if (dispatch_compile(&builder, &c->table) < 0)
+        errors++;
+    fprintf(stdout, "[CONFIG] Compiled %d button mapping(s) into %d action(s)\n",
+            c->table.num_bindings, c->table.num_actions);
+    fflush(stdout);
+
+    if (strict && errors) {
+        fprintf(stdout, "[CONFIG] %d error(s) in %s, config not loaded\n", errors, path);
+        fflush(stdout);
+        free(*out_device);
+        *out_device = NULL;
+        free(c);
+        return NULL;
+    }
+    return c;
 }
@@ -0,0 +1,162 @@
+/**
+ * @file frametime.c
+ * Decription: MPC frame-time profiler (see frametime.h).
+ *
+ */
+#define _GNU_SOURCE
+#include "frametime.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <xf86drmMode.h>
+
+#include "stats.h"
+#include "trace.h"
+
+#define DEFAULT_PERIOD_NS 16666667ull  // 60 Hz until measured
+
+int frametime_enabled = 0;
+
+// Commits waiting for their flip event. MPC may commit and handle events
+// on different threads, so the table has a lock (uncontended, 60 Hz).
+static pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+    void* user_data;
+    uint64_t commit_ns;
+    uint64_t trace_t0;
+} pending[FRAMETIME_PENDING];
+static int num_pending = 0;
+
+// Event thread state
+static uint64_t last_flip_ns = 0;
+static unsigned int last_seq = 0;
+static uint64_t period_ns = DEFAULT_PERIOD_NS;
+
+// MPC's handlers for the drmHandleEvent call in progress on this thread
+static __thread drmEventContextPtr mpc_ctx = NULL;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void frametime_commit(uint32_t flags, void* user_data)
+{
+    if (!frametime_enabled || !(flags & DRM_MODE_PAGE_FLIP_EVENT) || (flags & DRM_MODE_ATOMIC_TEST_ONLY))
+        return;
+
+    stats_inc(STAT_GUI_COMMITS);
+    uint64_t t0 = trace_begin();
+    pthread_mutex_lock(&pending_lock);
+    // Oldest entry goes if events were never handled (MPC polls elsewhere)
+    if (num_pending == FRAMETIME_PENDING) {
+        memmove(&pending[0], &pending[1], sizeof(pending[0]) * (FRAMETIME_PENDING - 1));
+        num_pending--;
+    }
+    pending[num_pending].user_data = user_data;
+    pending[num_pending].commit_ns = now_ns();
+    pending[num_pending].trace_t0 = t0;
+    num_pending++;
+    pthread_mutex_unlock(&pending_lock);
+}
+
+// Remove the oldest commit with this user_data; returns its commit time or 0
+static uint64_t take_pending(void* user_data, uint64_t* trace_t0)
+{
+    uint64_t commit_ns = 0;
+
+    pthread_mutex_lock(&pending_lock);
+    for (int i = 0; i < num_pending; i++) {
+        if (pending[i].user_data == user_data) {
+            commit_ns = pending[i].commit_ns;
+            *trace_t0 = pending[i].trace_t0;
+            memmove(&pending[i], &pending[i + 1], sizeof(pending[0]) * (num_pending - i - 1));
+            num_pending--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pending_lock);
+    return commit_ns;
+}
+
+void frametime_abort(void* user_data)
+{
+    uint64_t trace_t0;
+    if (frametime_enabled)
+        take_pending(user_data, &trace_t0);
+}
+
+static void flip_done(unsigned int seq, unsigned int tv_sec, unsigned int tv_usec, void* user_data)
+{
+    uint64_t flip_ns = (uint64_t)tv_sec * 1000000000ull + (uint64_t)tv_usec * 1000ull;
+    uint64_t trace_t0 = 0;
+    uint64_t commit_ns = take_pending(user_data, &trace_t0);
+
+    stats_inc(STAT_GUI_FLIPS);
+
+    // Refresh period from consecutive flips one vblank apart, smoothed
+    if (last_flip_ns && flip_ns > last_flip_ns) {
+        uint64_t interval = flip_ns - last_flip_ns;
+        if (seq == last_seq + 1)
+            period_ns = (period_ns * 7 + interval) / 8;
+        if (interval < FRAMETIME_IDLE_NS)
+            stats_hist_record(HIST_FRAME_INTERVAL, interval);
+    }
+    last_flip_ns = flip_ns;
+    last_seq = seq;
+
+    uint32_t missed = 0;
+    if (commit_ns && flip_ns > commit_ns) {
+        uint64_t latency = flip_ns - commit_ns;
+        stats_hist_record(HIST_COMMIT_TO_FLIP, latency);
+        // Any vblank within a period of the commit was the one to hit
+        missed = (uint32_t)(latency / period_ns);
+        if (missed)
+            stats_add(STAT_GUI_MISSED_VBLANKS, missed);
+    }
+    trace_end("mpc_frame", trace_t0, missed);
+}
+
+static void on_page_flip(int fd, unsigned int seq, unsigned int tv_sec, unsigned int tv_usec, void* user_data)
+{
+    flip_done(seq, tv_sec, tv_usec, user_data);
+    if (mpc_ctx && mpc_ctx->page_flip_handler)
+        mpc_ctx->page_flip_handler(fd, seq, tv_sec, tv_usec, user_data);
+}
+
+static void on_page_flip2(int fd, unsigned int seq, unsigned int tv_sec, unsigned int tv_usec, unsigned int crtc_id, void* user_data)
+{
+    flip_done(seq, tv_sec, tv_usec, user_data);
+    if (mpc_ctx && mpc_ctx->page_flip_handler2)
+        mpc_ctx->page_flip_handler2(fd, seq, tv_sec, tv_usec, crtc_id, user_data);
+}
+
+drmEventContextPtr frametime_wrap_events(drmEventContextPtr evctx, drmEventContext* wrapped)
+{
+    // Only versions whose layout we know; MPC may be built against older
+    // headers, so copy just the fields its version has.
+    if (!frametime_enabled || !evctx || evctx->version < 2 || evctx->version > 4)
+        return evctx;
+
+    size_t size = evctx->version >= 4 ? sizeof(*wrapped)
+                : evctx->version == 3 ? offsetof(drmEventContext, sequence_handler)
+                : offsetof(drmEventContext, page_flip_handler2);
+    memset(wrapped, 0, sizeof(*wrapped));
+    memcpy(wrapped, evctx, size);
+
+    if (wrapped->page_flip_handler)
+        wrapped->page_flip_handler = on_page_flip;
+    if (evctx->version >= 3 && wrapped->page_flip_handler2)
+        wrapped->page_flip_handler2 = on_page_flip2;
+    mpc_ctx = evctx;
+    return wrapped;
+}
+
+void frametime_unwrap_events(void)
+{
+    mpc_ctx = NULL;
+}
@@ -0,0 +1,44 @@
+/**
+ * @file frametime.h
+ * Decription: MPC frame-time profiler (measurement mode, FRAME_STATS=1).
+ *
+ * Every frame MPC submits (drmModePageFlip or drmModeAtomicCommit with a
+ * flip event requested) is stamped on the way in. drmHandleEvent is wrapped
+ * so the matching flip-complete event is seen before MPC's own handler
+ * runs; its kernel timestamp gives:
+ *
+ *   frame_interval   flip -> next flip, while MPC renders continuously
+ *   commit_to_flip   commit call -> flip on screen
+ *
+ * plus a missed_vblanks counter for flips that landed one or more refresh
+ * periods later than the first vblank after the commit. With TRACE=1 each
+ * frame also shows up on the trace timeline as "mpc_frame".
+ *
+ * Compare a run with the cursor remapping active against one without to
+ * see what our own hooks cost MPC.
+ *
+ */
+#ifndef FRAMETIME_H
+#define FRAMETIME_H
+
+#include <stdint.h>
+#include <xf86drm.h>
+
+#define FRAMETIME_PENDING 8                  // flips in flight (per CRTC: 1-2)
+#define FRAMETIME_IDLE_NS 250000000ull       // longer gaps are idle, not jank
+
+extern int frametime_enabled;  // FRAME_STATS=
+
+// PageFlip / AtomicCommit hooks, before calling the real function
+void frametime_commit(uint32_t flags, void* user_data);
+
+// PageFlip / AtomicCommit hooks: the real call failed, forget the commit
+void frametime_abort(void* user_data);
+
+// drmHandleEvent hook. Fills *wrapped with a copy of evctx whose flip
+// handlers record the frame and then chain to MPC's. Returns evctx itself
+// when there is nothing to wrap.
+drmEventContextPtr frametime_wrap_events(drmEventContextPtr evctx, drmEventContext* wrapped);
+void frametime_unwrap_events(void);
+
+#endif // FRAMETIME_H
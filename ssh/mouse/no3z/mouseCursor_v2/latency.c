@@ -0,0 +1,123 @@
+/**
+ * @file latency.c
+ * Decription: Motion-to-photon latency histograms (see latency.h).
+ *
+ */
+#define _GNU_SOURCE
+#include "latency.h"
+
+#include <linux/input.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include "stats.h"
+
+#define DEFAULT_PERIOD_NS 16666667ull  // 60 Hz until measured
+
+int latency_enabled = 1;
+
+static int monotonic_events = 0;  // event timestamps comparable with ev_now_ns()
+static int drm_fd = -1;
+static uint32_t vblank_type = DRM_VBLANK_RELATIVE;
+static uint64_t period_ns = DEFAULT_PERIOD_NS;
+static unsigned int last_seq = 0;
+static uint64_t last_vblank_ns = 0;
+
+static struct {
+    uint64_t event_ns;
+    uint64_t dequeue_ns;
+} frames[LATENCY_MAX_FRAMES];
+static int num_frames = 0;
+
+int latency_set_clock(int mouse_fd)
+{
+    int clk = CLOCK_MONOTONIC;
+    monotonic_events = ioctl(mouse_fd, EVIOCSCLOCKID, &clk) == 0;
+    return monotonic_events ? 0 : -1;
+}
+
+void latency_set_crtc(int fd, uint32_t crtc_id)
+{
+    drmModeResPtr res = drmModeGetResources(fd);
+    int index = -1;
+
+    if (res) {
+        for (int i = 0; i < res->count_crtcs; i++) {
+            if (res->crtcs[i] == crtc_id)
+                index = i;
+        }
+        drmModeFreeResources(res);
+    }
+    if (index < 0)
+        return;
+
+    // vblank requests name the CRTC by index, not by id
+    vblank_type = DRM_VBLANK_RELATIVE;
+    if (index == 1)
+        vblank_type |= DRM_VBLANK_SECONDARY;
+    else if (index > 1)
+        vblank_type |= (index << DRM_VBLANK_HIGH_CRTC_SHIFT) & DRM_VBLANK_HIGH_CRTC_MASK;
+    drm_fd = fd;
+}
+
+void latency_frame(uint64_t event_ns, uint64_t dequeue_ns)
+{
+    if (!latency_enabled)
+        return;
+    int i = num_frames < LATENCY_MAX_FRAMES ? num_frames++ : LATENCY_MAX_FRAMES - 1;
+    frames[i].event_ns = monotonic_events ? event_ns : 0;
+    frames[i].dequeue_ns = dequeue_ns;
+    if (frames[i].event_ns && dequeue_ns > event_ns)
+        stats_hist_record(HIST_EVDEV_TO_DEQUEUE, dequeue_ns - event_ns);
+}
+
+// First vblank after t, from the last vblank the kernel reports
+static uint64_t next_vblank(uint64_t t)
+{
+    drmVBlank vbl;
+
+    if (drm_fd < 0)
+        return 0;
+    vbl.request.type = (drmVBlankSeqType)vblank_type;
+    vbl.request.sequence = 0;
+    vbl.request.signal = 0;
+    if (drmWaitVBlank(drm_fd, &vbl) != 0)
+        return 0;
+
+    uint64_t vb = (uint64_t)vbl.reply.tval_sec * 1000000000ull + (uint64_t)vbl.reply.tval_usec * 1000ull;
+    if (last_vblank_ns && vbl.reply.sequence > last_seq && vb > last_vblank_ns) {
+        // Refresh period from consecutive samples, smoothed
+        uint64_t p = (vb - last_vblank_ns) / (vbl.reply.sequence - last_seq);
+        period_ns = (period_ns * 7 + p) / 8;
+    }
+    last_seq = vbl.reply.sequence;
+    last_vblank_ns = vb;
+
+    if (vb > t)
+        return vb;
+    return vb + ((t - vb) / period_ns + 1) * period_ns;
+}
+
+void latency_moved(uint64_t move_ns)
+{
+    if (!latency_enabled || num_frames == 0)
+        return;
+
+    uint64_t vblank_ns = next_vblank(move_ns);
+    if (vblank_ns)
+        stats_hist_record(HIST_MOVE_TO_VBLANK, vblank_ns - move_ns);
+
+    for (int i = 0; i < num_frames; i++) {
+        stats_hist_record(HIST_DEQUEUE_TO_MOVE, move_ns - frames[i].dequeue_ns);
+        if (vblank_ns && frames[i].event_ns && vblank_ns > frames[i].event_ns)
+            stats_hist_record(HIST_MOTION_TO_PHOTON, vblank_ns - frames[i].event_ns);
+    }
+    num_frames = 0;
+}
+
+void latency_elided(void)
+{
+    num_frames = 0;
+}
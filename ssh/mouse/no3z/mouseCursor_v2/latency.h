@@ -0,0 +1,39 @@
+/**
+ * @file latency.h
+ * Decription: Motion-to-photon latency histograms for the cursor path.
+ *
+ * For every mouse frame: kernel event timestamp (CLOCK_MONOTONIC, set with
+ * EVIOCSCLOCKID) -> read() returned -> drmModeMoveCursor() returned -> the
+ * vblank that scans the new position out. Each stage feeds a histogram in the
+ * stats page (see stats.h), so cursor_stats can show p50/p99/max.
+ *
+ * The next vblank is derived from the last one (a non-blocking relative-0
+ * drmWaitVBlank query) plus the measured refresh period, so measuring never
+ * waits on the display.
+ *
+ */
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+#define LATENCY_MAX_FRAMES 64     // frames tracked per read batch
+
+extern int latency_enabled;       // LATENCY_STATS= (default on)
+
+// Switch the mouse fd to CLOCK_MONOTONIC event timestamps
+int latency_set_clock(int mouse_fd);
+
+// DRM device and CRTC the cursor is on (for vblank queries)
+void latency_set_crtc(int drm_fd, uint32_t crtc_id);
+
+// A frame (SYN_REPORT) with its kernel timestamp, read at dequeue_ns
+void latency_frame(uint64_t event_ns, uint64_t dequeue_ns);
+
+// The pending frames were shown by a cursor move that returned at move_ns
+void latency_moved(uint64_t move_ns);
+
+// The pending frames did not move the cursor
+void latency_elided(void);
+
+#endif // LATENCY_H
@@ -0,0 +1,264 @@
+/**
+ * @file log.c
+ * Decription: Asynchronous logger (see log.h).
+ *
+ * The ring is a bounded multi-producer queue (input thread, MIDI thread and
+ * the MPC render thread through the DRM hooks can all log): each slot carries
+ * a sequence number, producers claim a position with a CAS and publish the
+ * slot by bumping its sequence. The drainer is the only consumer.
+ *
+ */
+#define _GNU_SOURCE
+#include "log.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+struct log_rec {
+    atomic_size_t seq;          // stored relative to the slot index, so zero-init is valid
+    uint64_t ts_ns;
+    const char* fmt;
+    uint8_t level;
+    uint8_t nargs;
+    struct log_arg args[LOG_MAX_ARGS];
+};
+
+volatile int log_level = LOG_INFO;
+volatile int log_rate = LOG_DEFAULT_RATE;
+
+static struct log_rec ring[LOG_RING_SIZE];
+static atomic_size_t enqueue_pos;
+static size_t dequeue_pos;      // drainer only
+
+static atomic_int running;
+static pthread_t drain_thread;
+
+static atomic_ulong stat_written;
+static atomic_ulong stat_dropped;
+static atomic_ulong stat_suppressed;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline size_t slot_seq(size_t pos)
+{
+    return atomic_load_explicit(&ring[pos & (LOG_RING_SIZE - 1)].seq, memory_order_acquire) +
+           (pos & (LOG_RING_SIZE - 1));
+}
+
+void log_push(int level, const char* fmt, int nargs, const struct log_arg* args)
+{
+    size_t pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+    struct log_rec* r;
+
+    for (;;) {
+        r = &ring[pos & (LOG_RING_SIZE - 1)];
+        intptr_t diff = (intptr_t)slot_seq(pos) - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&enqueue_pos, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            // Full: the drainer is behind (stdout stalled). Never wait.
+            atomic_fetch_add_explicit(&stat_dropped, 1, memory_order_relaxed);
+            return;
+        } else {
+            pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    if (nargs > LOG_MAX_ARGS)
+        nargs = LOG_MAX_ARGS;
+    r->ts_ns = now_ns();
+    r->fmt = fmt;
+    r->level = (uint8_t)level;
+    r->nargs = (uint8_t)nargs;
+    if (nargs)
+        memcpy(r->args, args, (size_t)nargs * sizeof(args[0]));
+    atomic_store_explicit(&r->seq, pos + 1 - (pos & (LOG_RING_SIZE - 1)), memory_order_release);
+}
+
+// Format one conversion with the recorded argument, whatever its type
+static int format_arg(char* out, size_t size, const char* spec, size_t spec_len, char conv,
+    const struct log_arg* a)
+{
+    char f[32];
+    if (spec_len > sizeof(f) - 4)
+        spec_len = sizeof(f) - 4;
+    memcpy(f, spec, spec_len);
+
+    if (strchr("diouxX", conv)) {
+        memcpy(f + spec_len, "ll", 2);
+        f[spec_len + 2] = conv;
+        f[spec_len + 3] = '\0';
+        long long v = a->type == LOG_T_DBL ? (long long)a->d : a->i;
+        return snprintf(out, size, f, v);
+    }
+    f[spec_len] = conv;
+    f[spec_len + 1] = '\0';
+    if (strchr("fFeEgGaA", conv))
+        return snprintf(out, size, f, a->type == LOG_T_DBL ? a->d : (double)a->i);
+    if (conv == 'c')
+        return snprintf(out, size, f, (int)a->i);
+    if (conv == 's')
+        return snprintf(out, size, f, a->type == LOG_T_STR && a->s ? a->s : "(?)");
+    return snprintf(out, size, "%p", a->p);
+}
+
+// printf-style formatting from a record (length modifiers are ignored, the
+// argument type was captured at the call site)
+static size_t format_record(char* out, size_t size, const struct log_rec* r)
+{
+    size_t len = (size_t)snprintf(out, size, "[%llu.%06llu] ",
+                                  (unsigned long long)(r->ts_ns / 1000000000ull),
+                                  (unsigned long long)(r->ts_ns % 1000000000ull / 1000));
+    int argi = 0;
+
+    for (const char* p = r->fmt; *p && len < size - 2; p++) {
+        if (*p != '%') {
+            out[len++] = *p;
+            continue;
+        }
+        if (p[1] == '%') {
+            out[len++] = '%';
+            p++;
+            continue;
+        }
+
+        const char* spec = p;
+        const char* q = p + 1;
+        while (*q && strchr("-+ #0123456789.", *q))
+            q++;
+        size_t spec_len = (size_t)(q - spec);
+        while (*q && strchr("hlLqjzt", *q))
+            q++;
+        if (!*q)
+            break;
+
+        if (argi < r->nargs) {
+            int n = format_arg(out + len, size - len - 1, spec, spec_len, *q, &r->args[argi++]);
+            if (n > 0)
+                len += (size_t)n < size - len - 1 ? (size_t)n : size - len - 2;
+        }
+        p = q;
+    }
+
+    out[len++] = '\n';
+    return len;
+}
+
+static void write_all(const char* buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(STDOUT_FILENO, buf, len);
+        if (n <= 0)
+            return;
+        buf += n;
+        len -= (size_t)n;
+    }
+}
+
+// Drain everything queued. Lines over the rate limit are counted, not written.
+static void drain(uint64_t now, uint64_t* window_start, int* window_lines)
+{
+    static char batch[16384];
+    static unsigned long suppressed = 0;
+    size_t used = 0;
+
+    if (now - *window_start >= 1000000000ull) {
+        if (suppressed)
+            used += (size_t)snprintf(batch, sizeof(batch), "[LOG] %lu message(s) suppressed by LOG_RATE\n", suppressed);
+        suppressed = 0;
+        *window_start = now;
+        *window_lines = 0;
+    }
+
+    for (;;) {
+        struct log_rec* r = &ring[dequeue_pos & (LOG_RING_SIZE - 1)];
+        if (slot_seq(dequeue_pos) != dequeue_pos + 1)
+            break;
+
+        if (*window_lines < log_rate || r->level == LOG_ERROR) {
+            if (used > sizeof(batch) - 512) {
+                write_all(batch, used);
+                used = 0;
+            }
+            used += format_record(batch + used, 512, r);
+            (*window_lines)++;
+            atomic_fetch_add_explicit(&stat_written, 1, memory_order_relaxed);
+        } else {
+            suppressed++;
+            atomic_fetch_add_explicit(&stat_suppressed, 1, memory_order_relaxed);
+        }
+
+        // Hand the slot back to producers one lap ahead
+        size_t next = dequeue_pos + LOG_RING_SIZE;
+        atomic_store_explicit(&r->seq, next - (dequeue_pos & (LOG_RING_SIZE - 1)), memory_order_release);
+        dequeue_pos++;
+    }
+
+    if (used)
+        write_all(batch, used);
+}
+
+static void* drain_main(void* arg)
+{
+    (void)arg;
+    uint64_t window_start = now_ns();
+    int window_lines = 0;
+    struct timespec period = { 0, LOG_FLUSH_MS * 1000000L };
+
+    while (atomic_load_explicit(&running, memory_order_relaxed)) {
+        nanosleep(&period, NULL);
+        drain(now_ns(), &window_start, &window_lines);
+    }
+    drain(now_ns(), &window_start, &window_lines);
+    return NULL;
+}
+
+int log_start(void)
+{
+    if (atomic_exchange(&running, 1))
+        return 0;
+    if (pthread_create(&drain_thread, NULL, drain_main, NULL) != 0) {
+        atomic_store(&running, 0);
+        return -1;
+    }
+    return 0;
+}
+
+void log_stop(void)
+{
+    if (!atomic_exchange(&running, 0))
+        return;
+    pthread_join(drain_thread, NULL);
+}
+
+void log_get_stats(struct log_stats* out)
+{
+    out->written = atomic_load(&stat_written);
+    out->dropped = atomic_load(&stat_dropped);
+    out->suppressed = atomic_load(&stat_suppressed);
+}
+
+// LOG_LEVEL= accepts a name or 0-3
+int log_parse_level(const char* str)
+{
+    static const char* names[] = { "error", "warn", "info", "debug" };
+    for (int i = 0; i <= LOG_DEBUG; i++) {
+        if (strcasecmp(str, names[i]) == 0)
+            return i;
+    }
+    if (str[0] >= '0' && str[0] <= '3' && str[1] == '\0')
+        return str[0] - '0';
+    return -1;
+}
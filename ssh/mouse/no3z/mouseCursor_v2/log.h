@@ -0,0 +1,105 @@
+/**
+ * @file log.h
+ * Decription: Asynchronous logger for the input and MIDI hot paths.
+ *
+ * LOGI("[BUTTON] Key %d (pressed=%d)", code, pressed) copies the format
+ * pointer and up to LOG_MAX_ARGS arguments into a fixed-size record in a
+ * lock-free ring and returns: no formatting, no syscalls, no locks. A
+ * background thread formats the records, applies the rate limit and writes
+ * them to stdout in batches. When the ring is full (stdout stalled) records
+ * are dropped and counted, never waited for.
+ *
+ * Formats must be string literals, and %s arguments must point to storage
+ * that outlives the call (literals, static tables). Everything is formatted
+ * later on another thread.
+ *
+ */
+#ifndef LOG_H
+#define LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOG_RING_SIZE 1024         // records, must be a power of two
+#define LOG_MAX_ARGS 6
+#define LOG_DEFAULT_RATE 200       // lines per second written by the drainer
+#define LOG_FLUSH_MS 50            // drainer wakeup period
+
+enum log_level {
+    LOG_ERROR = 0,
+    LOG_WARN,
+    LOG_INFO,
+    LOG_DEBUG,
+};
+
+enum log_arg_type {
+    LOG_T_INT = 0,
+    LOG_T_DBL,
+    LOG_T_STR,
+    LOG_T_PTR,
+};
+
+struct log_arg {
+    uint8_t type;
+    union {
+        int64_t i;
+        double d;
+        const char* s;
+        const void* p;
+    };
+};
+
+struct log_stats {
+    unsigned long written;
+    unsigned long dropped;         // ring full
+    unsigned long suppressed;      // over the rate limit
+};
+
+extern volatile int log_level;     // records above this level are not queued
+extern volatile int log_rate;      // LOG_RATE= lines per second
+
+void log_push(int level, const char* fmt, int nargs, const struct log_arg* args);
+int log_start(void);
+void log_stop(void);               // drains what is queued, then joins
+void log_get_stats(struct log_stats* out);
+int log_parse_level(const char* str);
+
+static inline struct log_arg log_int(int64_t v) { struct log_arg a = { .type = LOG_T_INT, .i = v }; return a; }
+static inline struct log_arg log_dbl(double v) { struct log_arg a = { .type = LOG_T_DBL, .d = v }; return a; }
+static inline struct log_arg log_str(const char* v) { struct log_arg a = { .type = LOG_T_STR, .s = v }; return a; }
+static inline struct log_arg log_ptr(const void* v) { struct log_arg a = { .type = LOG_T_PTR, .p = v }; return a; }
+
+#define LOG_ARG(x) _Generic((x),                   \
+    char*: log_str, const char*: log_str,          \
+    float: log_dbl, double: log_dbl,               \
+    void*: log_ptr, const void*: log_ptr,          \
+    default: log_int)(x)
+
+#define LOG_COUNT(...) LOG_COUNT_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define LOG_COUNT_(_0, _1, _2, _3, _4, _5, _6, n, ...) n
+#define LOG_CAT(a, b) LOG_CAT_(a, b)
+#define LOG_CAT_(a, b) a##b
+
+#define LOG_PACK(...) LOG_CAT(LOG_PACK_, LOG_COUNT(__VA_ARGS__))(__VA_ARGS__)
+#define LOG_PACK_0() 0, NULL
+#define LOG_PACK_1(a) 1, (const struct log_arg[]){ LOG_ARG(a) }
+#define LOG_PACK_2(a, b) 2, (const struct log_arg[]){ LOG_ARG(a), LOG_ARG(b) }
+#define LOG_PACK_3(a, b, c) 3, (const struct log_arg[]){ LOG_ARG(a), LOG_ARG(b), LOG_ARG(c) }
+#define LOG_PACK_4(a, b, c, d) 4, (const struct log_arg[]){ LOG_ARG(a), LOG_ARG(b), LOG_ARG(c), LOG_ARG(d) }
+#define LOG_PACK_5(a, b, c, d, e) 5, (const struct log_arg[]){ LOG_ARG(a), LOG_ARG(b), LOG_ARG(c), LOG_ARG(d), \
+    LOG_ARG(e) }
+#define LOG_PACK_6(a, b, c, d, e, f) 6, (const struct log_arg[]){ LOG_ARG(a), LOG_ARG(b), LOG_ARG(c), LOG_ARG(d), \
+    LOG_ARG(e), LOG_ARG(f) }
+
+#define LOG(level, fmt, ...)                                    \
+    do {                                                        \
+        if ((level) <= log_level)                               \
+            log_push((level), (fmt), LOG_PACK(__VA_ARGS__));    \
+    } while (0)
+
+#define LOGE(fmt, ...) LOG(LOG_ERROR, fmt, ##__VA_ARGS__)
+#define LOGW(fmt, ...) LOG(LOG_WARN, fmt, ##__VA_ARGS__)
+#define LOGI(fmt, ...) LOG(LOG_INFO, fmt, ##__VA_ARGS__)
+#define LOGD(fmt, ...) LOG(LOG_DEBUG, fmt, ##__VA_ARGS__)
+
+#endif // LOG_H
@@ -0,0 +1,318 @@
+/**
+ * @file macro.c
+ * Decription: Timed macro sequencer (see macro.h).
+ *
+ */
+#define _GNU_SOURCE
+#include "macro.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/prctl.h>
+
+#include "button_dispatch.h"
+#include "ev_loop.h"
+#include "trace.h"
+
+struct macro {
+    char name[MACRO_NAME_LEN];
+    uint16_t first_step;
+    uint16_t num_steps;
+};
+
+struct macro_set {
+    struct macro macros[MACRO_MAX];
+    int num_macros;
+    struct macro_step steps[MACRO_MAX_STEPS];
+    int num_steps;
+};
+
+// The player only ever reads 'active'; the config side writes 'staging'
+static struct macro_set sets[2];
+static struct macro_set* active = &sets[0];
+static struct macro_set* staging = &sets[1];
+
+// Player state
+static struct macro_sink sink;
+static int timer_fd = -1;
+static int cur_step = -1;          // index into steps[], -1 = idle
+static int end_step = 0;
+static uint64_t deadline_ns = 0;   // when the current wait ends
+static int queue[MACRO_QUEUE_SIZE];
+static int queue_head = 0;
+static int queue_len = 0;
+static struct macro_stats stats;
+
+static int add_step(const struct macro_step* st)
+{
+    if (staging->num_steps == MACRO_MAX_STEPS)
+        return -1;
+    staging->steps[staging->num_steps++] = *st;
+    return 0;
+}
+
+static int add_wait_ms(double ms)
+{
+    struct macro_step st = { .type = MACRO_STEP_WAIT, .wait_ns = (uint64_t)(ms * 1000000.0) };
+    return add_step(&st);
+}
+
+// Parse one step ("TAP 400 600", "WAIT 12.5", ...) into one or more steps
+static int parse_step(char* text)
+{
+    char word[16];
+    char arg[32];
+    int x, y, n;
+    double ms;
+    struct macro_step st;
+
+    memset(&st, 0, sizeof(st));
+    if (sscanf(text, "%15s", word) != 1)
+        return 0;  // empty step
+
+    if (strcasecmp(word, "TAP") == 0) {
+        ms = MACRO_TAP_HOLD_MS;
+        if (sscanf(text, "%*s %d %d %lf", &x, &y, &ms) < 2 || x < 0 || x > 799 || y < 0 || y > 1279)
+            return -1;
+        st.type = MACRO_STEP_TOUCH;
+        st.a = (uint16_t)x;
+        st.b = y;
+        st.c = 1;
+        if (add_step(&st) < 0 || add_wait_ms(ms) < 0)
+            return -1;
+        st.c = 0;
+        return add_step(&st);
+    }
+
+    if (strcasecmp(word, "KEY") == 0 || strcasecmp(word, "KEYDOWN") == 0 || strcasecmp(word, "KEYUP") == 0) {
+        if (sscanf(text, "%*s %31s", arg) != 1)
+            return -1;
+        n = dispatch_key_code(arg);
+        if (n < 0)
+            return -1;
+        st.type = MACRO_STEP_KEY;
+        st.a = (uint16_t)n;
+        st.c = strcasecmp(word, "KEYUP") != 0;
+        if (add_step(&st) < 0)
+            return -1;
+        if (strcasecmp(word, "KEY") != 0)
+            return 0;
+        st.c = 0;
+        return add_step(&st);
+    }
+
+    if (strcasecmp(word, "CC") == 0 || strcasecmp(word, "NRPN") == 0) {
+        int is_nrpn = strcasecmp(word, "NRPN") == 0;
+        int max = is_nrpn ? 16383 : 127;
+        if (sscanf(text, "%*s %d %d", &x, &y) != 2 || x < 0 || x > max || y < 0 || y > max)
+            return -1;
+        st.type = MACRO_STEP_MIDI;
+        st.msg.type = is_nrpn ? MIDI_MSG_NRPN : MIDI_MSG_CC;
+        st.msg.param = (uint16_t)x;
+        st.msg.value = y;
+        return add_step(&st);
+    }
+
+    if (strcasecmp(word, "WAIT") == 0) {
+        if (sscanf(text, "%*s %lf", &ms) != 1 || ms < 0.0 || ms > 60000.0)
+            return -1;
+        return add_wait_ms(ms);
+    }
+
+    return -1;
+}
+
+void macro_reset(void)
+{
+    staging->num_macros = 0;
+    staging->num_steps = 0;
+}
+
+// Define (or redefine) a macro from its ';' separated step list
+int macro_define(const char* name, char* text)
+{
+    struct macro_set* m = staging;
+    int index = macro_find(name);
+    if (index < 0) {
+        if (m->num_macros == MACRO_MAX) {
+            fprintf(stdout, "[CONFIG] Warning: Too many macros (max %d), '%s' skipped\n", MACRO_MAX, name);
+            fflush(stdout);
+            return -1;
+        }
+        index = m->num_macros;
+    }
+
+    int first = m->num_steps;
+    char* save = NULL;
+    for (char* tok = strtok_r(text, ";", &save); tok; tok = strtok_r(NULL, ";", &save)) {
+        if (parse_step(tok) < 0) {
+            fprintf(stdout, "[CONFIG] Warning: Invalid macro step '%s' in '%s' (macro skipped)\n", tok, name);
+            fflush(stdout);
+            m->num_steps = first;
+            return -1;
+        }
+    }
+
+    snprintf(m->macros[index].name, MACRO_NAME_LEN, "%s", name);
+    m->macros[index].first_step = (uint16_t)first;
+    m->macros[index].num_steps = (uint16_t)(m->num_steps - first);
+    if (index == m->num_macros)
+        m->num_macros++;
+
+    fprintf(stdout, "[CONFIG] Macro '%s': %d step(s)\n", name, m->macros[index].num_steps);
+    fflush(stdout);
+    return index;
+}
+
+int macro_find(const char* name)
+{
+    for (int i = 0; i < staging->num_macros; i++) {
+        if (strcasecmp(staging->macros[i].name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// Swap the sets. Queued macro indexes would point into the wrong set, so
+// the caller waits for the player to go idle first.
+void macro_commit(void)
+{
+    struct macro_set* old = active;
+    active = staging;
+    staging = old;
+    queue_len = 0;
+}
+
+int macro_count(void)
+{
+    return active->num_macros;
+}
+
+int macro_uses(int step_type)
+{
+    for (int i = 0; i < active->num_steps; i++) {
+        if (active->steps[i].type == step_type)
+            return 1;
+    }
+    return 0;
+}
+
+static void start_macro(int index, uint64_t now)
+{
+    cur_step = active->macros[index].first_step;
+    end_step = cur_step + active->macros[index].num_steps;
+    deadline_ns = now;
+    stats.played++;
+}
+
+// Run steps until the next wait (arming the timer) or the end of the queue
+static void run_steps(void)
+{
+    while (cur_step >= 0) {
+        if (cur_step == end_step) {
+            cur_step = -1;
+            if (queue_len > 0) {
+                int next = queue[queue_head];
+                queue_head = (queue_head + 1) % MACRO_QUEUE_SIZE;
+                queue_len--;
+                start_macro(next, deadline_ns);
+                continue;
+            }
+            return;
+        }
+
+        const struct macro_step* st = &active->steps[cur_step++];
+        switch (st->type) {
+        case MACRO_STEP_TOUCH:
+            if (sink.touch)
+                sink.touch(st->a, st->b, st->c);
+            break;
+        case MACRO_STEP_KEY:
+            if (sink.key)
+                sink.key(st->a, st->c);
+            break;
+        case MACRO_STEP_MIDI:
+            if (sink.midi)
+                sink.midi(&st->msg);
+            break;
+        case MACRO_STEP_WAIT:
+            // Deadlines chain off the previous deadline, not the wakeup time,
+            // so timer latency never accumulates over a long macro
+            deadline_ns += st->wait_ns;
+            if (deadline_ns > ev_now_ns()) {
+                ev_timer_arm_at(timer_fd, deadline_ns);
+                return;
+            }
+            break;
+        }
+    }
+}
+
+static void on_timer(void* ctx, uint32_t events)
+{
+    (void)ctx;
+    (void)events;
+    uint64_t late = ev_now_ns() - deadline_ns;
+
+    stats.waits++;
+    stats.late_total_ns += late;
+    if (late > stats.late_max_ns)
+        stats.late_max_ns = late;
+    trace_mark("macro_wakeup_late_us", (uint32_t)(late / 1000));
+    run_steps();
+}
+
+int macro_init(const struct macro_sink* s)
+{
+    sink = *s;
+    cur_step = -1;
+    queue_len = 0;
+    memset(&stats, 0, sizeof(stats));
+
+    // Default 50us timer slack would eat into the sub-millisecond budget
+    prctl(PR_SET_TIMERSLACK, 1000UL, 0, 0, 0);
+
+    timer_fd = ev_timer_create(on_timer, NULL);
+    return timer_fd < 0 ? -1 : 0;
+}
+
+void macro_close(void)
+{
+    ev_timer_destroy(timer_fd);
+    timer_fd = -1;
+    cur_step = -1;
+    queue_len = 0;
+}
+
+// Start a macro now, or queue it behind the one that is playing
+int macro_play(int index)
+{
+    if (index < 0 || index >= active->num_macros || timer_fd < 0)
+        return -1;
+
+    if (cur_step >= 0) {
+        if (queue_len == MACRO_QUEUE_SIZE) {
+            stats.dropped++;
+            return -1;
+        }
+        queue[(queue_head + queue_len) % MACRO_QUEUE_SIZE] = index;
+        queue_len++;
+        return 0;
+    }
+
+    start_macro(index, ev_now_ns());
+    run_steps();
+    return 0;
+}
+
+int macro_playing(void)
+{
+    return cur_step >= 0;
+}
+
+void macro_get_stats(struct macro_stats* out)
+{
+    *out = stats;
+}
@@ -0,0 +1,78 @@
+/**
+ * @file macro.h
+ * Decription: Timed macro sequencer for button bindings.
+ *
+ * A macro is defined once in the config and compiled to a flat step list:
+ *
+ *   MACRO name=TAP 400 600; WAIT 50; KEY KEY_ENTER; CC 108 127; WAIT 0.5
+ *
+ * Steps run from a timerfd on the input thread's event loop. Waits are
+ * scheduled against absolute deadlines (no drift, sub-millisecond slack) and
+ * never sleep, so the cursor keeps moving while a macro plays.
+ *
+ * Definitions go into a staging set; macro_commit() makes it the set the
+ * player uses, so a config reload can fail halfway without touching it.
+ *
+ */
+#ifndef MACRO_H
+#define MACRO_H
+
+#include <stdint.h>
+
+#include "midi_out.h"
+
+#define MACRO_MAX 32
+#define MACRO_MAX_STEPS 512
+#define MACRO_NAME_LEN 32
+#define MACRO_QUEUE_SIZE 8         // macros waiting behind the one playing
+#define MACRO_TAP_HOLD_MS 30       // default finger down time for TAP
+
+enum macro_step_type {
+    MACRO_STEP_TOUCH = 0,   // a = x, b = y, c = pressed
+    MACRO_STEP_KEY,         // a = key code, c = pressed
+    MACRO_STEP_MIDI,        // msg
+    MACRO_STEP_WAIT,        // wait_ns
+};
+
+struct macro_step {
+    uint8_t type;
+    uint8_t c;
+    uint16_t a;
+    int32_t b;
+    uint64_t wait_ns;
+    struct midi_msg msg;
+};
+
+// Where steps go; set by the library (real devices) or a test harness
+struct macro_sink {
+    void (*touch)(int x, int y, int pressed);
+    void (*key)(int code, int pressed);
+    void (*midi)(const struct midi_msg* msg);
+};
+
+struct macro_stats {
+    unsigned long played;
+    unsigned long dropped;       // queue full
+    unsigned long waits;         // timer deadlines hit
+    uint64_t late_total_ns;      // sum of (wakeup - deadline)
+    uint64_t late_max_ns;
+};
+
+// Config side (staging set)
+void macro_reset(void);
+int macro_define(const char* name, char* steps);   // returns macro index or -1
+int macro_find(const char* name);
+void macro_commit(void);         // staging set becomes active; not while playing
+
+// Active set
+int macro_count(void);
+int macro_uses(int step_type);   // any macro has a step of this type
+
+// Runtime side (event loop thread)
+int macro_init(const struct macro_sink* sink);
+void macro_close(void);
+int macro_play(int index);
+int macro_playing(void);
+void macro_get_stats(struct macro_stats* out);
+
+#endif // MACRO_H
@@ -0,0 +1,99 @@
+/**
+ * @file mailbox.c
+ * Decription: Shared cursor mailbox (see mailbox.h).
+ *
+ */
+#define _GNU_SOURCE
+#include "mailbox.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// The two sides are different processes: shared (not PRIVATE) futex ops
+static long futex(uint32_t* word, int op, uint32_t val, const struct timespec* timeout)
+{
+    return syscall(SYS_futex, word, op, val, timeout, NULL, 0);
+}
+
+struct mailbox* mailbox_map(const char* name)
+{
+    int fd = shm_open(name, O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return NULL;
+    if (ftruncate(fd, sizeof(struct mailbox)) < 0) {
+        close(fd);
+        return NULL;
+    }
+    void* ptr = mmap(NULL, sizeof(struct mailbox), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+        return NULL;
+
+    // Whichever side comes first sets the page up; a page from an older
+    // layout starts over with the cursor hidden
+    struct mailbox* mb = ptr;
+    if (__atomic_load_n(&mb->magic, __ATOMIC_ACQUIRE) != MAILBOX_MAGIC || mb->version != MAILBOX_VERSION) {
+        memset(mb, 0, sizeof(*mb));
+        mb->version = MAILBOX_VERSION;
+        __atomic_store_n(&mb->magic, MAILBOX_MAGIC, __ATOMIC_RELEASE);
+    }
+    return mb;
+}
+
+void mailbox_post(struct mailbox* mb, int x, int y, int shape)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    __atomic_store_n(&mb->post_ns, (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec, __ATOMIC_RELAXED);
+    __atomic_store_n(&mb->shape, (uint32_t)shape, __ATOMIC_RELAXED);
+    __atomic_store_n(&mb->pos, (uint64_t)(uint32_t)x << 32 | (uint32_t)y, __ATOMIC_RELEASE);
+    // seq_cst pairs with the reader's sleeping store then seq load: either
+    // the reader sees the new seq, or this side sees it sleeping
+    __atomic_add_fetch(&mb->seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&mb->sleeping, __ATOMIC_SEQ_CST))
+        futex(&mb->seq, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+int mailbox_wait(struct mailbox* mb, uint32_t* seen, int timeout_ms)
+{
+    struct timespec timeout = { timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000L };
+    uint32_t seq = __atomic_load_n(&mb->seq, __ATOMIC_ACQUIRE);
+
+    if (seq == *seen) {
+        __atomic_store_n(&mb->sleeping, 1, __ATOMIC_SEQ_CST);
+        seq = __atomic_load_n(&mb->seq, __ATOMIC_SEQ_CST);
+        if (seq == *seen) {
+            // EAGAIN: a post landed in between; EINTR, ETIMEDOUT: nothing new
+            futex(&mb->seq, FUTEX_WAIT, seq, timeout_ms < 0 ? NULL : &timeout);
+            seq = __atomic_load_n(&mb->seq, __ATOMIC_ACQUIRE);
+        }
+        __atomic_store_n(&mb->sleeping, 0, __ATOMIC_RELAXED);
+    }
+    if (seq == *seen)
+        return 0;
+    *seen = seq;
+    return 1;
+}
+
+int mailbox_writer_alive(const struct mailbox* mb)
+{
+    pid_t pid = __atomic_load_n(&mb->writer_pid, __ATOMIC_RELAXED);
+    // EPERM: it is there, just not ours to signal
+    return pid <= 0 || kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+void mailbox_wake(struct mailbox* mb)
+{
+    // A bare FUTEX_WAKE is lost if the reader is not asleep yet: bump seq
+    __atomic_add_fetch(&mb->seq, 1, __ATOMIC_SEQ_CST);
+    futex(&mb->seq, FUTEX_WAKE, INT_MAX, NULL);
+}
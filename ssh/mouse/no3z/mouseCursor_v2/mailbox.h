@@ -0,0 +1,75 @@
+/**
+ * @file mailbox.h
+ * Decription: Cursor mailbox between cursord and the preloaded shim.
+ *
+ * With FORCE_CURSOR_DAEMON=1 the engine runs in cursord, its own process
+ * and systemd unit, instead of inside MPC. MPC keeps only the shim: the DRM
+ * hooks and one thread that sleeps on this page and moves the cursor when
+ * cursord posts a new position or shape.
+ *
+ * The page holds the newest value only. The writer stores the position as
+ * one 64-bit word, bumps seq and makes the FUTEX_WAKE syscall only when the
+ * reader is asleep. A reader that falls behind skips to the newest position,
+ * it never replays old ones. Neither side takes a lock.
+ *
+ * A cursord that stops cleanly posts MAILBOX_SHAPE_HIDDEN. One that crashes
+ * cannot, so the reader also looks for writer_pid every
+ * MAILBOX_WRITER_CHECK_MS while no posts come, and hides the cursor itself
+ * once that process is gone.
+ *
+ */
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <stdint.h>
+
+#define MAILBOX_SHM_NAME "/force_cursor_mailbox"   // /dev/shm/force_cursor_mailbox
+#define MAILBOX_MAGIC 0x584d4346u                  // "FCMX"
+#define MAILBOX_VERSION 1
+#define MAILBOX_WRITER_CHECK_MS 1000
+
+enum mailbox_shape {
+    MAILBOX_SHAPE_HIDDEN = 0,  // no cursor (cursord not running)
+    MAILBOX_SHAPE_ARROW,       // the built-in cursor, cursor_arrow.h
+};
+
+struct mailbox {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seq;              // futex word, +1 per post
+    uint32_t sleeping;         // the reader is in (or entering) FUTEX_WAIT
+    uint64_t pos;              // x << 32 | y
+    uint64_t post_ns;          // CLOCK_MONOTONIC of the newest post
+    uint32_t shape;            // enum mailbox_shape
+    int32_t writer_pid;        // cursord, 0 before it first maps the page
+};
+
+// Create or attach to the shared page (MAILBOX_SHM_NAME); NULL on failure
+struct mailbox* mailbox_map(const char* name);
+
+// Writer (one thread): publish a position and shape, wake the reader
+void mailbox_post(struct mailbox* mb, int x, int y, int shape);
+
+// Reader (one thread): wait until seq differs from *seen, for up to
+// timeout_ms (-1 = no limit). Returns 1 and updates *seen on a new post
+// or mailbox_wake(), 0 on timeout.
+int mailbox_wait(struct mailbox* mb, uint32_t* seen, int timeout_ms);
+
+// Reader: 0 once the writer_pid process no longer exists, 1 otherwise
+// (including no writer yet)
+int mailbox_writer_alive(const struct mailbox* mb);
+
+// Return the reader from mailbox_wait() with the values unchanged, so it
+// looks at its own stop flag (shutdown)
+void mailbox_wake(struct mailbox* mb);
+
+static inline void mailbox_read(const struct mailbox* mb, int* x, int* y, int* shape, uint64_t* post_ns)
+{
+    uint64_t pos = __atomic_load_n(&mb->pos, __ATOMIC_ACQUIRE);
+    *x = (int32_t)(pos >> 32);
+    *y = (int32_t)(uint32_t)pos;
+    *shape = (int)__atomic_load_n(&mb->shape, __ATOMIC_ACQUIRE);
+    *post_ns = __atomic_load_n(&mb->post_ns, __ATOMIC_RELAXED);
+}
+
+#endif // MAILBOX_H
@@ -0,0 +1,379 @@
+/**
+ * @file midi_out.c
+ * Decription: Asynchronous, batched ALSA sequencer output (see midi_out.h).
+ *
+ */
+#define _GNU_SOURCE
+#include "midi_out.h"
+
+#include <alsa/asoundlib.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "xrun.h"
+#include "trace.h"
+
+#define MIDI_OUT_MAX_POLLFDS 4
+
+static snd_seq_t* seq = NULL;
+static int out_port = -1;       // our output port, subscribed to the destination
+static int announce_port = -1;  // receives System:Announce events
+static int wake_fd = -1;
+static pthread_t midi_thread;
+static atomic_int running;
+static char dest_spec[128];
+static int dest_client = -1;
+static int dest_port = -1;
+
+// SPSC ring: producer owns tail, consumer owns head
+static struct midi_msg queue[MIDI_OUT_QUEUE_SIZE];
+static atomic_uint queue_head;
+static atomic_uint queue_tail;
+static atomic_int consumer_sleeping;
+
+// Counters for midi_out_get_stats(), updated relaxed from either side
+static atomic_ulong stat_queued;
+static atomic_ulong stat_sent;
+static atomic_ulong stat_dropped;
+static atomic_ulong stat_drains;
+static atomic_ulong stat_rescans;
+
+int midi_out_send(const struct midi_msg* msg)
+{
+    if (!atomic_load_explicit(&running, memory_order_relaxed))
+        return -1;
+
+    unsigned int tail = atomic_load_explicit(&queue_tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&queue_head, memory_order_acquire);
+    if (tail - head == MIDI_OUT_QUEUE_SIZE) {
+        atomic_fetch_add_explicit(&stat_dropped, 1, memory_order_relaxed);
+        return -1;
+    }
+
+    queue[tail & (MIDI_OUT_QUEUE_SIZE - 1)] = *msg;
+    atomic_store_explicit(&queue_tail, tail + 1, memory_order_release);
+    atomic_fetch_add_explicit(&stat_queued, 1, memory_order_relaxed);
+    xrun_activity(XRUN_ACT_MIDI);
+
+    // Only pay for the eventfd write when the output thread is asleep
+    if (atomic_exchange_explicit(&consumer_sleeping, 0, memory_order_acq_rel)) {
+        uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) < 0) {
+            // Counter overflow is impossible here; nothing useful to do
+        }
+    }
+    return 0;
+}
+
+// Does this port match the configured destination?
+static int port_matches(const char* client_name, const char* port_name,
+    int client, int port)
+{
+    char spec[sizeof(dest_spec)];
+    snprintf(spec, sizeof spec, "%s", dest_spec);
+
+    // Numeric "client:port"
+    int c, p;
+    char tail;
+    if (sscanf(spec, "%d:%d%c", &c, &p, &tail) == 2)
+        return c == client && p == port;
+
+    // "client name:port name"
+    char* colon = strrchr(spec, ':');
+    if (colon) {
+        *colon = '\0';
+        return strcmp(spec, client_name) == 0 && strcmp(colon + 1, port_name) == 0;
+    }
+
+    // Bare name: port name first, then client name
+    return strcmp(spec, port_name) == 0 || strcmp(spec, client_name) == 0;
+}
+
+// Find the destination port and subscribe our output port to it
+static int resolve_destination(void)
+{
+    snd_seq_client_info_t* cinfo;
+    snd_seq_port_info_t* pinfo;
+    int found = 0;
+
+    atomic_fetch_add_explicit(&stat_rescans, 1, memory_order_relaxed);
+
+    if (snd_seq_client_info_malloc(&cinfo) < 0)
+        return -1;
+    if (snd_seq_port_info_malloc(&pinfo) < 0) {
+        snd_seq_client_info_free(cinfo);
+        return -1;
+    }
+    snd_seq_client_info_set_client(cinfo, -1);
+
+    while (!found && snd_seq_query_next_client(seq, cinfo) >= 0) {
+        int client = snd_seq_client_info_get_client(cinfo);
+        if (client == snd_seq_client_id(seq))
+            continue;
+
+        snd_seq_port_info_set_client(pinfo, client);
+        snd_seq_port_info_set_port(pinfo, -1);
+        while (snd_seq_query_next_port(seq, pinfo) >= 0) {
+            unsigned int caps = snd_seq_port_info_get_capability(pinfo);
+            if ((caps & (SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE)) !=
+                (SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE))
+                continue;
+
+            int port = snd_seq_port_info_get_port(pinfo);
+            if (port_matches(snd_seq_client_info_get_name(cinfo),
+                    snd_seq_port_info_get_name(pinfo), client, port)) {
+                // Subscribe once; events then go to subscribers, no per-event routing
+                int err = snd_seq_connect_to(seq, out_port, client, port);
+                if (err >= 0 || err == -EBUSY) {
+                    dest_client = client;
+                    dest_port = port;
+                    found = 1;
+                }
+                break;
+            }
+        }
+    }
+
+    snd_seq_client_info_free(cinfo);
+    snd_seq_port_info_free(pinfo);
+
+    if (found) {
+        LOGI("[MIDI] Destination '%s' resolved to %d:%d", dest_spec, dest_client, dest_port);
+    } else {
+        LOGW("[MIDI] Destination '%s' not found, waiting for it to appear", dest_spec);
+    }
+    return found ? 0 : -1;
+}
+
+// Handle System:Announce events: drop a vanished destination, pick up a new one
+static void handle_announce(void)
+{
+    snd_seq_event_t* ev;
+
+    while (snd_seq_event_input_pending(seq, 1) > 0 && snd_seq_event_input(seq, &ev) >= 0) {
+        switch (ev->type) {
+        case SND_SEQ_EVENT_CLIENT_EXIT:
+        case SND_SEQ_EVENT_PORT_EXIT:
+            if (dest_client >= 0 && ev->data.addr.client == dest_client &&
+                (ev->type == SND_SEQ_EVENT_CLIENT_EXIT || ev->data.addr.port == dest_port)) {
+                LOGW("[MIDI] Destination %d:%d went away", dest_client, dest_port);
+                dest_client = -1;
+                dest_port = -1;
+            }
+            break;
+        case SND_SEQ_EVENT_CLIENT_START:
+        case SND_SEQ_EVENT_PORT_START:
+        case SND_SEQ_EVENT_PORT_CHANGE:
+            if (dest_client < 0)
+                resolve_destination();
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static void fill_event(snd_seq_event_t* ev, const struct midi_msg* msg)
+{
+    snd_seq_ev_clear(ev);
+    switch (msg->type) {
+    case MIDI_MSG_NOTE_ON:
+        snd_seq_ev_set_noteon(ev, msg->channel, msg->param, msg->value);
+        break;
+    case MIDI_MSG_NOTE_OFF:
+        snd_seq_ev_set_noteoff(ev, msg->channel, msg->param, msg->value);
+        break;
+    case MIDI_MSG_NRPN:
+        // No seqmid helper; the sequencer expands it to CC 99/98/6/38 for MIDI ports
+        ev->type = SND_SEQ_EVENT_NONREGPARAM;
+        snd_seq_ev_set_fixed(ev);
+        ev->data.control.channel = msg->channel;
+        ev->data.control.param = msg->param;
+        ev->data.control.value = msg->value;
+        break;
+    default:
+        snd_seq_ev_set_controller(ev, msg->channel, msg->param, msg->value);
+        break;
+    }
+    snd_seq_ev_set_source(ev, out_port);
+    snd_seq_ev_set_subs(ev);
+    snd_seq_ev_set_direct(ev);
+}
+
+// Move everything queued so far into the sequencer with a single drain
+static void flush_queue(void)
+{
+    unsigned int head = atomic_load_explicit(&queue_head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&queue_tail, memory_order_acquire);
+    unsigned long sent = 0;
+
+    if (head == tail)
+        return;
+
+    if (dest_client < 0) {
+        atomic_fetch_add_explicit(&stat_dropped, tail - head, memory_order_relaxed);
+        atomic_store_explicit(&queue_head, tail, memory_order_release);
+        return;
+    }
+
+    uint64_t t = trace_begin();
+    for (; head != tail; head++) {
+        snd_seq_event_t ev;
+        fill_event(&ev, &queue[head & (MIDI_OUT_QUEUE_SIZE - 1)]);
+        // snd_seq_event_output() only drains by itself when its buffer fills up
+        if (snd_seq_event_output(seq, &ev) >= 0)
+            sent++;
+    }
+    atomic_store_explicit(&queue_head, head, memory_order_release);
+
+    snd_seq_drain_output(seq);
+    trace_end("midi_drain", t, (uint32_t)sent);
+    atomic_fetch_add_explicit(&stat_sent, sent, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stat_drains, 1, memory_order_relaxed);
+}
+
+static void* midi_thread_main(void* arg)
+{
+    (void)arg;
+    struct pollfd pfds[MIDI_OUT_MAX_POLLFDS + 1];
+    int nseq = snd_seq_poll_descriptors(seq, pfds + 1, MIDI_OUT_MAX_POLLFDS, POLLIN);
+
+    pfds[0].fd = wake_fd;
+    pfds[0].events = POLLIN;
+
+    while (atomic_load(&running)) {
+        flush_queue();
+
+        // Announce we are going to sleep, then re-check to not miss a push
+        atomic_store(&consumer_sleeping, 1);
+        if (atomic_load(&queue_tail) != atomic_load(&queue_head)) {
+            atomic_store(&consumer_sleeping, 0);
+            continue;
+        }
+
+        if (poll(pfds, 1 + nseq, -1) < 0 && errno != EINTR)
+            break;
+        atomic_store(&consumer_sleeping, 0);
+
+        if (pfds[0].revents & POLLIN) {
+            uint64_t count;
+            if (read(wake_fd, &count, sizeof(count)) < 0) {
+                // EAGAIN: already consumed
+            }
+        }
+        for (int i = 1; i <= nseq; i++) {
+            if (pfds[i].revents & POLLIN) {
+                handle_announce();
+                break;
+            }
+        }
+    }
+
+    flush_queue();
+    return NULL;
+}
+
+int midi_out_start(const char* dest)
+{
+    int err;
+
+    if (atomic_load(&running))
+        return 0;
+
+    snprintf(dest_spec, sizeof dest_spec, "%s", dest && dest[0] ? dest : MIDI_OUT_DEFAULT_DEST);
+
+    // Duplex: we also read announce events from the system client
+    err = snd_seq_open(&seq, "default", SND_SEQ_OPEN_DUPLEX, 0);
+    if (err < 0) {
+        fprintf(stdout, "[MIDI] Failed to open ALSA sequencer: %s\n", snd_strerror(err));
+        fflush(stdout);
+        return -1;
+    }
+
+    // Set client name
+    snd_seq_set_client_name(seq, "MouseButtonMIDI");
+
+    out_port = snd_seq_create_simple_port(seq, "Output",
+                                          SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ,
+                                          SND_SEQ_PORT_TYPE_APPLICATION);
+    announce_port = snd_seq_create_simple_port(seq, "Announce",
+                                               SND_SEQ_PORT_CAP_WRITE,
+                                               SND_SEQ_PORT_TYPE_APPLICATION);
+    if (out_port < 0 || announce_port < 0) {
+        fprintf(stdout, "[MIDI] Failed to create MIDI port\n");
+        fflush(stdout);
+        snd_seq_close(seq);
+        seq = NULL;
+        return -1;
+    }
+    snd_seq_connect_from(seq, announce_port, SND_SEQ_CLIENT_SYSTEM, SND_SEQ_PORT_SYSTEM_ANNOUNCE);
+
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0) {
+        snd_seq_close(seq);
+        seq = NULL;
+        return -1;
+    }
+
+    resolve_destination();
+
+    atomic_store(&queue_head, 0);
+    atomic_store(&queue_tail, 0);
+    atomic_store(&running, 1);
+    if (pthread_create(&midi_thread, NULL, midi_thread_main, NULL) != 0) {
+        atomic_store(&running, 0);
+        close(wake_fd);
+        wake_fd = -1;
+        snd_seq_close(seq);
+        seq = NULL;
+        return -1;
+    }
+
+    fprintf(stdout, "[MIDI] ALSA sequencer initialized, client %d port %d\n",
+            snd_seq_client_id(seq), out_port);
+    fflush(stdout);
+    return 0;
+}
+
+int midi_out_running(void)
+{
+    return atomic_load(&running);
+}
+
+void midi_out_stop(void)
+{
+    if (!atomic_exchange(&running, 0))
+        return;
+
+    uint64_t one = 1;
+    if (write(wake_fd, &one, sizeof(one)) < 0) {
+        // Thread will still see running == 0 on its next wakeup
+    }
+    pthread_join(midi_thread, NULL);
+
+    close(wake_fd);
+    wake_fd = -1;
+    snd_seq_close(seq);
+    seq = NULL;
+    out_port = announce_port = -1;
+    dest_client = dest_port = -1;
+}
+
+void midi_out_get_stats(struct midi_out_stats* out)
+{
+    out->queued = atomic_load_explicit(&stat_queued, memory_order_relaxed);
+    out->sent = atomic_load_explicit(&stat_sent, memory_order_relaxed);
+    out->dropped = atomic_load_explicit(&stat_dropped, memory_order_relaxed);
+    out->drains = atomic_load_explicit(&stat_drains, memory_order_relaxed);
+    out->rescans = atomic_load_explicit(&stat_rescans, memory_order_relaxed);
+    out->dest_client = dest_client;
+    out->dest_port = dest_port;
+}
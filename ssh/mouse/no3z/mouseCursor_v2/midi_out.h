@@ -0,0 +1,71 @@
+/**
+ * @file midi_out.h
+ * Decription: Asynchronous MIDI output for the Force cursor.
+ *
+ * The input thread only pushes small messages into a lock-free single
+ * producer / single consumer ring. A dedicated thread owns the ALSA
+ * sequencer: it batches everything queued since the last wakeup into one
+ * snd_seq_drain_output(), keeps a subscription to the destination port
+ * (resolved by name, not by client number) and re-resolves it when the
+ * sequencer announces clients or ports coming and going.
+ *
+ */
+#ifndef MIDI_OUT_H
+#define MIDI_OUT_H
+
+#include <stdint.h>
+
+// Destination used when the config has no MIDI_DEST line
+#define MIDI_OUT_DEFAULT_DEST "Mockba Automation In"
+
+#define MIDI_OUT_QUEUE_SIZE 1024  // must be a power of two
+
+enum midi_msg_type {
+    MIDI_MSG_CC = 0,
+    MIDI_MSG_NOTE_ON,
+    MIDI_MSG_NOTE_OFF,
+    MIDI_MSG_NRPN,       // param and value are 14-bit
+};
+
+struct midi_msg {
+    uint8_t type;
+    uint8_t channel;
+    uint16_t param;     // CC number / note / NRPN number
+    int32_t value;
+};
+
+struct midi_out_stats {
+    unsigned long queued;     // accepted by midi_out_send()
+    unsigned long sent;       // handed to the sequencer
+    unsigned long dropped;    // queue full, or no destination
+    unsigned long drains;     // snd_seq_drain_output() calls (one per batch)
+    unsigned long rescans;    // destination lookups
+    int dest_client;          // -1 while unresolved
+    int dest_port;
+};
+
+// Start the sequencer client and output thread.
+// dest is "client name", "port name", "client:port" names, or "129:0" numbers.
+int midi_out_start(const char* dest);
+void midi_out_stop(void);
+int midi_out_running(void);   // started and not stopped since
+
+// Queue a message from the (single) producer thread. Never blocks.
+// Returns -1 if the engine is not running or the queue is full.
+int midi_out_send(const struct midi_msg* msg);
+
+static inline int midi_out_cc(int channel, int cc, int value)
+{
+    struct midi_msg msg = { MIDI_MSG_CC, (uint8_t)channel, (uint16_t)cc, value };
+    return midi_out_send(&msg);
+}
+
+static inline int midi_out_nrpn(int channel, int nrpn, int value)
+{
+    struct midi_msg msg = { MIDI_MSG_NRPN, (uint8_t)channel, (uint16_t)nrpn, value };
+    return midi_out_send(&msg);
+}
+
+void midi_out_get_stats(struct midi_out_stats* out);
+
+#endif // MIDI_OUT_H
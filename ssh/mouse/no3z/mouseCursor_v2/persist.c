@@ -0,0 +1,41 @@
+/**
+ * @file persist.c
+ * Decription: Cursor state kept in /dev/shm across restarts (see engine.h).
+ *
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "engine.h"
+
+// Cursor position and mouse device from before the last restart
+struct engine_persist* persist_map(void)
+{
+    int fd = shm_open(ENGINE_PERSIST_SHM, O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return NULL;
+    if (ftruncate(fd, sizeof(struct engine_persist)) < 0) {
+        close(fd);
+        return NULL;
+    }
+    void* ptr = mmap(NULL, sizeof(struct engine_persist), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+        return NULL;
+
+    struct engine_persist* p = ptr;
+    if (p->magic != ENGINE_PERSIST_MAGIC || p->version != ENGINE_PERSIST_VERSION) {
+        memset(p, 0, sizeof(*p));
+        p->cursor_x = ENGINE_DEFAULT_X;
+        p->cursor_y = ENGINE_DEFAULT_Y;
+        p->version = ENGINE_PERSIST_VERSION;
+        p->magic = ENGINE_PERSIST_MAGIC;
+    }
+    p->cursor_x = p->cursor_x < 0 ? 0 : p->cursor_x > 799 ? 799 : p->cursor_x;
+    p->cursor_y = p->cursor_y < 0 ? 0 : p->cursor_y > 1279 ? 1279 : p->cursor_y;
+    p->device[sizeof(p->device) - 1] = '\0';
+    return p;
+}
@@ -0,0 +1,254 @@
+/**
+ * @file pipeline.h
+ * Decription: Mouse event pipeline shared by every build of the cursor.
+ *
+ * One copy of what all builds do with a mouse event: REL motion -> portrait
+ * screen position and clamp, buttons -> touch at the cursor tip, drag, and
+ * SYN_REPORT -> cursor move. A build picks its stages with the PIPELINE_*
+ * macros below, set before the #include or with -D, and defines the stages
+ * it plugs in as static functions anywhere in the same file. The result is
+ * one pipeline_event() per build with the unused stages compiled out and
+ * the plugged-in ones called directly, so the compiler inlines them.
+ *
+ * Builds (see ../../src/compile and ./compile):
+ *   src/force_cursor.c              config file source, buttons -> touch
+ *   ... -DPIPELINE_SOURCE=PIPELINE_SOURCE_AUTODETECT
+ *                                   first mouse in /proc/bus/input/devices
+ *   mouseCursor_v2/force_cursor.c   the engine: buttons, wheel and encoder
+ *                                   plug in, one move per read batch
+ *
+ * bench/variants reports the size and ns/event of each.
+ *
+ */
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <linux/input.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PIPELINE_WIDTH 800             // portrait screen
+#define PIPELINE_HEIGHT 1280
+
+// Where the mouse device comes from (lite builds, pipeline_source())
+#define PIPELINE_SOURCE_CONFIG 0       // first line of the config file, speed on the second
+#define PIPELINE_SOURCE_AUTODETECT 1   // first device with REL axes; speed on the first line
+#define PIPELINE_SOURCE_NONE 2         // the build opens its own devices
+
+// What mouse buttons do
+#define PIPELINE_BUTTONS_TOUCH 0       // left, right and middle touch at the cursor tip
+#define PIPELINE_BUTTONS_HOOK 1        // EV_KEY goes to pipeline_key()
+
+#ifndef PIPELINE_SOURCE
+#define PIPELINE_SOURCE PIPELINE_SOURCE_CONFIG
+#endif
+#ifndef PIPELINE_BUTTONS
+#define PIPELINE_BUTTONS PIPELINE_BUTTONS_TOUCH
+#endif
+#ifndef PIPELINE_CLICK_OFFSET_X        // cursor top-left -> tip of the image
+#define PIPELINE_CLICK_OFFSET_X 0
+#endif
+#ifndef PIPELINE_CLICK_OFFSET_Y
+#define PIPELINE_CLICK_OFFSET_Y 0
+#endif
+#ifndef PIPELINE_DRAG                  // touch follows the cursor while pressed
+#define PIPELINE_DRAG 1
+#endif
+#ifndef PIPELINE_REL_FILTER            // pipeline_rel_filter() may take REL events first
+#define PIPELINE_REL_FILTER 0
+#endif
+#ifndef PIPELINE_WHEEL                 // REL_WHEEL goes to pipeline_wheel()
+#define PIPELINE_WHEEL 0
+#endif
+#ifndef PIPELINE_COALESCE              // SYN_REPORT goes to pipeline_frame(); the build
+#define PIPELINE_COALESCE 0            // moves the cursor once per read batch
+#endif
+#ifndef PIPELINE_DEFAULT_RATE
+#if PIPELINE_SOURCE == PIPELINE_SOURCE_AUTODETECT
+#define PIPELINE_DEFAULT_RATE 2.0f
+#else
+#define PIPELINE_DEFAULT_RATE 1.0f
+#endif
+#endif
+
+struct pipeline {
+    int x;                             // cursor top-left on screen
+    int y;
+    float rate;                        // speed multiplier
+    int touch_down;                    // a touch is held (drag)
+};
+
+// Stages the including file defines
+static void pipeline_touch(int x, int y, int pressed);
+#if PIPELINE_COALESCE
+static void pipeline_frame(const struct input_event* ev);
+#else
+static void pipeline_move(int x, int y);
+#endif
+#if PIPELINE_BUTTONS == PIPELINE_BUTTONS_HOOK
+static void pipeline_key(const struct input_event* ev);
+#endif
+#if PIPELINE_REL_FILTER
+static int pipeline_rel_filter(const struct input_event* ev);
+#endif
+#if PIPELINE_WHEEL
+static void pipeline_wheel(int value);
+#endif
+
+static inline int pipeline_clamp(int v, int max)
+{
+    return v < 0 ? 0 : v > max ? max : v;
+}
+
+// REL motion -> screen; returns 1 if the cursor moved (not if the axis
+// only pushed it against the edge of the screen)
+static inline int pipeline_rel(struct pipeline* p, uint16_t code, int32_t value)
+{
+    // Swap X and Y for portrait display (800x1280), invert Y
+    if (code == REL_X) {
+        int old = p->y;
+        p->y -= value * p->rate;  // Mouse X -> Screen Y (inverted)
+        p->y = pipeline_clamp(p->y, PIPELINE_HEIGHT - 1);
+        return p->y != old;
+    }
+    if (code == REL_Y) {
+        int old = p->x;
+        p->x += value * p->rate;  // Mouse Y -> Screen X
+        p->x = pipeline_clamp(p->x, PIPELINE_WIDTH - 1);
+        return p->x != old;
+    }
+    return 0;
+}
+
+// Where a touch lands: the tip of the cursor image, on screen
+static inline void pipeline_tip(const struct pipeline* p, int* x, int* y)
+{
+    *x = pipeline_clamp(p->x + PIPELINE_CLICK_OFFSET_X, PIPELINE_WIDTH - 1);
+    *y = pipeline_clamp(p->y + PIPELINE_CLICK_OFFSET_Y, PIPELINE_HEIGHT - 1);
+}
+
+// One single-touch frame: position, BTN_TOUCH, sync
+static inline void pipeline_touch_frame(struct input_event ev[4], int x, int y, int pressed)
+{
+    memset(ev, 0, 4 * sizeof(ev[0]));
+    ev[0].type = EV_ABS;
+    ev[0].code = ABS_X;
+    ev[0].value = x;
+    ev[1].type = EV_ABS;
+    ev[1].code = ABS_Y;
+    ev[1].value = y;
+    ev[2].type = EV_KEY;
+    ev[2].code = BTN_TOUCH;
+    ev[2].value = pressed;
+    ev[3].type = EV_SYN;
+    ev[3].code = SYN_REPORT;
+}
+
+static inline void pipeline_event(struct pipeline* p, const struct input_event* ev)
+{
+    if (ev->type == EV_REL) {
+#if PIPELINE_REL_FILTER
+        if (pipeline_rel_filter(ev))
+            return;
+#endif
+#if PIPELINE_WHEEL
+        if (ev->code == REL_WHEEL) {
+            pipeline_wheel(ev->value);
+            return;
+        }
+#endif
+        if (!pipeline_rel(p, ev->code, ev->value))
+            return;
+#if PIPELINE_DRAG
+        if (p->touch_down) {
+            int x, y;
+            pipeline_tip(p, &x, &y);
+            pipeline_touch(x, y, 1);
+        }
+#endif
+    } else if (ev->type == EV_KEY) {
+#if PIPELINE_BUTTONS == PIPELINE_BUTTONS_HOOK
+        pipeline_key(ev);
+#else
+        if (ev->code == BTN_LEFT || ev->code == BTN_RIGHT || ev->code == BTN_MIDDLE) {
+            int x, y;
+            p->touch_down = ev->value != 0;
+            pipeline_tip(p, &x, &y);
+            pipeline_touch(x, y, p->touch_down);
+        }
+#endif
+    } else if (ev->type == EV_SYN && ev->code == SYN_REPORT) {
+#if PIPELINE_COALESCE
+        pipeline_frame(ev);
+#else
+        pipeline_move(p->x, p->y);
+#endif
+    }
+}
+
+#if PIPELINE_SOURCE != PIPELINE_SOURCE_NONE
+// The mouse device and speed, from the config file and (autodetect) from
+// /proc/bus/input/devices. Returns a malloc'd path, NULL if there is none.
+static char* pipeline_source(const char* conf_path, float* rate)
+{
+    char line[256];
+    char* path = NULL;
+    *rate = PIPELINE_DEFAULT_RATE;
+
+    FILE* fp = fopen(conf_path, "r");
+#if PIPELINE_SOURCE == PIPELINE_SOURCE_CONFIG
+    if (!fp)
+        return NULL;
+    /* ----- first line (string) ----- */
+    if (fgets(line, sizeof line, fp)) {
+        size_t len = strcspn(line, "\r\n"); /* strip newline */
+        path = malloc(len + 1);
+        if (path) {
+            memcpy(path, line, len);
+            path[len] = '\0';
+        }
+    }
+#endif
+    /* ----- speed line (float) ----- */
+    if (fp && fgets(line, sizeof line, fp)) {
+        char* endptr;
+        float val = strtof(line, &endptr);
+        if (endptr != line && val >= 0.1f && val <= 5.0f)
+            *rate = val;
+    }
+    if (fp)
+        fclose(fp);
+
+#if PIPELINE_SOURCE == PIPELINE_SOURCE_AUTODETECT
+    // Blocks in /proc/bus/input/devices end with an empty line
+    fp = fopen("/proc/bus/input/devices", "r");
+    if (!fp)
+        return NULL;
+    char event_name[32] = { 0 };
+    int has_rel = 0;
+    while (!path && fgets(line, sizeof line, fp)) {
+        if (strncmp(line, "H: Handlers=", 12) == 0) {
+            char* ev = strstr(line, "event");
+            if (ev)
+                sscanf(ev, "%31s", event_name);
+        } else if (strncmp(line, "B: REL=", 7) == 0) {
+            has_rel = 1;
+        } else if (line[0] == '\n') {
+            if (has_rel && event_name[0]) {
+                path = malloc(64);
+                if (path)
+                    snprintf(path, 64, "/dev/input/%s", event_name);
+            }
+            event_name[0] = 0;
+            has_rel = 0;
+        }
+    }
+    fclose(fp);
+#endif
+    return path;
+}
+#endif
+
+#endif // PIPELINE_H
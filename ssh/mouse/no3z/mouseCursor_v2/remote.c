@@ -0,0 +1,331 @@
+/**
+ * @file remote.c
+ * Decription: Remote pointer/keyboard server on the event loop (see remote.h).
+ *
+ */
+#define _GNU_SOURCE
+#include "remote.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "ev_loop.h"
+#include "log.h"
+#include "stats.h"
+
+#define REMOTE_RX_LEN 4096          // per client, several packets
+
+struct remote_client {
+    int fd;
+    size_t len;
+    unsigned char held[(KEY_MAX + 1) / 8];  // EV_KEY codes the client holds down
+    unsigned char buf[REMOTE_RX_LEN];
+};
+
+struct remote_config remote_config = { 0, REMOTE_DEFAULT_PORT };
+
+static struct remote_client clients[REMOTE_MAX_CLIENTS];
+static remote_handler handler;
+static int started = 0;
+static int unix_fd = -1;
+static int tcp_fd = -1;
+static int tcp_port = 0;            // port tcp_fd is bound to
+
+static void track_keys(struct remote_client* c, const struct input_event* evs, int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (evs[i].type != EV_KEY || evs[i].code > KEY_MAX || evs[i].value == 2)
+            continue;
+        if (evs[i].value)
+            c->held[evs[i].code / 8] |= (unsigned char)(1u << (evs[i].code % 8));
+        else
+            c->held[evs[i].code / 8] &= (unsigned char)~(1u << (evs[i].code % 8));
+    }
+}
+
+// A client that goes away (closed, SSH forward dropped) with a button or key
+// down would leave a touch or a key stuck on MPC: release them for it, as
+// one frame through the handler
+static void release_held(struct remote_client* c)
+{
+    static struct input_event evs[KEY_MAX + 2];
+    int count = 0;
+
+    for (int code = 0; code <= KEY_MAX; code++) {
+        if (!(c->held[code / 8] & (1u << (code % 8))))
+            continue;
+        memset(&evs[count], 0, sizeof(evs[count]));
+        evs[count].type = EV_KEY;
+        evs[count].code = (uint16_t)code;
+        count++;
+    }
+    memset(c->held, 0, sizeof(c->held));
+    if (!count)
+        return;
+    LOGI("[REMOTE] Client left with %d button(s)/key(s) down, released", count);
+    memset(&evs[count], 0, sizeof(evs[count]));
+    evs[count].type = EV_SYN;
+    evs[count].code = SYN_REPORT;
+    handler(evs, count + 1);
+}
+
+static void drop_client(int slot)
+{
+    ev_loop_remove(clients[slot].fd);
+    close(clients[slot].fd);
+    clients[slot].fd = -1;
+    clients[slot].len = 0;
+    release_held(&clients[slot]);
+}
+
+static int send_pong(int fd, const struct remote_header* ping)
+{
+    struct remote_header pong;
+    memset(&pong, 0, sizeof(pong));
+    pong.magic = REMOTE_MAGIC;
+    pong.version = REMOTE_VERSION;
+    pong.kind = REMOTE_PONG;
+    pong.sent_ns = ev_now_ns();
+    pong.echo_ns = ping->sent_ns;
+    return send(fd, &pong, sizeof(pong), MSG_DONTWAIT | MSG_NOSIGNAL) == sizeof(pong) ? 0 : -1;
+}
+
+// Every complete packet in the buffer; the events of all of them go to the
+// handler in one call, so they move the cursor once. -1: not our protocol.
+static int parse_packets(struct remote_client* c, uint64_t dequeue_ns)
+{
+    static struct input_event evs[REMOTE_RX_LEN / sizeof(struct remote_event)];
+    int count = 0;
+    size_t off = 0;
+
+    while (c->len - off >= sizeof(struct remote_header)) {
+        struct remote_header h;
+        memcpy(&h, c->buf + off, sizeof(h));
+        if (h.magic != REMOTE_MAGIC || h.version != REMOTE_VERSION || h.count > REMOTE_MAX_EVENTS)
+            return -1;
+        size_t size = sizeof(h) + h.count * sizeof(struct remote_event);
+        if (c->len - off < size)
+            break;
+
+        if (h.kind == REMOTE_PING) {
+            if (send_pong(c->fd, &h) < 0)
+                return -1;
+        } else if (h.kind == REMOTE_EVENTS) {
+            stats_inc(STAT_REMOTE_PACKETS);
+            stats_add(STAT_REMOTE_EVENTS, h.count);
+            // Sent time on our clock, once the client has measured the offset
+            uint64_t sent_ns = h.sent_ns + (uint64_t)h.offset_ns;
+            if ((h.flags & REMOTE_SYNCED) && dequeue_ns > sent_ns)
+                stats_hist_record(HIST_REMOTE_TO_DEQUEUE, dequeue_ns - sent_ns);
+
+            const unsigned char* p = c->buf + off + sizeof(h);
+            for (int i = 0; i < h.count; i++, p += sizeof(struct remote_event)) {
+                struct remote_event re;
+                memcpy(&re, p, sizeof(re));
+                memset(&evs[count], 0, sizeof(evs[count]));
+                evs[count].type = re.type;
+                evs[count].code = re.code;
+                evs[count].value = re.value;
+                count++;
+            }
+        }
+        off += size;
+    }
+
+    memmove(c->buf, c->buf + off, c->len - off);
+    c->len -= off;
+    if (count) {
+        track_keys(c, evs, count);
+        handler(evs, count);
+    }
+    return 0;
+}
+
+static void on_client(void* ctx, uint32_t events)
+{
+    int slot = (int)(intptr_t)ctx;
+    struct remote_client* c = &clients[slot];
+
+    if (c->fd < 0)
+        return;
+    if (events & EPOLLERR) {
+        drop_client(slot);
+        return;
+    }
+
+    for (;;) {
+        ssize_t n = recv(c->fd, c->buf + c->len, sizeof(c->buf) - c->len, MSG_DONTWAIT);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if (n <= 0) {
+            drop_client(slot);
+            return;
+        }
+        c->len += (size_t)n;
+        if (parse_packets(c, ev_now_ns()) < 0) {
+            LOGW("[REMOTE] Client sent something that is not a cursor_remote packet, dropped");
+            drop_client(slot);
+            return;
+        }
+    }
+}
+
+static void on_accept(void* ctx, uint32_t events)
+{
+    int listen_fd = (int)(intptr_t)ctx;
+    (void)events;
+
+    for (;;) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        int slot = -1;
+        for (int i = 0; i < REMOTE_MAX_CLIENTS; i++) {
+            if (clients[i].fd < 0) {
+                slot = i;
+                break;
+            }
+        }
+        if (slot < 0 || ev_loop_add(fd, EPOLLIN, on_client, (void*)(intptr_t)slot) < 0) {
+            LOGW("[REMOTE] Too many remote clients, connection refused");
+            close(fd);
+            continue;
+        }
+        // PONGs go out right away, not after the next packet
+        int one = 1;
+        if (listen_fd == tcp_fd)
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        clients[slot].fd = fd;
+        clients[slot].len = 0;
+        memset(clients[slot].held, 0, sizeof(clients[slot].held));
+        LOGI("[REMOTE] Client connected (%s)", listen_fd == tcp_fd ? "tcp" : "unix");
+    }
+}
+
+static int listen_on(int fd, const struct sockaddr* addr, socklen_t len)
+{
+    if (bind(fd, addr, len) < 0 || listen(fd, REMOTE_MAX_CLIENTS) < 0
+        || ev_loop_add(fd, EPOLLIN, on_accept, (void*)(intptr_t)fd) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int open_unix(void)
+{
+    struct sockaddr_un addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", REMOTE_SOCKET_PATH);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    unlink(REMOTE_SOCKET_PATH);
+    fd = listen_on(fd, (struct sockaddr*)&addr, sizeof(addr));
+    if (fd >= 0)
+        chmod(REMOTE_SOCKET_PATH, 0660);
+    return fd;
+}
+
+// Loopback only: from another machine, go through an SSH port forward
+static int open_tcp(int port)
+{
+    struct sockaddr_in addr;
+    int one = 1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((uint16_t)port);
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    return listen_on(fd, (struct sockaddr*)&addr, sizeof(addr));
+}
+
+static void close_listener(int* fd)
+{
+    if (*fd < 0)
+        return;
+    ev_loop_remove(*fd);
+    close(*fd);
+    *fd = -1;
+}
+
+void remote_apply(void)
+{
+    if (!started)
+        return;
+
+    int want_tcp = remote_config.enabled && remote_config.port > 0 && remote_config.port < 65536;
+    if (tcp_fd >= 0 && (!want_tcp || tcp_port != remote_config.port))
+        close_listener(&tcp_fd);
+    if (want_tcp && tcp_fd < 0) {
+        tcp_fd = open_tcp(remote_config.port);
+        tcp_port = remote_config.port;
+        if (tcp_fd < 0)
+            LOGE("[REMOTE] Could not listen on 127.0.0.1:%d (errno=%d)", remote_config.port, errno);
+        else
+            LOGI("[REMOTE] Listening on 127.0.0.1:%d", remote_config.port);
+    }
+
+    if (!remote_config.enabled && unix_fd >= 0) {
+        close_listener(&unix_fd);
+        unlink(REMOTE_SOCKET_PATH);
+        for (int i = 0; i < REMOTE_MAX_CLIENTS; i++) {
+            if (clients[i].fd >= 0)
+                drop_client(i);
+        }
+        LOGI("[REMOTE] Off");
+    }
+    if (remote_config.enabled && unix_fd < 0) {
+        unix_fd = open_unix();
+        if (unix_fd < 0)
+            LOGE("[REMOTE] Could not listen on " REMOTE_SOCKET_PATH " (errno=%d)", errno);
+        else
+            LOGI("[REMOTE] Listening on " REMOTE_SOCKET_PATH);
+    }
+}
+
+int remote_start(remote_handler h)
+{
+    for (int i = 0; i < REMOTE_MAX_CLIENTS; i++) {
+        clients[i].fd = -1;
+        clients[i].len = 0;
+    }
+    handler = h;
+    started = 1;
+    remote_apply();
+    if (remote_config.enabled && (unix_fd < 0 || (remote_config.port > 0 && tcp_fd < 0)))
+        return -1;
+    return 0;
+}
+
+void remote_stop(void)
+{
+    if (!started)
+        return;
+    for (int i = 0; i < REMOTE_MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0)
+            drop_client(i);
+    }
+    close_listener(&tcp_fd);
+    if (unix_fd >= 0) {
+        close_listener(&unix_fd);
+        unlink(REMOTE_SOCKET_PATH);
+    }
+    started = 0;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file remote.h
+ * Decription: Remote pointer/keyboard server: binary protocol and server.
+ *
+ * Lets a laptop drive the cursor: cursor_remote forwards its trackpad and
+ * keyboard as evdev-style events, over a Unix stream socket on the device
+ * or over TCP on 127.0.0.1, reachable through an SSH port forward:
+ *
+ *   ssh -L 7531:127.0.0.1:7531 root@force
+ *   cursor_remote -t 127.0.0.1:7531 -d /dev/input/event5
+ *
+ * A packet is a header and up to REMOTE_MAX_EVENTS events, so a whole
+ * trackpad frame (or several) costs one write. The server runs on the
+ * input thread's event loop, like the control socket, and hands the events
+ * to the same handler as the local mouse: they are coalesced into one
+ * cursor move per read and go through the same bindings. Buttons and keys a
+ * client still holds when it goes away are released for it.
+ *
+ * Latency: the client measures the clock offset with PING/PONG (NTP style,
+ * lowest round trip wins) and sends it in every header, so the server can
+ * time sent -> dequeued (remote_to_dequeue) across machines.
+ *
+ */
+#ifndef REMOTE_H
+#define REMOTE_H
+
+#include <stdint.h>
+#include <linux/input.h>
+
+#define REMOTE_SOCKET_PATH "/dev/shm/force_cursor_remote.sock"
+#define REMOTE_DEFAULT_PORT 7531
+#define REMOTE_MAGIC 0x52434346u    // "FCCR"
+#define REMOTE_VERSION 1
+#define REMOTE_MAX_EVENTS 64        // per packet
+#define REMOTE_MAX_CLIENTS 4
+
+enum remote_kind {
+    REMOTE_EVENTS = 0,          // count events follow
+    REMOTE_PING,                // sent_ns: client clock; answered by a PONG
+    REMOTE_PONG,                // sent_ns: server clock; echo_ns: the ping's sent_ns
+};
+
+#define REMOTE_SYNCED 1u        // flags: offset_ns is a measured offset
+
+struct remote_header {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t kind;
+    uint16_t count;
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t sent_ns;           // sender's CLOCK_MONOTONIC
+    uint64_t echo_ns;
+    int64_t offset_ns;          // server clock - client clock
+};
+
+// evdev's type/code/value: EV_REL (REL_X, REL_Y, REL_WHEEL), EV_KEY
+// (BTN_* and KEY_*), EV_SYN ends a frame
+struct remote_event {
+    uint16_t type;
+    uint16_t code;
+    int32_t value;
+};
+
+struct remote_config {
+    int enabled;                // REMOTE=1: Unix socket
+    int port;                   // REMOTE_PORT=n: also TCP on 127.0.0.1, 0 = off
+};
+
+extern struct remote_config remote_config;
+
+// Runs on the event loop thread with the events of one read (any number
+// of packets, at most one client)
+typedef void (*remote_handler)(const struct input_event* evs, int count);
+
+// Server side, needs the event loop. remote_apply() opens or closes the
+// listeners after remote_config changed (before remote_start(): no-op).
+int remote_start(remote_handler handler);
+void remote_apply(void);
+void remote_stop(void);
+
+#endif // REMOTE_H
@@ -0,0 +1,141 @@
+/**
+ * @file stats.c
+ * Decription: Live counters page (see stats.h).
+ *
+ */
+#define _GNU_SOURCE
+#include "stats.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char* const stat_names[STAT_COUNT] = {
+    [STAT_EVENTS_READ] = "events_read",
+    [STAT_READ_BATCHES] = "read_batches",
+    [STAT_FRAMES] = "frames",
+    [STAT_FRAMES_COALESCED] = "frames_coalesced",
+    [STAT_CURSOR_MOVES] = "cursor_moves",
+    [STAT_CURSOR_MOVES_ELIDED] = "cursor_moves_elided",
+    [STAT_TOUCH_FRAMES] = "touch_frames",
+    [STAT_TOUCH_DROPPED] = "touch_dropped",
+    [STAT_KEY_EVENTS] = "key_events",
+    [STAT_GESTURES] = "gestures",
+    [STAT_LOOP_WAKEUPS] = "loop_wakeups",
+    [STAT_INPUT_CPU_NS] = "input_cpu_ns",
+    [STAT_MIDI_QUEUED] = "midi_queued",
+    [STAT_MIDI_SENT] = "midi_sent",
+    [STAT_MIDI_DROPPED] = "midi_dropped",
+    [STAT_MIDI_DRAINS] = "midi_drains",
+    [STAT_LOG_WRITTEN] = "log_written",
+    [STAT_LOG_DROPPED] = "log_dropped",
+    [STAT_MACROS_PLAYED] = "macros_played",
+    [STAT_UI_PROBES] = "ui_probes",
+    [STAT_UI_PROBE_HITS] = "ui_probe_hits",
+    [STAT_UI_PROBE_TIMEOUTS] = "ui_probe_timeouts",
+    [STAT_PAGE_FLIPS] = "page_flips",
+    [STAT_GUI_COMMITS] = "gui_commits",
+    [STAT_GUI_FLIPS] = "gui_flips",
+    [STAT_GUI_MISSED_VBLANKS] = "gui_missed_vblanks",
+    [STAT_PCM_XRUNS] = "pcm_xruns",
+    [STAT_PCM_XRUNS_NEAR_INPUT] = "pcm_xruns_near_input",
+    [STAT_PCM_LATE_PERIODS] = "pcm_late_periods",
+    [STAT_REMOTE_PACKETS] = "remote_packets",
+    [STAT_REMOTE_EVENTS] = "remote_events",
+    [STAT_VNC_UPDATES] = "vnc_updates",
+    [STAT_VNC_TILES] = "vnc_tiles",
+    [STAT_VNC_BYTES] = "vnc_bytes",
+    [STAT_VNC_THROTTLED] = "vnc_throttled",
+    [STAT_VNC_CPU_NS] = "vnc_cpu_ns",
+    [STAT_VNC_TOUCHES] = "vnc_touches",
+};
+
+static const char* const hist_names[HIST_COUNT] = {
+    [HIST_EVDEV_TO_DEQUEUE] = "evdev_to_dequeue",
+    [HIST_DEQUEUE_TO_MOVE] = "dequeue_to_move",
+    [HIST_MOVE_TO_VBLANK] = "move_to_vblank",
+    [HIST_MOTION_TO_PHOTON] = "motion_to_photon",
+    [HIST_TOUCH_TO_UI] = "touch_to_ui",
+    [HIST_FRAME_INTERVAL] = "frame_interval",
+    [HIST_COMMIT_TO_FLIP] = "commit_to_flip",
+    [HIST_MAILBOX_TO_MOVE] = "mailbox_to_move",
+    [HIST_REMOTE_TO_DEQUEUE] = "remote_to_dequeue",
+    [HIST_VNC_FLIP_TO_SENT] = "vnc_flip_to_sent",
+};
+
+static struct stats_page private_page;
+static struct stats_page* shared_page = NULL;
+struct stats_page* stats = &private_page;
+
+static void fill_header(struct stats_page* p)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    p->version = STATS_VERSION;
+    p->size = sizeof(*p);
+    p->num_counters = STAT_COUNT;
+    p->pid = getpid();
+    p->start_ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    for (int i = 0; i < STAT_COUNT; i++)
+        snprintf(p->name[i], STATS_NAME_LEN, "%s", stat_names[i]);
+    p->num_hists = HIST_COUNT;
+    for (int i = 0; i < HIST_COUNT; i++)
+        snprintf(p->hist_name[i], STATS_NAME_LEN, "%s", hist_names[i]);
+}
+
+// Map the shared page and carry over anything counted so far. The page is
+// mapped once and stays mapped for the life of the process: the DRM hooks
+// and the VNC thread may hold the 'stats' pointer across an unpublish.
+int stats_publish(const char* name)
+{
+    if (stats == shared_page)
+        return 0;
+
+    if (shared_page) {
+        // Published before: the page is still there, only the values moved
+        memcpy(shared_page->counter, private_page.counter, sizeof(shared_page->counter));
+        memcpy(shared_page->hist, private_page.hist, sizeof(shared_page->hist));
+        __atomic_store_n(&stats, shared_page, __ATOMIC_RELEASE);
+        return 0;
+    }
+
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (fd < 0)
+        return -1;
+    if (ftruncate(fd, sizeof(struct stats_page)) < 0) {
+        close(fd);
+        return -1;
+    }
+    void* ptr = mmap(NULL, sizeof(struct stats_page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+        return -1;
+
+    struct stats_page* p = ptr;
+    p->magic = 0;  // readers ignore the page while it is being set up
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(p->counter, private_page.counter, sizeof(p->counter));
+    memcpy(p->hist, private_page.hist, sizeof(p->hist));
+    fill_header(p);
+    __atomic_store_n(&p->magic, STATS_MAGIC, __ATOMIC_RELEASE);
+
+    shared_page = p;
+    __atomic_store_n(&stats, p, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Keep the last values readable after the input thread stops, and move the
+// writers back to the private page. The shared page is not unmapped: a
+// thread that loaded 'stats' just before the switch may still write to it.
+void stats_unpublish(void)
+{
+    if (!shared_page || stats != shared_page)
+        return;
+    memcpy(private_page.counter, shared_page->counter, sizeof(private_page.counter));
+    memcpy(private_page.hist, shared_page->hist, sizeof(private_page.hist));
+    __atomic_store_n(&stats, &private_page, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,182 @@
+/**
+ * @file stats.h
+ * Decription: Live counters published in /dev/shm for cursor_stats.
+ *
+ * The page is a fixed header followed by an array of 64-bit counters and
+ * their names, so a reader built against an older layout can still print
+ * everything it finds. Each counter has a single writer thread and is
+ * updated with relaxed atomic stores: no locks, no syscalls. Readers only
+ * ever load.
+ *
+ * Version 2 appends latency histograms: log-linear buckets (4 per power of
+ * two), good for p50/p99 within about 12%.
+ *
+ */
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+#define STATS_SHM_NAME "/force_cursor_stats"   // /dev/shm/force_cursor_stats
+#define STATS_DAEMON_SHM_NAME "/force_cursor_daemon_stats"  // cursord's page
+#define STATS_MAGIC 0x54534346u                // "FCST"
+#define STATS_VERSION 2
+#define STATS_MAX_COUNTERS 64
+#define STATS_NAME_LEN 24
+#define STATS_MAX_HISTS 16
+#define STATS_HIST_BUCKETS 128     // covers 1 ns .. 8.6 s
+
+// Counter ids. Append only: readers match by name, not by position.
+enum stat_id {
+    STAT_EVENTS_READ = 0,      // evdev events read from the mouse
+    STAT_READ_BATCHES,         // read() calls that returned events
+    STAT_FRAMES,               // SYN_REPORT frames
+    STAT_FRAMES_COALESCED,     // frames folded into a later cursor move
+    STAT_CURSOR_MOVES,         // drmModeMoveCursor calls issued
+    STAT_CURSOR_MOVES_ELIDED,  // moves skipped, position unchanged
+    STAT_TOUCH_FRAMES,         // touch frames written to uinput
+    STAT_TOUCH_DROPPED,        // touch frames the write() rejected
+    STAT_KEY_EVENTS,           // key events written to the keyboard device
+    STAT_GESTURES,             // pinch gestures injected
+    STAT_LOOP_WAKEUPS,         // event loop iterations
+    STAT_INPUT_CPU_NS,         // input thread CPU time
+    STAT_MIDI_QUEUED,          // the rest are refreshed once per second
+    STAT_MIDI_SENT,
+    STAT_MIDI_DROPPED,
+    STAT_MIDI_DRAINS,
+    STAT_LOG_WRITTEN,
+    STAT_LOG_DROPPED,
+    STAT_MACROS_PLAYED,
+    STAT_UI_PROBES,            // touch presses armed for the UI probe
+    STAT_UI_PROBE_HITS,        // probes answered by a changed frame
+    STAT_UI_PROBE_TIMEOUTS,    // no change near the touch within the timeout
+    STAT_PAGE_FLIPS,           // drmModePageFlip calls from MPC
+    STAT_GUI_COMMITS,          // MPC flips/commits that asked for an event
+    STAT_GUI_FLIPS,            // flip-complete events MPC received
+    STAT_GUI_MISSED_VBLANKS,   // refresh periods lost between commit and flip
+    STAT_PCM_XRUNS,            // MPC audio xruns (XRUN_MONITOR=1)
+    STAT_PCM_XRUNS_NEAR_INPUT, // ... with our activity in the XRUN_WINDOW before
+    STAT_PCM_LATE_PERIODS,     // audio transfers over 1.5 periods apart
+    STAT_REMOTE_PACKETS,       // cursor_remote packets received
+    STAT_REMOTE_EVENTS,        // ... and the events in them
+    STAT_VNC_UPDATES,          // VNC framebuffer updates sent
+    STAT_VNC_TILES,            // ... changed tiles in them
+    STAT_VNC_BYTES,            // ... bytes on the wire
+    STAT_VNC_THROTTLED,        // frames delayed by the VNC_CPU budget
+    STAT_VNC_CPU_NS,           // VNC thread CPU time (gauge)
+    STAT_VNC_TOUCHES,          // viewer clicks injected as touches
+    STAT_COUNT
+};
+
+// Histogram ids (append only, like the counters)
+enum hist_id {
+    HIST_EVDEV_TO_DEQUEUE = 0, // kernel event timestamp -> read() returned
+    HIST_DEQUEUE_TO_MOVE,      // read() returned -> drmModeMoveCursor returned
+    HIST_MOVE_TO_VBLANK,       // drmModeMoveCursor returned -> next vblank
+    HIST_MOTION_TO_PHOTON,     // kernel event timestamp -> next vblank
+    HIST_TOUCH_TO_UI,          // injected press -> first flip with changed pixels
+    HIST_FRAME_INTERVAL,       // MPC flip -> next flip (gaps over 250 ms skipped)
+    HIST_COMMIT_TO_FLIP,       // MPC page flip/atomic commit -> flip on screen
+    HIST_MAILBOX_TO_MOVE,      // cursord posted -> drmModeMoveCursor returned in MPC
+    HIST_REMOTE_TO_DEQUEUE,    // cursor_remote sent (offset-corrected) -> read() returned
+    HIST_VNC_FLIP_TO_SENT,     // page flip -> its VNC update written to the socket
+    HIST_COUNT
+};
+
+struct stats_hist {
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+    uint64_t bucket[STATS_HIST_BUCKETS];
+};
+
+struct stats_page {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;             // bytes, for sanity checks by readers
+    uint32_t num_counters;
+    int32_t pid;
+    uint32_t reserved;
+    uint64_t start_ns;         // CLOCK_MONOTONIC when published
+    uint64_t update_ns;        // last periodic refresh
+    uint64_t counter[STATS_MAX_COUNTERS];
+    char name[STATS_MAX_COUNTERS][STATS_NAME_LEN];
+    // Version 2
+    uint32_t num_hists;
+    uint32_t reserved2;
+    char hist_name[STATS_MAX_HISTS][STATS_NAME_LEN];
+    struct stats_hist hist[STATS_MAX_HISTS];
+};
+
+// Points at a private page until stats_publish() maps the shared one
+extern struct stats_page* stats;
+
+// Map the shared page: STATS_SHM_NAME in MPC, STATS_DAEMON_SHM_NAME in cursord.
+// It stays mapped once published; unpublish only moves the writers off it.
+int stats_publish(const char* name);
+void stats_unpublish(void);
+
+static inline void stats_add(int id, uint64_t n)
+{
+    uint64_t* c = &stats->counter[id];
+    __atomic_store_n(c, __atomic_load_n(c, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+static inline void stats_inc(int id)
+{
+    stats_add(id, 1);
+}
+
+static inline void stats_set(int id, uint64_t v)
+{
+    __atomic_store_n(&stats->counter[id], v, __ATOMIC_RELAXED);
+}
+
+static inline int stats_hist_bucket(uint64_t ns)
+{
+    if (ns < 4)
+        return (int)ns;
+    int msb = 63 - __builtin_clzll(ns);
+    int idx = msb * 4 + (int)((ns >> (msb - 2)) & 3) - 4;
+    return idx < STATS_HIST_BUCKETS ? idx : STATS_HIST_BUCKETS - 1;
+}
+
+// Smallest value that lands in bucket idx
+static inline uint64_t stats_hist_bucket_lo(int idx)
+{
+    if (idx < 4)
+        return (uint64_t)idx;
+    return (uint64_t)(4 + idx % 4) << (idx / 4 - 1);
+}
+
+static inline void stats_hist_record(int id, uint64_t ns)
+{
+    struct stats_hist* h = &stats->hist[id];
+    uint64_t* b = &h->bucket[stats_hist_bucket(ns)];
+    __atomic_store_n(b, __atomic_load_n(b, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->sum_ns, h->sum_ns + ns, __ATOMIC_RELAXED);
+    if (ns > h->max_ns)
+        __atomic_store_n(&h->max_ns, ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->count, h->count + 1, __ATOMIC_RELAXED);
+}
+
+// Percentile (0-100) from a bucket snapshot: bucket midpoint, capped at max
+static inline uint64_t stats_hist_percentile(const uint64_t* bucket, uint64_t count, uint64_t max_ns, double pct)
+{
+    if (count == 0)
+        return 0;
+    uint64_t rank = (uint64_t)(pct / 100.0 * (double)(count - 1)) + 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < STATS_HIST_BUCKETS; i++) {
+        seen += bucket[i];
+        if (seen >= rank) {
+            uint64_t lo = stats_hist_bucket_lo(i);
+            uint64_t hi = i + 1 < STATS_HIST_BUCKETS ? stats_hist_bucket_lo(i + 1) : lo;
+            uint64_t mid = lo + (hi - lo) / 2;
+            return mid < max_ns ? mid : max_ns;
+        }
+    }
+    return max_ns;
+}
+
+#endif // STATS_H
@@ -0,0 +1,221 @@
+/**
+ * @file trace.c
+ * Decription: Per-thread trace rings and the Chrome JSON writer (see trace.h).
+ *
+ */
+#define _GNU_SOURCE
+#include "trace.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+struct trace_event {
+    uint64_t ts_ns;
+    const char* name;
+    uint32_t dur_ns;        // complete events ('X')
+    uint32_t arg;
+    char ph;                // 'X' complete, 'i' instant
+};
+
+struct trace_ring {
+    int tid;
+    char thread_name[16];
+    atomic_int owned;       // a live thread records here; 0: free for the next one
+    atomic_uint head;       // written by the owning thread only
+    atomic_int writing;     // owner is inside record(), see trace_dump()
+    struct trace_event ev[TRACE_RING_SIZE];
+};
+
+volatile int trace_on = 0;
+
+static struct trace_ring* rings[TRACE_MAX_THREADS];
+static atomic_int num_rings;
+static atomic_int dumping;  // writers leave the rings alone while set
+static __thread struct trace_ring* my_ring = NULL;
+static __thread int my_ring_failed = 0;
+static __thread int my_ring_reused = 0;  // still holds the last owner's events
+static pthread_key_t ring_key;          // its destructor frees the ring at thread exit
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+uint64_t trace_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Thread exit: the ring keeps its events for the next dump, and goes to the
+// next thread that needs one (the MIDI thread is a new one every engine run)
+static void release_ring(void* arg)
+{
+    struct trace_ring* r = arg;
+    my_ring = NULL;
+    atomic_store_explicit(&r->owned, 0, memory_order_release);
+}
+
+static void make_ring_key(void)
+{
+    pthread_key_create(&ring_key, release_ring);
+}
+
+static void name_ring(struct trace_ring* r)
+{
+    r->tid = (int)syscall(SYS_gettid);
+    if (pthread_getname_np(pthread_self(), r->thread_name, sizeof(r->thread_name)) != 0)
+        snprintf(r->thread_name, sizeof(r->thread_name), "tid %d", r->tid);
+}
+
+// First trace point on a thread: take a ring an exited thread left, else
+// allocate and register a new one
+static struct trace_ring* get_ring(void)
+{
+    if (my_ring || my_ring_failed)
+        return my_ring;
+
+    pthread_once(&ring_key_once, make_ring_key);
+    struct trace_ring* r = NULL;
+    int n = atomic_load(&num_rings);
+    if (n > TRACE_MAX_THREADS)
+        n = TRACE_MAX_THREADS;
+    for (int i = 0; i < n && !r; i++) {
+        struct trace_ring* old = __atomic_load_n(&rings[i], __ATOMIC_ACQUIRE);
+        int free_ring = 0;
+        if (old && atomic_compare_exchange_strong(&old->owned, &free_ring, 1))
+            r = old;
+    }
+    if (r) {
+        // Renamed and emptied in record(), where a dump cannot be reading it
+        my_ring_reused = 1;
+    } else {
+        int slot = atomic_fetch_add(&num_rings, 1);
+        if (slot >= TRACE_MAX_THREADS) {
+            my_ring_failed = 1;
+            return NULL;
+        }
+        r = calloc(1, sizeof(*r));
+        if (!r) {
+            my_ring_failed = 1;
+            return NULL;
+        }
+        name_ring(r);
+        atomic_init(&r->owned, 1);
+        __atomic_store_n(&rings[slot], r, __ATOMIC_RELEASE);
+    }
+    pthread_setspecific(ring_key, r);
+    my_ring = r;
+    return r;
+}
+
+static void record(char ph, const char* name, uint64_t ts, uint64_t dur, uint32_t arg)
+{
+    struct trace_ring* r = get_ring();
+    if (!r)
+        return;
+    // Pairs with trace_dump(): either it sees us writing and waits, or we
+    // see it dumping and drop the event
+    atomic_store(&r->writing, 1);
+    if (atomic_load(&dumping)) {
+        atomic_store_explicit(&r->writing, 0, memory_order_release);
+        return;
+    }
+    if (my_ring_reused) {
+        my_ring_reused = 0;
+        name_ring(r);
+        atomic_store_explicit(&r->head, 0, memory_order_relaxed);
+    }
+    unsigned int h = atomic_load_explicit(&r->head, memory_order_relaxed);
+    struct trace_event* e = &r->ev[h & (TRACE_RING_SIZE - 1)];
+    e->ts_ns = ts;
+    e->name = name;
+    e->dur_ns = dur > UINT32_MAX ? UINT32_MAX : (uint32_t)dur;
+    e->arg = arg;
+    e->ph = ph;
+    atomic_store_explicit(&r->head, h + 1, memory_order_release);
+    atomic_store_explicit(&r->writing, 0, memory_order_release);
+}
+
+void trace_complete(const char* name, uint64_t start_ns, uint32_t arg)
+{
+    record('X', name, start_ns, trace_now() - start_ns, arg);
+}
+
+void trace_instant(const char* name, uint32_t arg)
+{
+    record('i', name, trace_now(), 0, arg);
+}
+
+// A JSON string: thread names come from pthread_setname_np() and event
+// names from anywhere in the tree, neither is known to be clean
+static void put_json_string(FILE* fp, const char* s)
+{
+    fputc('"', fp);
+    for (; s && *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+            fprintf(fp, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(fp, "\\u%04x", c);
+        else
+            fputc(c, fp);
+    }
+    fputc('"', fp);
+}
+
+// Write every ring as Chrome trace JSON. Events recorded meanwhile are
+// dropped, and the dump starts once every writer that was already inside
+// record() has finished, so the rings hold still.
+int trace_dump(const char* path)
+{
+    FILE* fp = fopen(path ? path : TRACE_DEFAULT_PATH, "w");
+    if (!fp)
+        return -1;
+
+    atomic_store(&dumping, 1);
+    int pid = getpid();
+    int count = 0;
+    int n = atomic_load(&num_rings);
+    if (n > TRACE_MAX_THREADS)
+        n = TRACE_MAX_THREADS;
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (int i = 0; i < n; i++) {
+        struct trace_ring* r = __atomic_load_n(&rings[i], __ATOMIC_ACQUIRE);
+        if (!r)
+            continue;
+        while (atomic_load(&r->writing))
+            sched_yield();
+        fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":",
+                count ? ",\n" : "", pid, r->tid);
+        put_json_string(fp, r->thread_name);
+        fprintf(fp, "}}");
+        count++;
+
+        unsigned int head = atomic_load_explicit(&r->head, memory_order_acquire);
+        unsigned int first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+        for (unsigned int k = first; k != head; k++) {
+            const struct trace_event* e = &r->ev[k & (TRACE_RING_SIZE - 1)];
+            fprintf(fp, ",\n{\"name\":");
+            put_json_string(fp, e->name);
+            fprintf(fp, ",\"ph\":\"%c\",\"pid\":%d,\"tid\":%d,\"ts\":%llu.%03llu", e->ph, pid, r->tid,
+                    (unsigned long long)(e->ts_ns / 1000), (unsigned long long)(e->ts_ns % 1000));
+            if (e->ph == 'X')
+                fprintf(fp, ",\"dur\":%u.%03u", e->dur_ns / 1000, e->dur_ns % 1000);
+            else
+                fprintf(fp, ",\"s\":\"t\"");
+            fprintf(fp, ",\"args\":{\"n\":%u}}", e->arg);
+            count++;
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+
+    atomic_store_explicit(&dumping, 0, memory_order_release);
+    return count;
+}
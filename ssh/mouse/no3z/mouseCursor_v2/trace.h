@@ -0,0 +1,66 @@
+/**
+ * @file trace.h
+ * Decription: Timeline trace points, dumped in Chrome/Perfetto JSON format.
+ *
+ * Every thread that hits a trace point gets its own ring (flight recorder,
+ * oldest events overwritten), so recording takes no locks, only the ring
+ * head and a busy flag that trace_dump() waits on. A ring goes back to the
+ * pool when its thread exits, so engine reloads do not use up the slots. trace_dump() writes all rings as a Chrome trace
+ * that ui.perfetto.dev or chrome://tracing open directly.
+ *
+ *   uint64_t t = trace_begin();
+ *   ...work...
+ *   trace_end("drmModeMoveCursor", t, 0);
+ *
+ * While tracing is off a trace point is one load and a predicted branch.
+ * Build with -DNO_TRACE to compile them out entirely. Names must be string
+ * literals (only the pointer is recorded).
+ *
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_RING_SIZE 8192        // events per thread, power of two
+#define TRACE_MAX_THREADS 16
+#define TRACE_DEFAULT_PATH "/tmp/force_cursor_trace.json"
+
+extern volatile int trace_on;       // TRACE= / control command
+
+uint64_t trace_now(void);
+void trace_complete(const char* name, uint64_t start_ns, uint32_t arg);
+void trace_instant(const char* name, uint32_t arg);
+int trace_dump(const char* path);   // returns events written, -1 on error
+
+#ifndef NO_TRACE
+
+static inline uint64_t trace_begin(void)
+{
+    if (__builtin_expect(!trace_on, 1))
+        return 0;
+    return trace_now();
+}
+
+static inline void trace_end(const char* name, uint64_t start_ns, uint32_t arg)
+{
+    if (__builtin_expect(start_ns == 0, 1))
+        return;
+    trace_complete(name, start_ns, arg);
+}
+
+static inline void trace_mark(const char* name, uint32_t arg)
+{
+    if (__builtin_expect(trace_on, 0))
+        trace_instant(name, arg);
+}
+
+#else
+
+static inline uint64_t trace_begin(void) { return 0; }
+static inline void trace_end(const char* name, uint64_t start_ns, uint32_t arg) { (void)name; (void)start_ns; (void)arg; }
+static inline void trace_mark(const char* name, uint32_t arg) { (void)name; (void)arg; }
+
+#endif // NO_TRACE
+
+#endif // TRACE_H
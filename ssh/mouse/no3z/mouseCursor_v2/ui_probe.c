@@ -0,0 +1,155 @@
+/**
+ * @file ui_probe.c
+ * Decription: Input-to-UI response probe (see ui_probe.h).
+ *
+ */
+#define _GNU_SOURCE
+#include "ui_probe.h"
+
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+#include "fb_map.h"
+#include "log.h"
+#include "stats.h"
+
+#define GRID (UI_PROBE_BOX / UI_PROBE_STEP)
+
+int ui_probe_enabled = 0;
+
+// Armed probe, published by the input thread with a sequence lock
+static atomic_uint arm_seq;
+static int arm_x, arm_y;
+static uint64_t arm_ns;
+
+// Page flip thread state
+static unsigned int active_seq = 0;
+static unsigned int done_seq = 0;
+static int have_baseline = 0;
+static uint32_t baseline[GRID * GRID];
+static uint32_t front_fb = 0;
+
+static struct fb_map cache[UI_PROBE_FB_CACHE];
+static int next_evict = 0;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void ui_probe_arm(int x, int y)
+{
+    if (!ui_probe_enabled)
+        return;
+    unsigned int s = atomic_load_explicit(&arm_seq, memory_order_relaxed);
+    atomic_store_explicit(&arm_seq, s + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    arm_x = x;
+    arm_y = y;
+    arm_ns = now_ns();
+    atomic_store_explicit(&arm_seq, s + 2, memory_order_release);
+    stats_inc(STAT_UI_PROBES);
+}
+
+static const struct fb_map* map_fb(int fd, uint32_t fb_id)
+{
+    for (int i = 0; i < UI_PROBE_FB_CACHE; i++) {
+        if (cache[i].fb_id == fb_id && cache[i].ptr)
+            return &cache[i];
+    }
+
+    struct fb_map* m = &cache[next_evict];
+    next_evict = (next_evict + 1) % UI_PROBE_FB_CACHE;
+    fb_unmap(fd, m);
+    return fb_map(fd, fb_id, m) == 0 ? m : NULL;
+}
+
+// Sample the grid around (x, y); returns -1 if the buffer can't be read
+static int sample(int fd, uint32_t fb_id, int x, int y, uint32_t* out)
+{
+    const struct fb_map* m = map_fb(fd, fb_id);
+    if (!m)
+        return -1;
+
+    int x0 = x - UI_PROBE_BOX / 2;
+    int y0 = y - UI_PROBE_BOX / 2;
+    if (x0 < 0)
+        x0 = 0;
+    if (y0 < 0)
+        y0 = 0;
+    if (x0 + UI_PROBE_BOX > (int)m->width)
+        x0 = (int)m->width - UI_PROBE_BOX;
+    if (y0 + UI_PROBE_BOX > (int)m->height)
+        y0 = (int)m->height - UI_PROBE_BOX;
+    if (x0 < 0 || y0 < 0)
+        return -1;
+
+    for (int gy = 0; gy < GRID; gy++) {
+        const uint32_t* row = (const uint32_t*)(m->ptr + (size_t)(y0 + gy * UI_PROBE_STEP) * m->pitch);
+        for (int gx = 0; gx < GRID; gx++)
+            out[gy * GRID + gx] = row[x0 + gx * UI_PROBE_STEP] & 0x00FFFFFFu;  // ignore alpha/padding
+    }
+    return 0;
+}
+
+void ui_probe_flip(int fd, uint32_t fb_id)
+{
+    uint32_t prev_fb = front_fb;
+    front_fb = fb_id;
+    stats_inc(STAT_PAGE_FLIPS);
+
+    if (!ui_probe_enabled)
+        return;
+    unsigned int s = atomic_load_explicit(&arm_seq, memory_order_acquire);
+    if ((s & 1) || s == done_seq || s == 0)
+        return;
+    int x = arm_x, y = arm_y;
+    uint64_t t0 = arm_ns;
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&arm_seq, memory_order_relaxed) != s)
+        return;  // re-armed while we read, catch it on the next flip
+
+    if (s != active_seq) {
+        active_seq = s;
+        have_baseline = 0;
+    }
+
+    uint64_t now = now_ns();
+    if (now - t0 > UI_PROBE_TIMEOUT_NS) {
+        stats_inc(STAT_UI_PROBE_TIMEOUTS);
+        done_seq = s;
+        return;
+    }
+
+    // The frame on screen at the press is the one this flip replaces
+    if (!have_baseline) {
+        if (!prev_fb || sample(fd, prev_fb, x, y, baseline) < 0) {
+            done_seq = s;
+            return;
+        }
+        have_baseline = 1;
+    }
+
+    uint32_t cur[GRID * GRID];
+    if (sample(fd, fb_id, x, y, cur) < 0) {
+        done_seq = s;
+        return;
+    }
+    if (memcmp(cur, baseline, sizeof(cur)) != 0) {
+        stats_hist_record(HIST_TOUCH_TO_UI, now - t0);
+        stats_inc(STAT_UI_PROBE_HITS);
+        LOGD("[PROBE] UI reacted to touch at (%d, %d) after %.1f ms", x, y, (now - t0) / 1e6);
+        done_seq = s;
+    }
+}
+
+void ui_probe_forget(int fd, uint32_t fb_id)
+{
+    for (int i = 0; i < UI_PROBE_FB_CACHE; i++) {
+        if (cache[i].fb_id == fb_id)
+            fb_unmap(fd, &cache[i]);
+    }
+}
@@ -0,0 +1,37 @@
+/**
+ * @file ui_probe.h
+ * Decription: Input-to-UI response probe (measurement mode, UI_PROBE=1).
+ *
+ * When a touch press is injected, the probe remembers where and when. Each
+ * page flip MPC submits afterwards (drmModePageFlip hook, MPC's render
+ * thread) is compared with the frame that was on screen at the press, over
+ * a small grid of pixels around the touch point. The first flip that differs
+ * ends the probe and its delay goes into the touch_to_ui histogram.
+ *
+ * Framebuffers are mapped read-only (dumb map, or PRIME mmap for GPU
+ * buffers) and cached per fb id. Anything animating near the touch point
+ * (meters, playheads) will trigger the probe too: probe a static control.
+ *
+ */
+#ifndef UI_PROBE_H
+#define UI_PROBE_H
+
+#include <stdint.h>
+
+#define UI_PROBE_TIMEOUT_NS 1000000000ull  // give up after 1 s
+#define UI_PROBE_BOX 64                    // pixels compared around the touch (edge)
+#define UI_PROBE_STEP 4                    // grid spacing inside the box
+#define UI_PROBE_FB_CACHE 4                // MPC double/triple buffers
+
+extern int ui_probe_enabled;  // UI_PROBE=
+
+// Input thread: a touch press was injected at (x, y)
+void ui_probe_arm(int x, int y);
+
+// Page flip hook: fb_id is about to be shown
+void ui_probe_flip(int drm_fd, uint32_t fb_id);
+
+// RmFB hook: drop any mapping of fb_id (ids get reused)
+void ui_probe_forget(int drm_fd, uint32_t fb_id);
+
+#endif // UI_PROBE_H
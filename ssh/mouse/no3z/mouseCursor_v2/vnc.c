@@ -0,0 +1,1013 @@
+/**
+ * @file vnc.c
+ * Decription: Screen streaming server, RFB 3.3/3.7/3.8 (see vnc.h).
+ *
+ */
+#define _GNU_SOURCE
+#include "vnc.h"
+
+#include <errno.h>
+#include <linux/input.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+#include <zlib.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "fb_map.h"
+#include "log.h"
+#include "stats.h"
+
+#define VNC_NAME "MPC"
+#define VNC_DEFAULT_WIDTH 800           // ServerInit before the first frame
+#define VNC_DEFAULT_HEIGHT 1280
+#define VNC_RX_LEN 4096
+#define VNC_SEND_TIMEOUT_S 2            // a viewer that stops reading is dropped
+
+#define ENC_RAW 0
+#define ENC_ZLIB 6
+
+enum client_step {
+    STEP_VERSION = 0,                   // waiting for "RFB 003.00x\n"
+    STEP_SECURITY,                      // 3.7+: security type choice
+    STEP_INIT,                          // ClientInit
+    STEP_NORMAL,
+};
+
+struct pixel_format {
+    uint8_t bpp;
+    uint8_t depth;
+    uint8_t big_endian;
+    uint8_t true_colour;
+    uint16_t red_max;
+    uint16_t green_max;
+    uint16_t blue_max;
+    uint8_t red_shift;
+    uint8_t green_shift;
+    uint8_t blue_shift;
+};
+
+// XRGB8888, what MPC renders: sent as is when the viewer keeps it
+static const struct pixel_format native_format = { 32, 24, 0, 1, 255, 255, 255, 16, 8, 0 };
+
+struct client {
+    int fd;                             // -1: no viewer
+    int step;
+    int minor;                          // RFB 3.x
+    struct pixel_format pf;
+    int zlib;                           // viewer accepts zlib
+    int z_ready;
+    z_stream z;
+    int update_requested;
+    int full_requested;
+    int buttons;                        // last pointer button mask
+    size_t skip;                        // cut text bytes still to discard
+    size_t in_len;
+    uint8_t in[VNC_RX_LEN];
+};
+
+struct vnc_config vnc_config = { 0, VNC_DEFAULT_PORT, VNC_DEFAULT_FPS, VNC_DEFAULT_CPU };
+
+static const int* touch_fd = NULL;     // set by vnc_init()
+
+// The server thread is detached and tears itself down, so turning VNC off
+// never waits for a viewer stuck in send() on the input thread. thread_port
+// is what vnc_apply() wants now (0: off); the thread compares it with the
+// port it serves when it stops and starts over if they differ.
+static pthread_mutex_t thread_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t thread_gone = PTHREAD_COND_INITIALIZER;
+static int thread_started = 0;          // under thread_lock
+static int thread_port = 0;             // under thread_lock
+static int running = 0;                 // flips are being recorded
+static int stop = 0;
+static int wake_fd = -1;                // eventfd: a frame or a stop, open for good once made
+static int listen_fd = -1;              // the thread's
+static struct client client = { .fd = -1 };
+
+// Newest frame, written by MPC's render thread. The fb and the time are
+// stored before frame_seq, the thread reads frame_seq first.
+static uint64_t latest_fb = 0;          // drm fd << 32 | fb id
+static uint64_t latest_ns = 0;
+static const struct vnc_frame* latest_mem = NULL;
+static uint32_t frame_seq = 0;
+static int want_frame = 0;              // the thread waits for the next flip
+static int crtc_fd = -1;
+static uint32_t crtc_id = 0;
+
+// Mapped framebuffers. Only the thread maps and unmaps; RmFB (MPC's
+// thread) marks entries stale under the lock.
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct fb_map cache[VNC_FB_CACHE];
+static int cache_fd[VNC_FB_CACHE];
+static int cache_stale[VNC_FB_CACHE];
+static int next_evict = 0;
+
+// The last frame sent, packed (pitch = width * 4), and the send buffer
+static uint8_t* shadow = NULL;
+static uint32_t shadow_w = 0, shadow_h = 0;
+static uint8_t* out = NULL;
+static size_t out_len = 0, out_cap = 0;
+static uint8_t* conv = NULL;            // one rectangle in the viewer's format
+static size_t conv_cap = 0;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t thread_cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void put16(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static void put32(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static uint32_t get16(const uint8_t* p)
+{
+    return (uint32_t)p[0] << 8 | p[1];
+}
+
+static uint32_t get32(const uint8_t* p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static int reserve(uint8_t** buf, size_t* cap, size_t need)
+{
+    if (need <= *cap)
+        return 0;
+    size_t n = *cap ? *cap : 65536;
+    while (n < need)
+        n *= 2;
+    uint8_t* p = realloc(*buf, n);
+    if (!p)
+        return -1;
+    *buf = p;
+    *cap = n;
+    return 0;
+}
+
+static int send_all(int fd, const void* buf, size_t len)
+{
+    const uint8_t* p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// --- Frames -----------------------------------------------------------
+
+void vnc_flip(int drm_fd, uint32_t fb_id)
+{
+    if (!__atomic_load_n(&running, __ATOMIC_RELAXED))
+        return;
+    __atomic_store_n(&latest_fb, (uint64_t)(uint32_t)drm_fd << 32 | fb_id, __ATOMIC_RELAXED);
+    __atomic_store_n(&latest_ns, now_ns(), __ATOMIC_RELAXED);
+    __atomic_add_fetch(&frame_seq, 1, __ATOMIC_SEQ_CST);
+    // One eventfd write per frame the thread asked for, none otherwise
+    if (__atomic_exchange_n(&want_frame, 0, __ATOMIC_SEQ_CST)) {
+        uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) < 0) {
+            // Only a full counter fails, and then the thread is awake anyway
+        }
+    }
+}
+
+void vnc_present(const struct vnc_frame* frame)
+{
+    __atomic_store_n(&latest_mem, frame, __ATOMIC_RELAXED);
+    vnc_flip(-1, 0);
+}
+
+void vnc_set_crtc(int drm_fd, uint32_t crtc)
+{
+    crtc_id = crtc;
+    __atomic_store_n(&crtc_fd, drm_fd, __ATOMIC_RELEASE);
+}
+
+void vnc_forget(int drm_fd, uint32_t fb_id)
+{
+    if (!__atomic_load_n(&running, __ATOMIC_RELAXED))
+        return;
+    pthread_mutex_lock(&cache_lock);
+    for (int i = 0; i < VNC_FB_CACHE; i++) {
+        if (cache[i].fb_id == fb_id && cache_fd[i] == drm_fd)
+            cache_stale[i] = 1;
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
+
+static void drop_cache(void)
+{
+    pthread_mutex_lock(&cache_lock);
+    for (int i = 0; i < VNC_FB_CACHE; i++) {
+        if (cache[i].ptr)
+            fb_unmap(cache_fd[i], &cache[i]);
+        cache_stale[i] = 0;
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
+
+// The mapping stays valid after the lock is released: only this thread
+// unmaps, and a stale entry is only unmapped on a later lookup
+static const struct fb_map* map_frame(int fd, uint32_t fb_id)
+{
+    const struct fb_map* found = NULL;
+
+    pthread_mutex_lock(&cache_lock);
+    for (int i = 0; i < VNC_FB_CACHE; i++) {
+        if (cache_stale[i]) {
+            fb_unmap(cache_fd[i], &cache[i]);
+            cache_stale[i] = 0;
+        }
+    }
+    for (int i = 0; i < VNC_FB_CACHE && !found; i++) {
+        if (cache[i].ptr && cache[i].fb_id == fb_id && cache_fd[i] == fd)
+            found = &cache[i];
+    }
+    if (!found) {
+        int i = next_evict;
+        next_evict = (next_evict + 1) % VNC_FB_CACHE;
+        if (cache[i].ptr)
+            fb_unmap(cache_fd[i], &cache[i]);
+        cache_fd[i] = fd;
+        if (fb_map(fd, fb_id, &cache[i]) == 0)
+            found = &cache[i];
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return found;
+}
+
+// What is on screen now: the last flip, or the CRTC's buffer when MPC
+// has not flipped for a while (atomic commits, a static screen)
+static int current_frame(struct vnc_frame* f, int poll_crtc)
+{
+    const struct vnc_frame* mem = __atomic_load_n(&latest_mem, __ATOMIC_ACQUIRE);
+    if (mem) {
+        *f = *mem;
+        return 0;
+    }
+
+    uint64_t fb = __atomic_load_n(&latest_fb, __ATOMIC_RELAXED);
+    int fd = (int)(fb >> 32);
+    uint32_t fb_id = (uint32_t)fb;
+    int cfd = __atomic_load_n(&crtc_fd, __ATOMIC_ACQUIRE);
+    if ((poll_crtc || !fb_id) && cfd >= 0) {
+        drmModeCrtcPtr crtc = drmModeGetCrtc(cfd, crtc_id);
+        if (crtc) {
+            if (crtc->buffer_id) {
+                fd = cfd;
+                fb_id = crtc->buffer_id;
+            }
+            drmModeFreeCrtc(crtc);
+        }
+    }
+    if (!fb_id)
+        return -1;
+
+    const struct fb_map* m = map_frame(fd, fb_id);
+    if (!m)
+        return -1;
+    f->pixels = m->ptr;
+    f->width = m->width;
+    f->height = m->height;
+    f->pitch = m->pitch;
+    return 0;
+}
+
+// --- Tile compare -----------------------------------------------------
+
+// Nonzero if two rows of len bytes differ in any colour channel (the X
+// byte of XRGB is padding)
+static int row_differs(const uint8_t* a, const uint8_t* b, size_t len)
+{
+    size_t i = 0;
+#if defined(__ARM_NEON)
+    uint32x4_t mask = vdupq_n_u32(0x00FFFFFFu);
+    uint32x4_t acc = vdupq_n_u32(0);
+    for (; i + 16 <= len; i += 16) {
+        uint32x4_t x = veorq_u32(vld1q_u32((const uint32_t*)(a + i)), vld1q_u32((const uint32_t*)(b + i)));
+        acc = vorrq_u32(acc, vandq_u32(x, mask));
+    }
+    uint64x2_t acc64 = vreinterpretq_u64_u32(acc);
+    if (vgetq_lane_u64(acc64, 0) | vgetq_lane_u64(acc64, 1))
+        return 1;
+#elif defined(__SSE2__)
+    __m128i mask = _mm_set1_epi32(0x00FFFFFF);
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 16 <= len; i += 16) {
+        __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(a + i)), _mm_loadu_si128((const __m128i*)(b + i)));
+        acc = _mm_or_si128(acc, _mm_and_si128(x, mask));
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xFFFF)
+        return 1;
+#endif
+    for (; i < len; i += 4) {
+        uint32_t pa, pb;
+        memcpy(&pa, a + i, 4);
+        memcpy(&pb, b + i, 4);
+        if ((pa ^ pb) & 0x00FFFFFFu)
+            return 1;
+    }
+    return 0;
+}
+
+// Compare one tile with the shadow and copy it over if it changed
+static int update_tile(const struct vnc_frame* f, uint32_t x, uint32_t y, uint32_t w, uint32_t h, int force)
+{
+    size_t len = (size_t)w * 4;
+    uint32_t row = 0;
+
+    if (!force) {
+        for (; row < h; row++) {
+            const uint8_t* src = f->pixels + (size_t)(y + row) * f->pitch + (size_t)x * 4;
+            uint8_t* dst = shadow + ((size_t)(y + row) * shadow_w + x) * 4;
+            if (row_differs(src, dst, len))
+                break;
+        }
+        if (row == h)
+            return 0;
+    }
+    // Rows above the first difference are equal already
+    for (; row < h; row++) {
+        memcpy(shadow + ((size_t)(y + row) * shadow_w + x) * 4,
+               f->pixels + (size_t)(y + row) * f->pitch + (size_t)x * 4, len);
+    }
+    return 1;
+}
+
+// --- Encoding ---------------------------------------------------------
+
+static int same_format(const struct pixel_format* a, const struct pixel_format* b)
+{
+    return a->bpp == b->bpp && a->big_endian == b->big_endian && a->red_max == b->red_max
+        && a->green_max == b->green_max && a->blue_max == b->blue_max && a->red_shift == b->red_shift
+        && a->green_shift == b->green_shift && a->blue_shift == b->blue_shift;
+}
+
+// One rectangle of the shadow in the viewer's pixel format
+static size_t convert_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+{
+    const struct pixel_format* pf = &client.pf;
+    size_t bpp = pf->bpp / 8;
+    size_t size = (size_t)w * h * bpp;
+    uint8_t* p = conv;
+
+    if (same_format(pf, &native_format)) {
+        for (uint32_t r = 0; r < h; r++)
+            memcpy(p + (size_t)r * w * 4, shadow + ((size_t)(y + r) * shadow_w + x) * 4, (size_t)w * 4);
+        return size;
+    }
+    for (uint32_t r = 0; r < h; r++) {
+        const uint8_t* src = shadow + ((size_t)(y + r) * shadow_w + x) * 4;
+        for (uint32_t c = 0; c < w; c++, src += 4) {
+            uint32_t v = ((uint32_t)src[2] * pf->red_max + 127) / 255 << pf->red_shift
+                | ((uint32_t)src[1] * pf->green_max + 127) / 255 << pf->green_shift
+                | ((uint32_t)src[0] * pf->blue_max + 127) / 255 << pf->blue_shift;
+            for (size_t b = 0; b < bpp; b++)
+                *p++ = (uint8_t)(v >> (8 * (pf->big_endian ? bpp - 1 - b : b)));
+        }
+    }
+    return size;
+}
+
+// Append one rectangle (header and pixels) to the send buffer
+static int add_rect(uint32_t x, uint32_t y, uint32_t w, uint32_t h)
+{
+    size_t raw = (size_t)w * h * (client.pf.bpp / 8);
+    if (reserve(&conv, &conv_cap, raw) < 0)
+        return -1;
+    convert_rect(x, y, w, h);
+
+    size_t bound = client.zlib ? deflateBound(&client.z, raw) + 16 : raw;
+    if (reserve(&out, &out_cap, out_len + 16 + bound) < 0)
+        return -1;
+    uint8_t* hdr = out + out_len;
+    put16(hdr, x);
+    put16(hdr + 2, y);
+    put16(hdr + 4, w);
+    put16(hdr + 6, h);
+    put32(hdr + 8, client.zlib ? ENC_ZLIB : ENC_RAW);
+    out_len += 12;
+
+    if (!client.zlib) {
+        memcpy(out + out_len, conv, raw);
+        out_len += raw;
+        return 0;
+    }
+    // One zlib stream per connection, flushed at the end of each rectangle
+    client.z.next_in = conv;
+    client.z.avail_in = (uInt)raw;
+    client.z.next_out = out + out_len + 4;
+    client.z.avail_out = (uInt)bound;
+    if (deflate(&client.z, Z_SYNC_FLUSH) != Z_OK || client.z.avail_in != 0 || client.z.avail_out == 0)
+        return -1;
+    size_t zlen = bound - client.z.avail_out;
+    put32(out + out_len, (uint32_t)zlen);
+    out_len += 4 + zlen;
+    return 0;
+}
+
+// Compare the frame with the last one sent and send what changed, as one
+// FramebufferUpdate with a rectangle per run of dirty tiles in a tile row
+static int send_update(const struct vnc_frame* f)
+{
+    int full = client.full_requested;
+    if (f->width != shadow_w || f->height != shadow_h) {
+        free(shadow);
+        shadow = malloc((size_t)f->width * f->height * 4);
+        if (!shadow) {
+            shadow_w = shadow_h = 0;
+            return -1;
+        }
+        shadow_w = f->width;
+        shadow_h = f->height;
+        full = 1;
+    }
+
+    out_len = 4;
+    if (reserve(&out, &out_cap, out_len) < 0)
+        return -1;
+    uint32_t rects = 0, tiles = 0;
+    for (uint32_t ty = 0; ty < shadow_h; ty += VNC_TILE) {
+        uint32_t th = shadow_h - ty < VNC_TILE ? shadow_h - ty : VNC_TILE;
+        uint32_t run_x = 0, run_w = 0;
+        for (uint32_t tx = 0; tx <= shadow_w; tx += VNC_TILE) {
+            int dirty = 0;
+            uint32_t tw = 0;
+            if (tx < shadow_w) {
+                tw = shadow_w - tx < VNC_TILE ? shadow_w - tx : VNC_TILE;
+                dirty = update_tile(f, tx, ty, tw, th, full);
+            }
+            if (dirty) {
+                if (!run_w)
+                    run_x = tx;
+                run_w += tw;
+                tiles++;
+            } else if (run_w) {
+                if (rects == 65535 || add_rect(run_x, ty, run_w, th) < 0)
+                    return -1;
+                rects++;
+                run_w = 0;
+            }
+        }
+    }
+    if (!rects)
+        return 0;  // nothing changed: the request stays open
+
+    out[0] = 0;    // FramebufferUpdate
+    out[1] = 0;
+    put16(out + 2, rects);
+    if (send_all(client.fd, out, out_len) < 0)
+        return -1;
+
+    client.update_requested = 0;
+    client.full_requested = 0;
+    stats_inc(STAT_VNC_UPDATES);
+    stats_add(STAT_VNC_TILES, tiles);
+    stats_add(STAT_VNC_BYTES, out_len);
+    return 1;
+}
+
+// --- Viewer -----------------------------------------------------------
+
+static void drop_client(void)
+{
+    if (client.fd < 0)
+        return;
+    close(client.fd);
+    if (client.z_ready)
+        deflateEnd(&client.z);
+    memset(&client, 0, sizeof(client));
+    client.fd = -1;
+    LOGI("[VNC] Viewer disconnected");
+}
+
+// A click is a touch: button 1 down presses, motion while down drags
+static void pointer_event(int buttons, int x, int y)
+{
+    int fd = touch_fd ? __atomic_load_n(touch_fd, __ATOMIC_RELAXED) : -1;
+    int pressed = buttons & 1;
+
+    if (fd < 0 || (!pressed && !(client.buttons & 1))) {
+        client.buttons = buttons;
+        return;
+    }
+    client.buttons = buttons;
+    if (shadow_w && x >= (int)shadow_w)
+        x = (int)shadow_w - 1;
+    if (shadow_h && y >= (int)shadow_h)
+        y = (int)shadow_h - 1;
+
+    // Same frame the engine writes for a touch
+    struct input_event ev[4];
+    memset(ev, 0, sizeof(ev));
+    ev[0].type = EV_ABS;
+    ev[0].code = ABS_X;
+    ev[0].value = x;
+    ev[1].type = EV_ABS;
+    ev[1].code = ABS_Y;
+    ev[1].value = y;
+    ev[2].type = EV_KEY;
+    ev[2].code = BTN_TOUCH;
+    ev[2].value = pressed;
+    ev[3].type = EV_SYN;
+    ev[3].code = SYN_REPORT;
+    if (write(fd, ev, sizeof(ev)) == (ssize_t)sizeof(ev))
+        stats_inc(STAT_VNC_TOUCHES);
+}
+
+static int server_init(void)
+{
+    struct vnc_frame f;
+    uint32_t w = shadow_w, h = shadow_h;
+    if (!w && current_frame(&f, 0) == 0) {
+        w = f.width;
+        h = f.height;
+    }
+    if (!w) {
+        w = VNC_DEFAULT_WIDTH;
+        h = VNC_DEFAULT_HEIGHT;
+    }
+
+    uint8_t msg[24 + sizeof(VNC_NAME) - 1];
+    const struct pixel_format* pf = &native_format;
+    put16(msg, w);
+    put16(msg + 2, h);
+    msg[4] = pf->bpp;
+    msg[5] = pf->depth;
+    msg[6] = pf->big_endian;
+    msg[7] = pf->true_colour;
+    put16(msg + 8, pf->red_max);
+    put16(msg + 10, pf->green_max);
+    put16(msg + 12, pf->blue_max);
+    msg[14] = pf->red_shift;
+    msg[15] = pf->green_shift;
+    msg[16] = pf->blue_shift;
+    msg[17] = msg[18] = msg[19] = 0;
+    put32(msg + 20, sizeof(VNC_NAME) - 1);
+    memcpy(msg + 24, VNC_NAME, sizeof(VNC_NAME) - 1);
+    return send_all(client.fd, msg, sizeof(msg));
+}
+
+// Handle the first message in the buffer; returns its size, 0 if it is
+// not complete yet, -1 to drop the viewer
+static ssize_t client_message(const uint8_t* m, size_t len)
+{
+    switch (client.step) {
+    case STEP_VERSION: {
+        if (len < 12)
+            return 0;
+        if (memcmp(m, "RFB 003.", 8) != 0)
+            return -1;
+        int minor = atoi((const char*)m + 8);
+        client.minor = minor >= 8 ? 8 : minor == 7 ? 7 : 3;
+        if (client.minor == 3) {
+            // 3.3: the server picks "None"
+            uint8_t none[4] = { 0, 0, 0, 1 };
+            if (send_all(client.fd, none, sizeof(none)) < 0)
+                return -1;
+            client.step = STEP_INIT;
+        } else {
+            uint8_t types[2] = { 1, 1 };
+            if (send_all(client.fd, types, sizeof(types)) < 0)
+                return -1;
+            client.step = STEP_SECURITY;
+        }
+        return 12;
+    }
+    case STEP_SECURITY: {
+        if (len < 1)
+            return 0;
+        if (m[0] != 1)
+            return -1;
+        if (client.minor == 8) {
+            uint8_t ok[4] = { 0, 0, 0, 0 };
+            if (send_all(client.fd, ok, sizeof(ok)) < 0)
+                return -1;
+        }
+        client.step = STEP_INIT;
+        return 1;
+    }
+    case STEP_INIT:
+        if (len < 1)
+            return 0;
+        if (server_init() < 0)
+            return -1;
+        client.step = STEP_NORMAL;
+        return 1;
+    }
+
+    if (len < 1)
+        return 0;
+    switch (m[0]) {
+    case 0:  // SetPixelFormat
+        if (len < 20)
+            return 0;
+        client.pf.bpp = m[4];
+        client.pf.depth = m[5];
+        client.pf.big_endian = m[6] != 0;
+        client.pf.true_colour = m[7];
+        client.pf.red_max = (uint16_t)get16(m + 8);
+        client.pf.green_max = (uint16_t)get16(m + 10);
+        client.pf.blue_max = (uint16_t)get16(m + 12);
+        client.pf.red_shift = m[14];
+        client.pf.green_shift = m[15];
+        client.pf.blue_shift = m[16];
+        if (!client.pf.true_colour || (client.pf.bpp != 8 && client.pf.bpp != 16 && client.pf.bpp != 32)) {
+            LOGW("[VNC] Viewer wants a %d bpp colour map format, not supported", client.pf.bpp);
+            return -1;
+        }
+        // convert_rect() shifts by these: one past the pixel would be undefined
+        if (client.pf.red_shift >= client.pf.bpp || client.pf.green_shift >= client.pf.bpp
+            || client.pf.blue_shift >= client.pf.bpp) {
+            LOGW("[VNC] Viewer sent shifts %d/%d/%d for a %d bpp format, dropping it", client.pf.red_shift,
+                 client.pf.green_shift, client.pf.blue_shift, client.pf.bpp);
+            return -1;
+        }
+        client.full_requested = 1;
+        return 20;
+    case 2: {  // SetEncodings
+        if (len < 4)
+            return 0;
+        size_t n = get16(m + 2);
+        if (4 + 4 * n > VNC_RX_LEN)
+            return -1;
+        if (len < 4 + 4 * n)
+            return 0;
+        client.zlib = 0;
+        for (size_t i = 0; i < n; i++) {
+            if ((int32_t)get32(m + 4 + 4 * i) == ENC_ZLIB)
+                client.zlib = 1;
+        }
+        if (client.zlib && !client.z_ready) {
+            memset(&client.z, 0, sizeof(client.z));
+            if (deflateInit(&client.z, Z_BEST_SPEED) != Z_OK)
+                client.zlib = 0;
+            else
+                client.z_ready = 1;
+        }
+        return (ssize_t)(4 + 4 * n);
+    }
+    case 3:  // FramebufferUpdateRequest
+        if (len < 10)
+            return 0;
+        client.update_requested = 1;
+        if (!m[1])
+            client.full_requested = 1;
+        return 10;
+    case 4:  // KeyEvent: MPC has no keyboard to speak of
+        return len < 8 ? 0 : 8;
+    case 5:  // PointerEvent
+        if (len < 6)
+            return 0;
+        pointer_event(m[1], (int)get16(m + 2), (int)get16(m + 4));
+        return 6;
+    case 6:  // ClientCutText: discarded
+        if (len < 8)
+            return 0;
+        client.skip = get32(m + 4);
+        return 8;
+    }
+    LOGW("[VNC] Unknown message %d from the viewer", m[0]);
+    return -1;
+}
+
+static void on_client_readable(void)
+{
+    ssize_t n = recv(client.fd, client.in + client.in_len, sizeof(client.in) - client.in_len, MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if (n <= 0) {
+        drop_client();
+        return;
+    }
+    client.in_len += (size_t)n;
+
+    size_t off = 0;
+    for (;;) {
+        if (client.skip) {
+            size_t k = client.in_len - off < client.skip ? client.in_len - off : client.skip;
+            client.skip -= k;
+            off += k;
+            if (client.skip)
+                break;
+        }
+        ssize_t used = client_message(client.in + off, client.in_len - off);
+        if (used < 0) {
+            drop_client();
+            return;
+        }
+        if (used == 0)
+            break;
+        off += (size_t)used;
+    }
+    memmove(client.in, client.in + off, client.in_len - off);
+    client.in_len -= off;
+}
+
+static void on_accept(void)
+{
+    int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0)
+        return;
+    if (client.fd >= 0) {
+        LOGW("[VNC] One viewer at a time, connection refused");
+        close(fd);
+        return;
+    }
+
+    // Blocking sends with a timeout: this thread has nothing better to do
+    struct timeval tv = { VNC_SEND_TIMEOUT_S, 0 };
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    memset(&client, 0, sizeof(client));
+    client.fd = fd;
+    client.pf = native_format;
+    client.full_requested = 1;
+    if (send_all(fd, "RFB 003.008\n", 12) < 0) {
+        drop_client();
+        return;
+    }
+    // Every new viewer starts from a full frame
+    free(shadow);
+    shadow = NULL;
+    shadow_w = shadow_h = 0;
+    LOGI("[VNC] Viewer connected");
+}
+
+static int open_listener(int port)
+{
+    struct sockaddr_in addr;
+    int one = 1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((uint16_t)port);
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// --- Thread -----------------------------------------------------------
+
+// Listen on port and serve viewers until stop. Returns -1 if the port
+// could not be opened.
+static int serve(int port)
+{
+    listen_fd = open_listener(port);
+    if (listen_fd < 0) {
+        LOGE("[VNC] Could not listen on 127.0.0.1:%d (errno=%d)", port, errno);
+        return -1;
+    }
+    LOGI("[VNC] Listening on 127.0.0.1:%d, up to %d fps, %d%% CPU", port, vnc_config.fps,
+         vnc_config.cpu_pct);
+
+    uint32_t sent_seq = 0;
+    uint64_t next_frame_ns = 0;
+    uint64_t cpu_start = thread_cpu_ns();
+
+    while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+        struct pollfd pfd[3] = {
+            { wake_fd, POLLIN, 0 },
+            { listen_fd, POLLIN, 0 },
+            { client.fd, POLLIN, 0 },
+        };
+        int timeout = -1;
+        uint64_t now = now_ns();
+        if (client.update_requested) {
+            // Throttled: come back when the budget allows. Else a flip
+            // wakes us, and without flips we look at the CRTC now and then.
+            uint64_t wait = next_frame_ns > now ? next_frame_ns - now : VNC_POLL_NS;
+            timeout = (int)(wait / 1000000ull) + 1;
+        }
+        if (poll(pfd, client.fd >= 0 ? 3 : 2, timeout) < 0 && errno != EINTR)
+            break;
+
+        if (pfd[0].revents & POLLIN) {
+            uint64_t v;
+            if (read(wake_fd, &v, sizeof(v)) < 0) {
+            }
+        }
+        if (pfd[1].revents & POLLIN)
+            on_accept();
+        if (client.fd >= 0 && (pfd[2].revents & (POLLIN | POLLHUP | POLLERR)))
+            on_client_readable();
+        stats_set(STAT_VNC_CPU_NS, thread_cpu_ns() - cpu_start);
+
+        if (client.fd < 0 || client.step != STEP_NORMAL || !client.update_requested)
+            continue;
+        now = now_ns();
+        if (now < next_frame_ns)
+            continue;
+
+        uint32_t seq = __atomic_load_n(&frame_seq, __ATOMIC_SEQ_CST);
+        int stale = now - __atomic_load_n(&latest_ns, __ATOMIC_RELAXED) > VNC_POLL_NS;
+        if (seq == sent_seq && !client.full_requested && !stale) {
+            // Nothing new on screen: the next flip wakes us
+            __atomic_store_n(&want_frame, 1, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&frame_seq, __ATOMIC_SEQ_CST) == sent_seq)
+                continue;
+            seq = __atomic_load_n(&frame_seq, __ATOMIC_SEQ_CST);
+        }
+
+        struct vnc_frame f;
+        uint64_t cpu0 = thread_cpu_ns();
+        uint64_t flip_ns = __atomic_load_n(&latest_ns, __ATOMIC_RELAXED);
+        if (current_frame(&f, stale) < 0) {
+            next_frame_ns = now + 1000000000ull / (uint64_t)(vnc_config.fps > 0 ? vnc_config.fps : 1);
+            continue;
+        }
+        int ret = send_update(&f);
+        sent_seq = seq;
+        if (ret < 0) {
+            LOGW("[VNC] Could not send an update, viewer dropped");
+            drop_client();
+            continue;
+        }
+        uint64_t done = now_ns();
+        if (ret > 0 && !stale && done > flip_ns)
+            stats_hist_record(HIST_VNC_FLIP_TO_SENT, done - flip_ns);
+
+        // Frame rate cap, and the CPU budget: a frame that took c ns of
+        // CPU is followed by c * 100 / VNC_CPU ns before the next one
+        int fps = vnc_config.fps > 0 ? vnc_config.fps : 1;
+        int pct = vnc_config.cpu_pct > 0 ? vnc_config.cpu_pct : 1;
+        uint64_t min_gap = 1000000000ull / (uint64_t)fps;
+        uint64_t cpu_gap = (thread_cpu_ns() - cpu0) * 100 / (uint64_t)pct;
+        if (cpu_gap > min_gap)
+            stats_inc(STAT_VNC_THROTTLED);
+        next_frame_ns = now + (cpu_gap > min_gap ? cpu_gap : min_gap);
+    }
+
+    drop_client();
+    drop_cache();
+    close(listen_fd);
+    listen_fd = -1;
+    free(shadow);
+    free(out);
+    free(conv);
+    shadow = out = conv = NULL;
+    shadow_w = shadow_h = 0;
+    out_cap = conv_cap = 0;
+    return 0;
+}
+
+static void* vnc_thread(void* arg)
+{
+    (void)arg;
+    struct sched_param sp = { 0 };
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &sp);
+
+    pthread_mutex_lock(&thread_lock);
+    for (;;) {
+        int port = thread_port;
+        pthread_mutex_unlock(&thread_lock);
+        int ret = serve(port);
+        pthread_mutex_lock(&thread_lock);
+        // A port that failed is not retried until vnc_apply() asks again
+        if (ret < 0 && thread_port == port)
+            thread_port = 0;
+        if (!thread_port)
+            break;
+        __atomic_store_n(&stop, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&running, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&latest_fb, 0, __ATOMIC_RELAXED);
+    thread_started = 0;
+    pthread_cond_broadcast(&thread_gone);
+    pthread_mutex_unlock(&thread_lock);
+    LOGI("[VNC] Off");
+    return NULL;
+}
+
+void vnc_init(const int* fd)
+{
+    touch_fd = fd;
+}
+
+// Ask the thread to stop or move, under thread_lock
+static void request_port(int port)
+{
+    thread_port = port;
+    __atomic_store_n(&running, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+    uint64_t one = 1;
+    if (write(wake_fd, &one, sizeof(one)) < 0) {
+        // Only a full counter fails, and then a wakeup is pending anyway
+    }
+}
+
+// MPC exits: the touch device is about to go, so this one waits
+void vnc_stop(void)
+{
+    pthread_mutex_lock(&thread_lock);
+    if (thread_started) {
+        request_port(0);
+        while (thread_started)
+            pthread_cond_wait(&thread_gone, &thread_lock);
+    }
+    pthread_mutex_unlock(&thread_lock);
+}
+
+void vnc_apply(void)
+{
+    if (!touch_fd)
+        return;
+    int port = vnc_config.enabled ? vnc_config.port : 0;
+
+    pthread_mutex_lock(&thread_lock);
+    if (thread_started) {
+        if (port != thread_port)
+            request_port(port);
+        pthread_mutex_unlock(&thread_lock);
+        return;
+    }
+    if (!port) {
+        pthread_mutex_unlock(&thread_lock);
+        return;
+    }
+    // vnc_flip() may write to it any time after 'running', so it is never closed
+    if (wake_fd < 0)
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    thread_port = port;
+    __atomic_store_n(&stop, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+    pthread_t thread;
+    if (wake_fd < 0 || pthread_create(&thread, NULL, vnc_thread, NULL) != 0) {
+        LOGE("[VNC] Could not start the server thread (errno=%d)", errno);
+        __atomic_store_n(&running, 0, __ATOMIC_RELAXED);
+        thread_port = 0;
+        pthread_mutex_unlock(&thread_lock);
+        return;
+    }
+    pthread_detach(thread);
+    thread_started = 1;
+    pthread_mutex_unlock(&thread_lock);
+}
+
+void vnc_fork_child(void)
+{
+    __atomic_store_n(&running, 0, __ATOMIC_RELAXED);
+    pthread_mutex_init(&thread_lock, NULL);
+    pthread_cond_init(&thread_gone, NULL);
+    thread_started = 0;
+    thread_port = 0;
+    touch_fd = NULL;
+    if (listen_fd >= 0)
+        close(listen_fd);
+    if (wake_fd >= 0)
+        close(wake_fd);
+    if (client.fd >= 0)
+        close(client.fd);
+    listen_fd = wake_fd = client.fd = -1;
+}
@@ -0,0 +1,77 @@
+/**
+ * @file vnc.h
+ * Decription: Screen streaming server (RFB/VNC, VNC=1).
+ *
+ * Shows MPC's screen in any VNC viewer and turns clicks into touches. On
+ * each page flip the hook only records which framebuffer MPC shows; a
+ * background thread (SCHED_IDLE) maps that buffer read-only, compares it
+ * tile by tile with the previous frame (SSE2/NEON) and sends the changed
+ * tiles, zlib compressed when the viewer supports it. Unchanged tiles are
+ * never copied.
+ *
+ * The thread runs at most VNC_FPS frames per second and backs off so it
+ * uses no more than VNC_CPU percent of one core. SCHED_IDLE means it only
+ * gets CPU time MPC and its audio threads leave unused.
+ *
+ * It listens on 127.0.0.1 only, there is no VNC password: connect through
+ * an SSH port forward (ssh -L 5900:127.0.0.1:5900). One viewer at a time.
+ *
+ */
+#ifndef VNC_H
+#define VNC_H
+
+#include <stdint.h>
+
+#define VNC_DEFAULT_PORT 5900
+#define VNC_DEFAULT_FPS 10
+#define VNC_DEFAULT_CPU 15          // percent of one core
+#define VNC_TILE 32                 // pixels, compared and sent per tile
+#define VNC_FB_CACHE 4              // MPC double/triple buffers
+#define VNC_POLL_NS 1000000000ull   // no flip for this long: read the CRTC instead
+
+struct vnc_config {
+    int enabled;                // VNC=
+    int port;                   // VNC_PORT=
+    int fps;                    // VNC_FPS=
+    int cpu_pct;                // VNC_CPU=
+};
+
+extern struct vnc_config vnc_config;
+
+// An XRGB8888 frame in memory (vnc_present)
+struct vnc_frame {
+    const uint8_t* pixels;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pitch;
+};
+
+// Shim constructor: injected touches go to *touch_fd (the engine's
+// single-touch device, -1 while it has none). Before this, vnc_apply()
+// does nothing: the server only runs inside MPC.
+void vnc_init(const int* touch_fd);
+
+// After vnc_config changed: start, stop or move the server (input thread).
+// Never waits: a server that is told to stop winds down on its own thread.
+void vnc_apply(void);
+
+// MPC exits: stop the server and wait until its thread is gone
+void vnc_stop(void);
+
+// MPC's cursor CRTC, read when MPC presents without drmModePageFlip
+void vnc_set_crtc(int drm_fd, uint32_t crtc_id);
+
+// PageFlip hook (MPC's render thread): fb_id is about to be shown
+void vnc_flip(int drm_fd, uint32_t fb_id);
+
+// RmFB hook: fb_id may be reused from now on
+void vnc_forget(int drm_fd, uint32_t fb_id);
+
+// Show an in-memory frame instead of MPC's (bench_vnc). The frame must
+// stay valid and unchanged until the next call.
+void vnc_present(const struct vnc_frame* frame);
+
+// Forked child: the thread was not copied, stop looking at flips
+void vnc_fork_child(void);
+
+#endif // VNC_H
@@ -0,0 +1,321 @@
+/**
+ * @file xrun.c
+ * Decription: Audio xrun monitor and its ALSA PCM hooks (see xrun.h).
+ *
+ */
+#define _GNU_SOURCE
+#include "xrun.h"
+
+#include <alsa/asoundlib.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <time.h>
+
+#include "log.h"
+#include "trace.h"
+
+int xrun_enabled = 0;
+int xrun_window_ms = XRUN_DEFAULT_WINDOW_MS;
+
+// Activity history, written by the input thread only
+static uint64_t activity[XRUN_ACT_COUNT][XRUN_HISTORY];
+static unsigned int activity_head[XRUN_ACT_COUNT];
+
+// PCMs seen by the hooks; the snd_pcm_hw_params hook adds their period
+struct pcm_state {
+    snd_pcm_t* pcm;
+    uint64_t period_ns;
+    uint64_t last_ns;              // previous transfer call (audio thread)
+    int in_xrun;                   // counted already, until the next good transfer
+};
+
+static struct pcm_state pcms[XRUN_MAX_PCMS];
+
+static uint64_t xruns, near_activity, late_periods;
+
+// Nested calls (ALSA plugins calling into their slave PCM) pass straight through
+static __thread int hook_depth = 0;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void xrun_activity(int kind)
+{
+    if (!xrun_enabled)
+        return;
+    unsigned int h = activity_head[kind];
+    __atomic_store_n(&activity[kind][h % XRUN_HISTORY], now_ns(), __ATOMIC_RELAXED);
+    __atomic_store_n(&activity_head[kind], h + 1, __ATOMIC_RELEASE);
+}
+
+void xrun_get_stats(struct xrun_stats* out)
+{
+    out->xruns = __atomic_load_n(&xruns, __ATOMIC_RELAXED);
+    out->near_activity = __atomic_load_n(&near_activity, __ATOMIC_RELAXED);
+    out->late_periods = __atomic_load_n(&late_periods, __ATOMIC_RELAXED);
+}
+
+static struct pcm_state* find_pcm(snd_pcm_t* pcm)
+{
+    for (int i = 0; i < XRUN_MAX_PCMS; i++) {
+        if (__atomic_load_n(&pcms[i].pcm, __ATOMIC_ACQUIRE) == pcm)
+            return &pcms[i];
+    }
+    return NULL;
+}
+
+// Find or claim a slot; NULL when the table is full
+static struct pcm_state* track_pcm(snd_pcm_t* pcm)
+{
+    struct pcm_state* s = find_pcm(pcm);
+    for (int i = 0; !s && i < XRUN_MAX_PCMS; i++) {
+        snd_pcm_t* expected = NULL;
+        if (__atomic_compare_exchange_n(&pcms[i].pcm, &expected, pcm, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            s = &pcms[i];
+    }
+    return s;
+}
+
+// Activity events of one kind since 'since'
+static int count_activity(int kind, uint64_t since)
+{
+    unsigned int h = __atomic_load_n(&activity_head[kind], __ATOMIC_ACQUIRE);
+    int n = 0;
+    for (int i = 0; i < XRUN_HISTORY && i < (int)h; i++) {
+        if (__atomic_load_n(&activity[kind][(h - 1 - i) % XRUN_HISTORY], __ATOMIC_RELAXED) < since)
+            break;
+        n++;
+    }
+    return n;
+}
+
+static void on_xrun(snd_pcm_t* pcm, struct pcm_state* s)
+{
+    if (!s)
+        s = track_pcm(pcm);
+    if (s) {
+        if (s->in_xrun)
+            return;
+        s->in_xrun = 1;
+        s->last_ns = 0;
+    }
+
+    uint64_t now = now_ns();
+    uint64_t since = now - (uint64_t)xrun_window_ms * 1000000ull;
+    int counts[XRUN_ACT_COUNT];
+    int total = 0;
+    for (int k = 0; k < XRUN_ACT_COUNT; k++) {
+        counts[k] = count_activity(k, since);
+        total += counts[k];
+    }
+
+    __atomic_fetch_add(&xruns, 1, __ATOMIC_RELAXED);
+    if (total)
+        __atomic_fetch_add(&near_activity, 1, __ATOMIC_RELAXED);
+    trace_mark("pcm_xrun", total);
+
+    int capture = snd_pcm_stream(pcm) == SND_PCM_STREAM_CAPTURE;
+    if (total) {
+        // log records carry at most 6 arguments: the window is in the config
+        LOGW("[XRUN] %s xrun after %d cursor, %d touch, %d key, %d gesture, %d midi event(s)",
+             capture ? "Capture" : "Playback", counts[XRUN_ACT_CURSOR], counts[XRUN_ACT_TOUCH],
+             counts[XRUN_ACT_KEY], counts[XRUN_ACT_GESTURE], counts[XRUN_ACT_MIDI]);
+    } else {
+        LOGW("[XRUN] %s xrun, no input activity from us in the last %d ms",
+             capture ? "Capture" : "Playback", xrun_window_ms);
+    }
+}
+
+// Before a transfer: was the audio thread late for this period?
+static struct pcm_state* transfer_begin(snd_pcm_t* pcm)
+{
+    struct pcm_state* s = find_pcm(pcm);
+    if (!s || !s->period_ns)
+        return s;
+
+    uint64_t now = now_ns();
+    if (s->last_ns && now - s->last_ns > s->period_ns + s->period_ns / 2) {
+        __atomic_fetch_add(&late_periods, 1, __ATOMIC_RELAXED);
+        trace_mark("pcm_late_period", (uint32_t)((now - s->last_ns) / 1000));
+    }
+    s->last_ns = now;
+    return s;
+}
+
+static void transfer_end(snd_pcm_t* pcm, struct pcm_state* s, snd_pcm_sframes_t ret)
+{
+    if (ret == -EPIPE)
+        on_xrun(pcm, s);
+    else if (ret >= 0 && s)
+        s->in_xrun = 0;
+}
+
+static void* real_symbol(const char* name)
+{
+    void* sym = dlsym(RTLD_NEXT, name);
+    if (!sym)
+        LOGE("[XRUN] %s not found", name);
+    return sym;
+}
+
+// ALSA hooks. Setup: remember each PCM's period.
+int snd_pcm_hw_params(snd_pcm_t* pcm, snd_pcm_hw_params_t* params)
+{
+    static int (*real)(snd_pcm_t*, snd_pcm_hw_params_t*) = NULL;
+    if (!real && !(real = real_symbol("snd_pcm_hw_params")))
+        return -ENOSYS;
+
+    hook_depth++;
+    int ret = real(pcm, params);
+    hook_depth--;
+    if (ret < 0 || !xrun_enabled || hook_depth)
+        return ret;
+
+    unsigned int rate = 0;
+    snd_pcm_uframes_t period = 0;
+    int dir = 0;
+    if (snd_pcm_hw_params_get_rate(params, &rate, &dir) < 0 || snd_pcm_hw_params_get_period_size(params, &period, &dir) < 0 || !rate)
+        return ret;
+
+    struct pcm_state* s = track_pcm(pcm);
+    if (!s)
+        return ret;  // table full, this PCM goes unwatched for late periods
+    s->last_ns = 0;
+    s->in_xrun = 0;
+    s->period_ns = (uint64_t)period * 1000000000ull / rate;
+    LOGI("[XRUN] Watching %s PCM '%s': %lu frames at %u Hz (%.2f ms periods)",
+         snd_pcm_stream(pcm) == SND_PCM_STREAM_CAPTURE ? "capture" : "playback", snd_pcm_name(pcm),
+         (unsigned long)period, rate, s->period_ns / 1e6);
+    return ret;
+}
+
+int snd_pcm_close(snd_pcm_t* pcm)
+{
+    static int (*real)(snd_pcm_t*) = NULL;
+    if (!real && !(real = real_symbol("snd_pcm_close")))
+        return -ENOSYS;
+
+    struct pcm_state* s = find_pcm(pcm);
+    if (s) {
+        s->period_ns = 0;
+        __atomic_store_n(&s->pcm, NULL, __ATOMIC_RELEASE);
+    }
+    return real(pcm);
+}
+
+snd_pcm_sframes_t snd_pcm_writei(snd_pcm_t* pcm, const void* buffer, snd_pcm_uframes_t size)
+{
+    static snd_pcm_sframes_t (*real)(snd_pcm_t*, const void*, snd_pcm_uframes_t) = NULL;
+    if (!real && !(real = real_symbol("snd_pcm_writei")))
+        return -ENOSYS;
+    if (!xrun_enabled || hook_depth)
+        return real(pcm, buffer, size);
+
+    struct pcm_state* s = transfer_begin(pcm);
+    hook_depth++;
+    snd_pcm_sframes_t ret = real(pcm, buffer, size);
+    hook_depth--;
+    transfer_end(pcm, s, ret);
+    return ret;
+}
+
+snd_pcm_sframes_t snd_pcm_readi(snd_pcm_t* pcm, void* buffer, snd_pcm_uframes_t size)
+{
+    static snd_pcm_sframes_t (*real)(snd_pcm_t*, void*, snd_pcm_uframes_t) = NULL;
+    if (!real && !(real = real_symbol("snd_pcm_readi")))
+        return -ENOSYS;
+    if (!xrun_enabled || hook_depth)
+        return real(pcm, buffer, size);
+
+    struct pcm_state* s = transfer_begin(pcm);
+    hook_depth++;
+    snd_pcm_sframes_t ret = real(pcm, buffer, size);
+    hook_depth--;
+    transfer_end(pcm, s, ret);
+    return ret;
+}
+
+snd_pcm_sframes_t snd_pcm_writen(snd_pcm_t* pcm, void** bufs, snd_pcm_uframes_t size)
+{
+    static snd_pcm_sframes_t (*real)(snd_pcm_t*, void**, snd_pcm_uframes_t) = NULL;
+    if (!real && !(real = real_symbol("snd_pcm_writen")))
+        return -ENOSYS;
+    if (!xrun_enabled || hook_depth)
+        return real(pcm, bufs, size);
+
+    struct pcm_state* s = transfer_begin(pcm);
+    hook_depth++;
+    snd_pcm_sframes_t ret = real(pcm, bufs, size);
+    hook_depth--;
+    transfer_end(pcm, s, ret);
+    return ret;
+}
+
+snd_pcm_sframes_t snd_pcm_readn(snd_pcm_t* pcm, void** bufs, snd_pcm_uframes_t size)
+{
+    static snd_pcm_sframes_t (*real)(snd_pcm_t*, void**, snd_pcm_uframes_t) = NULL;
+    if (!real && !(real = real_symbol("snd_pcm_readn")))
+        return -ENOSYS;
+    if (!xrun_enabled || hook_depth)
+        return real(pcm, bufs, size);
+
+    struct pcm_state* s = transfer_begin(pcm);
+    hook_depth++;
+    snd_pcm_sframes_t ret = real(pcm, bufs, size);
+    hook_depth--;
+    transfer_end(pcm, s, ret);
+    return ret;
+}
+
+// mmap users: one commit per period is the transfer
+snd_pcm_sframes_t snd_pcm_mmap_commit(snd_pcm_t* pcm, snd_pcm_uframes_t offset, snd_pcm_uframes_t frames)
+{
+    static snd_pcm_sframes_t (*real)(snd_pcm_t*, snd_pcm_uframes_t, snd_pcm_uframes_t) = NULL;
+    if (!real && !(real = real_symbol("snd_pcm_mmap_commit")))
+        return -ENOSYS;
+    if (!xrun_enabled || hook_depth)
+        return real(pcm, offset, frames);
+
+    struct pcm_state* s = transfer_begin(pcm);
+    hook_depth++;
+    snd_pcm_sframes_t ret = real(pcm, offset, frames);
+    hook_depth--;
+    transfer_end(pcm, s, ret);
+    return ret;
+}
+
+// mmap users usually see the xrun here first
+snd_pcm_sframes_t snd_pcm_avail_update(snd_pcm_t* pcm)
+{
+    static snd_pcm_sframes_t (*real)(snd_pcm_t*) = NULL;
+    if (!real && !(real = real_symbol("snd_pcm_avail_update")))
+        return -ENOSYS;
+    if (!xrun_enabled || hook_depth)
+        return real(pcm);
+
+    hook_depth++;
+    snd_pcm_sframes_t ret = real(pcm);
+    hook_depth--;
+    if (ret == -EPIPE)
+        on_xrun(pcm, find_pcm(pcm));
+    return ret;
+}
+
+// Apps that poll snd_pcm_state() only tell us when they recover
+int snd_pcm_recover(snd_pcm_t* pcm, int err, int silent)
+{
+    static int (*real)(snd_pcm_t*, int, int) = NULL;
+    if (!real && !(real = real_symbol("snd_pcm_recover")))
+        return -ENOSYS;
+    if (xrun_enabled && !hook_depth && err == -EPIPE)
+        on_xrun(pcm, find_pcm(pcm));
+
+    hook_depth++;
+    int ret = real(pcm, err, silent);
+    hook_depth--;
+    return ret;
+}
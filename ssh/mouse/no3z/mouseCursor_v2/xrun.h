@@ -0,0 +1,52 @@
+/**
+ * @file xrun.h
+ * Decription: Audio xrun monitor (measurement mode, XRUN_MONITOR=1).
+ *
+ * Hooks the ALSA PCM calls MPC's audio threads make (snd_pcm_writei/readi/
+ * writen/readn, mmap_commit, avail_update, recover) and notes every xrun
+ * (-EPIPE) with the cursor, touch, key, gesture and MIDI activity we
+ * generated in the XRUN_WINDOW ms before it. Each xrun is logged, marked on
+ * the trace timeline ("pcm_xrun") and counted in cursor_stats, split by
+ * whether any of our activity was in the window.
+ *
+ * Late periods are counted too: a transfer call that comes more than 1.5
+ * periods after the previous one on the same PCM. The buffer usually hides
+ * those, but they show how close the audio thread came to an xrun.
+ *
+ * The hooks run on MPC's audio threads: no locks, no allocations, no
+ * syscalls except on an xrun.
+ *
+ */
+#ifndef XRUN_H
+#define XRUN_H
+
+#include <stdint.h>
+
+#define XRUN_MAX_PCMS 8            // PCMs MPC opens (playback, capture, ...)
+#define XRUN_HISTORY 64            // activity timestamps kept per kind
+#define XRUN_DEFAULT_WINDOW_MS 50
+
+enum xrun_activity_kind {
+    XRUN_ACT_CURSOR = 0,
+    XRUN_ACT_TOUCH,
+    XRUN_ACT_KEY,
+    XRUN_ACT_GESTURE,
+    XRUN_ACT_MIDI,
+    XRUN_ACT_COUNT
+};
+
+struct xrun_stats {
+    uint64_t xruns;
+    uint64_t near_activity;        // xruns with our activity in the window
+    uint64_t late_periods;
+};
+
+extern int xrun_enabled;           // XRUN_MONITOR=
+extern int xrun_window_ms;         // XRUN_WINDOW=
+
+// Input thread: we just did something that could disturb audio
+void xrun_activity(int kind);
+
+void xrun_get_stats(struct xrun_stats* out);
+
+#endif // XRUN_H
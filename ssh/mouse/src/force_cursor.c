@@ -6,8 +6,11 @@
  * MockbaMid Addon Adaptation: Amit Talwar (@locrian) (Discord)
  * Cursor image addition: Jukka Korhonen (@ThatBonsaipanda)
  * Date: January 2026
- * 
- * 
+ *
+ * The stripped down build: mouse -> cursor and touch, nothing more. The
+ * event handling is the shared pipeline (../no3z/mouseCursor_v2/pipeline.h);
+ * see compile for the variants, e.g. the mouse auto-detecting one.
+ *
  */
 #define _GNU_SOURCE
 #include <dlfcn.h>
@@ -24,45 +27,43 @@
 #include <unistd.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
-#define MULTIPLIER 1.5
 
-// Offset from cursor top-left to the "tip" in screen coordinates
-#define CLICK_OFFSET_X 0   // right edge
-#define CLICK_OFFSET_Y 27    // top edge
+// Cursor image, generated from cursor/mouse_cursor_offset.png (see compile).
+// Touches land on its hotspot: the tip, 27 px down the left edge.
+#include "cursor_offset.h"
+#define PIPELINE_CLICK_OFFSET_X CURSOR_OFFSET_HOT_X
+#define PIPELINE_CLICK_OFFSET_Y CURSOR_OFFSET_HOT_Y
+#include "pipeline.h"
 
 // Cursor state
 static uint32_t cursor_bo = 0;
 static int cursor_initialized = 0;
 static int saved_fd = -1;
 static uint32_t saved_crtc = 0;
-static int cursor_x = 799;  // hiding the cursor if mouse is 
-static int cursor_y = 1279; // not attached
+static struct pipeline cursor = { 799, 1279, PIPELINE_DEFAULT_RATE, 0 };  // hidden until the mouse moves
 static pthread_t input_thread;
 static int input_running = 0;
 static int uinput_fd = -1;
-char* device = NULL;
-static int touch_down = 0;
+static char* device = NULL;
+static int (*real_drmModeMoveCursor)(int, uint32_t, int, int) = NULL;
 
 // Configurable path for cursor parameters
 static const char* CONF_FILE_PATH = "/etc/force_cursor.conf";
 
-// External cursor design (64x64 RGBA)
-#include "mouse_cursor_offset.h"
-
-static float rate = 1.0f;
-static int read_params_file(const char* path, char** device, float* multiplier);
-
 // Initialize bright visible cursor
 static void init_cursor(int fd, uint32_t crtcId)
 {
     fprintf(stdout, "-------MockbaMod Mouse Cursor credits @no3z (Discord) --------\n");
-    if (read_params_file(CONF_FILE_PATH, &device, &rate) != 0) {
+    device = pipeline_source(CONF_FILE_PATH, &cursor.rate);
+    if (!device) {
+#if PIPELINE_SOURCE == PIPELINE_SOURCE_AUTODETECT
+        fprintf(stdout, "*** MockbaMod Mouse Cursor: No mouse device found ***\n");
+#else
         fprintf(stdout, "*** MockbaMod Mouse Cursor: Failed to read device.txt file *****\n");
-
+#endif
         return;
-    } else {
-        fprintf(stdout, "-------MockbaMod Mouse Cursor --------\n\n    Device: %s\n    Speed Multiplier:%f\n", device, rate);
     }
+    fprintf(stdout, "-------MockbaMod Mouse Cursor --------\n\n    Device: %s\n    Speed Multiplier:%f\n", device, cursor.rate);
     if (cursor_initialized)
         return;
 
@@ -83,16 +84,15 @@ static void init_cursor(int fd, uint32_t crtcId)
         if (drmIoctl(fd, DRM_IOCTL_MODE_MAP_DUMB, &map_req) == 0) {
             void* ptr = mmap(0, create_req.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, map_req.offset);
             if (ptr != MAP_FAILED) {
-                memcpy(ptr, cursor_data, sizeof(cursor_data));
+                if (cursor_image_decode(&cursor_offset[0], ptr, create_req.pitch, 64, 64) == 0)
+                    cursor_initialized = 1;
                 munmap(ptr, create_req.size);
-                cursor_initialized = 1;
             }
         }
     }
 }
 
 // Initialize uinput device for touch events
-
 static int init_uinput()
 {
     int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
@@ -109,11 +109,11 @@ static int init_uinput()
     // Set up absolute position ranges (portrait: 800x1280)
     struct uinput_abs_setup abs_x = {
         .code = ABS_X,
-        .absinfo = { .minimum = 0, .maximum = 799 },
+        .absinfo = { .minimum = 0, .maximum = PIPELINE_WIDTH - 1 },
     };
     struct uinput_abs_setup abs_y = {
         .code = ABS_Y,
-        .absinfo = { .minimum = 0, .maximum = 1279 },
+        .absinfo = { .minimum = 0, .maximum = PIPELINE_HEIGHT - 1 },
     };
     ioctl(fd, UI_ABS_SETUP, &abs_x);
     ioctl(fd, UI_ABS_SETUP, &abs_y);
@@ -138,40 +138,30 @@ static int init_uinput()
     return fd;
 }
 
-// Send touch event
-static void send_touch_event(int fd, int x, int y, int pressed)
+// Pipeline stages: touches go to the virtual device, moves to libdrm
+static void pipeline_touch(int x, int y, int pressed)
 {
     struct input_event ev[4];
-    memset(ev, 0, sizeof(ev));
-
-    // Position
-    ev[0].type = EV_ABS;
-    ev[0].code = ABS_X;
-    ev[0].value = x;
 
-    ev[1].type = EV_ABS;
-    ev[1].code = ABS_Y;
-    ev[1].value = y;
-
-    // Touch state
-    ev[2].type = EV_KEY;
-    ev[2].code = BTN_TOUCH;
-    ev[2].value = pressed;
-
-    // Sync
-    ev[3].type = EV_SYN;
-    ev[3].code = SYN_REPORT;
-    ev[3].value = 0;
+    if (uinput_fd < 0)
+        return;
+    pipeline_touch_frame(ev, x, y, pressed);
+    write(uinput_fd, ev, sizeof(ev));
+}
 
-    write(fd, ev, sizeof(ev));
+static void pipeline_move(int x, int y)
+{
+    if (saved_fd >= 0)
+        real_drmModeMoveCursor(saved_fd, saved_crtc, x, y);
 }
 
-// Input monitoring thread
+// Input monitoring thread: blocks until the mouse has events, then takes
+// everything queued in one read
 static void* input_monitor(void* arg)
 {
-
+    (void)arg;
     fprintf(stdout, "--------- opening device %s\n", device);
-    int fd = open(device, O_RDONLY | O_NONBLOCK);
+    int fd = open(device, O_RDONLY);
     if (fd < 0) {
         fprintf(stdout, "----------- ERROR opening device %s for Mouse Events\n", device);
         free(device);
@@ -183,66 +173,13 @@ static void* input_monitor(void* arg)
     // Initialize uinput for touch injection
     uinput_fd = init_uinput();
 
-    struct input_event ev;
-    int (*real_drmModeMoveCursor)(int, uint32_t, int, int) = dlsym(RTLD_NEXT, "drmModeMoveCursor");
-
+    struct input_event evs[64];
     while (input_running) {
-        ssize_t n = read(fd, &ev, sizeof(ev));
-        if (n == sizeof(ev)) {
-            if (ev.type == EV_REL) {
-                // Swap X and Y for portrait display (800x1280), invert Y
-                if (ev.code == REL_X) {
-                    cursor_y -= (ev.value * rate); // Mouse X -> Screen Y (inverted)
-                    if (cursor_y < 0)
-                        cursor_y = 0;
-                    if (cursor_y > 1279)
-                        cursor_y = 1279; // Portrait height
-                } else if (ev.code == REL_Y) {
-                    cursor_x += (ev.value * rate); // Mouse Y -> Screen X
-                    if (cursor_x < 0)
-                        cursor_x = 0;
-                    if (cursor_x > 799)
-                        cursor_x = 799; // Portrait width
-                }
-                if (touch_down && uinput_fd >= 0) {
-                    int drag_x = cursor_x + CLICK_OFFSET_X;
-                    int drag_y = cursor_y + CLICK_OFFSET_Y;
-
-                    // Clamp
-                    if (drag_x < 0) drag_x = 0;
-                    if (drag_x > 799) drag_x = 799;
-                    if (drag_y < 0) drag_y = 0;
-                    if (drag_y > 1279) drag_y = 1279;
-
-                    // Send position update while finger is down
-                    send_touch_event(uinput_fd, drag_x, drag_y, 1);
-                }
-            } else if (ev.type == EV_KEY) {
-                if (ev.code == BTN_LEFT || ev.code == BTN_RIGHT || ev.code == BTN_MIDDLE) {
-
-                    touch_down = ev.value; // 1 = pressed, 0 = released
-
-                    if (uinput_fd >= 0) {
-                        int click_x = cursor_x + CLICK_OFFSET_X;
-                        int click_y = cursor_y + CLICK_OFFSET_Y;
-
-                        // Clamp
-                        if (click_x < 0) click_x = 0;
-                        if (click_x > 799) click_x = 799;
-                        if (click_y < 0) click_y = 0;
-                        if (click_y > 1279) click_y = 1279;
-
-                        send_touch_event(uinput_fd, click_x, click_y, touch_down);
-                    }
-                }
-            } else if (ev.type == EV_SYN && ev.code == SYN_REPORT) {
-                // Move cursor after sync
-                if (saved_fd >= 0 && real_drmModeMoveCursor) {
-                    real_drmModeMoveCursor(saved_fd, saved_crtc, cursor_x, cursor_y);
-                }
-            }
-        }
-        usleep(1000); // 1ms sleep
+        ssize_t n = read(fd, evs, sizeof(evs));
+        if (n < (ssize_t)sizeof(evs[0]))
+            break;
+        for (size_t i = 0; i < (size_t)n / sizeof(evs[0]); i++)
+            pipeline_event(&cursor, &evs[i]);
     }
 
     if (uinput_fd >= 0) {
@@ -262,6 +199,7 @@ int drmModeSetCursor2(int fd, uint32_t crtcId, uint32_t bo_handle,
 
     if (!real_drmModeSetCursor2) {
         real_drmModeSetCursor2 = dlsym(RTLD_NEXT, "drmModeSetCursor2");
+        real_drmModeMoveCursor = dlsym(RTLD_NEXT, "drmModeMoveCursor");
     }
 
     if (bo_handle == 0) {
@@ -269,7 +207,7 @@ int drmModeSetCursor2(int fd, uint32_t crtcId, uint32_t bo_handle,
             init_cursor(fd, crtcId);
 
             // Start input monitor thread
-            if (!input_running) {
+            if (device && real_drmModeMoveCursor && !input_running) {
                 input_running = 1;
                 pthread_create(&input_thread, NULL, input_monitor, NULL);
             }
@@ -279,9 +217,8 @@ int drmModeSetCursor2(int fd, uint32_t crtcId, uint32_t bo_handle,
             int ret = real_drmModeSetCursor2(fd, crtcId, cursor_bo, 64, 64, 0, 0);
 
             // Initially position the cursor
-            int (*real_drmModeMoveCursor)(int, uint32_t, int, int) = dlsym(RTLD_NEXT, "drmModeMoveCursor");
             if (real_drmModeMoveCursor) {
-                real_drmModeMoveCursor(fd, crtcId, cursor_x, cursor_y);
+                real_drmModeMoveCursor(fd, crtcId, cursor.x, cursor.y);
             }
 
             return ret;
@@ -306,7 +243,6 @@ int drmModeSetCursor(int fd, uint32_t crtcId, uint32_t bo_handle,
 // Hook drmModeMoveCursor
 int drmModeMoveCursor(int fd, uint32_t crtcId, int x, int y)
 {
-    static int (*real_drmModeMoveCursor)(int, uint32_t, int, int) = NULL;
     static int count = 0;
 
     if (!real_drmModeMoveCursor) {
@@ -323,39 +259,3 @@ int drmModeMoveCursor(int fd, uint32_t crtcId, int x, int y)
     }
     return 0;
 }
-
-static int read_params_file(const char* path, char** out_str, float* out_val)
-{
-    FILE* fp = fopen(path, "r");
-    if (!fp)
-        return -1;
-
-    char line[256];
-    /* ----- first line (string) ----- */
-    if (!fgets(line, sizeof line, fp)) { /* no first line? */
-        fclose(fp);
-        return -1;
-    }
-    size_t len = strcspn(line, "\r\n"); /* strip newline */
-    *out_str = malloc(len + 1);
-    if (!*out_str) {
-        fclose(fp);
-        return -1;
-    }
-    memcpy(*out_str, line, len);
-    (*out_str)[len] = '\0';
-
-    /* ----- second line (float) ----- */
-    if (!fgets(line, sizeof line, fp)) {
-        *out_val = 1.0f; /* default if missing */
-    } else {
-        char* endptr;
-        float val = strtof(line, &endptr);
-        if (endptr == line || *out_val < 0.1f || val > 5.0f)
-            val = 1.0f; /* default on parse error or out of range */
-        *out_val = val;
-    }
-
-    fclose(fp);
-    return 0;
-}
\ No newline at end of file